@@ -0,0 +1,110 @@
+/*
+ * Collective communication, run under mpirun.
+ *
+ * Times raw MPI_Bcast / MPI_Reduce over message sizes and the model
+ * broadcast_model_weights / aggregate_gradients over hidden sizes (their messages are
+ * the parameter count). Samples start after a barrier and take the slowest rank's
+ * time. Rank 0 prints JSON (see bench_utils.c).
+ *
+ *   mpirun -np 4 ./build/bench/bench_comm
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <mpi.h>
+
+#include "bench_utils.c"
+#include "distributed/comm.h"
+#include "rng.h"
+
+typedef struct CommCase {
+    MPIContext *ctx;
+    MLP mlp;
+    float *send;
+    float *recv;
+    int count;
+} CommCase;
+
+static MPIContext *bench_ctx;
+
+static void barrier() {
+    MPI_Barrier(bench_ctx->comm);
+}
+
+static double slowest_rank(double seconds) {
+    double max;
+    MPI_Allreduce(&seconds, &max, 1, MPI_DOUBLE, MPI_MAX, bench_ctx->comm);
+    return max;
+}
+
+static void run_bcast(void *arg) {
+    CommCase *c = arg;
+    MPI_Bcast(c->send, c->count, MPI_FLOAT, 0, c->ctx->comm);
+}
+
+static void run_reduce(void *arg) {
+    CommCase *c = arg;
+    MPI_Reduce(c->send, c->recv, c->count, MPI_FLOAT, MPI_SUM, 0, c->ctx->comm);
+}
+
+static void run_broadcast_weights(void *arg) {
+    CommCase *c = arg;
+    broadcast_model_weights(&c->mlp, c->ctx, 0, NULL);
+}
+
+static void run_aggregate_gradients(void *arg) {
+    CommCase *c = arg;
+    aggregate_gradients(&c->mlp, c->ctx, 0, NULL);
+}
+
+int main(int argc, char *argv[]) {
+    MPIContext ctx = mpi_init_context(&argc, &argv);
+    bench_ctx = &ctx;
+
+    bench_parse_args(argc, argv);
+    bench.sync = barrier;
+    bench.combine = slowest_rank;
+    bench.quiet = ctx.rank != 0;
+    rng_seed(1 + ctx.rank);
+
+    long message_bytes[] = {1L << 10, 1L << 14, 1L << 18, 1L << 22};
+    int hidden_sizes[] = {16, 64, 256, 1024};
+
+    bench_begin("bench_comm");
+
+    for (size_t m = 0; m < sizeof(message_bytes) / sizeof(long); m++) {
+        char params[64];
+        snprintf(params, sizeof(params), "\"ranks\":%d,\"bytes\":%ld", ctx.world_size, message_bytes[m]);
+
+        CommCase c = {.ctx = &ctx, .count = (int)(message_bytes[m] / sizeof(float))};
+        c.send = calloc(c.count, sizeof(float));
+        c.recv = calloc(c.count, sizeof(float));
+
+        bench_report("mpi_bcast", params, bench_run(run_bcast, &c), message_bytes[m]);
+        bench_report("mpi_reduce", params, bench_run(run_reduce, &c), message_bytes[m]);
+
+        free(c.send);
+        free(c.recv);
+    }
+
+    for (size_t h = 0; h < sizeof(hidden_sizes) / sizeof(int); h++) {
+        int hidden = hidden_sizes[h];
+        int input_sizes[2] = {4, hidden};
+        Activation activations[2] = {relu, identity};
+
+        CommCase c = {.ctx = &ctx, .mlp = create_mlp(input_sizes, 1, 2, activations)};
+        kaiming_mlp_init(&c.mlp);
+
+        long bytes = (long)get_num_params(&c.mlp) * sizeof(float);
+        char params[96];
+        snprintf(params, sizeof(params), "\"ranks\":%d,\"hidden\":%d,\"bytes\":%ld", ctx.world_size, hidden, bytes);
+
+        bench_report("broadcast_model_weights", params, bench_run(run_broadcast_weights, &c), bytes);
+        bench_report("aggregate_gradients", params, bench_run(run_aggregate_gradients, &c), bytes);
+
+        free_mlp(&c.mlp);
+    }
+
+    bench_end();
+    mpi_finalize(&ctx);
+    return 0;
+}
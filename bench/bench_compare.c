@@ -0,0 +1,176 @@
+/*
+ * Benchmark regression check.
+ *
+ * Compares a bench_* JSON result file against a baseline (see bench_utils.c for the
+ * format) and exits non-zero if any benchmark got slower. A benchmark regresses when
+ * its median grew by more than both
+ *
+ *   - the relative threshold (-t, percent of the baseline median), and
+ *   - k times the combined noise, sqrt(mad_base^2 + mad_current^2) * 1.4826 (-k),
+ *
+ * so a noisy benchmark needs a larger slowdown to fail than a stable one. -T name=pct
+ * overrides the threshold of one benchmark name (repeatable).
+ *
+ *   bench_compare [-t 10] [-k 3] [-T adam_step=20] baseline.json current.json
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#define MAX_RESULTS 1024
+#define MAX_OVERRIDES 32
+
+// Scales a MAD to a standard deviation for normally distributed samples
+#define MAD_TO_SIGMA 1.4826
+
+typedef struct BenchEntry {
+    char name[64];
+    char params[192];
+    double median_ns;
+    double mad_ns;
+} BenchEntry;
+
+typedef struct Override {
+    const char *name;
+    double threshold;
+} Override;
+
+// Copies the text after `key` up to the closing character into dst
+static int extract(const char *line, const char *key, char close, char *dst, size_t size) {
+    const char *p = strstr(line, key);
+    if (!p) return 0;
+    p += strlen(key);
+
+    const char *end = strchr(p, close);
+    if (!end || (size_t)(end - p) >= size) return 0;
+
+    memcpy(dst, p, end - p);
+    dst[end - p] = '\0';
+    return 1;
+}
+
+static int extract_number(const char *line, const char *key, double *value) {
+    const char *p = strstr(line, key);
+    if (!p) return 0;
+
+    *value = strtod(p + strlen(key), NULL);
+    return 1;
+}
+
+static int load_results(const char *path, BenchEntry *entries) {
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        fprintf(stderr, "Error opening %s.\n", path);
+        return -1;
+    }
+
+    char line[1024];
+    int n = 0;
+    while (fgets(line, sizeof(line), f) && n < MAX_RESULTS) {
+        BenchEntry *e = &entries[n];
+
+        if (!extract(line, "{\"name\":\"", '"', e->name, sizeof(e->name))) continue;
+
+        if (!extract(line, "\"params\":{", '}', e->params, sizeof(e->params)) ||
+            !extract_number(line, "\"median_ns\":", &e->median_ns) ||
+            !extract_number(line, "\"mad_ns\":", &e->mad_ns)) {
+            fprintf(stderr, "WARNING: Skipping malformed result in %s: %s", path, line);
+            continue;
+        }
+
+        n++;
+    }
+
+    fclose(f);
+    return n;
+}
+
+static const BenchEntry *find(const BenchEntry *entries, int n, const BenchEntry *key) {
+    for (int i = 0; i < n; i++) {
+        if (strcmp(entries[i].name, key->name) == 0 && strcmp(entries[i].params, key->params) == 0)
+            return &entries[i];
+    }
+
+    return NULL;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [-t <percent>] [-k <noise multiplier>] [-T <name>=<percent>]... <baseline.json> <current.json>\n", prog);
+    exit(2);
+}
+
+int main(int argc, char *argv[]) {
+    double threshold = 10.0;
+    double noise_k = 3.0;
+    Override overrides[MAX_OVERRIDES];
+    int n_overrides = 0;
+    const char *paths[2];
+    int n_paths = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+            threshold = atof(argv[++i]);
+        } else if (strcmp(argv[i], "-k") == 0 && i + 1 < argc) {
+            noise_k = atof(argv[++i]);
+        } else if (strcmp(argv[i], "-T") == 0 && i + 1 < argc && n_overrides < MAX_OVERRIDES) {
+            char *eq = strchr(argv[++i], '=');
+            if (!eq) usage(argv[0]);
+            *eq = '\0';
+            overrides[n_overrides++] = (Override){argv[i], atof(eq + 1)};
+        } else if (argv[i][0] != '-' && n_paths < 2) {
+            paths[n_paths++] = argv[i];
+        } else {
+            usage(argv[0]);
+        }
+    }
+    if (n_paths != 2) usage(argv[0]);
+
+    static BenchEntry baseline[MAX_RESULTS], current[MAX_RESULTS];
+    int n_base = load_results(paths[0], baseline);
+    int n_cur = load_results(paths[1], current);
+    if (n_base < 0 || n_cur < 0) return 2;
+
+    printf("%-24s %-40s %12s %12s %8s %8s  %s\n", "benchmark", "params", "base ns", "current ns", "change", "limit", "verdict");
+
+    int regressions = 0, compared = 0;
+    for (int i = 0; i < n_cur; i++) {
+        const BenchEntry *cur = &current[i];
+        const BenchEntry *base = find(baseline, n_base, cur);
+
+        if (!base) {
+            printf("%-24s %-40s %12s %12.1f %8s %8s  new\n", cur->name, cur->params, "-", cur->median_ns, "-", "-");
+            continue;
+        }
+
+        double limit_pct = threshold;
+        for (int o = 0; o < n_overrides; o++)
+            if (strcmp(overrides[o].name, cur->name) == 0) limit_pct = overrides[o].threshold;
+
+        double delta = cur->median_ns - base->median_ns;
+        double noise = noise_k * MAD_TO_SIGMA * sqrt(base->mad_ns * base->mad_ns + cur->mad_ns * cur->mad_ns);
+        double limit = fmax(limit_pct / 100.0 * base->median_ns, noise);
+        double change_pct = base->median_ns > 0 ? 100.0 * delta / base->median_ns : 0.0;
+
+        const char *verdict = "ok";
+        if (delta > limit) {
+            verdict = "REGRESSION";
+            regressions++;
+        } else if (-delta > limit) {
+            verdict = "faster";
+        }
+
+        printf("%-24s %-40s %12.1f %12.1f %+7.1f%% %7.1f%%  %s\n",
+               cur->name, cur->params, base->median_ns, cur->median_ns, change_pct,
+               base->median_ns > 0 ? 100.0 * limit / base->median_ns : 0.0, verdict);
+        compared++;
+    }
+
+    for (int i = 0; i < n_base; i++) {
+        if (!find(current, n_cur, &baseline[i]))
+            printf("%-24s %-40s %12.1f %12s %8s %8s  missing\n", baseline[i].name, baseline[i].params, baseline[i].median_ns, "-", "-", "-");
+    }
+
+    printf("\n%d compared, %d regression(s)\n", compared, regressions);
+    return regressions > 0;
+}
@@ -0,0 +1,67 @@
+/*
+ * Environment stepping.
+ *
+ * Times cartpole reset and step (with random actions, resetting on termination) for
+ * both action modes. One call runs STEPS_PER_CALL steps. Prints JSON (see
+ * bench_utils.c).
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bench_utils.c"
+#include "environments/cartpole.h"
+#include "rng.h"
+
+#define STEPS_PER_CALL 1000
+
+typedef struct EnvCase {
+    Env env;
+    float *obs;
+    float *actions;     // pre-drawn, one per step of a call
+    float reward;
+    bool done;
+} EnvCase;
+
+static void run_reset(void *arg) {
+    EnvCase *c = arg;
+    env_reset(&c->env, c->obs);
+}
+
+static void run_step(void *arg) {
+    EnvCase *c = arg;
+
+    for (int t = 0; t < STEPS_PER_CALL; t++) {
+        env_step(&c->env, &c->actions[t], c->obs, &c->reward, &c->done);
+        if (c->done) env_reset(&c->env, c->obs);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    bench_parse_args(argc, argv);
+    rng_seed(1);
+
+    bench_begin("bench_env");
+
+    for (int continuous = 0; continuous <= 1; continuous++) {
+        char params[64];
+        snprintf(params, sizeof(params), "\"env\":\"cartpole\",\"continuous\":%d", continuous);
+
+        EnvCase c = {.env = make_cartpole_env(10.0f, continuous)};
+        c.obs = malloc(c.env.obs_size * sizeof(float));
+        c.actions = malloc(STEPS_PER_CALL * sizeof(float));
+        for (int t = 0; t < STEPS_PER_CALL; t++)
+            c.actions[t] = continuous ? rand_uniform(-1.0f, 1.0f) : (float)(rand_uniform(0.0f, 1.0f) < 0.5f);
+
+        env_reset(&c.env, c.obs);
+
+        bench_report("cartpole_reset", params, bench_run(run_reset, &c), 1);
+        bench_report("cartpole_step", params, bench_run(run_step, &c), STEPS_PER_CALL);
+
+        env_destroy(&c.env);
+        free(c.obs);
+        free(c.actions);
+    }
+
+    bench_end();
+    return 0;
+}
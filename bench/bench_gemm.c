@@ -0,0 +1,107 @@
+/*
+ * Crossover map between the in-tree GEMM kernels and BLAS.
+ *
+ * Sweeps the three linear-layer GEMMs over episode lengths and layer widths and
+ * prints the median time of both implementations as CSV on stdout.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <cblas.h>
+
+#include "nn/gemm.h"
+#include "rng.h"
+
+#define REPS 15
+
+typedef void (*GemmFn)(int, int, int, const float *, int, const float *, int, float, float *, int);
+
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static void blas_nt(int M, int N, int K, const float *A, int lda, const float *B, int ldb, float beta, float *C, int ldc) {
+    cblas_sgemm(CblasRowMajor, CblasNoTrans, CblasTrans, M, N, K, 1.0f, A, lda, B, ldb, beta, C, ldc);
+}
+
+static void blas_tn(int M, int N, int K, const float *A, int lda, const float *B, int ldb, float beta, float *C, int ldc) {
+    cblas_sgemm(CblasRowMajor, CblasTrans, CblasNoTrans, M, N, K, 1.0f, A, lda, B, ldb, beta, C, ldc);
+}
+
+static void blas_nn(int M, int N, int K, const float *A, int lda, const float *B, int ldb, float beta, float *C, int ldc) {
+    cblas_sgemm(CblasRowMajor, CblasNoTrans, CblasNoTrans, M, N, K, 1.0f, A, lda, B, ldb, beta, C, ldc);
+}
+
+// Median seconds per call; inner repetitions keep each sample above timer resolution
+static double time_gemm(GemmFn fn, int M, int N, int K, const float *A, int lda, const float *B, int ldb, float *C) {
+    double samples[REPS];
+    long flops = 2L * M * N * K;
+    int inner = flops > 0 ? (int)(2e5 / flops) + 1 : 1;
+
+    fn(M, N, K, A, lda, B, ldb, 0.0f, C, N);
+
+    for (int r = 0; r < REPS; r++) {
+        double start = now_seconds();
+        for (int i = 0; i < inner; i++) fn(M, N, K, A, lda, B, ldb, 0.0f, C, N);
+        samples[r] = (now_seconds() - start) / inner;
+    }
+
+    qsort(samples, REPS, sizeof(double), cmp_double);
+    return samples[REPS / 2];
+}
+
+int main() {
+    rng_seed(1);
+
+    int episode_lengths[] = {1, 16, 64, 200, 500, 2000};
+    int widths[] = {1, 4, 16, 64, 256};
+    int n_lengths = sizeof(episode_lengths) / sizeof(int);
+    int n_widths = sizeof(widths) / sizeof(int);
+
+    int max = 2000 * 256;
+    float *A = malloc(max * sizeof(float));
+    float *B = malloc(max * sizeof(float));
+    float *C = malloc(max * sizeof(float));
+    for (int i = 0; i < max; i++) {
+        A[i] = rand_uniform(-1.0f, 1.0f);
+        B[i] = rand_uniform(-1.0f, 1.0f);
+    }
+
+    printf("variant,M,N,K,kernel_us,blas_us,speedup\n");
+
+    for (int t = 0; t < n_lengths; t++) {
+        for (int a = 0; a < n_widths; a++) {
+            for (int b = 0; b < n_widths; b++) {
+                int T = episode_lengths[t], in = widths[a], out = widths[b];
+                double k_us, b_us;
+
+                // Forward: [T, in] x [out, in]^T
+                k_us = time_gemm(skinny_gemm_nt, T, out, in, A, in, B, in, C) * 1e6;
+                b_us = time_gemm(blas_nt, T, out, in, A, in, B, in, C) * 1e6;
+                printf("nt,%d,%d,%d,%.3f,%.3f,%.2f\n", T, out, in, k_us, b_us, b_us / k_us);
+
+                // Weight gradient: [T, out]^T x [T, in]
+                k_us = time_gemm(skinny_gemm_tn, out, in, T, A, out, B, in, C) * 1e6;
+                b_us = time_gemm(blas_tn, out, in, T, A, out, B, in, C) * 1e6;
+                printf("tn,%d,%d,%d,%.3f,%.3f,%.2f\n", out, in, T, k_us, b_us, b_us / k_us);
+
+                // Input gradient: [T, out] x [out, in]
+                k_us = time_gemm(skinny_gemm_nn, T, in, out, A, out, B, in, C) * 1e6;
+                b_us = time_gemm(blas_nn, T, in, out, A, out, B, in, C) * 1e6;
+                printf("nn,%d,%d,%d,%.3f,%.3f,%.2f\n", T, in, out, k_us, b_us, b_us / k_us);
+            }
+        }
+    }
+
+    free(A);
+    free(B);
+    free(C);
+    return 0;
+}
@@ -0,0 +1,127 @@
+/*
+ * Linear layer and MLP kernels.
+ *
+ * Sweeps hidden sizes and batch sizes (episode lengths) over linear_forward,
+ * linear_backward, mlp_forward and mlp_backward of the policy-shaped network
+ * (obs -> hidden -> hidden -> out), plus the Adam step over hidden sizes. Prints
+ * JSON (see bench_utils.c).
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench_utils.c"
+#include "nn/mlp.h"
+#include "nn/optimizers.h"
+#include "rng.h"
+
+#define OBS_SIZE 4
+#define OUT_SIZE 2
+
+typedef struct NNCase {
+    MLP mlp;
+    MLPCache cache;
+    LinearCache linear_cache;
+    float *input;
+    float *hidden_out;
+    float *out;
+    float *out_grad;
+    float *hidden_grad;
+    Optimizer optimizer;
+    int batch;
+} NNCase;
+
+static void run_linear_forward(void *arg) {
+    NNCase *c = arg;
+    linear_forward(&c->mlp.layers[1], c->hidden_out, c->batch, c->hidden_grad, NULL);
+}
+
+static void run_linear_backward(void *arg) {
+    NNCase *c = arg;
+    linear_backward(&c->mlp.layers[1], &c->linear_cache, c->hidden_grad, c->hidden_out);
+}
+
+static void run_mlp_forward(void *arg) {
+    NNCase *c = arg;
+    mlp_forward(&c->mlp, c->input, c->batch, c->out, NULL);
+}
+
+static void run_mlp_backward(void *arg) {
+    NNCase *c = arg;
+    mlp_backward(&c->mlp, &c->cache, c->out_grad, NULL);
+}
+
+static void run_adam_step(void *arg) {
+    NNCase *c = arg;
+    optimizer_step(&c->optimizer, &c->mlp, &c->cache);
+}
+
+static float *random_buffer(int n) {
+    float *buf = malloc(n * sizeof(float));
+    for (int i = 0; i < n; i++) buf[i] = rand_uniform(-1.0f, 1.0f);
+    return buf;
+}
+
+int main(int argc, char *argv[]) {
+    bench_parse_args(argc, argv);
+    rng_seed(1);
+
+    int hidden_sizes[] = {16, 64, 256};
+    int batch_sizes[] = {1, 64, 500};
+
+    bench_begin("bench_nn");
+
+    for (size_t h = 0; h < sizeof(hidden_sizes) / sizeof(int); h++) {
+        for (size_t b = 0; b < sizeof(batch_sizes) / sizeof(int); b++) {
+            int hidden = hidden_sizes[h], batch = batch_sizes[b];
+            char params[64];
+            snprintf(params, sizeof(params), "\"hidden\":%d,\"batch\":%d", hidden, batch);
+
+            NNCase c = {.batch = batch};
+            int input_sizes[3] = {OBS_SIZE, hidden, hidden};
+            Activation activations[3] = {relu, relu, identity};
+            c.mlp = create_mlp(input_sizes, OUT_SIZE, 3, activations);
+            kaiming_mlp_init(&c.mlp);
+
+            c.input = random_buffer(batch * OBS_SIZE);
+            c.hidden_out = random_buffer(batch * hidden);
+            c.hidden_grad = random_buffer(batch * hidden);
+            c.out = malloc(batch * OUT_SIZE * sizeof(float));
+            c.out_grad = random_buffer(batch * OUT_SIZE);
+
+            // Caches filled once; the backward passes only read them
+            c.cache = create_mlp_cache(&c.mlp, batch);
+            mlp_forward(&c.mlp, c.input, batch, c.out, &c.cache);
+            c.linear_cache = create_linear_cache(&c.mlp.layers[1], batch);
+            float *scratch = malloc(batch * hidden * sizeof(float));
+            memcpy(c.linear_cache.layer_inputs, c.hidden_out, batch * hidden * sizeof(float));
+            linear_forward(&c.mlp.layers[1], c.hidden_out, batch, scratch, &c.linear_cache);
+            free(scratch);
+
+            bench_report("linear_forward", params, bench_run(run_linear_forward, &c), batch);
+            bench_report("linear_backward", params, bench_run(run_linear_backward, &c), batch);
+            bench_report("mlp_forward", params, bench_run(run_mlp_forward, &c), batch);
+            bench_report("mlp_backward", params, bench_run(run_mlp_backward, &c), batch);
+
+            // The step does not depend on the batch, and empties the cache
+            if (b == sizeof(batch_sizes) / sizeof(int) - 1) {
+                snprintf(params, sizeof(params), "\"hidden\":%d", hidden);
+                c.optimizer = make_adam(&c.mlp, 1e-4f, 0.9f, 0.999f, 1e-8f);
+                bench_report("adam_step", params, bench_run(run_adam_step, &c), get_num_params(&c.mlp));
+                free_optimizer(&c.optimizer);
+            }
+
+            free_linear_cache(&c.linear_cache);
+            free_mlp_cache(&c.cache);
+            free_mlp(&c.mlp);
+            free(c.input);
+            free(c.hidden_out);
+            free(c.hidden_grad);
+            free(c.out);
+            free(c.out_grad);
+        }
+    }
+
+    bench_end();
+    return 0;
+}
@@ -0,0 +1,222 @@
+/*
+ * Policy heads and return computation.
+ *
+ * Times action sampling, log-probabilities, entropies and the fused policy-gradient
+ * loss of the binary, discrete and Gaussian policies over batch sizes (and action
+ * counts, up to 1024), the discrete samplers on distinct and on repeated rows, discounted_cumsum
+ * over episode lengths, and a full single-episode cartpole rollout over hidden sizes.
+ * Prints JSON (see bench_utils.c).
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bench_utils.c"
+#include "algorithms/utils.h"
+#include "environments/cartpole.h"
+#include "rng.h"
+
+#define MAX_STEPS 500
+
+typedef struct PolicyCase {
+    Policy policy;
+    Env env;
+    ExperienceBuffer buffer;
+    float *logits;
+    float *actions;
+    float *log_prob;
+    float *grad;
+    float *returns;
+    int batch;
+} PolicyCase;
+
+static void run_sample(void *arg) {
+    PolicyCase *c = arg;
+    policy_sample_action_from_logits(&c->policy, c->logits, c->batch, c->actions);
+}
+
+static void run_log_prob(void *arg) {
+    PolicyCase *c = arg;
+    policy_log_prob_from_logits(&c->policy, c->logits, c->actions, c->batch, c->log_prob, c->grad);
+}
+
+static void run_entropy(void *arg) {
+    PolicyCase *c = arg;
+    policy_entropy_from_logits(&c->policy, c->logits, c->batch, c->log_prob, c->grad);
+}
+
+static void run_pg_loss(void *arg) {
+    PolicyCase *c = arg;
+    policy_pg_loss_and_grad(&c->policy, c->logits, c->actions, c->returns, c->batch, 0.0f, c->grad);
+}
+
+static void run_cumsum(void *arg) {
+    PolicyCase *c = arg;
+    discounted_cumsum(&c->buffer, 0.99f, c->returns);
+}
+
+static void run_rollout(void *arg) {
+    PolicyCase *c = arg;
+    policy_rollout(&c->env, &c->policy, MAX_STEPS, 1, &c->buffer, NULL);
+}
+
+static MLP make_mlp(int in, int hidden, int out) {
+    int input_sizes[2] = {in, hidden};
+    Activation activations[2] = {relu, identity};
+
+    MLP mlp = create_mlp(input_sizes, out, 2, activations);
+    kaiming_mlp_init(&mlp);
+    return mlp;
+}
+
+static void bench_heads(const char *kind, int n_actions, int batch) {
+    char params[96];
+    snprintf(params, sizeof(params), "\"policy\":\"%s\",\"actions\":%d,\"batch\":%d", kind, n_actions, batch);
+
+    int out = n_actions == 2 ? 1 : n_actions;
+    MLP mlp = make_mlp(4, 16, out);
+
+    PolicyCase c = {.batch = batch};
+    c.policy = n_actions == 2 ? create_binary_policy(&mlp) : create_discrete_policy(&mlp, n_actions, SAMPLER_CDF);
+    c.logits = malloc(batch * out * sizeof(float));
+    c.actions = malloc(batch * sizeof(float));
+    c.log_prob = malloc(batch * sizeof(float));
+    c.grad = malloc(batch * out * sizeof(float));
+    c.returns = malloc(batch * sizeof(float));
+    for (int i = 0; i < batch * out; i++) c.logits[i] = rand_uniform(-2.0f, 2.0f);
+    for (int b = 0; b < batch; b++) c.returns[b] = rand_uniform(0.0f, 100.0f);
+
+    policy_sample_action_from_logits(&c.policy, c.logits, batch, c.actions);
+
+    bench_report("sample_action", params, bench_run(run_sample, &c), batch);
+    bench_report("log_prob", params, bench_run(run_log_prob, &c), batch);
+    bench_report("entropy", params, bench_run(run_entropy, &c), batch);
+    bench_report("pg_loss", params, bench_run(run_pg_loss, &c), batch);
+
+    free(c.logits);
+    free(c.returns);
+    free(c.actions);
+    free(c.log_prob);
+    free(c.grad);
+    free_mlp(&mlp);
+}
+
+// Diagonal Gaussian with a state-dependent std: the network outputs [mean | log std]
+static void bench_gaussian(int act_size, int batch) {
+    char params[96];
+    snprintf(params, sizeof(params), "\"policy\":\"gaussian\",\"act_size\":%d,\"batch\":%d", act_size, batch);
+
+    int out = 2 * act_size;
+    MLP mlp = make_mlp(4, 16, out);
+
+    PolicyCase c = {.batch = batch, .policy = create_gaussian_policy(&mlp, act_size, NULL)};
+    c.logits = malloc(batch * out * sizeof(float));
+    c.actions = malloc(batch * act_size * sizeof(float));
+    c.log_prob = malloc(batch * sizeof(float));
+    c.grad = malloc(batch * out * sizeof(float));
+    c.returns = malloc(batch * sizeof(float));
+    for (int i = 0; i < batch * out; i++) c.logits[i] = rand_uniform(-1.0f, 1.0f);
+    for (int b = 0; b < batch; b++) c.returns[b] = rand_uniform(0.0f, 100.0f);
+
+    policy_sample_action_from_logits(&c.policy, c.logits, batch, c.actions);
+
+    bench_report("sample_action", params, bench_run(run_sample, &c), batch);
+    bench_report("log_prob", params, bench_run(run_log_prob, &c), batch);
+    bench_report("pg_loss", params, bench_run(run_pg_loss, &c), batch);
+
+    free(c.logits);
+    free(c.actions);
+    free(c.log_prob);
+    free(c.grad);
+    free(c.returns);
+    free_mlp(&mlp);
+}
+
+// Repeated rows are one state sampled batch times, where the alias table pays off
+static void bench_sampler(const char *name, DiscreteSampler sampler, int n_actions, int batch, bool repeated) {
+    char params[128];
+    snprintf(params, sizeof(params), "\"sampler\":\"%s\",\"actions\":%d,\"batch\":%d,\"rows\":\"%s\"",
+             name, n_actions, batch, repeated ? "repeated" : "distinct");
+
+    MLP mlp = make_mlp(4, 16, n_actions);
+
+    PolicyCase c = {.batch = batch, .policy = create_discrete_policy(&mlp, n_actions, sampler)};
+    c.logits = malloc(batch * n_actions * sizeof(float));
+    c.actions = malloc(batch * sizeof(float));
+    for (int i = 0; i < batch * n_actions; i++)
+        c.logits[i] = repeated && i >= n_actions ? c.logits[i % n_actions] : rand_uniform(-2.0f, 2.0f);
+
+    bench_report("sample_discrete", params, bench_run(run_sample, &c), batch);
+
+    free(c.logits);
+    free(c.actions);
+    free_mlp(&mlp);
+}
+
+int main(int argc, char *argv[]) {
+    bench_parse_args(argc, argv);
+    rng_seed(1);
+
+    int batch_sizes[] = {1, 64, 500};
+    int action_counts[] = {2, 4, 16, 128, 1024};
+    int lengths[] = {16, 200, 500, 2000};
+    int hidden_sizes[] = {16, 64, 256};
+
+    bench_begin("bench_policy");
+
+    for (size_t a = 0; a < sizeof(action_counts) / sizeof(int); a++)
+        for (size_t b = 0; b < sizeof(batch_sizes) / sizeof(int); b++)
+            bench_heads(action_counts[a] == 2 ? "binary" : "discrete", action_counts[a], batch_sizes[b]);
+
+    int gaussian_sizes[] = {1, 8};
+    for (size_t a = 0; a < sizeof(gaussian_sizes) / sizeof(int); a++)
+        for (size_t b = 0; b < sizeof(batch_sizes) / sizeof(int); b++)
+            bench_gaussian(gaussian_sizes[a], batch_sizes[b]);
+
+    const char *sampler_names[] = {"cdf", "gumbel", "alias"};
+    for (int s = 0; s < 3; s++)
+        for (size_t a = 2; a < sizeof(action_counts) / sizeof(int); a++)
+            for (int repeated = 0; repeated < 2; repeated++)
+                bench_sampler(sampler_names[s], (DiscreteSampler)s, action_counts[a], 64, repeated);
+
+    for (size_t l = 0; l < sizeof(lengths) / sizeof(int); l++) {
+        int T = lengths[l];
+        char params[64];
+        snprintf(params, sizeof(params), "\"length\":%d", T);
+
+        // Episodes of 100 steps
+        PolicyCase c = {.buffer = create_buffer(T, 4, 1)};
+        c.buffer.size = T;
+        c.returns = malloc(T * sizeof(float));
+        for (int t = 0; t < T; t++) {
+            c.buffer.rewards[t] = 1.0f;
+            c.buffer.dones[t] = (t + 1) % 100 == 0 || t == T - 1;
+        }
+
+        bench_report("discounted_cumsum", params, bench_run(run_cumsum, &c), T);
+
+        free(c.returns);
+        free_buffer(&c.buffer);
+    }
+
+    for (size_t h = 0; h < sizeof(hidden_sizes) / sizeof(int); h++) {
+        char params[64];
+        snprintf(params, sizeof(params), "\"env\":\"cartpole\",\"hidden\":%d", hidden_sizes[h]);
+
+        MLP mlp = make_mlp(4, hidden_sizes[h], 1);
+        PolicyCase c = {
+            .policy = create_binary_policy(&mlp),
+            .env = make_cartpole_env(10.0f, false),
+            .buffer = create_buffer(MAX_STEPS, 4, 1),
+        };
+
+        // Episode lengths vary with the (untrained) policy; the result is per episode
+        bench_report("policy_rollout", params, bench_run(run_rollout, &c), 0);
+
+        env_destroy(&c.env);
+        free_buffer(&c.buffer);
+        free_mlp(&mlp);
+    }
+
+    bench_end();
+    return 0;
+}
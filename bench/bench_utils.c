@@ -0,0 +1,148 @@
+/*
+ * Microbenchmark harness shared by the bench_* programs (included like test_utils.c).
+ *
+ * bench_run times fn(arg): warmup calls for BENCH_WARMUP seconds, then `reps` samples
+ * of `inner` calls each, with inner chosen so that one sample lasts BENCH_MIN_SAMPLE
+ * seconds. It reports the median and median absolute deviation (MAD) per call.
+ *
+ * Results go to stdout (or -o <file>) as one JSON document with one result object per
+ * line:
+ *
+ *   {"suite":"bench_nn","reps":21,"results":[
+ *   {"name":"linear_forward","params":{"hidden":16,"batch":64},"median_ns":...,"mad_ns":...,...},
+ *   ...
+ *   ]}
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_WARMUP 0.02
+#define BENCH_MIN_SAMPLE 2e-4
+#define BENCH_DEFAULT_REPS 21
+#define BENCH_MAX_REPS 1001
+
+typedef void (*BenchFn)(void *arg);
+
+typedef struct BenchResult {
+    double median;      // seconds per call
+    double mad;
+    double min;
+    long inner;         // calls per sample
+    int reps;
+} BenchResult;
+
+typedef struct BenchHarness {
+    const char *suite;
+    int reps;
+    FILE *out;
+    int count;
+
+    // Multi-process benchmarks: called before each sample, and to agree on a measured
+    // time (e.g. the max over ranks). Only ranks with `quiet` unset print.
+    void (*sync)(void);
+    double (*combine)(double seconds);
+    int quiet;
+} BenchHarness;
+
+static BenchHarness bench = {.reps = BENCH_DEFAULT_REPS};
+
+static double bench_now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int bench_cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static double bench_agree(double seconds) {
+    return bench.combine ? bench.combine(seconds) : seconds;
+}
+
+// Parses -r <reps> and -o <file>; call before bench_begin
+static void bench_parse_args(int argc, char *argv[]) {
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+            bench.reps = atoi(argv[++i]);
+            if (bench.reps < 3) bench.reps = 3;
+            if (bench.reps > BENCH_MAX_REPS) bench.reps = BENCH_MAX_REPS;
+        } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            bench.out = fopen(argv[++i], "w");
+            if (!bench.out) {
+                fprintf(stderr, "Error opening %s.\n", argv[i]);
+                exit(1);
+            }
+        } else {
+            fprintf(stderr, "Usage: %s [-r <reps>] [-o <results.json>]\n", argv[0]);
+            exit(1);
+        }
+    }
+}
+
+static void bench_begin(const char *suite) {
+    bench.suite = suite;
+    if (!bench.out) bench.out = stdout;
+    if (bench.quiet) return;
+
+    fprintf(bench.out, "{\"suite\":\"%s\",\"reps\":%d,\"results\":[\n", suite, bench.reps);
+}
+
+static BenchResult bench_run(BenchFn fn, void *arg) {
+    double samples[BENCH_MAX_REPS];
+    BenchResult result = {.reps = bench.reps};
+
+    // Warmup, which also sizes the samples
+    long calls = 0;
+    double elapsed = 0.0, start = bench_now();
+    do {
+        fn(arg);
+        calls++;
+        elapsed = bench_agree(bench_now() - start);
+    } while (elapsed < BENCH_WARMUP || calls < 2);
+
+    result.inner = (long)(BENCH_MIN_SAMPLE / (elapsed / calls)) + 1;
+
+    for (int r = 0; r < bench.reps; r++) {
+        if (bench.sync) bench.sync();
+
+        double t0 = bench_now();
+        for (long i = 0; i < result.inner; i++) fn(arg);
+        samples[r] = bench_agree(bench_now() - t0) / result.inner;
+    }
+
+    qsort(samples, bench.reps, sizeof(double), bench_cmp_double);
+    result.median = samples[bench.reps / 2];
+    result.min = samples[0];
+
+    for (int r = 0; r < bench.reps; r++) {
+        double d = samples[r] - result.median;
+        samples[r] = d < 0 ? -d : d;
+    }
+    qsort(samples, bench.reps, sizeof(double), bench_cmp_double);
+    result.mad = samples[bench.reps / 2];
+
+    return result;
+}
+
+/**
+ * Prints one result. params is the body of a JSON object ("\"batch\":64"); items is
+ * the work per call (rows, steps, bytes...) used for items_per_s, 0 to omit it.
+ */
+static void bench_report(const char *name, const char *params, BenchResult r, double items) {
+    if (bench.quiet) return;
+
+    fprintf(bench.out, "%s{\"name\":\"%s\",\"params\":{%s},\"median_ns\":%.3f,\"mad_ns\":%.3f,\"min_ns\":%.3f,\"inner\":%ld",
+            bench.count++ ? ",\n" : "", name, params, r.median * 1e9, r.mad * 1e9, r.min * 1e9, r.inner);
+    if (items > 0) fprintf(bench.out, ",\"items_per_s\":%.6g", items / r.median);
+    fputc('}', bench.out);
+    fflush(bench.out);
+}
+
+static void bench_end() {
+    if (!bench.quiet) fputs("\n]}\n", bench.out);
+    if (bench.out != stdout) fclose(bench.out);
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include "policy.h"
+#include "utils.h"
+
+/**
+ * GAE(λ) advantages over a buffer of whole episodes, from the value head's
+ * values[t] = V(s_t) for every step of the buffer:
+ *
+ *   δ_t = r_t + γ V(s_{t+1}) - V(s_t),   A_t = δ_t + γλ A_{t+1}
+ *
+ * with V and A zero past a done. targets[t] = A_t + V(s_t) are the λ-returns the
+ * value head regresses on. One backward pass with no branch per step.
+ */
+void gae_advantages(
+    const ExperienceBuffer *buffer,
+    const float *values,
+    float gamma,
+    float lambda,
+    float *advantages,
+    float *targets
+);
+
+/**
+ * Value loss c/2 Σ (v - target)^2 over n steps, for values v = scale * head output.
+ * Writes the gradient with respect to the head output, c scale (v - target).
+ */
+float value_loss_and_grad(const float *values, const float *targets, int n, float coef, float scale, float *grad);
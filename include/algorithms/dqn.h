@@ -0,0 +1,121 @@
+#pragma once
+
+#include "utils.h"
+
+/*
+ * Deep Q-learning from a prioritized replay buffer.
+ *
+ * The replay is an ExperienceBuffer used as a ring: transition i is row i of the
+ * observations, actions, rewards and dones arrays (plus the next observation), the
+ * oldest row is overwritten once it is full, and `size` counts the filled rows. Rows
+ * are drawn with probability p_i / Σ p through a sum tree, where p_i = (|δ_i| + ε)^α
+ * from the transition's last TD error (new rows get the largest priority so far).
+ */
+
+// Binary tree of sums over `capacity` leaf priorities, O(log N) updates and draws
+typedef struct SumTree {
+    int capacity;
+    int leaves;         // capacity rounded up to a power of two
+    float *nodes;       // [2 * leaves]: node 1 is the root, leaf i is node leaves + i
+} SumTree;
+
+SumTree create_sum_tree(int capacity);
+
+void free_sum_tree(SumTree *tree);
+
+void sum_tree_set(SumTree *tree, int i, float priority);
+
+static inline float sum_tree_total(const SumTree *tree) {
+    return tree->nodes[1];
+}
+
+static inline float sum_tree_get(const SumTree *tree, int i) {
+    return tree->nodes[tree->leaves + i];
+}
+
+/** The leaf whose slice of the cumulative sum holds mass, for mass in [0, total). */
+int sum_tree_find(const SumTree *tree, float mass);
+
+typedef struct ReplayBuffer {
+    ExperienceBuffer base;          // capacity rows; size is the number filled
+    float *next_observations;       // [capacity, obs_size]
+    int obs_size, act_size;
+    int head;                       // row written next
+
+    SumTree priorities;
+    float alpha;                    // 0 samples uniformly
+    float max_priority;
+} ReplayBuffer;
+
+/** A minibatch gathered into contiguous rows, ready for mlp_forward. */
+typedef struct ReplayBatch {
+    int *indices;                   // replay rows, for the priority update
+    float *observations;
+    float *actions;
+    float *rewards;
+    float *next_observations;
+    bool *dones;
+    float *weights;                 // importance-sampling weights, max 1
+} ReplayBatch;
+
+ReplayBuffer create_replay(int capacity, int obs_size, int act_size, float alpha);
+
+void free_replay(ReplayBuffer *replay);
+
+/** Appends a transition, overwriting the oldest one when the buffer is full. */
+void replay_add(
+    ReplayBuffer *replay,
+    const float *obs,
+    const float *action,
+    float reward,
+    const float *next_obs,
+    bool done
+);
+
+/**
+ * Size of the shard's state as written by replay_save_state: head, size and largest
+ * priority, every ring row and the sum tree, so that sampling resumes bit-identically.
+ */
+size_t replay_state_size(const ReplayBuffer *replay);
+
+void replay_save_state(const ReplayBuffer *replay, void *dst);
+
+// Into a shard of the same capacity and shapes
+void replay_load_state(ReplayBuffer *replay, const void *src);
+
+ReplayBatch create_replay_batch(int batch_size, int obs_size, int act_size);
+
+void free_replay_batch(ReplayBatch *batch);
+
+/**
+ * Draws batch_size rows (with replacement), one from each of batch_size equal slices of
+ * the priority mass, and copies them into batch with the weights (N P(i))^-β scaled so
+ * that the largest is 1. The replay must not be empty.
+ */
+void replay_sample(const ReplayBuffer *replay, int batch_size, float beta, ReplayBatch *batch);
+
+/** Sets the priorities of the sampled rows from their TD errors. */
+void replay_update_priorities(ReplayBuffer *replay, const int *indices, const float *td_errors, int n);
+
+/**
+ * Importance-weighted Huber TD loss of a minibatch, with q[batch, n_actions] the online
+ * network's Q(s, ·) and next_q[batch, n_actions] the target network's Q(s', ·):
+ *
+ *   δ_b = Q(s_b, a_b) - (r_b + γ (1 - done_b) max_a' Q_target(s'_b, a'))
+ *   L   = Σ_b w_b huber(δ_b) / batch_size
+ *
+ * Writes δ to td_errors and ∂L/∂q to grad_out (nonzero only in the taken action's column).
+ */
+float dqn_loss_and_grad(
+    const float *q,
+    const float *next_q,
+    const ReplayBatch *batch,
+    int batch_size,
+    int n_actions,
+    float gamma,
+    float *td_errors,
+    float *grad_out
+);
+
+/** Copies the online network's parameters into the target network (same shape). */
+void dqn_sync_target(MLP *target, const MLP *online);
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "nn/mlp.h"
+
+/*
+ * OpenAI-style evolution strategies on the flat parameter vector of an MLP (layer by
+ * layer, weights then biases, the order of the model collectives).
+ *
+ * A perturbation is named by a 32-bit seed: its noise ε ~ N(0, I) is regenerated from
+ * the seed on any rank, so ranks exchange seeds and returns instead of parameters.
+ */
+
+// Result of one antithetic pair: returns at θ + σε and θ - σε
+typedef struct ESResult {
+    uint32_t seed;
+    float positive;
+    float negative;
+} ESResult;
+
+/** Seed of perturbation `index` at update `step`, from the run's seed (same on every rank). */
+uint32_t es_seed(uint32_t base, uint32_t step, uint32_t index);
+
+/** ε for a seed: n standard normals from a private stream, the process RNG is left as it was. */
+void es_noise(uint32_t seed, int n, float *out);
+
+void es_get_params(const MLP *mlp, float *theta);
+
+/** Sets the parameters to theta + sigma * noise (noise may be NULL for theta). */
+void es_set_params(MLP *mlp, const float *theta, const float *noise, float sigma);
+
+/** Adds weight * noise to the gradients. */
+void es_accumulate_grad(MLP *mlp, const float *noise, float weight);
+
+/**
+ * Writes the gradient of -E[return] estimated from n antithetic pairs into mlp's
+ * gradients, with returns replaced by centered ranks in [-0.5, 0.5] over all 2n of them:
+ *
+ *   ∇ = -1 / (2 n σ) Σ_i (u(R+_i) - u(R-_i)) ε_i
+ *
+ * noise is scratch of get_num_params floats. The same results give the same gradient
+ * bit for bit on every rank.
+ */
+void es_gradient(MLP *mlp, const ESResult *results, int n, float sigma, float *noise);
@@ -2,24 +2,50 @@
 
 #include "environments/common.h"
 #include "nn/mlp.h"
+#include "trace.h"
 
 /**
  * Policy interface.
  *
- * The policy is a thin wrapper around an MLP with two function pointers:
+ * The policy is a thin wrapper around an MLP with function pointers:
  *  - sample:    draws an action from π(a | s)
  *  - log_prob:  computes log π(a | s) and (optionally) ∇z log π(a | s), where z is the network output
+ *  - entropy:   computes H(π(· | s)) and (optionally) ∇z H
+ *  - pg_loss:   policy-gradient loss -Σ (A log π(a | s) + β H) and its ∇z in one pass
  *
  * Ownership:
  *  - The Policy does NOT own the MLP. The caller is responsible for its lifetime.
  *
  */
+
+#define GAUSSIAN_LOG_STD_MIN -5.0f
+#define GAUSSIAN_LOG_STD_MAX 2.0f
+
+/**
+ * How a discrete policy draws actions:
+ *  - SAMPLER_CDF    : inverse CDF over the softmax of each row (O(A) scalar scan)
+ *  - SAMPLER_GUMBEL : Gumbel-max on the logits with bulk uniforms (O(A) SIMD, no softmax)
+ *  - SAMPLER_ALIAS  : one alias table per run of identical rows, then O(1) per draw;
+ *                     rows that differ from their neighbours fall back to the CDF
+ *  - SAMPLER_GREEDY : argmax of each row, no randomness (acting on Q-values)
+ */
+typedef enum DiscreteSampler {
+    SAMPLER_CDF,
+    SAMPLER_GUMBEL,
+    SAMPLER_ALIAS,
+    SAMPLER_GREEDY,
+} DiscreteSampler;
+
 typedef struct Policy {
     /** Pointer to the underlying neural network (NOT owned). */
     MLP *mlp;
 
     int act_size;
     int n_actions;
+    DiscreteSampler sampler;
+
+    /** Gaussian policies: fixed log std per action dimension, or NULL when the network outputs it (NOT owned). */
+    float *log_std;
 
     /**
      * Samples an action from the policy.
@@ -59,6 +85,16 @@ typedef struct Policy {
         float *entropy,
         float *grad_out
     );
+
+    float (*pg_loss) (
+        const struct Policy *policy,
+        const float *logits,
+        const float *actions,
+        const float *advantages,
+        int batch_size,
+        float entropy_coef,
+        float *grad_out
+    );
 } Policy;
 
 /**
@@ -83,7 +119,9 @@ static inline void policy_sample_action_from_logits(
     int batch_size,
     float *actions
 ) {
+    TRACE_BEGIN(ZONE_SAMPLE_ACTION);
     policy->sample(policy, logits, batch_size, actions);
+    TRACE_END(ZONE_SAMPLE_ACTION);
 }
 
 static inline void policy_log_prob_from_logits(
@@ -107,6 +145,25 @@ static inline void policy_entropy_from_logits(
     policy->entropy(policy, logits, batch_size, entropy, grad_out);
 }
 
+/**
+ * Fused REINFORCE loss over a batch of logits.
+ *
+ * Returns L = -Σ_b (advantages[b] log π(actions[b]) + entropy_coef H_b) and writes
+ * ∂L/∂z to grad_out (can be NULL), ready for mlp_backward. Same result as log_prob
+ * and entropy followed by scaling, without the intermediate arrays.
+ */
+static inline float policy_pg_loss_and_grad(
+    const Policy *policy,
+    const float *logits,
+    const float *actions,
+    const float *advantages,
+    int batch_size,
+    float entropy_coef,
+    float *grad_out       // Can be NULL
+) {
+    return policy->pg_loss(policy, logits, actions, advantages, batch_size, entropy_coef, grad_out);
+}
+
 void policy_sample_action(
     const Policy *policy,
     const float *obs,
@@ -151,9 +208,28 @@ Policy create_binary_policy(MLP *mlp);
  * The output distribution is a categorical distribution produced by the MLP.
  *
  * Arguments:
- *  - mlp : network producing logits over discrete actions
+ *  - mlp     : network producing logits over discrete actions
+ *  - sampler : sampling algorithm (see DiscreteSampler)
+ *
+ * Returns:
+ *  - Initialized Policy (does not allocate or copy mlp)
+ */
+Policy create_discrete_policy(MLP *mlp, int n_actions, DiscreteSampler sampler);
+/**
+ * Creates a diagonal-Gaussian policy over act_size real actions.
+ *
+ * With log_std NULL the network outputs [mean | log std] per row (size 2 * act_size),
+ * so the std depends on the state and is learned with the rest of the network; the log
+ * std is clamped to [GAUSSIAN_LOG_STD_MIN, GAUSSIAN_LOG_STD_MAX]. Otherwise the network
+ * outputs the mean only and log_std[act_size] is a fixed, state-independent std (no
+ * gradient flows to it).
+ *
+ * Arguments:
+ *  - mlp      : network producing the mean (and log std)
+ *  - act_size : action dimension
+ *  - log_std  : fixed log std per dimension, or NULL (not copied)
  *
  * Returns:
  *  - Initialized Policy (does not allocate or copy mlp)
  */
-Policy create_discrete_policy(MLP *mlp, int n_actions);
\ No newline at end of file
+Policy create_gaussian_policy(MLP *mlp, int act_size, float *log_std);
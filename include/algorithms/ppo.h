@@ -0,0 +1,26 @@
+#pragma once
+
+#include "policy.h"
+
+/**
+ * Clipped PPO loss over a minibatch, with ratios r = π(a | s) / π_old(a | s):
+ *
+ *   L = -Σ min(r A, clip(r, 1 - ε, 1 + ε) A) - β Σ H
+ *
+ * Writes ∂L/∂z to grad_out. The gradient of the min is r A ∇ log π where it picks the
+ * unclipped term and 0 where the clip is active, so the fused pg_loss runs the backward
+ * with those weights. log_probs and weights are scratch of size batch_size.
+ */
+float ppo_loss_and_grad(
+    const Policy *policy,
+    const float *logits,
+    const float *actions,
+    const float *advantages,
+    const float *old_log_probs,
+    int batch_size,
+    float clip,
+    float entropy_coef,
+    float *log_probs,
+    float *weights,
+    float *grad_out
+);
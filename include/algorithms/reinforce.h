@@ -11,4 +11,4 @@ void policy_gradient(
     MLPCache *cache
 );
 
-void mean_baseline(ExperienceBuffer *buffer, int gamma, float *baseline);
+void mean_baseline(ExperienceBuffer *buffer, float gamma, float *baseline);
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <stddef.h>
+#include <pthread.h>
+
+#include "nn/mlp.h"
+#include "nn/optimizers.h"
+#include "metrics.h"
+#include "algorithms/dqn.h"
+
+/*
+ * Training checkpoints, one file per rank (<dir>/rank<r>.ckpt) holding the grad-step
+ * counter, the rank's RNG stream and its running metric aggregates (the per-update
+ * records are already in the metrics stream). Rank 0's file also holds the weights
+ * and the optimizer state. Off-policy runs add each rank's replay shard and counters,
+ * and the target network to rank 0's file.
+ *
+ * Writes are asynchronous: checkpoint_async copies the state into one of two
+ * snapshot buffers and a background thread writes it out (to a temporary file that
+ * is renamed over the previous checkpoint), while training carries on. It only
+ * blocks if the previous snapshot is still being written.
+ */
+typedef struct Checkpointer {
+    char dir[512];
+    int rank;
+    int world_size;
+
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+
+    void *buffers[2];
+    size_t capacities[2];
+    size_t sizes[2];
+    int back;       // buffer filled by the next snapshot
+    int pending;    // the other buffer holds a snapshot not yet written
+    int stop;
+    int failures;
+} Checkpointer;
+
+// The off-policy part of a trainer, by reference (NULL for the on-policy algorithms)
+typedef struct ReplayState {
+    ReplayBuffer *replay;   // this rank's shard
+    MLP *target;            // replicated, saved by rank 0 like the online network
+    long *env_steps;        // this rank's, for the ε schedule
+    long *num_updates;
+} ReplayState;
+
+Checkpointer *create_checkpointer(const char *dir, int rank, int world_size);
+
+// next_step: the grad step training resumes from
+void checkpoint_async(
+    Checkpointer *ckpt,
+    int next_step,
+    const MLP *mlp,
+    const Optimizer *optimizer,
+    const TrainingMetrics *metrics,
+    const ReplayState *replay
+);
+
+// Waits for the pending write, then stops the writer thread.
+void free_checkpointer(Checkpointer *ckpt);
+
+/**
+ * Restores this rank's state from <dir>/rank<r>.ckpt, including the RNG stream.
+ * Returns 0 (with a message) if the file is missing or does not match the world
+ * size, network, metrics or replay shape.
+ */
+int load_checkpoint(
+    const char *dir,
+    int rank,
+    int world_size,
+    MLP *mlp,
+    Optimizer *optimizer,
+    TrainingMetrics *metrics,
+    ReplayState *replay,
+    int *next_step
+);
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stdint.h>
+
+/*
+ * Hardware performance counters of the calling thread, opened as one perf_event_open
+ * group so that a single read() samples all of them at the same instant. Counters the
+ * kernel or CPU does not offer (VMs, perf_event_paranoid, non-x86 PMUs) are left out;
+ * reads of a missing counter return 0.
+ */
+enum {
+    COUNTER_CYCLES,
+    COUNTER_INSTRUCTIONS,
+    COUNTER_L1D_MISSES,
+    COUNTER_LLC_MISSES,
+    COUNTER_BRANCH_MISSES,
+    N_COUNTERS
+};
+
+typedef struct PerfCounters {
+    int leader;                 // group fd, -1 when no counter could be opened
+    int fds[N_COUNTERS];        // -1 for counters that are not available
+    uint64_t ids[N_COUNTERS];
+    int n_open;
+} PerfCounters;
+
+/** Opens every available counter, counting user space only. Returns the number opened. */
+int perf_counters_open(PerfCounters *pc);
+
+/**
+ * Reads the running totals, scaled up when the kernel multiplexed the group. Returns
+ * 0 (and zeros) if the group is not open or the read fails.
+ */
+int perf_counters_read(const PerfCounters *pc, uint64_t values[N_COUNTERS]);
+
+void perf_counters_close(PerfCounters *pc);
+
+const char *perf_counter_name(int counter);
@@ -1,8 +1,70 @@
 #pragma once
 
+#include <stddef.h>
+
 #include "nn/mlp.h"
+#include "nn/optimizers.h"
 #include "mpi_utils.h"
 
-void broadcast_model_weights(MLP *mlp, const MPIContext *mpi_ctx, int src_rank);
+/*
+ * Cost of one model collective on the calling rank. The MPI time also holds the wait
+ * for ranks that reach the collective late.
+ */
+typedef struct CommStats {
+    double bytes;       // payload sent by this rank
+    double pack;        // buffer allocation and serialization (seconds)
+    double mpi;         // inside the MPI call
+    double unpack;      // deserialization and buffer release
+} CommStats;
+
+/*
+ * Point-to-point cost model from a ping-pong: a message of n bytes takes
+ * latency + n / bandwidth. Messages below latency * bandwidth bytes are latency-bound.
+ */
+typedef struct CommBaseline {
+    double latency;     // seconds
+    double bandwidth;   // bytes per second, 0 when not measured
+} CommBaseline;
+
+// stats (may be NULL) receives the cost breakdown of the call
+void broadcast_model_weights(MLP *mlp, const MPIContext *mpi_ctx, int src_rank, CommStats *stats);
+
+void aggregate_gradients(MLP *mlp, const MPIContext *mpi_ctx, int compute_rank, CommStats *stats);
+
+/**
+ * Sums the gradients of every rank into every rank's mlp, for algorithms that step a
+ * replicated optimizer on all ranks instead of reducing to one and broadcasting back.
+ */
+void allreduce_gradients(MLP *mlp, const MPIContext *mpi_ctx, CommStats *stats);
+
+/**
+ * Gathers `bytes` bytes of every rank into all[world_size * bytes], in rank order, on
+ * every rank. For the small per-rank results of evolution strategies. With local NULL,
+ * or pointing at this rank's block of all, the gather runs in place from that block.
+ */
+void allgather_bytes(const void *local, int bytes, void *all, const MPIContext *mpi_ctx, CommStats *stats);
+
+// Copies src_rank's optimizer state (Adam moments, step count) to every rank
+void broadcast_optimizer_state(Optimizer *optimizer, const MPIContext *mpi_ctx, int src_rank);
+
+/**
+ * Sends src_rank's weights and optimizer state to dst_rank in one point-to-point
+ * message. Only those two ranks take part; the others return at once.
+ */
+void transfer_model_state(MLP *mlp, Optimizer *optimizer, int src_rank, int dst_rank, const MPIContext *mpi_ctx);
+
+/**
+ * Standardizes x[n] to zero mean and unit variance over the values of every rank,
+ * from one allreduce of the count, sum and sum of squares. Collective.
+ */
+void normalize_across_ranks(float *x, int n, const MPIContext *mpi_ctx);
+
+/**
+ * Measures the latency and bandwidth between rank 0 and the last rank with ping-pongs
+ * of a small message and of max(max_bytes, 1 MiB). Collective; every rank gets the
+ * result (zeros on a single rank).
+ */
+CommBaseline comm_measure_baseline(const MPIContext *mpi_ctx, size_t max_bytes);
 
-void aggregate_gradients(MLP *mlp, const MPIContext *mpi_ctx, int compute_rank);
+// Modelled point-to-point time of a message of `bytes` (0 without a baseline)
+double comm_model_time(const CommBaseline *baseline, double bytes);
@@ -6,12 +6,36 @@ typedef struct {
     int rank;
     int world_size;
     MPI_Comm comm;
+
+    // Ranks sharing this node's memory (MPI_COMM_TYPE_SHARED)
+    MPI_Comm node_comm;
+    int node_rank;
+    int node_size;
+
+    // Add to get_time() to read rank 0's clock (ping-pong estimate at init)
+    double clock_offset;
 } MPIContext;
 
 MPIContext mpi_init_context(int *argc, char ***argv);
 
 void main_printf(const MPIContext *ctx, const char *format, ...);
 
-void mpi_finalize();
+/**
+ * Splits this node's CPUs between its ranks so that BLAS thread pools do not
+ * oversubscribe the node: each rank gets max(1, cpus / sharers) BLAS threads, where
+ * cpus is the size of its affinity mask and sharers counts the node's ranks (itself
+ * included) whose masks overlap it. Ranks with identical masks are also pinned to
+ * disjoint blocks of that mask. Collective over the node. Returns the BLAS thread count.
+ */
+int mpi_apply_thread_policy(const MPIContext *ctx);
+
+/**
+ * Writes each rank's `size` bytes one after the other, in rank order, into one file
+ * with a single collective MPI-IO write at offsets from a prefix sum of the sizes.
+ * Collective; returns 1 on every rank if the whole file was written.
+ */
+int mpi_write_ordered(const MPIContext *ctx, const char *path, const void *data, size_t size);
+
+void mpi_finalize(MPIContext *ctx);
 
 double get_time();
@@ -12,6 +12,7 @@ and Anderson in https://ieeexplore.ieee.org/document/6313077.
 
 Action Space:
 - int: Push cart to the left (0) or right (1)
+- float (continuous): force in units of force_magnitude, clipped to [-1, 1]
 
 Observation Space:
 - float[4]:
@@ -3,6 +3,8 @@
 #include <stdbool.h>
 #include <stdlib.h>
 
+#include "trace.h"
+
 #define ENV_INLINE static inline
 
 typedef struct Env {
@@ -24,7 +26,9 @@ ENV_INLINE void env_reset(Env *env, float*obs_buf) {
 ENV_INLINE void env_step(
     Env *env, const float *action, float *obs_buf, float *reward_buf, bool *done_buf
 ) {
+    TRACE_BEGIN(ZONE_ENV_STEP);
     env->step(env->ptr, action, obs_buf, reward_buf, done_buf);
+    TRACE_END(ZONE_ENV_STEP);
 };
 
 ENV_INLINE void env_destroy(Env *env) {
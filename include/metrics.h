@@ -1,20 +1,132 @@
 #pragma once
 
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "counters.h"
+#include "distributed/comm.h"
 #include "distributed/mpi_utils.h"
 
+// Log-spaced step time histogram: bucket b covers [1us * 2^(b/4), 1us * 2^((b+1)/4))
+#define METRICS_HIST_BUCKETS 128
+
+// Training phases, in timeline CSV order
+enum {
+    PHASE_STEP,
+    PHASE_COMM,
+    PHASE_ROLLOUT,
+    PHASE_FORWARD,
+    PHASE_BACKWARD,
+    PHASE_UPDATE,
+    METRICS_N_PHASES
+};
+
+// Model collectives of an update, sub-events of the comm phase
+enum {
+    COLLECTIVE_BCAST,
+    COLLECTIVE_REDUCE,
+    METRICS_N_COLLECTIVES
+};
+
+/*
+ * Running aggregates over every update recorded so far. They back the training
+ * summary, so it does not depend on the records still held in memory.
+ */
+typedef struct MetricsAggregates {
+    long updates;
+    long episodes;
+    long env_steps;
+
+    double step_time;
+    double comm_time;
+    double rollout_time;
+    double forward_time;
+    double backward_time;
+    double update_time;
+
+    double return_sum;
+    double return_sq_sum;
+    double return_min;
+    double return_max;
+
+    int64_t step_time_hist[METRICS_HIST_BUCKETS];
+
+    // Hardware counter totals per phase (zero without counters)
+    double counters[METRICS_N_PHASES][N_COUNTERS];
+
+    // Collective cost totals (one call of each per update)
+    CommStats collectives[METRICS_N_COLLECTIVES];
+} MetricsAggregates;
+
+/*
+ * Distribution of one per-rank quantity over the ranks, as reduced by reduce_metrics.
+ * argmax is the rank holding the max (lowest rank on ties).
+ */
+typedef struct RankStat {
+    double sum;
+    double min;
+    double max;
+    int argmax;
+} RankStat;
+
+// Quantities reduced across ranks, one RankStat each
+enum {
+    STAT_WALL_TRAIN,
+    STAT_WALL_TOTAL,
+    STAT_STEP,
+    STAT_COMM,
+    STAT_ROLLOUT,
+    STAT_FORWARD,
+    STAT_BACKWARD,
+    STAT_UPDATE,
+    STAT_EPISODES,
+    STAT_ENV_STEPS,
+    STAT_RETURN_SUM,
+    STAT_RETURN_SQ_SUM,
+    STAT_RETURN_MIN,
+    STAT_RETURN_MAX,
+    STAT_COUNTER_RANKS,     // 1 on ranks with hardware counters
+    STAT_COUNTER_ENV_STEPS, // env steps of those ranks
+    STAT_STEP_HIST,         // METRICS_HIST_BUCKETS entries
+    STAT_COUNTERS = STAT_STEP_HIST + METRICS_HIST_BUCKETS,  // [phase][counter]
+    STAT_COLLECTIVES = STAT_COUNTERS + METRICS_N_PHASES * N_COUNTERS,  // [collective][bytes, pack, mpi, unpack]
+    METRICS_N_STATS = STAT_COLLECTIVES + METRICS_N_COLLECTIVES * 4
+};
+
+typedef struct MetricsStream MetricsStream;
+
 typedef struct TrainingMetrics {
-    int updates_capacity;
+    int window;             // updates held in memory (ring size)
     int num_episodes;
 
+    long updates;           // updates started so far
+    long flushed;           // updates handed to the stream
+
     double wall_time_train;
     double wall_time_total;
 
-    // Size [updates * episodes]
+    // Activation cache footprint (bytes per rank) and rematerialization interval
+    size_t cache_bytes;
+    int checkpoint_every;
+
+    // Ping-pong cost model the collectives are compared against (set by the caller)
+    CommBaseline comm_baseline;
+
+    MetricsAggregates totals;
+
+    // Per-rank distribution of the totals, filled on the root by reduce_metrics
+    RankStat stats[METRICS_N_STATS];
+    int world_size;
+
+    // Ring of the last `window` updates: update u lives in slot u % window
+
+    // Size [window * episodes]
     float *returns;
     int *steps;
     float *loss;
 
-    // Size [updates]
+    // Size [window]
 
     // Durations (seconds)
     double *step_times;
@@ -23,6 +135,8 @@ typedef struct TrainingMetrics {
     double *forward_times;
     double *backward_times;
     double *update_times;
+    double *bcast_times;        // sub-events of comm
+    double *reduce_times;
 
     // Start timestamps (seconds, MPI_Wtime())
     double *step_starts;
@@ -31,14 +145,81 @@ typedef struct TrainingMetrics {
     double *forward_starts;
     double *backward_starts;
     double *update_starts;
+    double *bcast_starts;
+    double *reduce_starts;
+
+    // Collective costs, size [window * METRICS_N_COLLECTIVES]
+    CommStats *comm_stats;
+
+    // Hardware counters, NULL unless metrics_open_counters found any
+    PerfCounters *perf;
+    uint64_t *phase_counters;   // size [window * METRICS_N_PHASES * N_COUNTERS]
+
+    // Background CSV writer, NULL unless metrics_open_stream was called
+    MetricsStream *stream;
 } TrainingMetrics;
 
-TrainingMetrics create_metrics(int grad_steps, int n_episodes);
+TrainingMetrics create_metrics(int window, int n_episodes);
+
+/**
+ * Changes the episodes recorded per update, clearing the per-episode records of the
+ * ring; the update counter and totals carry on. Not for a streaming run, whose rows
+ * have a fixed width.
+ */
+void metrics_set_episodes(TrainingMetrics *metrics, int n_episodes);
+
+size_t metrics_bytes(const TrainingMetrics *metrics);
+
+/**
+ * Opens the calling thread's hardware counters and records them per phase from then
+ * on (see metrics_count_phase). Call before metrics_open_stream, which then adds the
+ * counts to the timeline CSV. Returns the number of counters available; with none,
+ * recording stays off and every counting call is a no-op.
+ */
+int metrics_open_counters(TrainingMetrics *metrics);
+
+/**
+ * Streams every update of every rank to <dir>/training_timeline.bin (see timeline.h;
+ * one row per phase, then one per collective with its bytes and pack/MPI/unpack times)
+ * and, from the root, the rank-averaged episode results to <dir>/training_results.csv.
+ * Records go out in blocks of half a window: the timeline as one non-blocking
+ * collective MPI-IO write, the rest from a background thread. With resume_step > 0
+ * the files are kept up to that update and appended to. Collective.
+ *
+ * With trace set, the root also writes <dir>/trace.json: a Chrome trace-event file
+ * (Perfetto, chrome://tracing) with one process per rank and one track per phase,
+ * timestamps moved onto rank 0's clock. Each block is gathered to the root.
+ */
+int metrics_open_stream(TrainingMetrics *metrics, const MPIContext *mpi_ctx, const char *dir, int resume_step, int trace);
+
+// Clears and returns the ring slot for the next update (waits if the slot is still being written).
+int metrics_begin_update(TrainingMetrics *metrics);
+
+// Reads the hardware counters into mark (zeros without counters).
+void metrics_counter_mark(const TrainingMetrics *metrics, uint64_t mark[N_COUNTERS]);
+
+// Adds the counts since mark to a phase of the update in slot.
+void metrics_count_phase(TrainingMetrics *metrics, int slot, int phase, const uint64_t mark[N_COUNTERS]);
+
+// Folds the current update into the aggregates; hands a block to the stream when due. Collective when streaming.
+void metrics_end_update(TrainingMetrics *metrics, const MPIContext *mpi_ctx);
+
+// Hands every finished update to the stream. Collective when streaming.
+void metrics_flush(TrainingMetrics *metrics, const MPIContext *mpi_ctx);
 
+// Waits for the stream to drain and closes it. Collective when streaming.
 void free_metrics(TrainingMetrics *metrics);
 
+/**
+ * Reduces the running totals of every rank to the root in a single collective. On the
+ * root, `stats` holds the sum/min/max/argmax of each quantity over ranks and `totals`
+ * the summed counts, times and returns (the run-wide min/max return, the histogram
+ * over every rank's steps).
+ */
 void reduce_metrics(TrainingMetrics *metrics, const MPIContext *mpi_ctx, int root_rank);
 
-void write_metrics_timeline_csv(const TrainingMetrics *metrics, const MPIContext *mpi_ctx, const char *filepath);
+// Origin of the trace.json timeline on rank 0's clock, shared by all ranks (0 without a stream)
+double metrics_trace_base(const TrainingMetrics *metrics);
 
-void write_metrics_results_csv(const TrainingMetrics *metrics, const MPIContext *mpi_ctx, const char *filepath);
+// Step time below which a fraction q of the updates fall, from the histogram
+double metrics_step_time_quantile(const MetricsAggregates *totals, double q);
@@ -0,0 +1,37 @@
+#pragma once
+
+/*
+ * GEMM backend used by gemm_nt / gemm_tn / gemm_nn (and so by every linear layer).
+ *
+ *  - auto      : in-tree kernels or the linked BLAS, chosen per call from the shape
+ *  - openblas  : always the linked BLAS, which must be OpenBLAS
+ *  - blis      : always the linked BLAS, which must be BLIS
+ *  - reference : naive loops, useful as a correctness baseline
+ *  - kernels   : always the in-tree kernels (src/nn/gemm.c)
+ *
+ * The backend is process-wide and is meant to be chosen once at startup.
+ */
+typedef struct GemmBackend {
+    const char *name;
+
+    void (*nt)(int M, int N, int K, const float *A, int lda, const float *B, int ldb, float beta, float *C, int ldc);
+    void (*tn)(int M, int N, int K, const float *A, int lda, const float *B, int ldb, float beta, float *C, int ldc);
+    void (*nn)(int M, int N, int K, const float *A, int lda, const float *B, int ldb, float beta, float *C, int ldc);
+} GemmBackend;
+
+/**
+ * Selects the backend by name. Returns 0 (keeping the current backend) if the name is
+ * unknown or names a BLAS library other than the one linked in.
+ */
+int gemm_backend_select(const char *name);
+
+const GemmBackend *gemm_backend();
+
+/** Name of the BLAS library linked in ("OpenBLAS", "BLIS" or "unknown BLAS"). */
+const char *blas_vendor();
+
+/** Sets the BLAS library's thread pool size. Returns 0 if the library offers no control. */
+int blas_set_num_threads(int n_threads);
+
+/** Current BLAS thread count, or -1 when unknown. */
+int blas_get_num_threads();
@@ -0,0 +1,34 @@
+#pragma once
+
+/*
+ * Row-major single precision GEMMs used by the linear layers.
+ *
+ *   nt: C[M,N] = A[M,K] B[N,K]^T + beta C     (forward,          Z = X W^T)
+ *   tn: C[M,N] = A[K,M]^T B[K,N] + beta C     (weight gradient, dW = dZ^T X)
+ *   nn: C[M,N] = A[M,K] B[K,N]   + beta C     (input gradient,  dX = dZ W)
+ *
+ * The skinny_gemm_* variants are the in-tree blocked SIMD kernels, tuned for the
+ * tall-skinny shapes of RL policies (one dimension is the episode length, the
+ * others are the observation / hidden sizes). The auto_gemm_* variants dispatch to
+ * either the in-tree kernels or BLAS depending on the shape. The gemm_* variants
+ * call the active backend (see nn/backend.h), "auto" by default.
+ */
+
+void skinny_gemm_nt(int M, int N, int K, const float *A, int lda, const float *B, int ldb, float beta, float *C, int ldc);
+void skinny_gemm_tn(int M, int N, int K, const float *A, int lda, const float *B, int ldb, float beta, float *C, int ldc);
+void skinny_gemm_nn(int M, int N, int K, const float *A, int lda, const float *B, int ldb, float beta, float *C, int ldc);
+
+void auto_gemm_nt(int M, int N, int K, const float *A, int lda, const float *B, int ldb, float beta, float *C, int ldc);
+void auto_gemm_tn(int M, int N, int K, const float *A, int lda, const float *B, int ldb, float beta, float *C, int ldc);
+void auto_gemm_nn(int M, int N, int K, const float *A, int lda, const float *B, int ldb, float beta, float *C, int ldc);
+
+void gemm_nt(int M, int N, int K, const float *A, int lda, const float *B, int ldb, float beta, float *C, int ldc);
+void gemm_tn(int M, int N, int K, const float *A, int lda, const float *B, int ldb, float beta, float *C, int ldc);
+void gemm_nn(int M, int N, int K, const float *A, int lda, const float *B, int ldb, float beta, float *C, int ldc);
+
+/*
+ * Shape crossover used by the auto_gemm_* dispatch: the in-tree kernels are used when
+ * M*N*K <= small_volume, or for gemm_nt when the reduction K <= nt_max_k (forward
+ * products over the observation). BLAS otherwise. Defaults come from bench_gemm.
+ */
+void gemm_set_crossover(int nt_max_k, long small_volume);
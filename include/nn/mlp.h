@@ -1,12 +1,35 @@
 #pragma once
 
+#include <stddef.h>
+
 #include "linear.h"
 
+/*
+ * A network is a chain of linear layers, or a shared trunk feeding several heads
+ * (e.g. policy logits and a value). Either way `layers` is one flat array (trunk layers,
+ * then each head's in order), so everything that walks the parameters (optimizers, the
+ * comm layer, checkpoints, weight files) sees one parameter block.
+ *
+ * Multi-head outputs are head-major: for a batch of B rows, head 0's [B, head_sizes[0]]
+ * block, then head 1's, and so on (see mlp_head_output). Output gradients passed to
+ * mlp_backward use the same layout over all cached rows.
+ */
 typedef struct MLP {
     LinearLayer *layers;
     int num_layers;
     int input_size;
-    int output_size;
+    int output_size;         // Summed over heads
+
+    // 1 for a plain chain. Otherwise layers [0, trunk_layers) are shared and head h owns
+    // the next head_layers[h] layers, producing head_sizes[h] outputs
+    int num_heads;
+    int trunk_layers;
+    int *head_layers;
+    int *head_sizes;
+
+    // Set by map_mlp_weights: weights and biases point into this read-only mapping
+    void *mapping;
+    size_t mapping_size;
 } MLP;
 
 MLP create_mlp(
@@ -16,10 +39,47 @@ MLP create_mlp(
     Activation *activations
 );
 
+typedef struct MLPHead {
+    int num_layers;
+    int *hidden_sizes;       // [num_layers - 1] widths after the trunk, NULL for a single layer
+    int output_size;
+    Activation *activations; // [num_layers]
+} MLPHead;
+
+/**
+ * Trunk of trunk_layers layers with widths trunk_sizes[0..trunk_layers] (input first,
+ * shared representation last), and num_heads heads reading its output.
+ */
+MLP create_multihead_mlp(
+    int *trunk_sizes,
+    int trunk_layers,
+    Activation *trunk_activations,
+    const MLPHead *heads,
+    int num_heads
+);
+
+static inline int mlp_head_size(const MLP *mlp, int head) {
+    return mlp->num_heads > 1 ? mlp->head_sizes[head] : mlp->output_size;
+}
+
+// Start of a head's block in the outputs (or output gradients) of batch_size rows
+static inline float *mlp_head_output(const MLP *mlp, float *out, int batch_size, int head) {
+    for (int h = 0; h < head; h++) out += (size_t)batch_size * mlp->head_sizes[h];
+    return out;
+}
+
 typedef struct MLPCache {
     int num_layers, size, capacity;
     LinearCache *layer_caches;
     float *output;
+
+    // Activation rematerialization. With checkpoint_every == 1 every layer input and
+    // pre-activation is cached. With checkpoint_every = k > 1 only the inputs of layers
+    // l % k == 0 are kept, and mlp_backward recomputes each segment of k layers in
+    // chunks of remat_chunk rows.
+    int checkpoint_every;
+    int remat_chunk;
+    float *remat_scratch;
 } MLPCache;
 
 void kaiming_mlp_init(MLP *mlp);
@@ -30,16 +90,31 @@ void mlp_backward(MLP *mlp, const MLPCache *cache, const float *out_grad, float
 
 void mlp_zero_grad(MLP *mlp);
 
+// Writes the v2 format: aligned tensors behind a header index, with a checksum.
 int save_mlp_weights(MLP *mlp, char *path);
 
+// Copies weights from a v1 or v2 file into the network.
 int load_mlp_weights(MLP *mlp, const char *path);
 
+/**
+ * Zero-copy load of a v2 file: the network's weights and biases point straight into a
+ * read-only shared mapping, so processes on a node share one copy through the page
+ * cache. For inference only; writing the weights (e.g. an optimizer step) faults.
+ * verify also checks the checksum, which touches every page once.
+ */
+int map_mlp_weights(MLP *mlp, const char *path, int verify);
+
 void free_mlp(MLP* mlp);
 
 int get_num_params(MLP *mlp);
 
 MLPCache create_mlp_cache(const MLP *mlp, int capacity);
 
+// checkpoint_every <= 0 keeps only the raw network inputs. Multi-head networks cache everything.
+MLPCache create_mlp_remat_cache(const MLP *mlp, int capacity, int checkpoint_every);
+
+size_t mlp_cache_bytes(const MLP *mlp, const MLPCache *cache);
+
 void empty_mlp_cache(MLPCache *cache);
 
 void free_mlp_cache(MLPCache *cache);
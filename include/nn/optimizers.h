@@ -2,15 +2,25 @@
 
 #include "stdlib.h"
 #include "mlp.h"
+#include "trace.h"
 
 typedef struct Optimizer {
     void *state;
     void (*step)(void *, MLP *, MLPCache *);
     void (*destroy)(void *);
+
+    // Serialization of the optimizer's running state (for checkpoints); NULL if stateless
+    size_t (*state_size)(void *);
+    void (*save_state)(void *, void *dst);
+    void (*load_state)(void *, const void *src);
+
+    void (*set_lr)(void *, float lr);
 } Optimizer;
 
 static inline void optimizer_step(Optimizer *opt, MLP *mlp, MLPCache *cache) {
+    TRACE_BEGIN(ZONE_OPTIMIZER_STEP);
     opt->step(opt->state, mlp, cache);
+    TRACE_END(ZONE_OPTIMIZER_STEP);
     empty_mlp_cache(cache);
 }
 
@@ -19,6 +29,23 @@ static inline void free_optimizer(Optimizer *opt) {
     free(opt->state);
 }
 
+static inline size_t optimizer_state_size(const Optimizer *opt) {
+    return opt->state_size ? opt->state_size(opt->state) : 0;
+}
+
+static inline void optimizer_save_state(const Optimizer *opt, void *dst) {
+    if (opt->save_state) opt->save_state(opt->state, dst);
+}
+
+static inline void optimizer_load_state(Optimizer *opt, const void *src) {
+    if (opt->load_state) opt->load_state(opt->state, src);
+}
+
+// Changes the learning rate, keeping the running state
+static inline void optimizer_set_lr(Optimizer *opt, float lr) {
+    opt->set_lr(opt->state, lr);
+}
+
 Optimizer make_gd(float lr);
 
 Optimizer make_adam(
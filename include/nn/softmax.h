@@ -0,0 +1,44 @@
+#pragma once
+
+/*
+ * Row-wise softmax kernels for categorical policies.
+ *
+ * The exponentials are computed a SIMD vector at a time: x = k ln2 + r with
+ * |r| <= ln2 / 2, exp(r) from a degree-5 polynomial and 2^k assembled in the
+ * exponent bits (about 2 ulp over the float range). Logarithms split off the
+ * exponent bits the same way. The same vector math backs the bulk normal sampler.
+ */
+
+// out[i] = exp(x[i]) for i < n (out may alias x)
+void vexpf(const float *x, int n, float *out);
+
+// out[i] = log(x[i]) for positive normal x[i] (out may alias x)
+void vlogf(const float *x, int n, float *out);
+
+/**
+ * Box-Muller in place: uniforms in (0, 1) at u[0, h) and u[h, 2h) become 2h standard
+ * normals. Used by rand_normal_fill.
+ */
+void box_muller(float *u, int h);
+
+/**
+ * Gumbel-max draw from softmax(x[n]): argmax_i x[i] - log(-log u[i]) for uniforms
+ * u[i] in (0, 1), without forming the probabilities and with no branch per action.
+ */
+int gumbel_argmax(const float *x, int n, const float *u);
+
+/**
+ * One row of logits x[n]: writes the unnormalized probabilities e[i] = exp(x[i] - max x)
+ * and their sum, and returns log sum exp(x). Then p[i] = e[i] / sum and
+ * log p[i] = x[i] - lse.
+ */
+float softmax_row(const float *x, int n, float *e, float *sum);
+
+/** log_probs[r, i] = log softmax(logits[r, :])[i] over [rows, n] row-major logits. */
+void log_softmax(const float *logits, int rows, int n, float *log_probs);
+
+/**
+ * Inverse-CDF draw from unnormalized weights e[n] summing to `sum`: the first i whose
+ * cumulative weight exceeds u * sum (u in [0, 1)), n - 1 if rounding runs past the end.
+ */
+int sample_inverse_cdf(const float *e, int n, float sum, float u);
@@ -0,0 +1,34 @@
+#pragma once
+
+#include "training.h"
+
+/*
+ * Population-based training: the job is split into `members` sub-communicators of
+ * equal size, each running the usual data-parallel loop with its own learning rate,
+ * discount and episodes per step. Every `interval` grad steps the members are ranked
+ * by their mean return over the interval; each member in the bottom `fraction` copies
+ * the weights, optimizer state and hyperparameters of one in the top `fraction`
+ * (exploit, one point-to-point message between the two members' rank 0), then
+ * multiplies its learning rate and 1 - γ by 0.8 or 1.25 (explore).
+ *
+ * The population spec is a ':'-separated list of key=values fields:
+ *
+ *   members=4          population size, dividing the job size (default: one per rank)
+ *   interval=50        grad steps between exploit rounds
+ *   fraction=0.25      share of the population replaced each round
+ *   lr=1e-3,3e-2       log-uniform range of the initial learning rates
+ *                      (default: config->learning_rate / 4 to * 4)
+ *   gamma=0.95,0.99    initial discounts, one drawn per member (default: config->gamma)
+ *   episodes=1,2,4     initial episodes per step, one drawn per member (default: config->episodes)
+ *
+ * e.g. "members=4:interval=25:gamma=0.95,0.99". Every draw comes from a hash of
+ * config->seed, so every rank makes the same decisions without communicating them.
+ */
+
+/**
+ * Trains the population described by config->pbt for config->grad_steps steps. Rank 0
+ * logs every exploit, prints the final population and, with config->output_dir, writes
+ * the rounds to <output>/pbt.csv; the best member's rank 0 writes <output>/weights.bin.
+ * Collective; returns 0 if the spec is invalid.
+ */
+int run_pbt(const Config *config, const MPIContext *ctx);
@@ -1,7 +1,25 @@
 #pragma once
 
+#include <stdint.h>
+
+// Per-process PCG32 stream. The state can be read and restored for checkpointing.
+typedef struct RNGState {
+    uint64_t state;
+    uint64_t inc;
+} RNGState;
+
 float rand_uniform(float a, float b);
 
+// n uniforms in the open interval (0, 1), for bulk consumers such as Gumbel noise
+void rand_uniform_fill(float *out, int n);
+
 float rand_normal(float mean, float std);
 
+// n standard normals (Box-Muller on bulk uniforms), for sampling continuous actions
+void rand_normal_fill(float *out, int n);
+
 void rng_seed(unsigned int s);
+
+RNGState rng_get_state();
+
+void rng_set_state(RNGState state);
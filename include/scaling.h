@@ -0,0 +1,29 @@
+#pragma once
+
+#include "training.h"
+
+/*
+ * Scaling study: trains every configuration of a sweep inside one MPI job, each on a
+ * sub-communicator made of the first `ranks` ranks (largest first; the other ranks
+ * idle without spinning), and reports one row per configuration.
+ *
+ * The sweep spec is a ':'-separated list of key=values fields:
+ *
+ *   ranks=4,2,1        world sizes (default: powers of two up to the job size)
+ *   episodes=1,4       episodes per step: per rank (weak) or in total (strong)
+ *   hidden=16,64       hidden sizes (default: config->hidden_size)
+ *   mode=weak|strong   (default: weak)
+ *
+ * e.g. "ranks=4,2,1:episodes=4:mode=strong". Every configuration runs
+ * config->grad_steps steps from config->seed. Parallel efficiency is the env-step
+ * throughput per rank relative to the smallest world size of the same episodes and
+ * hidden size. With config->target_return set, time-to-target is the training time
+ * until the rank-averaged return, smoothed over 10 steps, first reaches it.
+ */
+
+/**
+ * Runs the sweep described by config->scaling. Rank 0 prints the table and, with
+ * config->output_dir, writes it to <output>/scaling.csv. Collective; returns 0 if the
+ * spec is invalid.
+ */
+int run_scaling_study(const Config *config, const MPIContext *ctx);
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "distributed/mpi_utils.h"
+
+/*
+ * Columnar binary timeline shared by every rank, written with collective MPI-IO so a
+ * run creates one file however many ranks it has.
+ *
+ * Layout: a TimelineHeader, n_columns TimelineColumn descriptors, n_kinds row kind
+ * names, then blocks up to the end of the file. A block holds `rows` rows of every
+ * rank: a TimelineBlock, then each column in turn with rank 0's values, rank 1's
+ * values, ... (one TimelineValue per row). All ranks write the same number of rows
+ * per block, so each one computes its own offsets and a block is a single collective
+ * write. tools/timeline_to_csv.c converts the file back to CSV.
+ */
+#define TIMELINE_MAGIC "RLTIMELN"
+#define TIMELINE_VERSION 1
+#define TIMELINE_NAME_LEN 16
+
+typedef struct TimelineHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t world_size;
+    uint32_t n_columns;
+    uint32_t n_kinds;
+    uint64_t data_offset;       // first block
+} TimelineHeader;
+
+// Column types, and the value marking a missing entry in each
+enum {
+    TIMELINE_INT = 'i',         // INT64_MIN
+    TIMELINE_UINT = 'u',        // UINT64_MAX
+    TIMELINE_FLOAT = 'f',       // NaN
+};
+
+typedef struct TimelineColumn {
+    char name[TIMELINE_NAME_LEN - 1];
+    char type;
+} TimelineColumn;
+
+typedef struct TimelineBlock {
+    int64_t first_update;
+    int64_t updates;
+    int64_t rows;               // per rank
+    int64_t reserved;
+} TimelineBlock;
+
+typedef union TimelineValue {
+    int64_t i;
+    uint64_t u;
+    double f;
+} TimelineValue;
+
+typedef struct TimelineWriter {
+    MPI_File file;
+    MPI_Request request;        // block in flight, MPI_REQUEST_NULL when idle
+    const MPIContext *ctx;
+    int n_columns;
+    MPI_Offset end;             // offset of the next block
+
+    // Block being filled or written: the TimelineBlock (used on rank 0), then
+    // [n_columns][rows] values
+    TimelineValue *buffer;
+    size_t capacity;            // values after the block header
+    int rows;
+} TimelineWriter;
+
+/**
+ * Opens <path> on every rank of ctx. With resume_update > 0 an existing file of the
+ * same world size and columns keeps its blocks of updates before resume_update and is
+ * appended to; otherwise it is recreated. Collective; returns 0 (on every rank) on
+ * failure.
+ */
+int timeline_open(
+    TimelineWriter *writer,
+    const MPIContext *ctx,
+    const char *path,
+    const TimelineColumn *columns,
+    int n_columns,
+    const char *const *kinds,
+    int n_kinds,
+    long resume_update
+);
+
+/**
+ * Waits for the previous block to be written and returns the buffer for the next one,
+ * of rows values per column: column c of row k is at [c * rows + k].
+ */
+TimelineValue *timeline_block(TimelineWriter *writer, int rows);
+
+/** Starts the collective write of the block filled since timeline_block. */
+void timeline_write_block(TimelineWriter *writer, long first_update, long updates);
+
+/** Finishes the pending write and closes the file. Collective. */
+void timeline_close(TimelineWriter *writer);
+
+// Bytes of the block buffer
+size_t timeline_bytes(const TimelineWriter *writer);
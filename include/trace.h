@@ -0,0 +1,117 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+/*
+ * Hot-path trace zones.
+ *
+ * TRACE_BEGIN / TRACE_END record a timestamped event into the calling thread's ring
+ * buffer (no locks, no allocation after the first event) and accumulate per-zone
+ * totals. Timestamps are raw TSC ticks on x86, CLOCK_MONOTONIC_RAW nanoseconds
+ * elsewhere. The macros compile to nothing unless built with RL_TRACING (CMake
+ * option TRACING), and cost one branch until trace_init is called.
+ *
+ * Zones of one kind must not nest within themselves.
+ */
+typedef enum TraceZone {
+    ZONE_MLP_FORWARD,
+    ZONE_MLP_BACKWARD,
+    ZONE_LINEAR_FORWARD,
+    ZONE_LINEAR_BACKWARD,
+    ZONE_ENV_STEP,
+    ZONE_SAMPLE_ACTION,
+    ZONE_OPTIMIZER_STEP,
+    ZONE_MPI_BCAST,
+    ZONE_MPI_REDUCE,
+    ZONE_MPI_ALLREDUCE,
+    ZONE_MPI_ALLGATHER,
+    ZONE_MPI_METRICS,
+    TRACE_N_ZONES
+} TraceZone;
+
+typedef struct TraceEvent {
+    uint64_t ticks;
+    uint32_t zone;
+    uint32_t end;
+} TraceEvent;
+
+// Events kept per thread (power of two)
+#define TRACE_RING_SIZE (1 << 16)
+
+typedef struct TraceThread {
+    uint64_t head;      // events recorded so far; the ring holds the last TRACE_RING_SIZE
+    uint64_t open[TRACE_N_ZONES];
+    uint64_t ticks[TRACE_N_ZONES];
+    uint64_t count[TRACE_N_ZONES];
+    TraceEvent ring[TRACE_RING_SIZE];
+} TraceThread;
+
+extern int trace_enabled;
+extern _Thread_local TraceThread *trace_local;
+
+TraceThread *trace_thread_init();
+
+static inline uint64_t trace_ticks() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+#endif
+}
+
+static inline void trace_record(TraceZone zone, uint32_t end) {
+    if (!trace_enabled) return;
+
+    TraceThread *t = trace_local ? trace_local : trace_thread_init();
+    uint64_t now = trace_ticks();
+
+    TraceEvent *e = &t->ring[t->head++ & (TRACE_RING_SIZE - 1)];
+    e->ticks = now;
+    e->zone = zone;
+    e->end = end;
+
+    if (end) {
+        t->ticks[zone] += now - t->open[zone];
+        t->count[zone]++;
+    } else {
+        t->open[zone] = now;
+    }
+}
+
+#ifdef RL_TRACING
+#define TRACE_BEGIN(zone) trace_record((zone), 0)
+#define TRACE_END(zone) trace_record((zone), 1)
+#else
+#define TRACE_BEGIN(zone) ((void)0)
+#define TRACE_END(zone) ((void)0)
+#endif
+
+/**
+ * Calibrates the tick rate (about 20 ms) and starts recording. now_seconds is the
+ * caller's clock at this instant, used to place events on that clock in
+ * trace_write_chrome. Returns 0 when zones were compiled out.
+ */
+int trace_init(double now_seconds);
+
+const char *trace_zone_name(TraceZone zone);
+
+// Total seconds and number of completed zones of the calling thread
+void trace_zone_stats(double *seconds, uint64_t *counts);
+
+// Cost of an empty BEGIN/END pair, in nanoseconds
+double trace_overhead_ns();
+
+/**
+ * Writes the calling thread's ring as comma-separated Chrome trace events (the body of
+ * a JSON array) with the given pid, with timestamps relative to base_seconds on the
+ * clock given to trace_init.
+ */
+void trace_write_chrome(FILE *f, int pid, double base_seconds);
@@ -0,0 +1,194 @@
+#pragma once
+
+#include <stdbool.h>
+
+#include "algorithms/reinforce.h"
+#include "algorithms/a2c.h"
+#include "algorithms/ppo.h"
+#include "algorithms/es.h"
+#include "algorithms/dqn.h"
+#include "nn/optimizers.h"
+#include "metrics.h"
+#include "distributed/mpi_utils.h"
+
+/*
+ * How a gradient step turns rollouts into a loss:
+ *  - ALGO_REINFORCE : discounted returns, one forward and backward per episode
+ *  - ALGO_A2C       : a value head on the shared trunk, GAE(λ) advantages normalized
+ *                     over every rank, one batched forward and backward per step
+ *  - ALGO_PPO       : the A2C batch, reused for epochs of shuffled minibatches with the
+ *                     clipped objective and an optimizer step per minibatch
+ *  - ALGO_ES        : evolution strategies; antithetic parameter perturbations evaluated
+ *                     forward-only, exchanging only (seed, return) pairs
+ *  - ALGO_DQN       : off-policy Q-learning; ε-greedy episodes feed each rank's replay
+ *                     shard, then minibatches drawn by priority train against a target network
+ */
+typedef enum Algorithm {
+    ALGO_REINFORCE,
+    ALGO_A2C,
+    ALGO_PPO,
+    ALGO_ES,
+    ALGO_DQN,
+} Algorithm;
+
+typedef struct Config {
+    int seed;
+    int hidden_size;
+    int episodes;
+    int max_steps;
+    float gamma;
+    float entropy_coef;
+    char *algo;
+    float gae_lambda;
+    float value_coef;
+    int ppo_epochs;
+    int minibatches;
+    float clip_range;
+    float es_sigma;
+    int es_pairs;
+    int replay_capacity;
+    int batch_size;
+    int dqn_updates;
+    int target_every;
+    float per_alpha;
+    float per_beta;
+    float epsilon;
+    int grad_steps;
+    float learning_rate;
+    int checkpoint_every;
+    bool render;
+    char *env_name;
+    char *output_dir;
+    char *backend;
+    int save_interval;
+    char *resume_dir;
+    int metrics_window;
+    bool trace;
+    bool zones;
+    bool counters;
+
+    // Scaling study: sweep spec (see scaling.h), NULL for a single run
+    char *scaling;
+    float target_return;
+
+    // Population-based training: population spec (see pbt.h), NULL for a single run
+    char *pbt;
+} Config;
+
+/*
+ * One rank's part of a synchronous policy-gradient run over ctx->comm: the environment,
+ * policy network, optimizer (stepped on rank 0 of the communicator), rollout buffers
+ * and per-phase metrics. The trainer owns the policy network.
+ */
+typedef struct Trainer {
+    const MPIContext *ctx;
+
+    Env env;
+    Policy policy;
+    Optimizer optimizer;
+    ExperienceBuffer buffer;
+    MLPCache cache;
+    TrainingMetrics metrics;
+
+    Algorithm algo;
+    int episodes;
+    int max_steps;
+    float gamma;
+    float entropy_coef;
+    float gae_lambda;
+    float value_coef;
+    float value_scale;      // V(s) = value_scale * value head output
+    int ppo_epochs;
+    int minibatches;
+    float clip_range;
+    uint32_t seed;          // the run's seed, shared by every rank
+    float es_sigma;
+    int es_pairs;
+    int batch_size;
+    int dqn_updates;
+    int target_every;
+    float per_beta;
+    float epsilon;          // final ε of the exploration schedule
+    long env_steps;         // this rank's, for the ε schedule
+    long num_updates;       // DQN gradient updates so far
+
+    // Scratch of size [capacity] and [capacity * out_size]; returns hold the advantages under A2C
+    float *returns;
+    float *targets;
+    float *logits;
+    float *dlogp;
+
+    // PPO: log π_old of the batch, the minibatch order and the gathered minibatch, all of size [capacity]
+    float *old_log_probs;
+    int *order;
+    float *batch_obs, *batch_actions;
+    float *batch_advantages, *batch_old_log_probs, *batch_targets;
+    float *batch_log_probs, *batch_weights;
+
+    // ES: parameters θ and noise of size [num_params], results of [world_size * es_pairs]
+    float *theta;
+    float *noise;
+    ESResult *es_results;
+
+    // DQN: target network, this rank's replay shard, the minibatch, target Q(s', ·) of [batch_size * n_actions]
+    MLP target;
+    ReplayBuffer replay;
+    ReplayBatch replay_batch;
+    float *next_q;
+    float *td_errors;
+} Trainer;
+
+Env dispatch_environment(const char *env_name);
+
+/**
+ * Creates the policy network for env (owned by the caller) and its policy head. With
+ * value_head the network is a shared trunk with the policy outputs as head 0 and V(s)
+ * as head 1.
+ */
+Policy dispatch_policy(Env *env, int hidden_size, bool value_head);
+
+/** A Q-network with one output per discrete action, behind a greedy policy (owned by the caller). */
+Policy dispatch_q_network(Env *env, int hidden_size);
+
+/** Parses an --algo name; false if it is unknown. */
+bool parse_algorithm(const char *name, Algorithm *algo);
+
+/** Sets up a trainer from the config, on ctx's communicator. Seed the RNG first. */
+Trainer create_trainer(const Config *config, const MPIContext *ctx);
+
+/**
+ * Runs one gradient step: model broadcast, config->episodes rollouts with forward and
+ * backward passes, gradient reduction and the optimizer step, timing each phase into
+ * trainer->metrics. Collective over ctx->comm. Returns the metrics slot of the step.
+ *
+ * A2C rolls the episodes out into one buffer and runs a single forward and backward
+ * over it; the advantage normalization is a collective timed as communication. PPO
+ * replaces the single reduce and rank-0 update with an allreduce and an update on
+ * every rank per minibatch, which keeps the replicas equal without the broadcast. ES
+ * replaces the broadcast and reduce with one allgather of (seed, return) pairs, after
+ * which every rank applies the same update. DQN, like PPO, skips the broadcast and
+ * allreduces the gradient of each of its minibatches.
+ */
+int trainer_step(Trainer *trainer);
+
+/**
+ * Brings every rank to rank 0's weights and, where each rank steps its own optimizer
+ * (PPO, ES, DQN), optimizer state and DQN target network. Collective; call after
+ * resuming from a checkpoint.
+ */
+void trainer_sync(Trainer *trainer);
+
+/**
+ * Changes the learning rate and discount of a running trainer, keeping its weights and
+ * optimizer state. Local; every rank of the communicator must make the same change.
+ */
+void trainer_set_hyperparameters(Trainer *trainer, float learning_rate, float gamma);
+
+/**
+ * Changes the episodes per step, reallocating only the rollout buffer, activation cache
+ * and per-row scratch; the weights, optimizer, update counter (ES seeds) and DQN replay
+ * and counters carry on. Local, like trainer_set_hyperparameters; not while streaming metrics.
+ */
+void trainer_set_episodes(Trainer *trainer, int episodes);
+
+void free_trainer(Trainer *trainer);
@@ -0,0 +1,36 @@
+#include "algorithms/a2c.h"
+
+void gae_advantages(
+    const ExperienceBuffer *buffer,
+    const float *values,
+    float gamma,
+    float lambda,
+    float *advantages,
+    float *targets
+) {
+    float next_value = 0.0f, running = 0.0f;
+
+    for (int t = buffer->size - 1; t >= 0; --t) {
+        // Zero at an episode end, so neither the value nor the advantage crosses it
+        float discount = buffer->dones[t] ? 0.0f : gamma;
+
+        float delta = buffer->rewards[t] + discount * next_value - values[t];
+        running = delta + discount * lambda * running;
+
+        advantages[t] = running;
+        targets[t] = running + values[t];
+        next_value = values[t];
+    }
+}
+
+float value_loss_and_grad(const float *values, const float *targets, int n, float coef, float scale, float *grad) {
+    float loss = 0.0f, g = coef * scale;
+
+    for (int t = 0; t < n; t++) {
+        float err = values[t] - targets[t];
+        grad[t] = g * err;
+        loss += err * err;
+    }
+
+    return 0.5f * coef * loss;
+}
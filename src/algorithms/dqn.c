@@ -0,0 +1,248 @@
+#include <string.h>
+#include <math.h>
+
+#include "algorithms/dqn.h"
+#include "rng.h"
+
+// Added to |δ| so that no transition drops out of the draws
+#define PRIORITY_EPS 1e-3f
+
+SumTree create_sum_tree(int capacity) {
+    int leaves = 1;
+    while (leaves < capacity) leaves *= 2;
+
+    return (SumTree){
+        .capacity = capacity,
+        .leaves = leaves,
+        .nodes = calloc(2 * leaves, sizeof(float)),
+    };
+}
+
+void free_sum_tree(SumTree *tree) {
+    free(tree->nodes);
+}
+
+void sum_tree_set(SumTree *tree, int i, float priority) {
+    int node = tree->leaves + i;
+    tree->nodes[node] = priority;
+
+    // Parents are recomputed from their children, so sums never drift
+    for (node /= 2; node >= 1; node /= 2)
+        tree->nodes[node] = tree->nodes[2 * node] + tree->nodes[2 * node + 1];
+}
+
+int sum_tree_find(const SumTree *tree, float mass) {
+    int node = 1;
+
+    while (node < tree->leaves) {
+        float left = tree->nodes[2 * node];
+        if (mass < left) {
+            node = 2 * node;
+        } else {
+            mass -= left;
+            node = 2 * node + 1;
+        }
+    }
+
+    return node - tree->leaves;
+}
+
+ReplayBuffer create_replay(int capacity, int obs_size, int act_size, float alpha) {
+    return (ReplayBuffer){
+        .base = create_buffer(capacity, obs_size, act_size),
+        .next_observations = malloc((size_t)capacity * obs_size * sizeof(float)),
+        .obs_size = obs_size,
+        .act_size = act_size,
+        .head = 0,
+        .priorities = create_sum_tree(capacity),
+        .alpha = alpha,
+        .max_priority = 1.0f,
+    };
+}
+
+void free_replay(ReplayBuffer *replay) {
+    free_buffer(&replay->base);
+    free(replay->next_observations);
+    free_sum_tree(&replay->priorities);
+}
+
+void replay_add(
+    ReplayBuffer *replay,
+    const float *obs,
+    const float *action,
+    float reward,
+    const float *next_obs,
+    bool done
+) {
+    ExperienceBuffer *base = &replay->base;
+    int i = replay->head, obs_size = replay->obs_size, act_size = replay->act_size;
+
+    memcpy(base->observations + (size_t)i * obs_size, obs, obs_size * sizeof(float));
+    memcpy(replay->next_observations + (size_t)i * obs_size, next_obs, obs_size * sizeof(float));
+    memcpy(base->actions + (size_t)i * act_size, action, act_size * sizeof(float));
+    base->rewards[i] = reward;
+    base->dones[i] = done;
+
+    sum_tree_set(&replay->priorities, i, replay->max_priority);
+
+    replay->head = (i + 1) % base->capacity;
+    if (base->size < base->capacity) base->size++;
+}
+
+// The ring arrays in file order, with their sizes in bytes
+static int replay_arrays(const ReplayBuffer *replay, void **arrays, size_t *bytes) {
+    const ExperienceBuffer *base = &replay->base;
+    size_t rows = (size_t)base->capacity;
+
+    arrays[0] = base->observations;         bytes[0] = rows * replay->obs_size * sizeof(float);
+    arrays[1] = replay->next_observations;  bytes[1] = rows * replay->obs_size * sizeof(float);
+    arrays[2] = base->actions;              bytes[2] = rows * replay->act_size * sizeof(float);
+    arrays[3] = base->rewards;              bytes[3] = rows * sizeof(float);
+    arrays[4] = base->dones;                bytes[4] = rows * sizeof(bool);
+    arrays[5] = replay->priorities.nodes;   bytes[5] = 2 * (size_t)replay->priorities.leaves * sizeof(float);
+    return 6;
+}
+
+size_t replay_state_size(const ReplayBuffer *replay) {
+    void *arrays[6];
+    size_t bytes[6], size = 2 * sizeof(int) + sizeof(float);
+
+    int n = replay_arrays(replay, arrays, bytes);
+    for (int i = 0; i < n; i++) size += bytes[i];
+    return size;
+}
+
+void replay_save_state(const ReplayBuffer *replay, void *dst) {
+    char *p = dst;
+    void *arrays[6];
+    size_t bytes[6];
+
+    memcpy(p, &replay->head, sizeof(int));            p += sizeof(int);
+    memcpy(p, &replay->base.size, sizeof(int));       p += sizeof(int);
+    memcpy(p, &replay->max_priority, sizeof(float));  p += sizeof(float);
+
+    int n = replay_arrays(replay, arrays, bytes);
+    for (int i = 0; i < n; i++) {
+        memcpy(p, arrays[i], bytes[i]);
+        p += bytes[i];
+    }
+}
+
+void replay_load_state(ReplayBuffer *replay, const void *src) {
+    const char *p = src;
+    void *arrays[6];
+    size_t bytes[6];
+
+    memcpy(&replay->head, p, sizeof(int));            p += sizeof(int);
+    memcpy(&replay->base.size, p, sizeof(int));       p += sizeof(int);
+    memcpy(&replay->max_priority, p, sizeof(float));  p += sizeof(float);
+
+    int n = replay_arrays(replay, arrays, bytes);
+    for (int i = 0; i < n; i++) {
+        memcpy(arrays[i], p, bytes[i]);
+        p += bytes[i];
+    }
+}
+
+ReplayBatch create_replay_batch(int batch_size, int obs_size, int act_size) {
+    return (ReplayBatch){
+        .indices = malloc(batch_size * sizeof(int)),
+        .observations = malloc((size_t)batch_size * obs_size * sizeof(float)),
+        .actions = malloc((size_t)batch_size * act_size * sizeof(float)),
+        .rewards = malloc(batch_size * sizeof(float)),
+        .next_observations = malloc((size_t)batch_size * obs_size * sizeof(float)),
+        .dones = malloc(batch_size * sizeof(bool)),
+        .weights = malloc(batch_size * sizeof(float)),
+    };
+}
+
+void free_replay_batch(ReplayBatch *batch) {
+    free(batch->indices);
+    free(batch->observations);
+    free(batch->actions);
+    free(batch->rewards);
+    free(batch->next_observations);
+    free(batch->dones);
+    free(batch->weights);
+}
+
+void replay_sample(const ReplayBuffer *replay, int batch_size, float beta, ReplayBatch *batch) {
+    const ExperienceBuffer *base = &replay->base;
+    const SumTree *tree = &replay->priorities;
+    int size = base->size, obs_size = replay->obs_size, act_size = replay->act_size;
+
+    float total = sum_tree_total(tree), slice = total / batch_size, max_weight = 0.0f;
+
+    for (int b = 0; b < batch_size; b++) {
+        float mass = fminf((b + rand_uniform(0.0f, 1.0f)) * slice, nextafterf(total, 0.0f));
+        int i = sum_tree_find(tree, mass);
+        if (i >= size) i = size - 1;    // rounding past the last filled leaf
+
+        batch->indices[b] = i;
+        float p = sum_tree_get(tree, i) / total;
+        batch->weights[b] = p > 0.0f ? powf(size * p, -beta) : 0.0f;
+        if (batch->weights[b] > max_weight) max_weight = batch->weights[b];
+    }
+
+    for (int b = 0; b < batch_size; b++) {
+        int i = batch->indices[b];
+        batch->weights[b] = max_weight > 0.0f ? batch->weights[b] / max_weight : 1.0f;
+
+        memcpy(batch->observations + (size_t)b * obs_size, base->observations + (size_t)i * obs_size, obs_size * sizeof(float));
+        memcpy(batch->next_observations + (size_t)b * obs_size, replay->next_observations + (size_t)i * obs_size, obs_size * sizeof(float));
+        memcpy(batch->actions + (size_t)b * act_size, base->actions + (size_t)i * act_size, act_size * sizeof(float));
+        batch->rewards[b] = base->rewards[i];
+        batch->dones[b] = base->dones[i];
+    }
+}
+
+void replay_update_priorities(ReplayBuffer *replay, const int *indices, const float *td_errors, int n) {
+    for (int b = 0; b < n; b++) {
+        float priority = powf(fabsf(td_errors[b]) + PRIORITY_EPS, replay->alpha);
+        if (priority > replay->max_priority) replay->max_priority = priority;
+        sum_tree_set(&replay->priorities, indices[b], priority);
+    }
+}
+
+float dqn_loss_and_grad(
+    const float *q,
+    const float *next_q,
+    const ReplayBatch *batch,
+    int batch_size,
+    int n_actions,
+    float gamma,
+    float *td_errors,
+    float *grad_out
+) {
+    float loss = 0.0f, scale = 1.0f / batch_size;
+    memset(grad_out, 0, (size_t)batch_size * n_actions * sizeof(float));
+
+    for (int b = 0; b < batch_size; b++) {
+        const float *next = next_q + (size_t)b * n_actions;
+        float best = next[0];
+        for (int a = 1; a < n_actions; a++) best = next[a] > best ? next[a] : best;
+
+        int action = (int)batch->actions[b];
+        float target = batch->rewards[b] + (batch->dones[b] ? 0.0f : gamma * best);
+        float delta = q[(size_t)b * n_actions + action] - target;
+        float w = batch->weights[b] * scale;
+
+        // Huber with threshold 1: quadratic inside, linear outside
+        float abs_delta = fabsf(delta);
+        loss += w * (abs_delta < 1.0f ? 0.5f * delta * delta : abs_delta - 0.5f);
+        grad_out[(size_t)b * n_actions + action] = w * (abs_delta < 1.0f ? delta : (delta > 0.0f ? 1.0f : -1.0f));
+        td_errors[b] = delta;
+    }
+
+    return loss;
+}
+
+void dqn_sync_target(MLP *target, const MLP *online) {
+    for (int l = 0; l < online->num_layers; l++) {
+        const LinearLayer *src = &online->layers[l];
+        LinearLayer *dst = &target->layers[l];
+
+        memcpy(dst->weights, src->weights, (size_t)src->input_size * src->output_size * sizeof(float));
+        memcpy(dst->biases, src->biases, src->output_size * sizeof(float));
+    }
+}
@@ -0,0 +1,93 @@
+#include <stdlib.h>
+
+#include "algorithms/es.h"
+#include "rng.h"
+
+// splitmix64 finalizer
+static uint64_t mix64(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+uint32_t es_seed(uint32_t base, uint32_t step, uint32_t index) {
+    return (uint32_t)mix64(mix64(((uint64_t)base << 32) | step) ^ index);
+}
+
+void es_noise(uint32_t seed, int n, float *out) {
+    RNGState saved = rng_get_state();
+    rng_seed(seed);
+    rand_normal_fill(out, n);
+    rng_set_state(saved);
+}
+
+void es_get_params(const MLP *mlp, float *theta) {
+    for (int l = 0; l < mlp->num_layers; l++) {
+        const LinearLayer *layer = &mlp->layers[l];
+        int weights_size = layer->input_size * layer->output_size;
+
+        for (int i = 0; i < weights_size; i++) *theta++ = layer->weights[i];
+        for (int i = 0; i < layer->output_size; i++) *theta++ = layer->biases[i];
+    }
+}
+
+void es_set_params(MLP *mlp, const float *theta, const float *noise, float sigma) {
+    for (int l = 0; l < mlp->num_layers; l++) {
+        LinearLayer *layer = &mlp->layers[l];
+        int weights_size = layer->input_size * layer->output_size;
+
+        for (int i = 0; i < weights_size; i++) layer->weights[i] = *theta++ + (noise ? sigma * *noise++ : 0.0f);
+        for (int i = 0; i < layer->output_size; i++) layer->biases[i] = *theta++ + (noise ? sigma * *noise++ : 0.0f);
+    }
+}
+
+void es_accumulate_grad(MLP *mlp, const float *noise, float weight) {
+    for (int l = 0; l < mlp->num_layers; l++) {
+        LinearLayer *layer = &mlp->layers[l];
+        int weights_size = layer->input_size * layer->output_size;
+
+        for (int i = 0; i < weights_size; i++) layer->weights_grad[i] += weight * *noise++;
+        for (int i = 0; i < layer->output_size; i++) layer->biases_grad[i] += weight * *noise++;
+    }
+}
+
+typedef struct RankedReturn {
+    float value;
+    int index;
+} RankedReturn;
+
+static int compare_returns(const void *a, const void *b) {
+    const RankedReturn *x = a, *y = b;
+    if (x->value != y->value) return x->value < y->value ? -1 : 1;
+    return x->index - y->index;
+}
+
+void es_gradient(MLP *mlp, const ESResult *results, int n, float sigma, float *noise) {
+    mlp_zero_grad(mlp);
+    if (n == 0) return;
+
+    // Centered ranks: even 2n entries of [positive, negative] per pair
+    RankedReturn *sorted = malloc(2 * n * sizeof(RankedReturn));
+    float *utility = malloc(2 * n * sizeof(float));
+    for (int i = 0; i < n; i++) {
+        sorted[2 * i] = (RankedReturn){results[i].positive, 2 * i};
+        sorted[2 * i + 1] = (RankedReturn){results[i].negative, 2 * i + 1};
+    }
+    qsort(sorted, 2 * n, sizeof(RankedReturn), compare_returns);
+    for (int r = 0; r < 2 * n; r++) utility[sorted[r].index] = (2 * n > 1) ? (float)r / (2 * n - 1) - 0.5f : 0.0f;
+
+    int num_params = get_num_params(mlp);
+    float scale = -1.0f / (2.0f * n * sigma);
+    for (int i = 0; i < n; i++) {
+        float weight = scale * (utility[2 * i] - utility[2 * i + 1]);
+        if (weight == 0.0f) continue;
+
+        es_noise(results[i].seed, num_params, noise);
+        es_accumulate_grad(mlp, noise, weight);
+    }
+
+    free(sorted);
+    free(utility);
+}
@@ -2,10 +2,15 @@
 #include <string.h>
 #include <stdio.h>
 #include <math.h>
+#include <stdbool.h>
 
 #include "algorithms/policy.h"
+#include "nn/softmax.h"
 #include "rng.h"
 
+// Rows up to this many actions use stack scratch
+#define SOFTMAX_STACK 1024
+
 void policy_sample_action(
     const Policy *policy,
     const float *obs,
@@ -34,21 +39,131 @@ void policy_log_prob(
 }
 
 float log_sum_exp(const float *array, int size) {
-    float max_value = array[0];
-    for (int i = 1; i < size; i++)
-        if (array[i] > max_value) max_value = array[i];
+    float sum, stack[SOFTMAX_STACK];
+    float *e = size <= SOFTMAX_STACK ? stack : malloc(size * sizeof(float));
 
-    float sum_exp = 0.0f;
-    for (int i = 1; i < size; i++)
-        sum_exp += expf(array[i] - max_value);
-    
-    return max_value + logf(sum_exp);
+    float lse = softmax_row(array, size, e, &sum);
+
+    if (e != stack) free(e);
+    return lse;
 }
 
 /***************************
  * Discrete Policy methods *
  ***************************/
 
+/*
+ * Every method runs softmax_row once per row: it leaves the unnormalized probabilities
+ * e (p = e / sum) in the gradient row when there is one, in scratch otherwise.
+ */
+
+/*
+ * Vose alias table over unnormalized weights e[n]: column i keeps action i with
+ * probability prob[i] and gives alias[i] otherwise. small/large are scratch of size n.
+ */
+static void build_alias_table(const float *e, int n, float sum, float *prob, int *alias, int *small, int *large) {
+    int n_small = 0, n_large = 0;
+    float scale = n / sum;
+
+    for (int i = 0; i < n; i++) {
+        prob[i] = e[i] * scale;
+        alias[i] = i;
+        if (prob[i] < 1.0f) small[n_small++] = i;
+        else large[n_large++] = i;
+    }
+
+    while (n_small > 0 && n_large > 0) {
+        int s = small[--n_small], l = large[n_large - 1];
+
+        alias[s] = l;
+        prob[l] -= 1.0f - prob[s];
+        if (prob[l] < 1.0f) {
+            n_large--;
+            small[n_small++] = l;
+        }
+    }
+
+    // Leftovers are 1 up to rounding
+    while (n_large > 0) prob[large[--n_large]] = 1.0f;
+    while (n_small > 0) prob[small[--n_small]] = 1.0f;
+}
+
+static inline int sample_alias(const float *prob, const int *alias, int n) {
+    float u = rand_uniform(0, n);
+    int i = (int)u;
+    if (i >= n) i = n - 1;
+
+    // The fractional part is a second uniform
+    return (u - i) < prob[i] ? i : alias[i];
+}
+
+static void sample_discrete_cdf(int n_actions, const float *logits, int batch_size, float *actions, float *e) {
+    float sum;
+
+    for (int b = 0; b < batch_size; b++) {
+        softmax_row(logits, n_actions, e, &sum);
+        actions[b] = (float)sample_inverse_cdf(e, n_actions, sum, rand_uniform(0, 1));
+
+        logits += n_actions;
+    }
+}
+
+static void sample_discrete_gumbel(int n_actions, const float *logits, int batch_size, float *actions, float *u) {
+    for (int b = 0; b < batch_size; b++) {
+        rand_uniform_fill(u, n_actions);
+        actions[b] = (float)gumbel_argmax(logits, n_actions, u);
+
+        logits += n_actions;
+    }
+}
+
+static void sample_discrete_alias(int n_actions, const float *logits, int batch_size, float *actions, float *e) {
+    float *prob = NULL, sum;
+    int *alias = NULL, *small = NULL, *large = NULL;
+    size_t row_bytes = n_actions * sizeof(float);
+
+    for (int b = 0; b < batch_size;) {
+        const float *row = logits + (size_t)b * n_actions;
+
+        int run = 1;
+        while (b + run < batch_size && memcmp(row, row + (size_t)run * n_actions, row_bytes) == 0) run++;
+
+        // A table costs about two CDF scans to build
+        if (run < 3) {
+            sample_discrete_cdf(n_actions, row, run, actions + b, e);
+        } else {
+            if (!prob) {
+                prob = malloc(row_bytes);
+                alias = malloc(3 * n_actions * sizeof(int));
+                small = alias + n_actions;
+                large = small + n_actions;
+            }
+
+            softmax_row(row, n_actions, e, &sum);
+            build_alias_table(e, n_actions, sum, prob, alias, small, large);
+            for (int k = 0; k < run; k++)
+                actions[b + k] = (float)sample_alias(prob, alias, n_actions);
+        }
+
+        b += run;
+    }
+
+    free(prob);
+    free(alias);
+}
+
+// Lowest index of each row's max
+static void sample_discrete_greedy(int n_actions, const float *logits, int batch_size, float *actions) {
+    for (int b = 0; b < batch_size; b++) {
+        int best = 0;
+        for (int i = 1; i < n_actions; i++)
+            if (logits[i] > logits[best]) best = i;
+        actions[b] = (float)best;
+
+        logits += n_actions;
+    }
+}
+
 void sample_discrete_action(
     const Policy *policy,
     const float *logits,
@@ -56,21 +171,25 @@ void sample_discrete_action(
     float *actions
 ) {
     int n_actions = policy->n_actions;
-    float cum_prob, lsexp, u;
-    int act;
+    float stack[SOFTMAX_STACK];
+    float *scratch = n_actions <= SOFTMAX_STACK ? stack : malloc(n_actions * sizeof(float));
 
-    for (int b = 0; b < batch_size; b++) {
-        lsexp = log_sum_exp(logits, n_actions);
-        u = rand_uniform(0, 1);
-
-        cum_prob = 0;
-        for (act = 0; act < n_actions - 1; act++) {
-            cum_prob += expf(logits[act] - lsexp);
-            if (u < cum_prob) break;
-        }
-
-        actions[b] = (float)act;
+    switch (policy->sampler) {
+        case SAMPLER_GUMBEL:
+            sample_discrete_gumbel(n_actions, logits, batch_size, actions, scratch);
+            break;
+        case SAMPLER_ALIAS:
+            sample_discrete_alias(n_actions, logits, batch_size, actions, scratch);
+            break;
+        case SAMPLER_GREEDY:
+            sample_discrete_greedy(n_actions, logits, batch_size, actions);
+            break;
+        default:
+            sample_discrete_cdf(n_actions, logits, batch_size, actions, scratch);
+            break;
     }
+
+    if (scratch != stack) free(scratch);
 }
 
 void discrete_log_prob (
@@ -82,23 +201,30 @@ void discrete_log_prob (
     float *grad_out
 ) {
     int n_actions = policy->n_actions;
+    float sum, stack[SOFTMAX_STACK];
+    float *scratch = grad_out || n_actions <= SOFTMAX_STACK ? stack : malloc(n_actions * sizeof(float));
     
     for (int b = 0; b < batch_size; b++) {
         int action = (int)actions[b];
+        float *e = grad_out ? grad_out : scratch;
         
-        float lse = log_sum_exp(logits, n_actions);
-        log_prob[b] = logits[action] - lse;
+        float lse = softmax_row(logits, n_actions, e, &sum);
+        if (log_prob) log_prob[b] = logits[action] - lse;
         
         if (grad_out) {
-            for (int a = 0; a < n_actions; a++) {
-                float prob = expf(logits[a] - lse);
-                grad_out[a] = (a == action) ? (1.0f - prob) : -prob;
-            }
+            // d log p[action] / dz = onehot(action) - p
+            float inv_sum = 1.0f / sum;
+            for (int a = 0; a < n_actions; a++)
+                grad_out[a] *= -inv_sum;
+            grad_out[action] += 1.0f;
+
             grad_out += n_actions;
         }
         
         logits += n_actions;
     }
+
+    if (scratch != stack) free(scratch);
 }
 
 void discrete_entropy(
@@ -109,46 +235,105 @@ void discrete_entropy(
     float *grad_out
 ) {
     int n_actions = policy->n_actions;
+    float sum, stack[SOFTMAX_STACK];
+    float *scratch = grad_out || n_actions <= SOFTMAX_STACK ? stack : malloc(n_actions * sizeof(float));
     
     for (int b = 0; b < batch_size; b++) {
-        float lse = log_sum_exp(logits, n_actions);
+        float *e = grad_out ? grad_out : scratch;
+        float lse = softmax_row(logits, n_actions, e, &sum);
         
-        float H = 0.0f;
-        if (entropy || grad_out) {
+        // H = -sum p (z - lse) = lse - sum p z
+        float inv_sum = 1.0f / sum, pz = 0.0f;
+        for (int a = 0; a < n_actions; a++)
+            pz += e[a] * logits[a];
+        float H = lse - pz * inv_sum;
+
+        if (entropy) entropy[b] = H;
+        
+        if (grad_out) {
+            // dH/dz = -p (log p + H)
             for (int a = 0; a < n_actions; a++) {
-                float log_p = logits[a] - lse;
-                float p = expf(log_p);
-                H -= p * log_p;
+                float p = grad_out[a] * inv_sum;
+                grad_out[a] = -p * (logits[a] - lse + H);
             }
-            if (entropy) entropy[b] = H;
+            grad_out += n_actions;
         }
         
+        logits += n_actions;
+    }
+
+    if (scratch != stack) free(scratch);
+}
+
+float discrete_pg_loss(
+    const Policy *policy,
+    const float *logits,
+    const float *actions,
+    const float *advantages,
+    int batch_size,
+    float entropy_coef,
+    float *grad_out
+) {
+    int n_actions = policy->n_actions;
+    float sum, loss = 0.0f, stack[SOFTMAX_STACK];
+    float *scratch = grad_out || n_actions <= SOFTMAX_STACK ? stack : malloc(n_actions * sizeof(float));
+
+    for (int b = 0; b < batch_size; b++) {
+        float *e = grad_out ? grad_out : scratch;
+        int action = (int)actions[b];
+        float A = advantages[b];
+
+        float lse = softmax_row(logits, n_actions, e, &sum);
+        float inv_sum = 1.0f / sum, H = 0.0f;
+
+        if (entropy_coef != 0.0f) {
+            float pz = 0.0f;
+            for (int a = 0; a < n_actions; a++)
+                pz += e[a] * logits[a];
+            H = lse - pz * inv_sum;
+        }
+
+        loss -= A * (logits[action] - lse) + entropy_coef * H;
+
         if (grad_out) {
-            for (int a = 0; a < n_actions; a++) {
-                float log_p = logits[a] - lse;
-                float p = expf(log_p);
-                grad_out[a] = -p * (1.0f + log_p + H);
+            // -A (onehot - p) + β p (log p + H)
+            if (entropy_coef != 0.0f) {
+                float c = A + entropy_coef * (H - lse);
+                for (int a = 0; a < n_actions; a++)
+                    grad_out[a] *= inv_sum * (c + entropy_coef * logits[a]);
+            } else {
+                float c = A * inv_sum;
+                for (int a = 0; a < n_actions; a++)
+                    grad_out[a] *= c;
             }
+            grad_out[action] -= A;
+
             grad_out += n_actions;
         }
-        
+
         logits += n_actions;
     }
+
+    if (scratch != stack) free(scratch);
+    return loss;
 }
 
-Policy create_discrete_policy(MLP *mlp, int n_actions) {
-    if (mlp->output_size != n_actions)
+Policy create_discrete_policy(MLP *mlp, int n_actions, DiscreteSampler sampler) {
+    if (mlp_head_size(mlp, 0) != n_actions)
         fprintf(stderr,
             "WARNING: Expected an output of size %d from the neural network, got size %d.",
-            n_actions, mlp->output_size
+            n_actions, mlp_head_size(mlp, 0)
         );
 
     return (Policy) {
         .mlp = mlp,
         .act_size=1,
         .n_actions=n_actions,
+        .sampler = sampler,
         .sample = sample_discrete_action,
-        .log_prob = discrete_log_prob
+        .log_prob = discrete_log_prob,
+        .entropy = discrete_entropy,
+        .pg_loss = discrete_pg_loss
     };
 }
 
@@ -210,11 +395,40 @@ void binary_entropy(
     }
 }
 
+float binary_pg_loss(
+    const Policy *policy,
+    const float *logits,
+    const float *actions,
+    const float *advantages,
+    int batch_size,
+    float entropy_coef,
+    float *grad_out
+) {
+    float loss = 0.0f;
+
+    for (int b = 0; b < batch_size; b++) {
+        float z = logits[b], A = advantages[b];
+        float act = actions[b];
+
+        // softplus(-z) = -log p_one
+        float exp_neg = expf(-z);
+        float sp = logf(1.0f + exp_neg);
+        float p = 1.0f / (1.0f + exp_neg);
+
+        loss -= A * (-sp - (1.0f - act) * z);
+        if (entropy_coef != 0.0f) loss -= entropy_coef * (sp + (1.0f - p) * z);
+
+        if (grad_out) grad_out[b] = A * (p - act) + entropy_coef * z * p * (1.0f - p);
+    }
+
+    return loss;
+}
+
 Policy create_binary_policy(MLP *mlp) {
-    if (mlp->output_size != 1)
+    if (mlp_head_size(mlp, 0) != 1)
         fprintf(stderr,
             "WARNING: Expected a single probability output from the neural network, got size %d.",
-            mlp->output_size
+            mlp_head_size(mlp, 0)
         );
 
     return (Policy) {
@@ -223,6 +437,188 @@ Policy create_binary_policy(MLP *mlp) {
         .n_actions=2,
         .sample = sample_binary_action,
         .log_prob = binary_log_prob,
-        .entropy = binary_entropy
+        .entropy = binary_entropy,
+        .pg_loss = binary_pg_loss
+    };
+}
+
+/***************************
+ * Gaussian Policy methods *
+ ***************************/
+
+#define HALF_LOG_2PI 0.918938533204672742f
+
+/*
+ * Gathers the clamped log std of every row into log_std[batch_size * act_size] and
+ * marks where the clamp is active (zero log-std gradient) in clamped. Returns the row
+ * stride of the means: with a fixed std the logits are the means, otherwise
+ * [mean | log std] rows.
+ */
+static int gaussian_log_std(const Policy *policy, const float *logits, int batch_size, float *log_std, bool *clamped) {
+    int d = policy->act_size;
+
+    if (policy->log_std) {
+        for (int b = 0; b < batch_size; b++) memcpy(log_std + (size_t)b * d, policy->log_std, d * sizeof(float));
+        memset(clamped, 0, (size_t)batch_size * d * sizeof(bool));
+        return d;
+    }
+
+    for (int b = 0; b < batch_size; b++) {
+        const float *s = logits + (size_t)b * 2 * d + d;
+        for (int i = 0; i < d; i++) {
+            size_t k = (size_t)b * d + i;
+            clamped[k] = s[i] < GAUSSIAN_LOG_STD_MIN || s[i] > GAUSSIAN_LOG_STD_MAX;
+            log_std[k] = fminf(fmaxf(s[i], GAUSSIAN_LOG_STD_MIN), GAUSSIAN_LOG_STD_MAX);
+        }
+    }
+    return 2 * d;
+}
+
+void sample_gaussian_action(
+    const Policy *policy,
+    const float *logits,
+    int batch_size,
+    float *actions
+) {
+    int d = policy->act_size, n = batch_size * d;
+    float *std = malloc(n * sizeof(float));
+    bool *clamped = malloc(n * sizeof(bool));
+
+    // All the noise and all the stds at once, then a = mean + std * eps
+    rand_normal_fill(actions, n);
+    int stride = gaussian_log_std(policy, logits, batch_size, std, clamped);
+    vexpf(std, n, std);
+
+    for (int b = 0; b < batch_size; b++) {
+        const float *mean = logits + (size_t)b * stride;
+        float *a = actions + (size_t)b * d;
+        const float *s = std + (size_t)b * d;
+
+        for (int i = 0; i < d; i++) a[i] = mean[i] + s[i] * a[i];
+    }
+
+    free(std);
+    free(clamped);
+}
+
+/*
+ * Per row: log p = sum_i -(a_i - mu_i)^2 / (2 sigma_i^2) - log sigma_i - log(2 pi) / 2 and
+ * H = sum_i log sigma_i + (1 + log(2 pi)) / 2. The closed-form output gradients are
+ *   d log p / d mu = (a - mu) / sigma^2,  d log p / d log sigma = (a - mu)^2 / sigma^2 - 1,
+ *   dH / d mu = 0,                        dH / d log sigma = 1.
+ * The shared loop below computes both and combines them with weights w_lp and w_h.
+ */
+static float gaussian_pass(
+    const Policy *policy,
+    const float *logits,
+    const float *actions,
+    int batch_size,
+    const float *w_lp,       // per row, NULL for no log-prob term
+    float w_h,
+    float *log_prob,
+    float *entropy,
+    float *grad_out
+) {
+    int d = policy->act_size, n = batch_size * d;
+    float *log_std = malloc(2 * n * sizeof(float));
+    float *inv_var = log_std + n;
+    bool *clamped = malloc(n * sizeof(bool));
+    float total = 0.0f;
+
+    int stride = gaussian_log_std(policy, logits, batch_size, log_std, clamped);
+    for (int k = 0; k < n; k++) inv_var[k] = -2.0f * log_std[k];
+    vexpf(inv_var, n, inv_var);
+
+    for (int b = 0; b < batch_size; b++) {
+        const float *mean = logits + (size_t)b * stride;
+        const float *a = actions ? actions + (size_t)b * d : NULL;
+        const float *s = log_std + (size_t)b * d, *iv = inv_var + (size_t)b * d;
+        const bool *c = clamped + (size_t)b * d;
+        float *g = grad_out ? grad_out + (size_t)b * stride : NULL;
+        float lp = 0.0f, H = 0.0f, w = w_lp ? w_lp[b] : 0.0f;
+
+        for (int i = 0; i < d; i++) {
+            float diff = a ? a[i] - mean[i] : 0.0f;
+            float z2 = diff * diff * iv[i];
+
+            lp += -0.5f * z2 - s[i] - HALF_LOG_2PI;
+            H += s[i] + 0.5f + HALF_LOG_2PI;
+
+            if (g) {
+                g[i] = w * diff * iv[i];
+                if (!policy->log_std) g[d + i] = c[i] ? 0.0f : w * (z2 - 1.0f) + w_h;
+            }
+        }
+
+        if (log_prob) log_prob[b] = lp;
+        if (entropy) entropy[b] = H;
+        total += w * lp + w_h * H;
+    }
+
+    free(log_std);
+    free(clamped);
+    return total;
+}
+
+void gaussian_log_prob(
+    const Policy *policy,
+    const float *logits,
+    const float *actions,
+    int batch_size,
+    float *log_prob,
+    float *grad_out
+) {
+    float *ones = malloc(batch_size * sizeof(float));
+    for (int b = 0; b < batch_size; b++) ones[b] = 1.0f;
+
+    gaussian_pass(policy, logits, actions, batch_size, ones, 0.0f, log_prob, NULL, grad_out);
+    free(ones);
+}
+
+void gaussian_entropy(
+    const Policy *policy,
+    const float *logits,
+    int batch_size,
+    float *entropy,
+    float *grad_out
+) {
+    gaussian_pass(policy, logits, NULL, batch_size, NULL, 1.0f, NULL, entropy, grad_out);
+}
+
+float gaussian_pg_loss(
+    const Policy *policy,
+    const float *logits,
+    const float *actions,
+    const float *advantages,
+    int batch_size,
+    float entropy_coef,
+    float *grad_out
+) {
+    // The loss is the negated weighted sum: negate the weights, not the gradient
+    float *w = malloc(batch_size * sizeof(float));
+    for (int b = 0; b < batch_size; b++) w[b] = -advantages[b];
+
+    float loss = gaussian_pass(policy, logits, actions, batch_size, w, -entropy_coef, NULL, NULL, grad_out);
+    free(w);
+    return loss;
+}
+
+Policy create_gaussian_policy(MLP *mlp, int act_size, float *log_std) {
+    int expected = log_std ? act_size : 2 * act_size;
+    if (mlp_head_size(mlp, 0) != expected)
+        fprintf(stderr,
+            "WARNING: Expected an output of size %d from the neural network, got size %d.",
+            expected, mlp_head_size(mlp, 0)
+        );
+
+    return (Policy) {
+        .mlp = mlp,
+        .act_size = act_size,
+        .n_actions = 0,
+        .log_std = log_std,
+        .sample = sample_gaussian_action,
+        .log_prob = gaussian_log_prob,
+        .entropy = gaussian_entropy,
+        .pg_loss = gaussian_pg_loss
     };
 }
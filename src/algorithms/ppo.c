@@ -0,0 +1,36 @@
+#include <math.h>
+
+#include "algorithms/ppo.h"
+
+float ppo_loss_and_grad(
+    const Policy *policy,
+    const float *logits,
+    const float *actions,
+    const float *advantages,
+    const float *old_log_probs,
+    int batch_size,
+    float clip,
+    float entropy_coef,
+    float *log_probs,
+    float *weights,
+    float *grad_out
+) {
+    policy_log_prob_from_logits(policy, logits, actions, batch_size, log_probs, NULL);
+
+    float surrogate = 0.0f, weighted_logp = 0.0f;
+    for (int b = 0; b < batch_size; b++) {
+        float A = advantages[b], r = expf(log_probs[b] - old_log_probs[b]);
+        float clipped = fminf(fmaxf(r, 1.0f - clip), 1.0f + clip);
+
+        // The unclipped term is the min unless the ratio has left the trust region in A's direction
+        bool unclipped = A >= 0.0f ? r < 1.0f + clip : r > 1.0f - clip;
+        weights[b] = unclipped ? r * A : 0.0f;
+
+        surrogate += fminf(r * A, clipped * A);
+        weighted_logp += weights[b] * log_probs[b];
+    }
+
+    // pg_loss returns -Σ (w log π + β H); adding Σ w log π back leaves the entropy term
+    float pg = policy_pg_loss_and_grad(policy, logits, actions, weights, batch_size, entropy_coef, grad_out);
+    return -surrogate + pg + weighted_logp;
+}
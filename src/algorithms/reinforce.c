@@ -21,16 +21,12 @@ void policy_gradient(
     float *logits = malloc(size * out_size * sizeof(float));
     mlp_forward(policy->mlp, buffer->observations, size, logits, cache);
 
-    float *dlogp = malloc(size * out_size * sizeof(float));
-    policy_log_prob_from_logits(policy, logits, buffer->actions, size, NULL, dlogp);
-
-    for (int t = 0; t < size; t++) {
-        float advantage = returns[t];
-        if (baseline) advantage -= baseline[t];
+    // Advantages in place of the returns
+    if (baseline)
+        for (int t = 0; t < size; t++) returns[t] -= baseline[t];
 
-        for (int j = 0; j < out_size; j++)
-            dlogp[t * out_size + j] *= -advantage;
-    }
+    float *dlogp = malloc(size * out_size * sizeof(float));
+    policy_pg_loss_and_grad(policy, logits, buffer->actions, returns, size, 0.0f, dlogp);
 
     mlp_backward(policy->mlp, cache, dlogp, NULL);
 
@@ -39,7 +35,7 @@ void policy_gradient(
     free(dlogp);
 }
 
-void mean_baseline(ExperienceBuffer *buffer, int gamma, float *baseline) {
+void mean_baseline(ExperienceBuffer *buffer, float gamma, float *baseline) {
     float mean_R = mean_return(buffer);
 
     for (int t = 0; t < buffer->size; t++) baseline[t] = mean_R;
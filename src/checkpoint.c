@@ -0,0 +1,302 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "rng.h"
+#include "checkpoint.h"
+
+#define CKPT_MAGIC 0x4B434C52 /* 'RLCK' */
+#define CKPT_VERSION 5
+
+typedef struct CheckpointHeader {
+    uint32_t magic;
+    uint32_t version;
+    int32_t rank;
+    int32_t world_size;
+    int32_t next_step;
+    int32_t num_episodes;
+    uint64_t model_bytes;       // weights and biases, rank 0 only
+    uint64_t optimizer_bytes;   // rank 0 only
+    uint64_t target_bytes;      // DQN target network, rank 0 only
+    uint64_t replay_bytes;      // this rank's replay shard
+    int64_t env_steps;
+    int64_t num_updates;
+    RNGState rng;
+    MetricsAggregates totals;
+} CheckpointHeader;
+
+static size_t model_bytes(const MLP *mlp) {
+    return (size_t)get_num_params((MLP *)mlp) * sizeof(float);
+}
+
+// Weights and biases of every layer, in order; returns the end of the copy
+static char *save_params(const MLP *mlp, char *p) {
+    for (int l = 0; l < mlp->num_layers; l++) {
+        const LinearLayer *layer = &mlp->layers[l];
+        size_t wbytes = (size_t)layer->input_size * layer->output_size * sizeof(float);
+        size_t bbytes = (size_t)layer->output_size * sizeof(float);
+
+        memcpy(p, layer->weights, wbytes); p += wbytes;
+        memcpy(p, layer->biases, bbytes);  p += bbytes;
+    }
+    return p;
+}
+
+static const char *load_params(MLP *mlp, const char *p) {
+    for (int l = 0; l < mlp->num_layers; l++) {
+        LinearLayer *layer = &mlp->layers[l];
+        size_t wbytes = (size_t)layer->input_size * layer->output_size * sizeof(float);
+        size_t bbytes = (size_t)layer->output_size * sizeof(float);
+
+        memcpy(layer->weights, p, wbytes); p += wbytes;
+        memcpy(layer->biases, p, bbytes);  p += bbytes;
+    }
+    return p;
+}
+
+/***************************
+ *      Writer thread      *
+ ***************************/
+
+static int write_file(const Checkpointer *ckpt, const void *data, size_t size) {
+    char path[600], tmp_path[610];
+    snprintf(path, sizeof(path), "%s/rank%d.ckpt", ckpt->dir, ckpt->rank);
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+
+    FILE *file = fopen(tmp_path, "wb");
+    if (!file) {
+        fprintf(stderr, "Error opening checkpoint file %s.\n", tmp_path);
+        return 0;
+    }
+
+    int ok = fwrite(data, 1, size, file) == size;
+    ok = (fclose(file) == 0) && ok;
+
+    // The rename keeps the previous checkpoint intact until the new one is complete
+    if (!ok || rename(tmp_path, path) != 0) {
+        fprintf(stderr, "Error writing checkpoint file %s.\n", path);
+        remove(tmp_path);
+        return 0;
+    }
+
+    return 1;
+}
+
+static void *writer_loop(void *arg) {
+    Checkpointer *ckpt = arg;
+
+    pthread_mutex_lock(&ckpt->lock);
+    for (;;) {
+        while (!ckpt->pending && !ckpt->stop)
+            pthread_cond_wait(&ckpt->cond, &ckpt->lock);
+
+        if (!ckpt->pending) break;
+
+        int front = 1 - ckpt->back;
+        pthread_mutex_unlock(&ckpt->lock);
+
+        int ok = write_file(ckpt, ckpt->buffers[front], ckpt->sizes[front]);
+
+        pthread_mutex_lock(&ckpt->lock);
+        if (!ok) ckpt->failures++;
+        ckpt->pending = 0;
+        pthread_cond_broadcast(&ckpt->cond);
+    }
+    pthread_mutex_unlock(&ckpt->lock);
+
+    return NULL;
+}
+
+Checkpointer *create_checkpointer(const char *dir, int rank, int world_size) {
+    Checkpointer *ckpt = calloc(1, sizeof(Checkpointer));
+
+    snprintf(ckpt->dir, sizeof(ckpt->dir), "%s", dir);
+    ckpt->rank = rank;
+    ckpt->world_size = world_size;
+
+    pthread_mutex_init(&ckpt->lock, NULL);
+    pthread_cond_init(&ckpt->cond, NULL);
+
+    if (pthread_create(&ckpt->thread, NULL, writer_loop, ckpt) != 0) {
+        fprintf(stderr, "Error starting checkpoint writer thread.\n");
+        pthread_mutex_destroy(&ckpt->lock);
+        pthread_cond_destroy(&ckpt->cond);
+        free(ckpt);
+        return NULL;
+    }
+
+    return ckpt;
+}
+
+/***************************
+ *        Snapshots        *
+ ***************************/
+
+void checkpoint_async(
+    Checkpointer *ckpt,
+    int next_step,
+    const MLP *mlp,
+    const Optimizer *optimizer,
+    const TrainingMetrics *metrics,
+    const ReplayState *replay
+) {
+    int has_model = ckpt->rank == 0;
+
+    CheckpointHeader header = {
+        .magic = CKPT_MAGIC,
+        .version = CKPT_VERSION,
+        .rank = ckpt->rank,
+        .world_size = ckpt->world_size,
+        .next_step = next_step,
+        .num_episodes = metrics->num_episodes,
+        .model_bytes = has_model ? model_bytes(mlp) : 0,
+        .optimizer_bytes = has_model ? optimizer_state_size(optimizer) : 0,
+        .target_bytes = has_model && replay ? model_bytes(replay->target) : 0,
+        .replay_bytes = replay ? replay_state_size(replay->replay) : 0,
+        .env_steps = replay ? *replay->env_steps : 0,
+        .num_updates = replay ? *replay->num_updates : 0,
+        .rng = rng_get_state(),
+        .totals = metrics->totals,
+    };
+
+    size_t size = sizeof(header) + header.model_bytes + header.optimizer_bytes + header.target_bytes + header.replay_bytes;
+
+    // The back buffer is never touched by the writer, so it is filled without the lock
+    int back = ckpt->back;
+    if (ckpt->capacities[back] < size) {
+        free(ckpt->buffers[back]);
+        ckpt->buffers[back] = malloc(size);
+        ckpt->capacities[back] = size;
+    }
+
+    char *p = ckpt->buffers[back];
+    memcpy(p, &header, sizeof(header));
+    p += sizeof(header);
+
+    if (has_model) {
+        p = save_params(mlp, p);
+        optimizer_save_state(optimizer, p);
+        p += header.optimizer_bytes;
+    }
+
+    if (header.target_bytes) p = save_params(replay->target, p);
+
+    if (header.replay_bytes) {
+        replay_save_state(replay->replay, p);
+        p += header.replay_bytes;
+    }
+
+    ckpt->sizes[back] = size;
+
+    pthread_mutex_lock(&ckpt->lock);
+    while (ckpt->pending)
+        pthread_cond_wait(&ckpt->cond, &ckpt->lock);
+
+    ckpt->back = 1 - back;
+    ckpt->pending = 1;
+    pthread_cond_broadcast(&ckpt->cond);
+    pthread_mutex_unlock(&ckpt->lock);
+}
+
+void free_checkpointer(Checkpointer *ckpt) {
+    if (!ckpt) return;
+
+    pthread_mutex_lock(&ckpt->lock);
+    ckpt->stop = 1;
+    pthread_cond_broadcast(&ckpt->cond);
+    pthread_mutex_unlock(&ckpt->lock);
+
+    pthread_join(ckpt->thread, NULL);
+
+    if (ckpt->failures)
+        fprintf(stderr, "Rank %d: %d checkpoint write(s) failed.\n", ckpt->rank, ckpt->failures);
+
+    pthread_mutex_destroy(&ckpt->lock);
+    pthread_cond_destroy(&ckpt->cond);
+    free(ckpt->buffers[0]);
+    free(ckpt->buffers[1]);
+    free(ckpt);
+}
+
+/***************************
+ *         Restore         *
+ ***************************/
+
+int load_checkpoint(
+    const char *dir,
+    int rank,
+    int world_size,
+    MLP *mlp,
+    Optimizer *optimizer,
+    TrainingMetrics *metrics,
+    ReplayState *replay,
+    int *next_step
+) {
+    char path[600];
+    snprintf(path, sizeof(path), "%s/rank%d.ckpt", dir, rank);
+
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        fprintf(stderr, "Error opening checkpoint file %s.\n", path);
+        return 0;
+    }
+
+    CheckpointHeader header;
+    const char *error = NULL;
+
+    if (fread(&header, sizeof(header), 1, file) != 1)
+        error = "Error reading header";
+    else if (header.magic != CKPT_MAGIC || header.version != CKPT_VERSION)
+        error = "Invalid checkpoint format or version";
+    else if (header.rank != rank || header.world_size != world_size)
+        error = "Checkpoint was written with a different world size";
+    else if (header.num_episodes != metrics->num_episodes)
+        error = "Checkpoint does not fit the configured episodes per step";
+    else if (header.model_bytes && header.model_bytes != model_bytes(mlp))
+        error = "Checkpoint network size mismatch";
+    else if (header.optimizer_bytes && header.optimizer_bytes != optimizer_state_size(optimizer))
+        error = "Checkpoint optimizer state size mismatch";
+    else if (header.replay_bytes != (replay ? replay_state_size(replay->replay) : 0))
+        error = "Checkpoint does not fit the configured algorithm or replay capacity";
+    else if (replay && header.model_bytes && header.target_bytes != model_bytes(replay->target))
+        error = "Checkpoint target network size mismatch";
+
+    size_t body_size = error ? 0 : header.model_bytes + header.optimizer_bytes + header.target_bytes + header.replay_bytes;
+    char *body = error ? NULL : malloc(body_size);
+
+    if (!error && fread(body, 1, body_size, file) != body_size)
+        error = "Truncated checkpoint";
+    fclose(file);
+
+    if (error) {
+        fprintf(stderr, "%s in %s.\n", error, path);
+        free(body);
+        return 0;
+    }
+
+    const char *p = body;
+    if (header.model_bytes) p = load_params(mlp, p);
+
+    if (header.optimizer_bytes) {
+        optimizer_load_state(optimizer, p);
+        p += header.optimizer_bytes;
+    }
+
+    if (header.target_bytes) p = load_params(replay->target, p);
+
+    if (replay) {
+        replay_load_state(replay->replay, p);
+        p += header.replay_bytes;
+        *replay->env_steps = header.env_steps;
+        *replay->num_updates = header.num_updates;
+    }
+
+    metrics->totals = header.totals;
+    metrics->updates = metrics->flushed = header.next_step;
+    rng_set_state(header.rng);
+    *next_step = header.next_step;
+
+    free(body);
+    return 1;
+}
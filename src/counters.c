@@ -0,0 +1,101 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "counters.h"
+
+static const struct { const char *name; uint32_t type; uint64_t config; } counters[N_COUNTERS] = {
+    [COUNTER_CYCLES] = {"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    [COUNTER_INSTRUCTIONS] = {"instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    [COUNTER_L1D_MISSES] = {"l1d_misses", PERF_TYPE_HW_CACHE,
+        PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+    [COUNTER_LLC_MISSES] = {"llc_misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+    [COUNTER_BRANCH_MISSES] = {"branch_misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+};
+
+// Layout of a PERF_FORMAT_GROUP | TOTAL_TIME_* | ID read
+typedef struct GroupRead {
+    uint64_t nr;
+    uint64_t time_enabled;
+    uint64_t time_running;
+    struct { uint64_t value, id; } values[N_COUNTERS];
+} GroupRead;
+
+static int open_counter(int counter, int group_fd) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+
+    attr.size = sizeof(attr);
+    attr.type = counters[counter].type;
+    attr.config = counters[counter].config;
+    attr.disabled = group_fd == -1;     // the group starts when its leader is enabled
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_ID |
+                       PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, group_fd, 0);
+}
+
+int perf_counters_open(PerfCounters *pc) {
+    pc->leader = -1;
+    pc->n_open = 0;
+
+    for (int c = 0; c < N_COUNTERS; c++) {
+        pc->fds[c] = open_counter(c, pc->leader);
+        pc->ids[c] = 0;
+        if (pc->fds[c] < 0) continue;
+
+        if (ioctl(pc->fds[c], PERF_EVENT_IOC_ID, &pc->ids[c]) != 0) {
+            close(pc->fds[c]);
+            pc->fds[c] = -1;
+            continue;
+        }
+
+        if (pc->leader == -1) pc->leader = pc->fds[c];
+        pc->n_open++;
+    }
+
+    if (pc->leader == -1) return 0;
+
+    ioctl(pc->leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(pc->leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    return pc->n_open;
+}
+
+int perf_counters_read(const PerfCounters *pc, uint64_t values[N_COUNTERS]) {
+    memset(values, 0, N_COUNTERS * sizeof(uint64_t));
+    if (pc->leader == -1) return 0;
+
+    GroupRead data;
+    if (read(pc->leader, &data, sizeof(data)) < (ssize_t)(3 * sizeof(uint64_t))) return 0;
+
+    // The group is scheduled as a whole: scale every count by the fraction it ran
+    double scale = data.time_running > 0 ? (double)data.time_enabled / data.time_running : 1.0;
+
+    for (uint64_t i = 0; i < data.nr && i < N_COUNTERS; i++) {
+        for (int c = 0; c < N_COUNTERS; c++) {
+            if (pc->fds[c] >= 0 && pc->ids[c] == data.values[i].id)
+                values[c] = (uint64_t)(data.values[i].value * scale);
+        }
+    }
+
+    return 1;
+}
+
+void perf_counters_close(PerfCounters *pc) {
+    for (int c = 0; c < N_COUNTERS; c++) {
+        if (pc->fds[c] >= 0) close(pc->fds[c]);
+        pc->fds[c] = -1;
+    }
+
+    pc->leader = -1;
+    pc->n_open = 0;
+}
+
+const char *perf_counter_name(int counter) {
+    return counters[counter].name;
+}
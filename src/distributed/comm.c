@@ -1,7 +1,9 @@
 #include <stdlib.h>
+#include <math.h>
 
 #include <mpi.h>
 
+#include "trace.h"
 #include "distributed/comm.h"
 
 static void serialize_gradients(const MLP *mlp, float *buffer) {
@@ -71,7 +73,21 @@ static void deserialize_weights(MLP *mlp, const float *buffer) {
     }
 }
 
-void broadcast_model_weights(MLP *mlp, const MPIContext *mpi_ctx, int src_rank) {
+#define BASELINE_MIN_BYTES (1 << 20)
+#define BASELINE_SMALL_BYTES 8
+#define BASELINE_ROUNDS 20
+
+static inline void record(CommStats *stats, double bytes, double t0, double t1, double t2, double t3) {
+    if (!stats) return;
+
+    stats->bytes = bytes;
+    stats->pack = t1 - t0;
+    stats->mpi = t2 - t1;
+    stats->unpack = t3 - t2;
+}
+
+void broadcast_model_weights(MLP *mlp, const MPIContext *mpi_ctx, int src_rank, CommStats *stats) {
+    double t0 = get_time();
     int total_params = get_num_params(mlp);
     float *weights_buffer = (float *)malloc(total_params * sizeof(float));
 
@@ -79,14 +95,20 @@ void broadcast_model_weights(MLP *mlp, const MPIContext *mpi_ctx, int src_rank)
         serialize_weights(mlp, weights_buffer);
     }
 
+    double t1 = get_time();
+    TRACE_BEGIN(ZONE_MPI_BCAST);
     MPI_Bcast(weights_buffer, total_params, MPI_FLOAT, src_rank, mpi_ctx->comm);
+    TRACE_END(ZONE_MPI_BCAST);
+    double t2 = get_time();
 
     deserialize_weights(mlp, weights_buffer);
     
     free(weights_buffer);
+    record(stats, (double)total_params * sizeof(float), t0, t1, t2, get_time());
 }
 
-void aggregate_gradients(MLP *mlp, const MPIContext *mpi_ctx, int compute_rank) {
+void aggregate_gradients(MLP *mlp, const MPIContext *mpi_ctx, int compute_rank, CommStats *stats) {
+    double t0 = get_time();
     int total_params = get_num_params(mlp);
     float *local_grad_buffer = (float *)malloc(total_params * sizeof(float));
     float *aggregated_grad_buffer = (float *)malloc(total_params * sizeof(float));
@@ -95,8 +117,12 @@ void aggregate_gradients(MLP *mlp, const MPIContext *mpi_ctx, int compute_rank)
     serialize_gradients(mlp, local_grad_buffer);
     
     // Sum all gradients to compute_rank using MPI_Reduce
+    double t1 = get_time();
+    TRACE_BEGIN(ZONE_MPI_REDUCE);
     MPI_Reduce(local_grad_buffer, aggregated_grad_buffer, total_params, MPI_FLOAT, 
                MPI_SUM, compute_rank, mpi_ctx->comm);
+    TRACE_END(ZONE_MPI_REDUCE);
+    double t2 = get_time();
     
     // Only compute_rank computes the mean and deserializes the aggregated gradients
     if (mpi_ctx->rank == compute_rank) {
@@ -109,4 +135,145 @@ void aggregate_gradients(MLP *mlp, const MPIContext *mpi_ctx, int compute_rank)
     
     free(local_grad_buffer);
     free(aggregated_grad_buffer);
+    record(stats, (double)total_params * sizeof(float), t0, t1, t2, get_time());
+}
+
+void allreduce_gradients(MLP *mlp, const MPIContext *mpi_ctx, CommStats *stats) {
+    double t0 = get_time();
+    int total_params = get_num_params(mlp);
+    float *grad_buffer = (float *)malloc(total_params * sizeof(float));
+
+    serialize_gradients(mlp, grad_buffer);
+
+    double t1 = get_time();
+    TRACE_BEGIN(ZONE_MPI_ALLREDUCE);
+    MPI_Allreduce(MPI_IN_PLACE, grad_buffer, total_params, MPI_FLOAT, MPI_SUM, mpi_ctx->comm);
+    TRACE_END(ZONE_MPI_ALLREDUCE);
+    double t2 = get_time();
+
+    deserialize_gradients(mlp, grad_buffer);
+
+    free(grad_buffer);
+    record(stats, (double)total_params * sizeof(float), t0, t1, t2, get_time());
+}
+
+void allgather_bytes(const void *local, int bytes, void *all, const MPIContext *mpi_ctx, CommStats *stats) {
+    double t0 = get_time();
+    TRACE_BEGIN(ZONE_MPI_ALLGATHER);
+    // MPI forbids overlapping send and receive buffers; in place, MPI reads our block of all
+    if (local == NULL || (const char *)local == (const char *)all + (size_t)mpi_ctx->rank * bytes)
+        MPI_Allgather(MPI_IN_PLACE, 0, MPI_DATATYPE_NULL, all, bytes, MPI_BYTE, mpi_ctx->comm);
+    else
+        MPI_Allgather(local, bytes, MPI_BYTE, all, bytes, MPI_BYTE, mpi_ctx->comm);
+    TRACE_END(ZONE_MPI_ALLGATHER);
+    double t1 = get_time();
+
+    record(stats, (double)bytes, t0, t0, t1, t1);
+}
+
+void broadcast_optimizer_state(Optimizer *optimizer, const MPIContext *mpi_ctx, int src_rank) {
+    size_t size = optimizer_state_size(optimizer);
+    if (size == 0) return;
+
+    char *buffer = malloc(size);
+    if (mpi_ctx->rank == src_rank) optimizer_save_state(optimizer, buffer);
+
+    MPI_Bcast(buffer, (int)size, MPI_BYTE, src_rank, mpi_ctx->comm);
+    optimizer_load_state(optimizer, buffer);
+    free(buffer);
+}
+
+void transfer_model_state(MLP *mlp, Optimizer *optimizer, int src_rank, int dst_rank, const MPIContext *mpi_ctx) {
+    int rank = mpi_ctx->rank;
+    if ((rank != src_rank && rank != dst_rank) || src_rank == dst_rank) return;
+
+    // Weights, then the optimizer state
+    size_t weights_bytes = (size_t)get_num_params(mlp) * sizeof(float);
+    size_t size = weights_bytes + optimizer_state_size(optimizer);
+    char *buffer = malloc(size);
+
+    if (rank == src_rank) {
+        serialize_weights(mlp, (float *)buffer);
+        optimizer_save_state(optimizer, buffer + weights_bytes);
+        MPI_Send(buffer, (int)size, MPI_BYTE, dst_rank, 0, mpi_ctx->comm);
+    } else {
+        MPI_Recv(buffer, (int)size, MPI_BYTE, src_rank, 0, mpi_ctx->comm, MPI_STATUS_IGNORE);
+        deserialize_weights(mlp, (const float *)buffer);
+        optimizer_load_state(optimizer, buffer + weights_bytes);
+    }
+
+    free(buffer);
+}
+
+void normalize_across_ranks(float *x, int n, const MPIContext *mpi_ctx) {
+    double moments[3] = {(double)n, 0.0, 0.0};
+    for (int i = 0; i < n; i++) {
+        moments[1] += x[i];
+        moments[2] += (double)x[i] * x[i];
+    }
+
+    TRACE_BEGIN(ZONE_MPI_ALLREDUCE);
+    MPI_Allreduce(MPI_IN_PLACE, moments, 3, MPI_DOUBLE, MPI_SUM, mpi_ctx->comm);
+    TRACE_END(ZONE_MPI_ALLREDUCE);
+    if (moments[0] == 0.0) return;
+
+    double mean = moments[1] / moments[0];
+    double var = moments[2] / moments[0] - mean * mean;
+    float shift = (float)mean, scale = (float)(1.0 / sqrt((var > 0.0 ? var : 0.0) + 1e-8));
+
+    for (int i = 0; i < n; i++) x[i] = (x[i] - shift) * scale;
+}
+
+// Best one-way time of a bytes-sized message between rank 0 and peer (rank 0 only)
+static double ping_pong(char *buffer, int bytes, int peer, const MPIContext *mpi_ctx) {
+    double best = 1e30;
+
+    // The first round trip warms up the connection and is not counted
+    for (int round = 0; round <= BASELINE_ROUNDS; round++) {
+        if (mpi_ctx->rank == 0) {
+            double t0 = get_time();
+            MPI_Send(buffer, bytes, MPI_BYTE, peer, 0, mpi_ctx->comm);
+            MPI_Recv(buffer, bytes, MPI_BYTE, peer, 0, mpi_ctx->comm, MPI_STATUS_IGNORE);
+            double half = 0.5 * (get_time() - t0);
+
+            if (round > 0 && half < best) best = half;
+        } else {
+            MPI_Recv(buffer, bytes, MPI_BYTE, 0, 0, mpi_ctx->comm, MPI_STATUS_IGNORE);
+            MPI_Send(buffer, bytes, MPI_BYTE, 0, 0, mpi_ctx->comm);
+        }
+    }
+
+    return best;
+}
+
+CommBaseline comm_measure_baseline(const MPIContext *mpi_ctx, size_t max_bytes) {
+    CommBaseline baseline = {0};
+    if (mpi_ctx->world_size < 2) return baseline;
+
+    int large = max_bytes > BASELINE_MIN_BYTES ? (int)max_bytes : BASELINE_MIN_BYTES;
+    int peer = mpi_ctx->world_size - 1;
+
+    if (mpi_ctx->rank == 0 || mpi_ctx->rank == peer) {
+        char *buffer = calloc(large, 1);
+
+        double t_small = ping_pong(buffer, BASELINE_SMALL_BYTES, peer, mpi_ctx);
+        double t_large = ping_pong(buffer, large, peer, mpi_ctx);
+
+        // Two-point fit of latency + bytes / bandwidth
+        if (mpi_ctx->rank == 0 && t_large > t_small) {
+            baseline.bandwidth = (large - BASELINE_SMALL_BYTES) / (t_large - t_small);
+            baseline.latency = t_small - BASELINE_SMALL_BYTES / baseline.bandwidth;
+            if (baseline.latency < 0.0) baseline.latency = 0.0;
+        }
+
+        free(buffer);
+    }
+
+    MPI_Bcast(&baseline, 2, MPI_DOUBLE, 0, mpi_ctx->comm);
+    return baseline;
+}
+
+double comm_model_time(const CommBaseline *baseline, double bytes) {
+    if (baseline->bandwidth <= 0.0) return 0.0;
+    return baseline->latency + bytes / baseline->bandwidth;
 }
@@ -1,17 +1,62 @@
+#define _GNU_SOURCE
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdarg.h>
+#include <sched.h>
+#include <unistd.h>
 
 #include "distributed/mpi_utils.h"
+#include "nn/backend.h"
+
+#define CLOCK_SYNC_ROUNDS 16
+
+/*
+ * Offset of this rank's MPI_Wtime from rank 0's, from the ping-pong round trip with the
+ * smallest latency: rank 0 stamps its clock between our send and receive, which we
+ * assume happened halfway through.
+ */
+static double estimate_clock_offset(MPI_Comm comm, int rank, int size) {
+    double offset = 0.0, best_rtt = 1e30, remote;
+
+    for (int peer = 1; peer < size; peer++) {
+        for (int round = 0; round < CLOCK_SYNC_ROUNDS; round++) {
+            if (rank == 0) {
+                MPI_Recv(NULL, 0, MPI_BYTE, peer, 0, comm, MPI_STATUS_IGNORE);
+                remote = MPI_Wtime();
+                MPI_Send(&remote, 1, MPI_DOUBLE, peer, 0, comm);
+            } else if (rank == peer) {
+                double t1 = MPI_Wtime();
+                MPI_Send(NULL, 0, MPI_BYTE, 0, 0, comm);
+                MPI_Recv(&remote, 1, MPI_DOUBLE, 0, 0, comm, MPI_STATUS_IGNORE);
+                double t2 = MPI_Wtime();
+
+                if (t2 - t1 < best_rtt) {
+                    best_rtt = t2 - t1;
+                    offset = remote - 0.5 * (t1 + t2);
+                }
+            }
+        }
+    }
+
+    return offset;
+}
 
 MPIContext mpi_init_context(int *argc, char ***argv) {
-    MPI_Init(argc, argv);
+    // Helper threads (e.g. the checkpoint writer) never call MPI
+    int provided;
+    MPI_Init_thread(argc, argv, MPI_THREAD_FUNNELED, &provided);
     
     MPIContext ctx;
     ctx.comm = MPI_COMM_WORLD;
     
     MPI_Comm_rank(ctx.comm, &ctx.rank);
     MPI_Comm_size(ctx.comm, &ctx.world_size);
+
+    MPI_Comm_split_type(ctx.comm, MPI_COMM_TYPE_SHARED, ctx.rank, MPI_INFO_NULL, &ctx.node_comm);
+    MPI_Comm_rank(ctx.node_comm, &ctx.node_rank);
+    MPI_Comm_size(ctx.node_comm, &ctx.node_size);
+
+    ctx.clock_offset = estimate_clock_offset(ctx.comm, ctx.rank, ctx.world_size);
     
     return ctx;
 }
@@ -25,7 +70,86 @@ void main_printf(const MPIContext *ctx, const char *format, ...) {
     }
 }
 
-void mpi_finalize() {
+int mpi_apply_thread_policy(const MPIContext *ctx) {
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+        for (int cpu = 0; cpu < (int)sysconf(_SC_NPROCESSORS_ONLN) && cpu < CPU_SETSIZE; cpu++)
+            CPU_SET(cpu, &allowed);
+    int n_allowed = CPU_COUNT(&allowed);
+
+    // Only the node's ranks whose masks overlap ours compete for our CPUs: a launcher
+    // binding to disjoint cores leaves one sharer, binding per socket leaves the socket's
+    cpu_set_t *masks = malloc(ctx->node_size * sizeof(cpu_set_t));
+    MPI_Allgather(&allowed, sizeof(cpu_set_t), MPI_BYTE, masks, sizeof(cpu_set_t), MPI_BYTE, ctx->node_comm);
+
+    int sharers = 0, slot = 0, identical = 1;
+    for (int r = 0; r < ctx->node_size; r++) {
+        cpu_set_t common;
+        CPU_AND(&common, &allowed, &masks[r]);
+        if (CPU_COUNT(&common) == 0) continue;
+
+        sharers++;
+        if (r < ctx->node_rank) slot++;
+        identical = identical && CPU_EQUAL(&allowed, &masks[r]);
+    }
+    free(masks);
+
+    int n_threads = n_allowed / sharers;
+    if (n_threads < 1) n_threads = 1;
+
+    // Ranks sharing one mask split it into blocks; partial overlaps are left to the launcher
+    if (sharers > 1 && identical && n_allowed >= sharers) {
+        cpu_set_t block;
+        CPU_ZERO(&block);
+
+        int first = slot * n_threads, seen = 0;
+        for (int cpu = 0; cpu < CPU_SETSIZE && seen < first + n_threads; cpu++) {
+            if (!CPU_ISSET(cpu, &allowed)) continue;
+            if (seen >= first) CPU_SET(cpu, &block);
+            seen++;
+        }
+
+        if (sched_setaffinity(0, sizeof(block), &block) != 0)
+            fprintf(stderr, "Rank %d: could not pin to CPUs %d-%d\n", ctx->rank, first, first + n_threads - 1);
+    }
+
+    blas_set_num_threads(n_threads);
+    return n_threads;
+}
+
+int mpi_write_ordered(const MPIContext *ctx, const char *path, const void *data, size_t size) {
+    long long bytes = (long long)size, offset = 0;
+    MPI_Exscan(&bytes, &offset, 1, MPI_LONG_LONG, MPI_SUM, ctx->comm);
+    if (ctx->rank == 0) offset = 0;     // MPI_Exscan leaves rank 0's result undefined
+
+    MPI_File file;
+    int ok = MPI_File_open(ctx->comm, path, MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &file) == MPI_SUCCESS;
+
+    int all_ok;
+    MPI_Allreduce(&ok, &all_ok, 1, MPI_INT, MPI_MIN, ctx->comm);
+    if (!all_ok) {
+        if (ok) MPI_File_close(&file);
+        if (!ok) fprintf(stderr, "Rank %d: could not open %s.\n", ctx->rank, path);
+        return 0;
+    }
+
+    // Drop the tail of an older, longer file
+    MPI_File_set_size(file, 0);
+
+    MPI_Status status;
+    int written = 0;
+    ok = MPI_File_write_at_all(file, (MPI_Offset)offset, data, (int)size, MPI_BYTE, &status) == MPI_SUCCESS;
+    if (ok) MPI_Get_count(&status, MPI_BYTE, &written);
+    ok = ok && (size_t)written == size;
+    ok = (MPI_File_close(&file) == MPI_SUCCESS) && ok;
+
+    MPI_Allreduce(&ok, &all_ok, 1, MPI_INT, MPI_MIN, ctx->comm);
+    return all_ok;
+}
+
+void mpi_finalize(MPIContext *ctx) {
+    MPI_Comm_free(&ctx->node_comm);
     MPI_Finalize();
 }
 
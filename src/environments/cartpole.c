@@ -37,7 +37,8 @@ void cartpole_reset(CartpoleState *state, float *obs_buf) {
 }
 
 void cartpole_step(CartpoleState *state, const float *action, float *obs_buf, float *reward_buf, bool *done_buf) {
-    float force = state->continuous ? *(action) * state->force_magnitude
+    // Continuous actions are clipped to [-1, 1] of the force magnitude
+    float force = state->continuous ? fminf(fmaxf(*(action), -1.0f), 1.0f) * state->force_magnitude
                                   : (*(action) > 0.5f ? state->force_magnitude: -state->force_magnitude);
 
     float costheta = cosf(state->theta);
@@ -106,14 +107,15 @@ Env make_cartpole_env(float force_magnitude, bool continuous) {
     state->force_magnitude=force_magnitude;
     state->continuous=continuous;
 
-    static int act_space[1] = {2};
+    static int discrete_space[1] = {2};
+    static int continuous_space[1] = {1};
 
     return (Env){
         .ptr = state,
-        .name = "Cartpole",
+        .name = continuous ? "CartpoleContinuous" : "Cartpole",
         .obs_size = 4,
         .act_size = 1,
-        .act_space = act_space,
+        .act_space = continuous ? continuous_space : discrete_space,
         .reset = (void (*)(void*, float*))cartpole_reset,
         .step = (void (*)(void*, const float*, float*, float*, bool*))cartpole_step,
         .destroy = (void (*)(void*))cartpole_destroy,
@@ -18,38 +18,51 @@
 #include "nn/optimizers.h"
 #include "nn/linear.h"
 #include "nn/debug.h"
+#include "nn/backend.h"
 #include "rng.h"
 #include "metrics.h"
+#include "checkpoint.h"
+#include "training.h"
+#include "scaling.h"
+#include "pbt.h"
+#include "trace.h"
 
 #define WIDTH 600
 #define HEIGHT 200
 
-typedef struct {
-    int seed;
-    int hidden_size;
-    int episodes;
-    int max_steps;
-    float gamma;
-    int grad_steps;
-    float learning_rate;
-    bool render;
-    char *env_name;
-    char *output_dir;
-} Config;
-
 // Default values
 #define DEFAULT_SEED 1
 #define DEFAULT_HIDDENSIZE 16
 #define DEFAULT_EPISODES 1
 #define DEFAULT_MAX_STEPS 500
 #define DEFAULT_GAMMA 0.99f
+#define DEFAULT_ENTROPY_COEF 0.0f
+#define DEFAULT_ALGO "reinforce"
+#define DEFAULT_GAE_LAMBDA 0.95f
+#define DEFAULT_VALUE_COEF 1e-3f
+#define DEFAULT_PPO_EPOCHS 4
+#define DEFAULT_MINIBATCHES 4
+#define DEFAULT_CLIP_RANGE 0.2f
+#define DEFAULT_ES_SIGMA 0.1f
+#define DEFAULT_ES_PAIRS 4
+#define DEFAULT_REPLAY_CAPACITY 50000
+#define DEFAULT_BATCH_SIZE 64
+#define DEFAULT_DQN_UPDATES 32
+#define DEFAULT_TARGET_EVERY 250
+#define DEFAULT_PER_ALPHA 0.6f
+#define DEFAULT_PER_BETA 0.4f
+#define DEFAULT_EPSILON 0.05f
 #define DEFAULT_GRAD_STEPS 2500
 #define DEFAULT_LEARNING_RATE 1e-2f
+#define DEFAULT_CHECKPOINT_EVERY 1
+#define DEFAULT_BACKEND "auto"
+#define DEFAULT_SAVE_INTERVAL 0
+#define DEFAULT_METRICS_WINDOW 1024
 
 void print_usage(const char *prog_name) {
     fprintf(stderr, "Usage: %s [Environment] [options]\n", prog_name);
     fprintf(stderr, "Options:\n");
-    fprintf(stderr, "  Environment: positional name (Default: cartpole)\n");
+    fprintf(stderr, "  Environment: positional name, cartpole or cartpole-continuous (Default: cartpole)\n");
     fprintf(stderr, "  -s <int>   RNG seed (Default: %d)\n", DEFAULT_SEED);
     fprintf(stderr, "  -n <float> Neural network's hidden size (Default: %d)\n", DEFAULT_HIDDENSIZE);
     fprintf(stderr, "  -e <int>   Episodes per gradient step (batch size) (Default: %d)\n", DEFAULT_EPISODES);
@@ -57,7 +70,34 @@ void print_usage(const char *prog_name) {
     fprintf(stderr, "  -y <float> Discount factor (gamma) (Default: %.2f)\n", DEFAULT_GAMMA);
     fprintf(stderr, "  -k <float> Number of gradient steps to perform (Default: %d)\n", DEFAULT_GRAD_STEPS);
     fprintf(stderr, "  -l <float> Learning rate (Default: %.0e)\n", DEFAULT_LEARNING_RATE);
+    fprintf(stderr, "  -c <int>   Cache activations every c layers, recompute the rest (0: inputs only) (Default: %d)\n", DEFAULT_CHECKPOINT_EVERY);
+    fprintf(stderr, "  -b <name>  GEMM backend: auto, openblas, blis, reference, kernels (Default: %s)\n", DEFAULT_BACKEND);
     fprintf(stderr, "  -o <path>  Output directory for CSV files (Default: disabled)\n");
+    fprintf(stderr, "  -w <int>   Metrics window: updates kept in memory, streamed to <output> in halves (Default: %d)\n", DEFAULT_METRICS_WINDOW);
+    fprintf(stderr, "  -t         Write a Chrome/Perfetto trace of all ranks to <output>/trace.json\n");
+    fprintf(stderr, "  -z         Record hot-path zones; summary on rank 0, <output>/zones.json with -o\n");
+    fprintf(stderr, "  -x         Count cycles, instructions, cache and branch misses per phase (perf_event_open)\n");
+    fprintf(stderr, "  -p <int>   Write a training checkpoint to <output>/checkpoint every p grad steps (0: never) (Default: %d)\n", DEFAULT_SAVE_INTERVAL);
+    fprintf(stderr, "  --entropy <float>  Entropy bonus coefficient in the policy loss (Default: %.2f)\n", DEFAULT_ENTROPY_COEF);
+    fprintf(stderr, "  --algo <name>  reinforce, a2c (value head, GAE advantages), ppo, es or dqn (Default: %s)\n", DEFAULT_ALGO);
+    fprintf(stderr, "  --lambda <float>  GAE lambda for a2c and ppo (Default: %.2f)\n", DEFAULT_GAE_LAMBDA);
+    fprintf(stderr, "  --value-coef <float>  Value loss coefficient for a2c and ppo (Default: %.0e)\n", DEFAULT_VALUE_COEF);
+    fprintf(stderr, "  --epochs <int>  PPO epochs over each rollout batch (Default: %d)\n", DEFAULT_PPO_EPOCHS);
+    fprintf(stderr, "  --minibatches <int>  PPO minibatches per epoch, one gradient allreduce each (Default: %d)\n", DEFAULT_MINIBATCHES);
+    fprintf(stderr, "  --clip <float>  PPO ratio clip range (Default: %.2f)\n", DEFAULT_CLIP_RANGE);
+    fprintf(stderr, "  --sigma <float>  ES perturbation std (Default: %.2f)\n", DEFAULT_ES_SIGMA);
+    fprintf(stderr, "  --pairs <int>  ES antithetic pairs per rank and step, -e episodes each side (Default: %d)\n", DEFAULT_ES_PAIRS);
+    fprintf(stderr, "  --replay <int>  DQN replay capacity per rank, in transitions (Default: %d)\n", DEFAULT_REPLAY_CAPACITY);
+    fprintf(stderr, "  --batch <int>  DQN minibatch per rank (Default: %d)\n", DEFAULT_BATCH_SIZE);
+    fprintf(stderr, "  --updates <int>  DQN minibatches per grad step, one gradient allreduce each (Default: %d)\n", DEFAULT_DQN_UPDATES);
+    fprintf(stderr, "  --target-every <int>  DQN minibatches between target network syncs (Default: %d)\n", DEFAULT_TARGET_EVERY);
+    fprintf(stderr, "  --alpha <float>  Replay priority exponent, 0 for uniform sampling (Default: %.1f)\n", DEFAULT_PER_ALPHA);
+    fprintf(stderr, "  --beta <float>  Replay importance-sampling exponent (Default: %.1f)\n", DEFAULT_PER_BETA);
+    fprintf(stderr, "  --epsilon <float>  Final DQN exploration rate (Default: %.2f)\n", DEFAULT_EPSILON);
+    fprintf(stderr, "  --resume <dir>  Resume training from a checkpoint directory (same world size; DQN also restores its replay shards)\n");
+    fprintf(stderr, "  --scaling <spec>  Scaling study, e.g. ranks=4,2,1:episodes=1,4:hidden=16,64:mode=weak\n");
+    fprintf(stderr, "  --target <float>  Return used for time-to-target in the scaling study\n");
+    fprintf(stderr, "  --pbt <spec>  Population-based training, e.g. members=4:interval=50:lr=1e-3,3e-2:gamma=0.95,0.99:episodes=1,2\n");
     fprintf(stderr, "  -r         Render episode using trained policy\n");
     fprintf(stderr, "  -h         Print this help message\n");
 }
@@ -71,13 +111,59 @@ void parse_arguments(int argc, char *argv[], Config *config) {
     config->episodes = DEFAULT_EPISODES;
     config->max_steps = DEFAULT_MAX_STEPS;
     config->gamma = DEFAULT_GAMMA;
+    config->entropy_coef = DEFAULT_ENTROPY_COEF;
+    config->algo = DEFAULT_ALGO;
+    config->gae_lambda = DEFAULT_GAE_LAMBDA;
+    config->value_coef = DEFAULT_VALUE_COEF;
+    config->ppo_epochs = DEFAULT_PPO_EPOCHS;
+    config->minibatches = DEFAULT_MINIBATCHES;
+    config->clip_range = DEFAULT_CLIP_RANGE;
+    config->es_sigma = DEFAULT_ES_SIGMA;
+    config->es_pairs = DEFAULT_ES_PAIRS;
+    config->replay_capacity = DEFAULT_REPLAY_CAPACITY;
+    config->batch_size = DEFAULT_BATCH_SIZE;
+    config->dqn_updates = DEFAULT_DQN_UPDATES;
+    config->target_every = DEFAULT_TARGET_EVERY;
+    config->per_alpha = DEFAULT_PER_ALPHA;
+    config->per_beta = DEFAULT_PER_BETA;
+    config->epsilon = DEFAULT_EPSILON;
     config->grad_steps = DEFAULT_GRAD_STEPS;
     config->learning_rate = DEFAULT_LEARNING_RATE;
+    config->checkpoint_every = DEFAULT_CHECKPOINT_EVERY;
     config->env_name = "cartpole";
     config->output_dir = NULL;
+    config->backend = DEFAULT_BACKEND;
+    config->save_interval = DEFAULT_SAVE_INTERVAL;
+    config->resume_dir = NULL;
+    config->metrics_window = DEFAULT_METRICS_WINDOW;
+
+    static struct option long_options[] = {
+        {"entropy", required_argument, NULL, 'E'},
+        {"algo", required_argument, NULL, 'A'},
+        {"lambda", required_argument, NULL, 'L'},
+        {"value-coef", required_argument, NULL, 'V'},
+        {"epochs", required_argument, NULL, 'P'},
+        {"minibatches", required_argument, NULL, 'M'},
+        {"clip", required_argument, NULL, 'C'},
+        {"sigma", required_argument, NULL, 'N'},
+        {"pairs", required_argument, NULL, 'Q'},
+        {"replay", required_argument, NULL, 'D'},
+        {"batch", required_argument, NULL, 'G'},
+        {"updates", required_argument, NULL, 'U'},
+        {"target-every", required_argument, NULL, 'F'},
+        {"alpha", required_argument, NULL, 'I'},
+        {"beta", required_argument, NULL, 'J'},
+        {"epsilon", required_argument, NULL, 'K'},
+        {"resume", required_argument, NULL, 'R'},
+        {"scaling", required_argument, NULL, 'S'},
+        {"target", required_argument, NULL, 'T'},
+        {"pbt", required_argument, NULL, 'B'},
+        {"help", no_argument, NULL, 'h'},
+        {0, 0, 0, 0}
+    };
 
-    // Use "s:g:n:e:m:y:k:rl:o:h" to specify options that take an argument
-    while ((opt = getopt(argc, argv, "s:g:n:e:m:y:k:rl:o:h")) != -1) {
+    // Use "s:g:n:e:m:y:k:rl:c:b:o:p:w:tzxh" to specify options that take an argument
+    while ((opt = getopt_long(argc, argv, "s:g:n:e:m:y:k:rl:c:b:o:p:w:tzxh", long_options, NULL)) != -1) {
         switch (opt) {
             case 's':
                 config->seed = atoi(optarg);
@@ -100,9 +186,90 @@ void parse_arguments(int argc, char *argv[], Config *config) {
             case 'l':
                 config->learning_rate = atof(optarg);
                 break;
+            case 'c':
+                config->checkpoint_every = atoi(optarg);
+                break;
+            case 'b':
+                config->backend = optarg;
+                break;
             case 'o':
                 config->output_dir = optarg;
                 break;
+            case 'p':
+                config->save_interval = atoi(optarg);
+                break;
+            case 'w':
+                config->metrics_window = atoi(optarg);
+                break;
+            case 't':
+                config->trace = true;
+                break;
+            case 'z':
+                config->zones = true;
+                break;
+            case 'x':
+                config->counters = true;
+                break;
+            case 'E':
+                config->entropy_coef = atof(optarg);
+                break;
+            case 'A':
+                config->algo = optarg;
+                break;
+            case 'L':
+                config->gae_lambda = atof(optarg);
+                break;
+            case 'V':
+                config->value_coef = atof(optarg);
+                break;
+            case 'P':
+                config->ppo_epochs = atoi(optarg);
+                break;
+            case 'M':
+                config->minibatches = atoi(optarg);
+                break;
+            case 'C':
+                config->clip_range = atof(optarg);
+                break;
+            case 'N':
+                config->es_sigma = atof(optarg);
+                break;
+            case 'Q':
+                config->es_pairs = atoi(optarg);
+                break;
+            case 'D':
+                config->replay_capacity = atoi(optarg);
+                break;
+            case 'G':
+                config->batch_size = atoi(optarg);
+                break;
+            case 'U':
+                config->dqn_updates = atoi(optarg);
+                break;
+            case 'F':
+                config->target_every = atoi(optarg);
+                break;
+            case 'I':
+                config->per_alpha = atof(optarg);
+                break;
+            case 'J':
+                config->per_beta = atof(optarg);
+                break;
+            case 'K':
+                config->epsilon = atof(optarg);
+                break;
+            case 'R':
+                config->resume_dir = optarg;
+                break;
+            case 'S':
+                config->scaling = optarg;
+                break;
+            case 'T':
+                config->target_return = atof(optarg);
+                break;
+            case 'B':
+                config->pbt = optarg;
+                break;
             case 'r':
                 config->render = true;
                 break;
@@ -155,45 +322,6 @@ static int mkdir_p(const char *path) {
     return 0;
 }
 
-Env dispatch_environment(char *env_name) {
-    if (!env_name || strcmp(env_name, "cartpole") == 0)
-        return make_cartpole_env(10.0f, false);
-
-    fprintf(stderr, "ERROR: Could not find environment matching %s\n", env_name);
-    exit(1);
-}
-
-Policy dispatch_policy(Env *env, int hidden_size) {
-    static MLP policynet;
-    
-    Activation activations[2] = {relu, identity};
-    int input_size[2] = {env->obs_size, hidden_size};
-    int output_size = 1;
-
-    if (env->act_size == 1) {
-        int act_space = *env->act_space;
-        output_size = (act_space == 2) ? 1 : act_space;
-    }
-
-    policynet = create_mlp(
-        input_size,
-        output_size,
-        2,
-        activations
-    );
-    kaiming_mlp_init(&policynet);
-
-    if (env->act_size == 1) {
-        int act_space = *env->act_space;
-
-        if (act_space == 2) return create_binary_policy(&policynet);
-        if (act_space > 2) return create_discrete_policy(&policynet, act_space);
-    }
-
-    fprintf(stderr, "ERROR: Could not initialize a policy for environment %s", env->name);
-    exit(1);
-}
-
 int main(int argc, char *argv[]) {
     MPIContext mpi_ctx = mpi_init_context(&argc, &argv);
     double init_start = get_time();
@@ -203,94 +331,96 @@ int main(int argc, char *argv[]) {
 
     rng_seed(config.seed + mpi_ctx.rank);
 
-    Env env = dispatch_environment(config.env_name);
-    Policy policy = dispatch_policy(&env, config.hidden_size);
-    
-    AdamState optimizer_state = create_adam_state(policy.mlp);
-    ExperienceBuffer buffer = create_buffer(config.max_steps, env.obs_size, env.act_size);
-    MLPCache cache = create_mlp_cache(policy.mlp, config.max_steps);
-    
-    TrainingMetrics metrics = create_metrics(config.grad_steps, config.episodes);
+    if (!gemm_backend_select(config.backend)) {
+        main_printf(&mpi_ctx, "ERROR: GEMM backend %s is unknown or not linked in (BLAS is %s)\n", config.backend, blas_vendor());
+        mpi_finalize(&mpi_ctx);
+        exit(1);
+    }
 
-    int capacity = buffer.capacity;
-    int out_size = policy.mlp->output_size;
+    int blas_threads = mpi_apply_thread_policy(&mpi_ctx);
+    main_printf(&mpi_ctx, "GEMM backend: %s (%s), %d BLAS thread(s) per rank, %d rank(s) per node\n",
+        gemm_backend()->name, blas_vendor(), blas_threads, mpi_ctx.node_size);
 
-    float *returns = malloc(capacity * sizeof(float));
-    float *logits = malloc(capacity * out_size * sizeof(float));
-    float *logp = malloc(capacity * sizeof(float));
-    float *dlogp = malloc(capacity * out_size * sizeof(float));
+    if (config.zones) {
+        if (trace_init(get_time() + mpi_ctx.clock_offset))
+            main_printf(&mpi_ctx, "Hot-path zones: recording, %.1f ns per zone\n", trace_overhead_ns());
+        else
+            main_printf(&mpi_ctx, "WARNING: -z ignored, zones were compiled out (configure with -DTRACING=ON)\n");
+    }
 
+    Algorithm algo;
+    if (!parse_algorithm(config.algo, &algo)) {
+        main_printf(&mpi_ctx, "ERROR: Unknown algorithm %s (reinforce, a2c, ppo, es or dqn)\n", config.algo);
+        mpi_finalize(&mpi_ctx);
+        exit(1);
+    }
 
-    double training_start = get_time();
-    for (int grad_step = 0; grad_step < config.grad_steps; grad_step++) {
-        double step_start = get_time();
-        metrics.step_starts[grad_step] = step_start;
-
-        // Sync model across processes (communication time)
-        if (metrics.comm_starts[grad_step] == 0.0) metrics.comm_starts[grad_step] = step_start;
-        broadcast_model_weights(policy.mlp, &mpi_ctx, 0);
-        metrics.comm_times[grad_step] += (get_time() - step_start);
-
-        mlp_zero_grad(policy.mlp);
-
-        int idx = grad_step * config.episodes;
-        for (int ep = 0; ep < config.episodes; ep++) {
-            // Rollout
-            double rollout_start = get_time();
-            if (ep == 0 && metrics.rollout_starts[grad_step] == 0.0)
-                metrics.rollout_starts[grad_step] = rollout_start;
-            policy_rollout(&env, &policy, config.max_steps, &buffer);
-            metrics.rollout_times[grad_step] += (get_time() - rollout_start);
-
-            // policy_gradient(&policy, &buffer, config.gamma, NULL, &cache);
-            // ...
-            double forward_start = get_time();
-            if (ep == 0 && metrics.forward_starts[grad_step] == 0.0)
-                metrics.forward_starts[grad_step] = forward_start;
-            discounted_cumsum(&buffer, config.gamma, returns);
-            
-            mlp_forward(policy.mlp, buffer.observations, buffer.size, logits, &cache);
-            metrics.forward_times[grad_step] += (get_time() - forward_start);
-            
-            double backward_start = get_time();
-            if (ep == 0 && metrics.backward_starts[grad_step] == 0.0)
-                metrics.backward_starts[grad_step] = backward_start;
-            policy_log_prob_from_logits(&policy, logits, buffer.actions, buffer.size, logp, dlogp);
-
-            for (int t = 0; t < buffer.size; t++) {
-                metrics.loss[idx + ep] += logp[t] * returns[t];
-
-                for (int j = 0; j < out_size; j++) {
-                    dlogp[t * out_size + j] *= -returns[t];
-                }
-            }
-            
-            mlp_backward(policy.mlp, &cache, dlogp, NULL);
-            metrics.backward_times[grad_step] += (get_time() - backward_start);
+    if (config.scaling) {
+        if (config.output_dir && mpi_ctx.rank == 0 && mkdir_p(config.output_dir) != 0)
+            fprintf(stderr, "ERROR: Failed to create output directory '%s'\n", config.output_dir);
 
-            metrics.returns[idx + ep] = mean_return(&buffer);
-            metrics.steps[idx + ep] = buffer.size;
-        }
+        int ok = run_scaling_study(&config, &mpi_ctx);
+        mpi_finalize(&mpi_ctx);
+        return ok ? 0 : 1;
+    }
 
-        // Aggregate gradients (communication time)
-        double comm_start = get_time();
-        aggregate_gradients(policy.mlp, &mpi_ctx, 0);
-        metrics.comm_times[grad_step] += (get_time() - comm_start);
+    if (config.pbt) {
+        if (config.output_dir && mpi_ctx.rank == 0 && mkdir_p(config.output_dir) != 0)
+            fprintf(stderr, "ERROR: Failed to create output directory '%s'\n", config.output_dir);
+        MPI_Barrier(mpi_ctx.comm);
 
-        double update_start = get_time();
-        metrics.update_starts[grad_step] = update_start;
-        if (mpi_ctx.rank == 0) {
-            adam_step(policy.mlp, &optimizer_state, config.learning_rate, 0.9, 0.999, 1e-08);
-        }
-        metrics.update_times[grad_step] = (get_time() - update_start);
+        int ok = run_pbt(&config, &mpi_ctx);
+        mpi_finalize(&mpi_ctx);
+        return ok ? 0 : 1;
+    }
 
-        metrics.step_times[grad_step] = (get_time() - step_start);
+    Trainer trainer = create_trainer(&config, &mpi_ctx);
+    Policy policy = trainer.policy;
+    TrainingMetrics *metrics = &trainer.metrics;
+
+    if (config.counters) {
+        int n_counters = metrics_open_counters(metrics);
+        if (n_counters > 0)
+            main_printf(&mpi_ctx, "Hardware counters: %d of %d available\n", n_counters, N_COUNTERS);
+        else
+            main_printf(&mpi_ctx, "WARNING: -x ignored, no hardware counters (no PMU, or perf_event_paranoid > 2)\n");
     }
 
-    metrics.wall_time_train = (get_time() - training_start);
-    metrics.wall_time_total = (get_time() - init_start);
+    // Ping-pong baseline for the collectives, sized like the model messages
+    metrics->comm_baseline = comm_measure_baseline(&mpi_ctx, (size_t)get_num_params(policy.mlp) * sizeof(float));
+    if (metrics->comm_baseline.bandwidth > 0)
+        main_printf(&mpi_ctx, "Comm baseline: %.2f us latency, %.1f MB/s (rank 0 <-> rank %d ping-pong)\n",
+            metrics->comm_baseline.latency * 1e6, metrics->comm_baseline.bandwidth * 1e-6, mpi_ctx.world_size - 1);
+
+    // DQN also checkpoints its replay shard, exploration and update counters, and target network
+    ReplayState replay_state = {&trainer.replay, &trainer.target, &trainer.env_steps, &trainer.num_updates};
+    ReplayState *replay = trainer.algo == ALGO_DQN ? &replay_state : NULL;
+
+    int start_step = 0;
+    if (config.resume_dir) {
+        int ok = load_checkpoint(config.resume_dir, mpi_ctx.rank, mpi_ctx.world_size, policy.mlp, &trainer.optimizer, metrics, replay, &start_step);
+
+        // Every rank must restart from the same step
+        int lowest, highest;
+        int step = ok ? start_step : -1;
+        MPI_Allreduce(&step, &lowest, 1, MPI_INT, MPI_MIN, mpi_ctx.comm);
+        MPI_Allreduce(&step, &highest, 1, MPI_INT, MPI_MAX, mpi_ctx.comm);
+
+        if (lowest < 0 || lowest != highest) {
+            main_printf(&mpi_ctx, "ERROR: Could not resume from %s (per-rank checkpoints missing or at different steps)\n", config.resume_dir);
+            mpi_finalize(&mpi_ctx);
+            exit(1);
+        }
+
+        trainer_sync(&trainer);
+        main_printf(&mpi_ctx, "Resuming from %s at grad step %d\n", config.resume_dir, start_step);
+    }
 
-    reduce_metrics(&metrics, &mpi_ctx, 0);
+    if ((config.save_interval > 0 || config.trace) && !config.output_dir) {
+        main_printf(&mpi_ctx, "ERROR: -p and -t need an output directory (-o)\n");
+        mpi_finalize(&mpi_ctx);
+        exit(1);
+    }
 
     if (config.output_dir != NULL) {
         if (mpi_ctx.rank == 0) {
@@ -300,34 +430,76 @@ int main(int argc, char *argv[]) {
         }
         MPI_Barrier(MPI_COMM_WORLD);
 
-        char timeline_path[512];
-        snprintf(timeline_path, sizeof(timeline_path), "%s/training_timeline_rank%d.csv", config.output_dir, mpi_ctx.rank);
-        write_metrics_timeline_csv(&metrics, &mpi_ctx, timeline_path);
+        if (!metrics_open_stream(metrics, &mpi_ctx, config.output_dir, start_step, config.trace)) {
+            main_printf(&mpi_ctx, "ERROR: Could not stream metrics to '%s'\n", config.output_dir);
+            mpi_finalize(&mpi_ctx);
+            exit(1);
+        }
+    }
+
+    Checkpointer *checkpointer = NULL;
+    if (config.save_interval > 0) {
+        char checkpoint_dir[512];
+        snprintf(checkpoint_dir, sizeof(checkpoint_dir), "%s/checkpoint", config.output_dir);
+        if (mpi_ctx.rank == 0 && mkdir_p(checkpoint_dir) != 0)
+            fprintf(stderr, "ERROR: Failed to create checkpoint directory '%s'\n", checkpoint_dir);
+        MPI_Barrier(mpi_ctx.comm);
 
-        if (mpi_ctx.rank == 0) {
-            char results_path[512];
-            snprintf(results_path, sizeof(results_path), "%s/training_results.csv", config.output_dir);
-            write_metrics_results_csv(&metrics, &mpi_ctx, results_path);
+        checkpointer = create_checkpointer(checkpoint_dir, mpi_ctx.rank, mpi_ctx.world_size);
+    }
+
+    double training_start = get_time();
+    for (int grad_step = start_step; grad_step < config.grad_steps; grad_step++) {
+        trainer_step(&trainer);
 
-            snprintf(results_path, sizeof(results_path), "%s/weights.bin", config.output_dir);
-            save_mlp_weights(policy.mlp, results_path);
+        if (checkpointer && (grad_step + 1) % config.save_interval == 0) {
+            // Records up to the checkpoint go to the stream first, so a resume finds them on disk
+            metrics_flush(metrics, &mpi_ctx);
+            checkpoint_async(checkpointer, grad_step + 1, policy.mlp, &trainer.optimizer, metrics, replay);
         }
     }
 
-    if (mpi_ctx.rank == 0) {
-        if (config.render) render_episode(&env, &policy);
+    free_checkpointer(checkpointer);
+    metrics_flush(metrics, &mpi_ctx);
+
+    metrics->wall_time_train = (get_time() - training_start);
+    metrics->wall_time_total = (get_time() - init_start);
+
+    reduce_metrics(metrics, &mpi_ctx, 0);
+
+    if (config.output_dir != NULL && trace_enabled) {
+        // Every rank's events form one slice of a single JSON array
+        char *zones = NULL;
+        size_t zones_size = 0;
+        FILE *f = open_memstream(&zones, &zones_size);
+
+        fputs(mpi_ctx.rank == 0 ? "[\n" : ",\n", f);
+        trace_write_chrome(f, mpi_ctx.rank, metrics_trace_base(metrics));
+        if (mpi_ctx.rank == mpi_ctx.world_size - 1) fputs("\n]\n", f);
+        fclose(f);
+
+        char zones_path[512];
+        snprintf(zones_path, sizeof(zones_path), "%s/zones.json", config.output_dir);
+        if (!mpi_write_ordered(&mpi_ctx, zones_path, zones, zones_size))
+            main_printf(&mpi_ctx, "ERROR: Could not write %s\n", zones_path);
+        free(zones);
+    }
 
-        print_training_summary(&metrics, &mpi_ctx, &config);
+    if (config.output_dir != NULL && mpi_ctx.rank == 0) {
+        char results_path[512];
+        snprintf(results_path, sizeof(results_path), "%s/weights.bin", config.output_dir);
+        save_mlp_weights(policy.mlp, results_path);
     }
 
-    free_mlp_cache(&cache);
-    free_buffer(&buffer);
-    free_adam_state(&optimizer_state);
+    if (mpi_ctx.rank == 0) {
+        if (config.render) render_episode(&trainer.env, &policy);
+
+        print_training_summary(metrics, &mpi_ctx, &config);
+    }
 
-    free_mlp(policy.mlp);
-    env_destroy(&env);
+    free_trainer(&trainer);
 
-    mpi_finalize();
+    mpi_finalize(&mpi_ctx);
 
     return 0;
 }
@@ -378,105 +550,182 @@ void render_episode(Env *env, Policy *policy) {
     free(act);
 }
 
+// Mean over ranks, slowest rank and max/mean imbalance of one per-rank quantity
+static void print_rank_stat(const char *label, const RankStat *stat, int world_size) {
+    double mean = stat->sum / world_size;
+
+    fprintf(stdout, "  %-19s %8.3f s   %8.3f s   rank %-4d %6.2fx\n",
+        label, mean, stat->max, stat->argmax, mean > 0 ? stat->max / mean : 1.0);
+}
+
 void print_training_summary(TrainingMetrics *metrics, MPIContext *mpi_ctx, Config *config) {
     if (mpi_ctx->rank != 0) return;
     
     // Set locale for number formatting
     setlocale(LC_NUMERIC, "");
 
-    int updates_total = metrics->updates_capacity;
-    int episodes_per_rank = updates_total * metrics->num_episodes;
-
-    double time_rollout_total = 0.0;
-    double time_forward_total = 0.0;
-    double time_backward_total = 0.0;
-    double time_update_total = 0.0;
-    double time_comm_total = 0.0;
-    double time_step_total = 0.0;
-    for (int i = 0; i < updates_total; i++) {
-        time_rollout_total += metrics->rollout_times[i];
-        time_forward_total += metrics->forward_times[i];
-        time_backward_total += metrics->backward_times[i];
-        time_update_total += metrics->update_times[i];
-        time_comm_total += metrics->comm_times[i];
-        time_step_total += metrics->step_times[i];
-    }
+    const MetricsAggregates *totals = &metrics->totals;
+    const RankStat *stats = metrics->stats;
+    int world_size = mpi_ctx->world_size;
 
-    double total_compute = time_forward_total + time_backward_total + 
-                          time_update_total + time_rollout_total;
-
-    double comm_ratio = metrics->wall_time_train > 0 ? 
-                       (time_comm_total / metrics->wall_time_train) * 100 : 0;
-    double compute_ratio = metrics->wall_time_train > 0 ? 
-                          (total_compute / metrics->wall_time_train) * 100 : 0;
-
-    int steps_total = 0;
-    double returns_sum = 0.0;
-    double returns_min = metrics->returns[0];
-    double returns_max = metrics->returns[0];
-    for (int i = 0; i < updates_total * metrics->num_episodes; i++) {
-        returns_sum += metrics->returns[i];
-        if (metrics->returns[i] < returns_min) returns_min = metrics->returns[i];
-        if (metrics->returns[i] > returns_max) returns_max = metrics->returns[i];
-        steps_total += metrics->steps[i];
-    }
+    long updates_total = totals->updates;
+    long episodes_total = totals->episodes;
+    long steps_total = totals->env_steps;
 
-    double avg_return = episodes_per_rank > 0 ? returns_sum / episodes_per_rank : 0.0;
-    double variance_acc = 0.0;
-    for (int i = 0; i < updates_total * metrics->num_episodes; i++) {
-        double diff = metrics->returns[i] - avg_return;
-        variance_acc += diff * diff;
-    }
-    double return_variance = episodes_per_rank > 0 ? variance_acc / episodes_per_rank : 0.0;
+    // Per-rank means; the run lasts as long as its slowest rank
+    double time_rollout = totals->rollout_time / world_size;
+    double time_forward = totals->forward_time / world_size;
+    double time_backward = totals->backward_time / world_size;
+    double time_update = totals->update_time / world_size;
+    double time_comm = totals->comm_time / world_size;
+    double wall_train = stats[STAT_WALL_TRAIN].max;
+    double wall_total = stats[STAT_WALL_TOTAL].max;
+    double mean_wall_train = stats[STAT_WALL_TRAIN].sum / world_size;
+
+    double total_compute = time_forward + time_backward + time_update + time_rollout;
+
+    double comm_ratio = mean_wall_train > 0 ? (time_comm / mean_wall_train) * 100 : 0;
+    double compute_ratio = mean_wall_train > 0 ? (total_compute / mean_wall_train) * 100 : 0;
 
-    double steps_per_second = metrics->wall_time_train > 0 ? 
-                             steps_total / metrics->wall_time_train : 0;
-    double episodes_per_second = metrics->wall_time_train > 0 ? 
-                                mpi_ctx->world_size * episodes_per_rank / metrics->wall_time_train : 0;
+    double avg_return = episodes_total > 0 ? totals->return_sum / episodes_total : 0.0;
+    double return_variance = episodes_total > 0 ? totals->return_sq_sum / episodes_total - avg_return * avg_return : 0.0;
+    if (return_variance < 0.0) return_variance = 0.0;
+
+    double steps_per_second = wall_train > 0 ? steps_total / wall_train : 0;
+    double episodes_per_second = wall_train > 0 ? episodes_total / wall_train : 0;
     
-    double avg_episode_length = episodes_per_rank > 0 ? 
-                               (double)steps_total / (episodes_per_rank * mpi_ctx->world_size) : 0;
+    double avg_episode_length = episodes_total > 0 ? 
+                               (double)steps_total / episodes_total : 0;
 
     fprintf(stdout, "\n");
     fprintf(stdout, "=========================================================\n");
     fprintf(stdout, "              TRAINING SUMMARY REPORT                    \n");
     fprintf(stdout, "=========================================================\n");
     fprintf(stdout, "Environment:          %s\n", config->env_name);
-    fprintf(stdout, "MPI Processes:        %d\n", mpi_ctx->world_size);
-    fprintf(stdout, "Gradient Steps:       %d\n", updates_total);
+    fprintf(stdout, "Algorithm:            %s\n", config->algo);
+    fprintf(stdout, "MPI Processes:        %d\n", world_size);
+    fprintf(stdout, "Gradient Steps:       %ld\n", updates_total);
     fprintf(stdout, "Episodes per Step:    %d\n", config->episodes);
-    fprintf(stdout, "\n--- WALL TIME BREAKDOWN ---\n");
-        fprintf(stdout, "  Total Time:         %.3f s\n", metrics->wall_time_total);
-        fprintf(stdout, "  Training:           %.3f s (%.1f%%)\n", 
-            metrics->wall_time_train,
-            (metrics->wall_time_total > 0 ? (metrics->wall_time_train / metrics->wall_time_total) * 100 : 0));
-
-    fprintf(stdout, "\n--- TRAINING TIME BREAKDOWN ---\n");
+    fprintf(stdout, "\n--- WALL TIME BREAKDOWN (slowest rank) ---\n");
+        fprintf(stdout, "  Total Time:         %.3f s (rank %d)\n", wall_total, stats[STAT_WALL_TOTAL].argmax);
+        fprintf(stdout, "  Training:           %.3f s (%.1f%%, rank %d)\n", 
+            wall_train,
+            (wall_total > 0 ? (wall_train / wall_total) * 100 : 0),
+            stats[STAT_WALL_TRAIN].argmax);
+
+    fprintf(stdout, "\n--- TRAINING TIME BREAKDOWN (mean per rank) ---\n");
         fprintf(stdout, "  Communication:      %.3f s (%.1f%%)\n", 
-            time_comm_total, comm_ratio);
+            time_comm, comm_ratio);
         fprintf(stdout, "  Computation:        %.3f s (%.1f%%)\n", 
             total_compute, compute_ratio);
-        fprintf(stdout, "    - Rollout:        %.3f s\n", time_rollout_total);
-        fprintf(stdout, "    - Forward Pass:   %.3f s\n", time_forward_total);
-        fprintf(stdout, "    - Backward Pass:  %.3f s\n", time_backward_total);
-        fprintf(stdout, "    - Optimizer:      %.3f s\n", time_update_total);
+        fprintf(stdout, "    - Rollout:        %.3f s\n", time_rollout);
+        fprintf(stdout, "    - Forward Pass:   %.3f s\n", time_forward);
+        fprintf(stdout, "    - Backward Pass:  %.3f s\n", time_backward);
+        fprintf(stdout, "    - Optimizer:      %.3f s\n", time_update);
+        fprintf(stdout, "  Step Time p50/p99:  %.3f / %.3f ms\n",
+            metrics_step_time_quantile(totals, 0.50) * 1e3, metrics_step_time_quantile(totals, 0.99) * 1e3);
+
+    fprintf(stdout, "\n--- LOAD BALANCE (per phase) ---\n");
+    fprintf(stdout, "  %-19s %10s   %10s   %-9s %7s\n", "", "mean", "max", "slowest", "max/mean");
+        print_rank_stat("Training:", &stats[STAT_WALL_TRAIN], world_size);
+        print_rank_stat("Communication:", &stats[STAT_COMM], world_size);
+        print_rank_stat("Rollout:", &stats[STAT_ROLLOUT], world_size);
+        print_rank_stat("Forward Pass:", &stats[STAT_FORWARD], world_size);
+        print_rank_stat("Backward Pass:", &stats[STAT_BACKWARD], world_size);
+        print_rank_stat("Optimizer:", &stats[STAT_UPDATE], world_size);
     
     fprintf(stdout, "\n--- THROUGHPUT METRICS ---\n");
-    fprintf(stdout, "  Total Episodes:     %d\n", episodes_per_rank * mpi_ctx->world_size);
-    fprintf(stdout, "  Total Steps:        %'d\n", steps_total);
+    fprintf(stdout, "  Total Episodes:     %ld\n", episodes_total);
+    fprintf(stdout, "  Total Steps:        %'ld\n", steps_total);
     fprintf(stdout, "  Avg Episode Length: %.1f steps\n", avg_episode_length);
     fprintf(stdout, "  Episodes/second:    %'.2f\n", episodes_per_second);
     fprintf(stdout, "  Steps/second:       %'.2f\n", steps_per_second);
     
     fprintf(stdout, "\n--- LEARNING/CONVERGENCE METRICS ---\n");
     fprintf(stdout, "  Avg Return:         %.2f\n", avg_return);
-    fprintf(stdout, "  Min Return:         %.2f\n", returns_min);
-    fprintf(stdout, "  Max Return:         %.2f\n", returns_max);
+    fprintf(stdout, "  Min Return:         %.2f\n", totals->return_min);
+    fprintf(stdout, "  Max Return:         %.2f\n", totals->return_max);
     fprintf(stdout, "  Return Std Dev:     %.2f\n", sqrt(return_variance));
     
+    fprintf(stdout, "\n--- MEMORY ---\n");
+    fprintf(stdout, "  Activation Cache:   %.1f KiB per rank\n", metrics->cache_bytes / 1024.0);
+    fprintf(stdout, "  Metrics Window:     %d updates, %.1f KiB per rank\n", metrics->window, metrics_bytes(metrics) / 1024.0);
+    if (metrics->checkpoint_every > 1)
+        fprintf(stdout, "  Rematerialization:  checkpoint every %d layers (+1 forward per backward)\n",
+                metrics->checkpoint_every);
+    else
+        fprintf(stdout, "  Rematerialization:  disabled\n");
+
+    if (updates_total > 0) {
+        const CommBaseline *baseline = &metrics->comm_baseline;
+        static const char *collectives[METRICS_N_COLLECTIVES] = {"Broadcast", "Reduce"};
+
+        fprintf(stdout, "\n--- COLLECTIVES (mean per call and rank) ---\n");
+        if (baseline->bandwidth > 0)
+            fprintf(stdout, "  Ping-pong Baseline: %.2f us + bytes / %.1f MB/s (latency-bound below %.1f KiB)\n",
+                baseline->latency * 1e6, baseline->bandwidth * 1e-6, baseline->latency * baseline->bandwidth / 1024.0);
+        else
+            fprintf(stdout, "  Ping-pong Baseline: n/a (single rank)\n");
+
+        fprintf(stdout, "  %-15s %10s %9s %9s %9s %12s %9s  %s\n", "", "bytes", "pack", "MPI", "unpack", "achieved", "model", "bound");
+        for (int c = 0; c < METRICS_N_COLLECTIVES; c++) {
+            const CommStats *cs = &totals->collectives[c];
+            double calls = (double)updates_total * world_size;
+            double bytes = cs->bytes / calls, mpi = cs->mpi / calls;
+
+            fprintf(stdout, "  %-15s %10.0f %6.2f us %6.2f us %6.2f us", collectives[c],
+                bytes, cs->pack / calls * 1e6, mpi * 1e6, cs->unpack / calls * 1e6);
+            if (mpi > 0) fprintf(stdout, " %7.1f MB/s", bytes / mpi * 1e-6);
+            else fprintf(stdout, " %12s", "n/a");
+            if (baseline->bandwidth > 0)
+                fprintf(stdout, " %6.2f us  %s\n", comm_model_time(baseline, bytes) * 1e6,
+                    bytes < baseline->latency * baseline->bandwidth ? "latency" : "bandwidth");
+            else
+                fprintf(stdout, " %9s  %s\n", "n/a", "n/a");
+        }
+    }
+
+    if (stats[STAT_COUNTER_RANKS].sum > 0) {
+        // Per env step of the ranks that had counters
+        double counted_steps = stats[STAT_COUNTER_ENV_STEPS].sum;
+        static const char *phases[METRICS_N_PHASES] = {"Step", "Communication", "Rollout", "Forward Pass", "Backward Pass", "Optimizer"};
+
+        fprintf(stdout, "\n--- HARDWARE COUNTERS (%d of %d ranks, per env step) ---\n",
+            (int)stats[STAT_COUNTER_RANKS].sum, world_size);
+        fprintf(stdout, "  %-15s %6s %12s %12s %12s %12s\n", "", "IPC", "cycles", "L1D miss", "LLC miss", "branch miss");
+        for (int p = 0; p < METRICS_N_PHASES; p++) {
+            const double *c = totals->counters[p];
+            fprintf(stdout, "  %-15s", phases[p]);
+            if (c[COUNTER_CYCLES] > 0 && c[COUNTER_INSTRUCTIONS] > 0)
+                fprintf(stdout, " %6.2f", c[COUNTER_INSTRUCTIONS] / c[COUNTER_CYCLES]);
+            else
+                fprintf(stdout, " %6s", "n/a");
+            for (int k = 0; k < N_COUNTERS; k++) {
+                if (k == COUNTER_INSTRUCTIONS) continue;
+                if (counted_steps > 0 && c[k] > 0) fprintf(stdout, " %12.1f", c[k] / counted_steps);
+                else fprintf(stdout, " %12s", "n/a");
+            }
+            fprintf(stdout, "\n");
+        }
+    }
+
+    if (trace_enabled) {
+        double zone_seconds[TRACE_N_ZONES];
+        uint64_t zone_counts[TRACE_N_ZONES];
+        trace_zone_stats(zone_seconds, zone_counts);
+
+        fprintf(stdout, "\n--- HOT PATH ZONES (rank 0) ---\n");
+        fprintf(stdout, "  %-19s %12s %12s %12s\n", "", "count", "total", "mean");
+        for (int z = 0; z < TRACE_N_ZONES; z++) {
+            if (zone_counts[z] == 0) continue;
+            fprintf(stdout, "  %-19s %12lu %10.3f s %9.0f ns\n", trace_zone_name(z), (unsigned long)zone_counts[z],
+                zone_seconds[z], zone_seconds[z] / zone_counts[z] * 1e9);
+        }
+    }
+
     fprintf(stdout, "\n--- SCALABILITY METRICS ---\n");
     fprintf(stdout, "  Comm/Compute Ratio: %.2f%%\n", 
-                total_compute > 0 ? (time_comm_total / total_compute) * 100 : 0);
+                total_compute > 0 ? (time_comm / total_compute) * 100 : 0);
             fprintf(stdout, "  Parallel Efficiency: %.1f%%\n",
                 compute_ratio);
     fprintf(stdout, "\n=========================================================\n\n");
@@ -2,87 +2,618 @@
 #include <stdio.h>
 #include <string.h>
 #include <math.h>
+#include <unistd.h>
+#include <stddef.h>
 
+#include "trace.h"
+#include "timeline.h"
 #include "metrics.h"
 
-TrainingMetrics create_metrics(int grad_steps, int n_episodes) {
+struct MetricsStream {
+    TimelineWriter timeline;    // written from the main thread (MPI-IO)
+    FILE *results;          // root only
+    int rank;
+    int world_size;
+    int root;
+
+    // Shallow copy of the ring: sizes and array pointers
+    TrainingMetrics ring;
+
+    // Block of updates [begin, end) being written
+    long begin, end;
+    int busy;
+    int stop;
+
+    // Episode results of the block, reduced over ranks: [returns | loss] and steps
+    float *block_values;
+    int *block_steps;
+
+    // Chrome trace (root): aligned (start, duration) pairs per rank, update and event
+    FILE *trace;
+    double *trace_values;
+    double trace_base;
+    double clock_offset;
+    int trace_count;
+
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+};
+
+/*
+ * Trace events per update. Each event sits on its phase's track; broadcast and reduce
+ * are the two halves of comm and share its track.
+ */
+static const struct { const char *name; int track; } trace_events[] = {
+    {"step", 0}, {"broadcast", 1}, {"rollout", 2}, {"forward", 3},
+    {"backward", 4}, {"reduce", 1}, {"update", 5},
+};
+// Phase names (METRICS_N_PHASES), also the trace tracks
+static const char *phase_names[] = {"step", "comm", "rollout", "forward", "backward", "update"};
+// Timeline row kinds: the phases, then the collectives
+static const char *row_kinds[] = {"step", "comm", "rollout", "forward", "backward", "update", "broadcast", "reduce"};
+#define TIMELINE_ROWS (METRICS_N_PHASES + METRICS_N_COLLECTIVES)
+
+enum { COL_UPDATE, COL_KIND, COL_START, COL_DURATION, COL_BYTES, COL_PACK, COL_MPI, COL_UNPACK, COL_COUNTERS };
+#define TRACE_EVENTS 7
+#define TRACE_VALUES (2 * TRACE_EVENTS)
+
+TrainingMetrics create_metrics(int window, int n_episodes) {
     TrainingMetrics metrics = {0};
 
-    metrics.updates_capacity = grad_steps;
+    if (window < 1) window = 1;
+
+    metrics.window = window;
     metrics.num_episodes = n_episodes;
 
-    metrics.returns = calloc(grad_steps * n_episodes, sizeof(float));
-    metrics.steps = calloc(grad_steps * n_episodes, sizeof(int));
-    metrics.loss = calloc(grad_steps * n_episodes, sizeof(float));
+    metrics.returns = calloc(window * n_episodes, sizeof(float));
+    metrics.steps = calloc(window * n_episodes, sizeof(int));
+    metrics.loss = calloc(window * n_episodes, sizeof(float));
 
-    // Size [updates]
+    // Size [window]
 
-    metrics.step_times = calloc(grad_steps, sizeof(double));
-    metrics.comm_times = calloc(grad_steps, sizeof(double));
-    metrics.rollout_times = calloc(grad_steps, sizeof(double));
-    metrics.forward_times = calloc(grad_steps, sizeof(double));
-    metrics.backward_times = calloc(grad_steps, sizeof(double));
-    metrics.update_times = calloc(grad_steps, sizeof(double));
+    metrics.step_times = calloc(window, sizeof(double));
+    metrics.comm_times = calloc(window, sizeof(double));
+    metrics.rollout_times = calloc(window, sizeof(double));
+    metrics.forward_times = calloc(window, sizeof(double));
+    metrics.backward_times = calloc(window, sizeof(double));
+    metrics.update_times = calloc(window, sizeof(double));
+    metrics.bcast_times = calloc(window, sizeof(double));
+    metrics.reduce_times = calloc(window, sizeof(double));
 
     // Starts
-    metrics.step_starts = calloc(grad_steps, sizeof(double));
-    metrics.comm_starts = calloc(grad_steps, sizeof(double));
-    metrics.rollout_starts = calloc(grad_steps, sizeof(double));
-    metrics.forward_starts = calloc(grad_steps, sizeof(double));
-    metrics.backward_starts = calloc(grad_steps, sizeof(double));
-    metrics.update_starts = calloc(grad_steps, sizeof(double));
+    metrics.step_starts = calloc(window, sizeof(double));
+    metrics.comm_starts = calloc(window, sizeof(double));
+    metrics.rollout_starts = calloc(window, sizeof(double));
+    metrics.forward_starts = calloc(window, sizeof(double));
+    metrics.backward_starts = calloc(window, sizeof(double));
+    metrics.update_starts = calloc(window, sizeof(double));
+    metrics.bcast_starts = calloc(window, sizeof(double));
+    metrics.reduce_starts = calloc(window, sizeof(double));
+
+    metrics.comm_stats = calloc(window * METRICS_N_COLLECTIVES, sizeof(CommStats));
+
+    metrics.totals.return_min = INFINITY;
+    metrics.totals.return_max = -INFINITY;
 
     return metrics;
 }
 
-void write_metrics_timeline_csv(const TrainingMetrics *metrics, const MPIContext *mpi_ctx, const char *filepath) {
-    FILE *f = fopen(filepath, "w");
-    if (!f) return;
+void metrics_set_episodes(TrainingMetrics *metrics, int n_episodes) {
+    int window = metrics->window;
+
+    free(metrics->returns);
+    free(metrics->steps);
+    free(metrics->loss);
+
+    metrics->num_episodes = n_episodes;
+    metrics->returns = calloc(window * n_episodes, sizeof(float));
+    metrics->steps = calloc(window * n_episodes, sizeof(int));
+    metrics->loss = calloc(window * n_episodes, sizeof(float));
+}
+
+size_t metrics_bytes(const TrainingMetrics *metrics) {
+    size_t episodes = (size_t)metrics->window * metrics->num_episodes;
+    size_t bytes = 16 * metrics->window * sizeof(double) + episodes * (2 * sizeof(float) + sizeof(int));
+    bytes += (size_t)metrics->window * METRICS_N_COLLECTIVES * sizeof(CommStats);
+
+    if (metrics->phase_counters)
+        bytes += (size_t)metrics->window * METRICS_N_PHASES * N_COUNTERS * sizeof(uint64_t);
+
+    // The root also keeps the reduced results (and gathered trace events) of one block
+    if (metrics->stream) {
+        bytes += episodes * (2 * sizeof(float) + sizeof(int));
+        bytes += timeline_bytes(&metrics->stream->timeline);
+        if (metrics->stream->trace)
+            bytes += (size_t)metrics->stream->world_size * metrics->window * TRACE_VALUES * sizeof(double);
+    }
+
+    return bytes;
+}
+
+static inline int flush_every(const TrainingMetrics *metrics) {
+    return metrics->window > 1 ? metrics->window / 2 : 1;
+}
+
+/***************************
+ *      Stream writer      *
+ ***************************/
+
+static void write_block(MetricsStream *s, long begin, long end) {
+    const TrainingMetrics *m = &s->ring;
+    int episodes = m->num_episodes;
+
+    if (s->trace) {
+        int n = (int)(end - begin);
+
+        for (int r = 0; r < s->world_size; r++) {
+            for (int k = 0; k < n; k++) {
+                const double *v = s->trace_values + ((size_t)r * n + k) * TRACE_VALUES;
+
+                for (int e = 0; e < TRACE_EVENTS; e++) {
+                    if (v[2 * e] == 0.0) continue;  // phase did not run
+
+                    fprintf(s->trace, "%s{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":%d,"
+                            "\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"update\":%ld}}",
+                            s->trace_count++ ? ",\n" : "", trace_events[e].name, phase_names[trace_events[e].track],
+                            r, trace_events[e].track, (v[2 * e] - s->trace_base) * 1e6, v[2 * e + 1] * 1e6, begin + k);
+                }
+            }
+        }
+        fflush(s->trace);
+    }
+
+    if (!s->results) return;
+
+    int n = (int)(end - begin) * episodes;
+    for (int k = 0; k < n; k++) {
+        fprintf(s->results, "%ld,%d,%.9f,%d,%.9f\n",
+                begin + k / episodes, k % episodes, s->block_values[k], s->block_steps[k], s->block_values[n + k]);
+    }
+    fflush(s->results);
+}
+
+static void *stream_loop(void *arg) {
+    MetricsStream *s = arg;
+
+    pthread_mutex_lock(&s->lock);
+    for (;;) {
+        while (!s->busy && !s->stop)
+            pthread_cond_wait(&s->cond, &s->lock);
+
+        if (!s->busy) break;
+
+        long begin = s->begin, end = s->end;
+        pthread_mutex_unlock(&s->lock);
+
+        write_block(s, begin, end);
+
+        pthread_mutex_lock(&s->lock);
+        s->busy = 0;
+        pthread_cond_broadcast(&s->cond);
+    }
+    pthread_mutex_unlock(&s->lock);
+
+    return NULL;
+}
+
+// Drops the rows of updates >= resume_step (column `field` holds the update index)
+static FILE *open_for_resume(const char *path, const char *header, int field, int resume_step) {
+    FILE *f = resume_step > 0 ? fopen(path, "r+") : NULL;
+
+    if (!f) {
+        f = fopen(path, "w");
+        if (f) fputs(header, f);
+        return f;
+    }
+
+    char line[512];
+    long keep = 0;
+    if (fgets(line, sizeof(line), f)) keep = ftell(f);
+
+    while (fgets(line, sizeof(line), f)) {
+        const char *p = line;
+        for (int c = 0; c < field && p; c++) {
+            p = strchr(p, ',');
+            if (p) p++;
+        }
+
+        if (!p || atol(p) >= resume_step) break;
+        keep = ftell(f);
+    }
+
+    fflush(f);
+    if (ftruncate(fileno(f), keep) != 0) {
+        fclose(f);
+        return NULL;
+    }
+    fseek(f, 0, SEEK_END);
+    return f;
+}
+
+// Fills and starts writing the timeline block of updates [begin, end). Collective.
+static void write_timeline(MetricsStream *s, const TrainingMetrics *m, long begin, long end) {
+    int rows = (int)(end - begin) * TIMELINE_ROWS;
+    TimelineValue *v = timeline_block(&s->timeline, rows);
+
+#define COLUMN(c) (v + (size_t)(c) * rows)
+    for (long u = begin; u < end; u++) {
+        int i = (int)(u % m->window);
+
+        // comm is broadcast + reduce; rollout/forward/backward/update start at the first
+        // episode and accumulate over episodes
+        const double starts[TIMELINE_ROWS] = {
+            m->step_starts[i], m->comm_starts[i], m->rollout_starts[i], m->forward_starts[i],
+            m->backward_starts[i], m->update_starts[i], m->bcast_starts[i], m->reduce_starts[i],
+        };
+        const double durations[TIMELINE_ROWS] = {
+            m->step_times[i], m->comm_times[i], m->rollout_times[i], m->forward_times[i],
+            m->backward_times[i], m->update_times[i], m->bcast_times[i], m->reduce_times[i],
+        };
+
+        for (int r = 0; r < TIMELINE_ROWS; r++) {
+            int k = (int)(u - begin) * TIMELINE_ROWS + r;
+            COLUMN(COL_UPDATE)[k].i = u;
+            COLUMN(COL_KIND)[k].i = r;
+            COLUMN(COL_START)[k].f = starts[r];
+            COLUMN(COL_DURATION)[k].f = durations[r];
+
+            // Collectives carry their byte count and cost split, phases their counters
+            if (r >= METRICS_N_PHASES) {
+                const CommStats *cs = &m->comm_stats[i * METRICS_N_COLLECTIVES + r - METRICS_N_PHASES];
+                COLUMN(COL_BYTES)[k].i = (int64_t)cs->bytes;
+                COLUMN(COL_PACK)[k].f = cs->pack;
+                COLUMN(COL_MPI)[k].f = cs->mpi;
+                COLUMN(COL_UNPACK)[k].f = cs->unpack;
+            } else {
+                COLUMN(COL_BYTES)[k].i = INT64_MIN;
+                COLUMN(COL_PACK)[k].f = COLUMN(COL_MPI)[k].f = COLUMN(COL_UNPACK)[k].f = NAN;
+            }
+
+            if (m->phase_counters) {
+                const uint64_t *c = m->phase_counters + ((size_t)i * METRICS_N_PHASES + r) * N_COUNTERS;
+                for (int n = 0; n < N_COUNTERS; n++)
+                    COLUMN(COL_COUNTERS + n)[k].u = r < METRICS_N_PHASES ? c[n] : UINT64_MAX;
+            }
+        }
+    }
+#undef COLUMN
+
+    timeline_write_block(&s->timeline, begin, end - begin);
+}
+
+static FILE *open_trace(const char *path, int world_size) {
+    FILE *f = fopen(path, "w");
+    if (!f) return NULL;
+
+    // JSON array format: the closing bracket is optional, so a crashed run stays readable
+    fputs("[\n", f);
+    for (int r = 0; r < world_size; r++) {
+        fprintf(f, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"rank %d\"}},\n", r, r);
+        fprintf(f, "{\"name\":\"process_sort_index\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"sort_index\":%d}},\n", r, r);
+        for (int t = 0; t < METRICS_N_PHASES; t++)
+            fprintf(f, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"%s\"}},\n",
+                    r, t, phase_names[t]);
+    }
+
+    return f;
+}
+
+int metrics_open_stream(TrainingMetrics *metrics, const MPIContext *mpi_ctx, const char *dir, int resume_step, int trace) {
+    MetricsStream *s = calloc(1, sizeof(MetricsStream));
+    char path[600];
+
+    s->rank = mpi_ctx->rank;
+    s->world_size = mpi_ctx->world_size;
+    s->root = 0;
+    s->ring = *metrics;
+
+    TimelineColumn columns[COL_COUNTERS + N_COUNTERS] = {
+        {"update", TIMELINE_INT}, {"phase", TIMELINE_INT}, {"start", TIMELINE_FLOAT}, {"duration", TIMELINE_FLOAT},
+        {"bytes", TIMELINE_INT}, {"pack", TIMELINE_FLOAT}, {"mpi", TIMELINE_FLOAT}, {"unpack", TIMELINE_FLOAT},
+    };
+    int n_columns = COL_COUNTERS;
+    if (metrics->phase_counters) {
+        for (int c = 0; c < N_COUNTERS; c++) {
+            strncpy(columns[n_columns].name, perf_counter_name(c), sizeof(columns[n_columns].name) - 1);
+            columns[n_columns++].type = TIMELINE_UINT;
+        }
+    }
+
+    snprintf(path, sizeof(path), "%s/training_timeline.bin", dir);
+    int timeline_ok = timeline_open(&s->timeline, mpi_ctx, path, columns, n_columns, row_kinds, TIMELINE_ROWS, resume_step);
+
+    int ok = timeline_ok;
+    if (s->rank == s->root) {
+        snprintf(path, sizeof(path), "%s/training_results.csv", dir);
+        s->results = open_for_resume(path, "grad_step,episode,returns,steps,loss\n", 0, resume_step);
+        ok = ok && s->results != NULL;
+
+        if (trace) {
+            snprintf(path, sizeof(path), "%s/trace.json", dir);
+            s->trace = open_trace(path, s->world_size);
+            ok = ok && s->trace != NULL;
+        }
+    }
+
+    int block = flush_every(metrics) * metrics->num_episodes;
+    s->block_values = malloc(2 * block * sizeof(float));
+    s->block_steps = malloc(block * sizeof(int));
+
+    // Every rank packs its events; only the root needs room for all of them
+    s->clock_offset = mpi_ctx->clock_offset;
+    s->trace_base = get_time() + s->clock_offset;
+    MPI_Bcast(&s->trace_base, 1, MPI_DOUBLE, s->root, mpi_ctx->comm);
+    if (trace) {
+        size_t ranks = s->rank == s->root ? s->world_size : 1;
+        s->trace_values = malloc(ranks * flush_every(metrics) * TRACE_VALUES * sizeof(double));
+    }
+
+    pthread_mutex_init(&s->lock, NULL);
+    pthread_cond_init(&s->cond, NULL);
+    ok = ok && pthread_create(&s->thread, NULL, stream_loop, s) == 0;
+
+    int all_ok;
+    MPI_Allreduce(&ok, &all_ok, 1, MPI_INT, MPI_MIN, mpi_ctx->comm);
+
+    if (!all_ok) {
+        if (!ok) fprintf(stderr, "Rank %d: could not open the metrics stream in %s.\n", s->rank, dir);
+        if (ok) {
+            pthread_mutex_lock(&s->lock);
+            s->stop = 1;
+            pthread_cond_broadcast(&s->cond);
+            pthread_mutex_unlock(&s->lock);
+            pthread_join(s->thread, NULL);
+        }
+        if (timeline_ok) timeline_close(&s->timeline);
+        if (s->results) fclose(s->results);
+        if (s->trace) fclose(s->trace);
+        pthread_mutex_destroy(&s->lock);
+        pthread_cond_destroy(&s->cond);
+        free(s->block_values);
+        free(s->block_steps);
+        free(s->trace_values);
+        free(s);
+        return 0;
+    }
+
+    metrics->stream = s;
+    return 1;
+}
+
+/***************************
+ *        Recording        *
+ ***************************/
+
+int metrics_begin_update(TrainingMetrics *metrics) {
+    long u = metrics->updates++;
+    int i = (int)(u % metrics->window);
+
+    MetricsStream *s = metrics->stream;
+    if (s) {
+        // The slot may still hold an update of the block being written
+        pthread_mutex_lock(&s->lock);
+        while (s->busy && u >= s->begin + metrics->window)
+            pthread_cond_wait(&s->cond, &s->lock);
+        pthread_mutex_unlock(&s->lock);
+    }
+
+    int episodes = metrics->num_episodes;
+    memset(metrics->returns + i * episodes, 0, episodes * sizeof(float));
+    memset(metrics->steps + i * episodes, 0, episodes * sizeof(int));
+    memset(metrics->loss + i * episodes, 0, episodes * sizeof(float));
+
+    metrics->step_times[i] = metrics->comm_times[i] = metrics->rollout_times[i] = 0.0;
+    metrics->forward_times[i] = metrics->backward_times[i] = metrics->update_times[i] = 0.0;
+    metrics->step_starts[i] = metrics->comm_starts[i] = metrics->rollout_starts[i] = 0.0;
+    metrics->forward_starts[i] = metrics->backward_starts[i] = metrics->update_starts[i] = 0.0;
+    metrics->bcast_times[i] = metrics->reduce_times[i] = 0.0;
+    metrics->bcast_starts[i] = metrics->reduce_starts[i] = 0.0;
+    memset(metrics->comm_stats + i * METRICS_N_COLLECTIVES, 0, METRICS_N_COLLECTIVES * sizeof(CommStats));
+
+    if (metrics->phase_counters) {
+        size_t n = METRICS_N_PHASES * N_COUNTERS;
+        memset(metrics->phase_counters + i * n, 0, n * sizeof(uint64_t));
+    }
 
-    fprintf(f, "rank,update,phase,start,duration\n");
-    int updates = metrics->updates_capacity;
-    int rank = mpi_ctx ? mpi_ctx->rank : 0;
+    return i;
+}
+
+int metrics_open_counters(TrainingMetrics *metrics) {
+    PerfCounters *perf = malloc(sizeof(PerfCounters));
 
-    for (int i = 0; i < updates; i++) {
-        // step
-        fprintf(f, "%d,%d,step,%.9f,%.9f\n", rank, i, metrics->step_starts[i], metrics->step_times[i]);
-        // comm (combined broadcast + reduce)
-        fprintf(f, "%d,%d,comm,%.9f,%.9f\n", rank, i, metrics->comm_starts[i], metrics->comm_times[i]);
-        // rollout/forward/backward/update (first-episode starts; durations accumulated)
-        fprintf(f, "%d,%d,rollout,%.9f,%.9f\n", rank, i, metrics->rollout_starts[i], metrics->rollout_times[i]);
-        fprintf(f, "%d,%d,forward,%.9f,%.9f\n", rank, i, metrics->forward_starts[i], metrics->forward_times[i]);
-        fprintf(f, "%d,%d,backward,%.9f,%.9f\n", rank, i, metrics->backward_starts[i], metrics->backward_times[i]);
-        fprintf(f, "%d,%d,update,%.9f,%.9f\n", rank, i, metrics->update_starts[i], metrics->update_times[i]);
+    int n_open = perf_counters_open(perf);
+    if (n_open == 0) {
+        free(perf);
+        return 0;
     }
 
-    fclose(f);
+    metrics->perf = perf;
+    metrics->phase_counters = calloc((size_t)metrics->window * METRICS_N_PHASES * N_COUNTERS, sizeof(uint64_t));
+    return n_open;
+}
+
+void metrics_counter_mark(const TrainingMetrics *metrics, uint64_t mark[N_COUNTERS]) {
+    if (metrics->perf) perf_counters_read(metrics->perf, mark);
 }
 
-void write_metrics_results_csv(const TrainingMetrics *metrics, const MPIContext *mpi_ctx, const char *filepath) {
-    FILE *f = fopen(filepath, "w");
-    if (!f) return;
+void metrics_count_phase(TrainingMetrics *metrics, int slot, int phase, const uint64_t mark[N_COUNTERS]) {
+    if (!metrics->perf) return;
 
-    int updates = metrics->updates_capacity;
+    uint64_t now[N_COUNTERS];
+    perf_counters_read(metrics->perf, now);
+
+    uint64_t *c = metrics->phase_counters + ((size_t)slot * METRICS_N_PHASES + phase) * N_COUNTERS;
+    for (int k = 0; k < N_COUNTERS; k++)
+        c[k] += now[k] - mark[k];
+}
+
+static int hist_bucket(double seconds) {
+    if (seconds <= 1e-6) return 0;
+
+    int b = (int)floor(4.0 * log2(seconds * 1e6));
+    return b < METRICS_HIST_BUCKETS ? b : METRICS_HIST_BUCKETS - 1;
+}
+
+static void hand_off(TrainingMetrics *metrics, const MPIContext *mpi_ctx) {
+    MetricsStream *s = metrics->stream;
+    long begin = metrics->flushed, end = metrics->updates;
+
+    if (end == begin) return;
+
+    pthread_mutex_lock(&s->lock);
+    while (s->busy)
+        pthread_cond_wait(&s->cond, &s->lock);
+    pthread_mutex_unlock(&s->lock);
+
+    // Gather the block's episodes (the ring may wrap) and average them over ranks
     int episodes = metrics->num_episodes;
-    (void)mpi_ctx; // unused for averages removal
-
-    fprintf(f, "grad_step,episode,returns,steps,loss\n");
-
-    for (int gs = 0; gs < updates; gs++) {
-        for (int ep = 0; ep < episodes; ep++) {
-            int idx = gs * episodes + ep;
-            double ret_val = metrics->returns[idx];
-            int steps_val = metrics->steps[idx];
-            double loss_val = metrics->loss[idx];
-            fprintf(f, "%d,%d,%.9f,%d,%.9f\n",
-                    gs, ep, ret_val, steps_val, loss_val);
+    int n = (int)(end - begin) * episodes;
+    for (long u = begin; u < end; u++) {
+        int i = (int)(u % metrics->window), k = (int)(u - begin) * episodes;
+
+        memcpy(s->block_values + k, metrics->returns + i * episodes, episodes * sizeof(float));
+        memcpy(s->block_values + n + k, metrics->loss + i * episodes, episodes * sizeof(float));
+        memcpy(s->block_steps + k, metrics->steps + i * episodes, episodes * sizeof(int));
+    }
+
+    int is_root = s->rank == s->root;
+    TRACE_BEGIN(ZONE_MPI_METRICS);
+    write_timeline(s, metrics, begin, end);
+    MPI_Reduce(is_root ? MPI_IN_PLACE : s->block_values, s->block_values, 2 * n, MPI_FLOAT, MPI_SUM, s->root, mpi_ctx->comm);
+    MPI_Reduce(is_root ? MPI_IN_PLACE : s->block_steps, s->block_steps, n, MPI_INT, MPI_SUM, s->root, mpi_ctx->comm);
+
+    if (is_root) {
+        for (int k = 0; k < 2 * n; k++) s->block_values[k] /= s->world_size;
+    }
+
+    if (s->trace_values) {
+        int count = (int)(end - begin) * TRACE_VALUES;
+
+        for (long u = begin; u < end; u++) {
+            int i = (int)(u % metrics->window);
+            double *v = s->trace_values + (u - begin) * TRACE_VALUES;
+            const double starts[TRACE_EVENTS] = {
+                metrics->step_starts[i], metrics->bcast_starts[i], metrics->rollout_starts[i], metrics->forward_starts[i],
+                metrics->backward_starts[i], metrics->reduce_starts[i], metrics->update_starts[i],
+            };
+            const double durations[TRACE_EVENTS] = {
+                metrics->step_times[i], metrics->bcast_times[i], metrics->rollout_times[i], metrics->forward_times[i],
+                metrics->backward_times[i], metrics->reduce_times[i], metrics->update_times[i],
+            };
+
+            for (int e = 0; e < TRACE_EVENTS; e++) {
+                v[2 * e] = starts[e] != 0.0 ? starts[e] + s->clock_offset : 0.0;
+                v[2 * e + 1] = durations[e];
+            }
         }
+
+        MPI_Gather(is_root ? MPI_IN_PLACE : s->trace_values, count, MPI_DOUBLE,
+                   s->trace_values, count, MPI_DOUBLE, s->root, mpi_ctx->comm);
     }
+    TRACE_END(ZONE_MPI_METRICS);
 
-    fclose(f);
+    pthread_mutex_lock(&s->lock);
+    s->begin = begin;
+    s->end = end;
+    s->busy = 1;
+    pthread_cond_broadcast(&s->cond);
+    pthread_mutex_unlock(&s->lock);
+
+    metrics->flushed = end;
+}
+
+void metrics_end_update(TrainingMetrics *metrics, const MPIContext *mpi_ctx) {
+    int i = (int)((metrics->updates - 1) % metrics->window);
+    MetricsAggregates *t = &metrics->totals;
+
+    t->updates++;
+    t->step_time += metrics->step_times[i];
+    t->comm_time += metrics->comm_times[i];
+    t->rollout_time += metrics->rollout_times[i];
+    t->forward_time += metrics->forward_times[i];
+    t->backward_time += metrics->backward_times[i];
+    t->update_time += metrics->update_times[i];
+    t->step_time_hist[hist_bucket(metrics->step_times[i])]++;
+
+    if (metrics->phase_counters) {
+        const uint64_t *c = metrics->phase_counters + (size_t)i * METRICS_N_PHASES * N_COUNTERS;
+        for (int p = 0; p < METRICS_N_PHASES; p++)
+            for (int k = 0; k < N_COUNTERS; k++)
+                t->counters[p][k] += (double)c[p * N_COUNTERS + k];
+    }
+
+    for (int c = 0; c < METRICS_N_COLLECTIVES; c++) {
+        const CommStats *cs = &metrics->comm_stats[i * METRICS_N_COLLECTIVES + c];
+        t->collectives[c].bytes += cs->bytes;
+        t->collectives[c].pack += cs->pack;
+        t->collectives[c].mpi += cs->mpi;
+        t->collectives[c].unpack += cs->unpack;
+    }
+
+    for (int ep = 0; ep < metrics->num_episodes; ep++) {
+        double r = metrics->returns[i * metrics->num_episodes + ep];
+
+        t->episodes++;
+        t->env_steps += metrics->steps[i * metrics->num_episodes + ep];
+        t->return_sum += r;
+        t->return_sq_sum += r * r;
+        if (r < t->return_min) t->return_min = r;
+        if (r > t->return_max) t->return_max = r;
+    }
+
+    if (metrics->stream && metrics->updates - metrics->flushed >= flush_every(metrics))
+        hand_off(metrics, mpi_ctx);
+}
+
+void metrics_flush(TrainingMetrics *metrics, const MPIContext *mpi_ctx) {
+    if (metrics->stream) hand_off(metrics, mpi_ctx);
+}
+
+double metrics_trace_base(const TrainingMetrics *metrics) {
+    return metrics->stream ? metrics->stream->trace_base : 0.0;
+}
+
+double metrics_step_time_quantile(const MetricsAggregates *totals, double q) {
+    int64_t count = 0;
+    for (int b = 0; b < METRICS_HIST_BUCKETS; b++) count += totals->step_time_hist[b];
+    if (count == 0) return 0.0;
+
+    int64_t target = (int64_t)ceil(q * count), seen = 0;
+    for (int b = 0; b < METRICS_HIST_BUCKETS; b++) {
+        seen += totals->step_time_hist[b];
+
+        // Geometric midpoint of the bucket
+        if (seen >= target) return 1e-6 * exp2((b + 0.5) / 4.0);
+    }
+
+    return 1e-6 * exp2(METRICS_HIST_BUCKETS / 4.0);
 }
 
 void free_metrics(TrainingMetrics *metrics) {
+    MetricsStream *s = metrics->stream;
+    if (s) {
+        pthread_mutex_lock(&s->lock);
+        s->stop = 1;
+        pthread_cond_broadcast(&s->cond);
+        pthread_mutex_unlock(&s->lock);
+        pthread_join(s->thread, NULL);
+
+        timeline_close(&s->timeline);
+        if (s->results) fclose(s->results);
+        if (s->trace) {
+            fputs("\n]\n", s->trace);
+            fclose(s->trace);
+        }
+        pthread_mutex_destroy(&s->lock);
+        pthread_cond_destroy(&s->cond);
+        free(s->block_values);
+        free(s->block_steps);
+        free(s->trace_values);
+        free(s);
+        metrics->stream = NULL;
+    }
+
     free(metrics->returns);
     free(metrics->steps);
     free(metrics->loss);
@@ -92,6 +623,8 @@ void free_metrics(TrainingMetrics *metrics) {
     free(metrics->forward_times);
     free(metrics->backward_times);
     free(metrics->update_times);
+    free(metrics->bcast_times);
+    free(metrics->reduce_times);
 
     free(metrics->step_starts);
     free(metrics->comm_starts);
@@ -99,71 +632,111 @@ void free_metrics(TrainingMetrics *metrics) {
     free(metrics->forward_starts);
     free(metrics->backward_starts);
     free(metrics->update_starts);
+    free(metrics->bcast_starts);
+    free(metrics->reduce_starts);
+    free(metrics->comm_stats);
+
+    if (metrics->perf) perf_counters_close(metrics->perf);
+    free(metrics->perf);
+    free(metrics->phase_counters);
 }
 
-void reduce_metrics(TrainingMetrics *metrics, const MPIContext *mpi_ctx, int root_rank) {
-    int episode_elems = metrics->updates_capacity * metrics->num_episodes;
-    int update_elems  = metrics->updates_capacity;
-
-    MPI_Reduce(mpi_ctx->rank == root_rank ? MPI_IN_PLACE : metrics->returns,
-               metrics->returns,
-               episode_elems, MPI_FLOAT, MPI_SUM,
-               root_rank, mpi_ctx->comm);
-
-    MPI_Reduce(mpi_ctx->rank == root_rank ? MPI_IN_PLACE : metrics->steps,
-               metrics->steps,
-               episode_elems, MPI_INT, MPI_SUM,
-               root_rank, mpi_ctx->comm);
-
-    MPI_Reduce(mpi_ctx->rank == root_rank ? MPI_IN_PLACE : metrics->loss,
-               metrics->loss,
-               episode_elems, MPI_FLOAT, MPI_SUM,
-               root_rank, mpi_ctx->comm);
-
-    MPI_Reduce(mpi_ctx->rank == root_rank ? MPI_IN_PLACE : metrics->step_times,
-               metrics->step_times,
-               update_elems, MPI_DOUBLE, MPI_SUM,
-               root_rank, mpi_ctx->comm);
-
-    MPI_Reduce(mpi_ctx->rank == root_rank ? MPI_IN_PLACE : metrics->rollout_times,
-               metrics->rollout_times,
-               update_elems, MPI_DOUBLE, MPI_SUM,
-               root_rank, mpi_ctx->comm);
-
-    MPI_Reduce(mpi_ctx->rank == root_rank ? MPI_IN_PLACE : metrics->forward_times,
-               metrics->forward_times,
-               update_elems, MPI_DOUBLE, MPI_SUM,
-               root_rank, mpi_ctx->comm);
-
-    MPI_Reduce(mpi_ctx->rank == root_rank ? MPI_IN_PLACE : metrics->backward_times,
-               metrics->backward_times,
-               update_elems, MPI_DOUBLE, MPI_SUM,
-               root_rank, mpi_ctx->comm);
-
-    MPI_Reduce(mpi_ctx->rank == root_rank ? MPI_IN_PLACE : metrics->update_times,
-               metrics->update_times,
-               update_elems, MPI_DOUBLE, MPI_SUM,
-               root_rank, mpi_ctx->comm);
-
-    MPI_Reduce(mpi_ctx->rank == root_rank ? MPI_IN_PLACE : metrics->comm_times,
-               metrics->comm_times,
-               update_elems, MPI_DOUBLE, MPI_SUM,
-               root_rank, mpi_ctx->comm);
-
-    MPI_Reduce(mpi_ctx->rank == root_rank ? MPI_IN_PLACE : &metrics->wall_time_train,
-               &metrics->wall_time_train,
-               1, MPI_DOUBLE, MPI_SUM,
-               root_rank, mpi_ctx->comm);
-
-    MPI_Reduce(mpi_ctx->rank == root_rank ? MPI_IN_PLACE : &metrics->wall_time_total,
-               &metrics->wall_time_total,
-               1, MPI_DOUBLE, MPI_SUM,
-               root_rank, mpi_ctx->comm);
-
-    if (mpi_ctx->rank == root_rank) {
-        for (int i = 0; i < episode_elems; i++) {
-            metrics->returns[i] /= mpi_ctx->world_size;
-            metrics->loss[i] /= mpi_ctx->world_size;
+static void rank_stat_combine(void *in, void *inout, int *len, MPI_Datatype *type) {
+    const RankStat *a = in;
+    RankStat *b = inout;
+    (void)type;
+
+    for (int i = 0; i < *len; i++) {
+        b[i].sum += a[i].sum;
+        if (a[i].min < b[i].min) b[i].min = a[i].min;
+        if (a[i].max > b[i].max || (a[i].max == b[i].max && a[i].argmax < b[i].argmax)) {
+            b[i].max = a[i].max;
+            b[i].argmax = a[i].argmax;
         }
     }
-}
\ No newline at end of file
+}
+
+void reduce_metrics(TrainingMetrics *metrics, const MPIContext *mpi_ctx, int root_rank) {
+    MetricsAggregates *t = &metrics->totals;
+    double values[METRICS_N_STATS] = {
+        [STAT_WALL_TRAIN] = metrics->wall_time_train,
+        [STAT_WALL_TOTAL] = metrics->wall_time_total,
+        [STAT_STEP] = t->step_time,
+        [STAT_COMM] = t->comm_time,
+        [STAT_ROLLOUT] = t->rollout_time,
+        [STAT_FORWARD] = t->forward_time,
+        [STAT_BACKWARD] = t->backward_time,
+        [STAT_UPDATE] = t->update_time,
+        [STAT_EPISODES] = (double)t->episodes,
+        [STAT_ENV_STEPS] = (double)t->env_steps,
+        [STAT_RETURN_SUM] = t->return_sum,
+        [STAT_RETURN_SQ_SUM] = t->return_sq_sum,
+        [STAT_RETURN_MIN] = t->return_min,
+        [STAT_RETURN_MAX] = t->return_max,
+        [STAT_COUNTER_RANKS] = metrics->perf ? 1.0 : 0.0,
+        [STAT_COUNTER_ENV_STEPS] = metrics->perf ? (double)t->env_steps : 0.0,
+    };
+    for (int b = 0; b < METRICS_HIST_BUCKETS; b++)
+        values[STAT_STEP_HIST + b] = (double)t->step_time_hist[b];
+    for (int p = 0; p < METRICS_N_PHASES; p++)
+        for (int k = 0; k < N_COUNTERS; k++)
+            values[STAT_COUNTERS + p * N_COUNTERS + k] = t->counters[p][k];
+    for (int c = 0; c < METRICS_N_COLLECTIVES; c++) {
+        const CommStats *cs = &t->collectives[c];
+        double *v = &values[STAT_COLLECTIVES + 4 * c];
+        v[0] = cs->bytes;
+        v[1] = cs->pack;
+        v[2] = cs->mpi;
+        v[3] = cs->unpack;
+    }
+
+    RankStat local[METRICS_N_STATS];
+    for (int i = 0; i < METRICS_N_STATS; i++)
+        local[i] = (RankStat){values[i], values[i], values[i], mpi_ctx->rank};
+
+    int lengths[2] = {3, 1};
+    MPI_Aint displacements[2] = {offsetof(RankStat, sum), offsetof(RankStat, argmax)};
+    MPI_Datatype types[2] = {MPI_DOUBLE, MPI_INT}, packed, stat_type;
+
+    MPI_Type_create_struct(2, lengths, displacements, types, &packed);
+    MPI_Type_create_resized(packed, 0, sizeof(RankStat), &stat_type);
+    MPI_Type_commit(&stat_type);
+
+    MPI_Op combine;
+    MPI_Op_create(rank_stat_combine, 1, &combine);
+
+    TRACE_BEGIN(ZONE_MPI_METRICS);
+    MPI_Reduce(local, metrics->stats, METRICS_N_STATS, stat_type, combine, root_rank, mpi_ctx->comm);
+    TRACE_END(ZONE_MPI_METRICS);
+
+    MPI_Op_free(&combine);
+    MPI_Type_free(&stat_type);
+    MPI_Type_free(&packed);
+
+    if (mpi_ctx->rank != root_rank) return;
+
+    const RankStat *st = metrics->stats;
+    metrics->world_size = mpi_ctx->world_size;
+
+    t->step_time = st[STAT_STEP].sum;
+    t->comm_time = st[STAT_COMM].sum;
+    t->rollout_time = st[STAT_ROLLOUT].sum;
+    t->forward_time = st[STAT_FORWARD].sum;
+    t->backward_time = st[STAT_BACKWARD].sum;
+    t->update_time = st[STAT_UPDATE].sum;
+    t->episodes = (long)st[STAT_EPISODES].sum;
+    t->env_steps = (long)st[STAT_ENV_STEPS].sum;
+    t->return_sum = st[STAT_RETURN_SUM].sum;
+    t->return_sq_sum = st[STAT_RETURN_SQ_SUM].sum;
+    t->return_min = st[STAT_RETURN_MIN].min;
+    t->return_max = st[STAT_RETURN_MAX].max;
+    for (int b = 0; b < METRICS_HIST_BUCKETS; b++)
+        t->step_time_hist[b] = (int64_t)st[STAT_STEP_HIST + b].sum;
+    for (int p = 0; p < METRICS_N_PHASES; p++)
+        for (int k = 0; k < N_COUNTERS; k++)
+            t->counters[p][k] = st[STAT_COUNTERS + p * N_COUNTERS + k].sum;
+    for (int c = 0; c < METRICS_N_COLLECTIVES; c++) {
+        const RankStat *v = &st[STAT_COLLECTIVES + 4 * c];
+        t->collectives[c] = (CommStats){v[0].sum, v[1].sum, v[2].sum, v[3].sum};
+    }
+}
@@ -0,0 +1,145 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <cblas.h>
+
+#include "nn/gemm.h"
+#include "nn/backend.h"
+
+/*
+ * Vendor extensions, resolved at link time if present. Only one BLAS is linked, so the
+ * symbols that resolve tell which library it is.
+ */
+char *openblas_get_config(void);
+int openblas_get_num_threads(void);
+void openblas_set_num_threads(int num_threads);
+const char *bli_info_get_version_str(void);
+int64_t bli_thread_get_num_threads(void);
+void bli_thread_set_num_threads(int64_t n_threads);
+
+#pragma weak openblas_get_config
+#pragma weak openblas_get_num_threads
+#pragma weak openblas_set_num_threads
+#pragma weak bli_info_get_version_str
+#pragma weak bli_thread_get_num_threads
+#pragma weak bli_thread_set_num_threads
+
+/***************************
+ *      BLAS backend       *
+ ***************************/
+
+static void blas_nt(int M, int N, int K, const float *A, int lda, const float *B, int ldb, float beta, float *C, int ldc) {
+    cblas_sgemm(CblasRowMajor, CblasNoTrans, CblasTrans, M, N, K, 1.0f, A, lda, B, ldb, beta, C, ldc);
+}
+
+static void blas_tn(int M, int N, int K, const float *A, int lda, const float *B, int ldb, float beta, float *C, int ldc) {
+    cblas_sgemm(CblasRowMajor, CblasTrans, CblasNoTrans, M, N, K, 1.0f, A, lda, B, ldb, beta, C, ldc);
+}
+
+static void blas_nn(int M, int N, int K, const float *A, int lda, const float *B, int ldb, float beta, float *C, int ldc) {
+    cblas_sgemm(CblasRowMajor, CblasNoTrans, CblasNoTrans, M, N, K, 1.0f, A, lda, B, ldb, beta, C, ldc);
+}
+
+/***************************
+ *    Reference backend    *
+ ***************************/
+
+// C(i, j) = sum_k A(i, k) B(k, j) + beta C(i, j), operands addressed through strides
+static void reference_gemm(
+    int M, int N, int K,
+    const float *A, int a_rs, int a_cs,
+    const float *B, int b_rs, int b_cs,
+    float beta, float *C, int ldc
+) {
+    for (int i = 0; i < M; i++) {
+        for (int j = 0; j < N; j++) {
+            float sum = 0.0f;
+            for (int k = 0; k < K; k++)
+                sum += A[i * a_rs + k * a_cs] * B[k * b_rs + j * b_cs];
+
+            C[i * ldc + j] = (beta == 0.0f) ? sum : beta * C[i * ldc + j] + sum;
+        }
+    }
+}
+
+static void reference_nt(int M, int N, int K, const float *A, int lda, const float *B, int ldb, float beta, float *C, int ldc) {
+    reference_gemm(M, N, K, A, lda, 1, B, 1, ldb, beta, C, ldc);
+}
+
+static void reference_tn(int M, int N, int K, const float *A, int lda, const float *B, int ldb, float beta, float *C, int ldc) {
+    reference_gemm(M, N, K, A, 1, lda, B, ldb, 1, beta, C, ldc);
+}
+
+static void reference_nn(int M, int N, int K, const float *A, int lda, const float *B, int ldb, float beta, float *C, int ldc) {
+    reference_gemm(M, N, K, A, lda, 1, B, ldb, 1, beta, C, ldc);
+}
+
+/***************************
+ *        Registry         *
+ ***************************/
+
+static const GemmBackend backends[] = {
+    { "auto",      auto_gemm_nt,   auto_gemm_tn,   auto_gemm_nn },
+    { "openblas",  blas_nt,        blas_tn,        blas_nn },
+    { "blis",      blas_nt,        blas_tn,        blas_nn },
+    { "reference", reference_nt,   reference_tn,   reference_nn },
+    { "kernels",   skinny_gemm_nt, skinny_gemm_tn, skinny_gemm_nn },
+};
+
+static const GemmBackend *active = &backends[0];
+
+const char *blas_vendor() {
+    if (openblas_get_config) return "OpenBLAS";
+    if (bli_info_get_version_str) return "BLIS";
+    return "unknown BLAS";
+}
+
+int gemm_backend_select(const char *name) {
+    for (size_t b = 0; b < sizeof(backends) / sizeof(backends[0]); b++) {
+        if (strcmp(backends[b].name, name) != 0) continue;
+
+        if (strcmp(name, "openblas") == 0 && !openblas_get_config) return 0;
+        if (strcmp(name, "blis") == 0 && !bli_info_get_version_str) return 0;
+
+        active = &backends[b];
+        return 1;
+    }
+
+    return 0;
+}
+
+const GemmBackend *gemm_backend() {
+    return active;
+}
+
+int blas_set_num_threads(int n_threads) {
+    if (openblas_set_num_threads) {
+        openblas_set_num_threads(n_threads);
+        return 1;
+    }
+
+    if (bli_thread_set_num_threads) {
+        bli_thread_set_num_threads(n_threads);
+        return 1;
+    }
+
+    return 0;
+}
+
+int blas_get_num_threads() {
+    if (openblas_get_num_threads) return openblas_get_num_threads();
+    if (bli_thread_get_num_threads) return (int)bli_thread_get_num_threads();
+    return -1;
+}
+
+void gemm_nt(int M, int N, int K, const float *A, int lda, const float *B, int ldb, float beta, float *C, int ldc) {
+    active->nt(M, N, K, A, lda, B, ldb, beta, C, ldc);
+}
+
+void gemm_tn(int M, int N, int K, const float *A, int lda, const float *B, int ldb, float beta, float *C, int ldc) {
+    active->tn(M, N, K, A, lda, B, ldb, beta, C, ldc);
+}
+
+void gemm_nn(int M, int N, int K, const float *A, int lda, const float *B, int ldb, float beta, float *C, int ldc) {
+    active->nn(M, N, K, A, lda, B, ldb, beta, C, ldc);
+}
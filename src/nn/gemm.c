@@ -0,0 +1,267 @@
+#include <stdlib.h>
+#include <string.h>
+#include <cblas.h>
+
+#include "nn/gemm.h"
+
+#define GEMM_INLINE static inline __attribute__((always_inline))
+
+// Vector width follows the target ISA (-DNATIVE_ARCH=ON enables AVX builds)
+#if defined(__AVX__)
+#define VW 8
+#else
+#define VW 4
+#endif
+
+// Register block: MR rows x NR columns (NV vectors), sized to stay within 16 vector registers
+#define MR 4
+#define NV 2
+#define NR (NV * VW)
+
+// Capacity of each per-thread scratch buffer (floats); larger operands fall back to the heap
+#define PACK_SIZE 4096
+
+/*
+ * Crossover against OpenBLAS measured with bench_gemm (AVX-512 host): the kernels win
+ * every call with M*N*K <= 256 (batch-1 rollout forwards), and with -march=native
+ * also the forward NT products whose reduction is the tiny observation size.
+ */
+#if defined(__AVX__)
+static int gemm_nt_max_k = 4;
+#else
+static int gemm_nt_max_k = 0;
+#endif
+static long gemm_small_volume = 256;
+
+typedef float vfloat __attribute__((vector_size(VW * sizeof(float))));
+
+GEMM_INLINE vfloat vload(const float *p) {
+    vfloat v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+GEMM_INLINE void vstore(float *p, vfloat v) {
+    memcpy(p, &v, sizeof(v));
+}
+
+GEMM_INLINE vfloat vbroadcast(float x) {
+    return (vfloat){ 0 } + x;
+}
+
+/*
+ * C[i:i+mr, j:j+VW*nv] = sum_k A(i+r, k) B[k, j:j+VW*nv] + beta C
+ *
+ * A is addressed through (a_rs, a_cs) so the same kernel serves A and A^T.
+ * mr and nv are compile-time constants at every call site.
+ */
+GEMM_INLINE void micro_kernel(
+    int mr, int nv, int K,
+    const float *A, int a_rs, int a_cs,
+    const float *B, int ldb,
+    float beta, float *C, int ldc
+) {
+    vfloat acc[MR][NV];
+    #pragma GCC unroll 4
+    for (int r = 0; r < mr; r++)
+        #pragma GCC unroll 4
+        for (int v = 0; v < nv; v++)
+            acc[r][v] = vbroadcast(0.0f);
+
+    for (int k = 0; k < K; k++) {
+        vfloat b[NV];
+        #pragma GCC unroll 4
+        for (int v = 0; v < nv; v++) b[v] = vload(B + k * ldb + VW * v);
+
+        #pragma GCC unroll 4
+        for (int r = 0; r < mr; r++) {
+            vfloat a = vbroadcast(A[r * a_rs + k * a_cs]);
+            #pragma GCC unroll 4
+            for (int v = 0; v < nv; v++) acc[r][v] += a * b[v];
+        }
+    }
+
+    #pragma GCC unroll 4
+    for (int r = 0; r < mr; r++) {
+        #pragma GCC unroll 4
+        for (int v = 0; v < nv; v++) {
+            float *c = C + r * ldc + VW * v;
+            if (beta == 0.0f) vstore(c, acc[r][v]);
+            else vstore(c, vbroadcast(beta) * vload(c) + acc[r][v]);
+        }
+    }
+}
+
+GEMM_INLINE void row_panel(
+    int mr, int N, int K,
+    const float *A, int a_rs, int a_cs,
+    const float *B, int ldb,
+    const float *B_tail,
+    float beta, float *C, int ldc
+) {
+    int j = 0;
+    for (; j + NR <= N; j += NR)
+        micro_kernel(mr, NV, K, A, a_rs, a_cs, B + j, ldb, beta, C + j, ldc);
+    for (; j + VW <= N; j += VW)
+        micro_kernel(mr, 1, K, A, a_rs, a_cs, B + j, ldb, beta, C + j, ldc);
+
+    if (j < N) {
+        // Columns that do not fill a vector go through a zero-padded copy of B
+        float tile[MR * VW];
+        micro_kernel(mr, 1, K, A, a_rs, a_cs, B_tail, VW, 0.0f, tile, VW);
+
+        for (int r = 0; r < mr; r++)
+            for (int c = 0; c < N - j; c++) {
+                float *out = C + r * ldc + j + c;
+                *out = (beta == 0.0f) ? tile[r * VW + c] : beta * *out + tile[r * VW + c];
+            }
+    }
+}
+
+// C = A B + beta C, with B row-major [K, N] and A(i, k) = A[i * a_rs + k * a_cs]
+static void blocked_gemm(
+    int M, int N, int K,
+    const float *A, int a_rs, int a_cs,
+    const float *B, int ldb,
+    float beta, float *C, int ldc
+) {
+    static _Thread_local float tail_buffer[PACK_SIZE];
+    float *B_tail = NULL;
+    int n_tail = N % VW;
+
+    if (n_tail) {
+        B_tail = ((size_t)K * VW <= PACK_SIZE) ? tail_buffer : malloc((size_t)K * VW * sizeof(float));
+        for (int k = 0; k < K; k++)
+            for (int c = 0; c < VW; c++)
+                B_tail[k * VW + c] = (c < n_tail) ? B[k * ldb + N - n_tail + c] : 0.0f;
+    }
+
+    int i = 0;
+    for (; i + MR <= M; i += MR)
+        row_panel(MR, N, K, A + i * a_rs, a_rs, a_cs, B, ldb, B_tail, beta, C + i * ldc, ldc);
+
+    switch (M - i) {
+        case 3: row_panel(3, N, K, A + i * a_rs, a_rs, a_cs, B, ldb, B_tail, beta, C + i * ldc, ldc); break;
+        case 2: row_panel(2, N, K, A + i * a_rs, a_rs, a_cs, B, ldb, B_tail, beta, C + i * ldc, ldc); break;
+        case 1: row_panel(1, N, K, A + i * a_rs, a_rs, a_cs, B, ldb, B_tail, beta, C + i * ldc, ldc); break;
+        default: break;
+    }
+
+    if (B_tail != tail_buffer) free(B_tail);
+}
+
+GEMM_INLINE float hsum(vfloat v) {
+    float lanes[VW];
+    memcpy(lanes, &v, sizeof(v));
+
+    float sum = 0.0f;
+    for (int l = 0; l < VW; l++) sum += lanes[l];
+    return sum;
+}
+
+// C[i, j] = dot(A[i, :], Bt[j, :]) + beta C, for outputs narrower than a vector
+static void dot_gemm(
+    int M, int N, int K,
+    const float *A, int lda,
+    const float *Bt, int ldbt,
+    float beta, float *C, int ldc
+) {
+    for (int i = 0; i < M; i++) {
+        const float *a = A + i * lda;
+
+        for (int j = 0; j < N; j++) {
+            const float *b = Bt + j * ldbt;
+            vfloat acc[2] = { vbroadcast(0.0f), vbroadcast(0.0f) };
+
+            int k = 0;
+            for (; k + 2*VW <= K; k += 2*VW) {
+                acc[0] += vload(a + k) * vload(b + k);
+                acc[1] += vload(a + k + VW) * vload(b + k + VW);
+            }
+            for (; k + VW <= K; k += VW) acc[0] += vload(a + k) * vload(b + k);
+
+            float sum = hsum(acc[0] + acc[1]);
+            for (; k < K; k++) sum += a[k] * b[k];
+
+            C[i * ldc + j] = (beta == 0.0f) ? sum : beta * C[i * ldc + j] + sum;
+        }
+    }
+}
+
+void skinny_gemm_nt(int M, int N, int K, const float *A, int lda, const float *B, int ldb, float beta, float *C, int ldc) {
+    if (N < VW && K >= VW) {
+        dot_gemm(M, N, K, A, lda, B, ldb, beta, C, ldc);
+        return;
+    }
+
+    // Pack B^T into [K, N] so the inner loop runs along contiguous output columns
+    static _Thread_local float pack_buffer[PACK_SIZE];
+    float *packed = (K * N <= PACK_SIZE) ? pack_buffer : calloc((size_t)K * N, sizeof(float));
+
+    for (int j = 0; j < N; j++)
+        for (int k = 0; k < K; k++)
+            packed[k * N + j] = B[j * ldb + k];
+
+    blocked_gemm(M, N, K, A, lda, 1, packed, N, beta, C, ldc);
+
+    if (packed != pack_buffer) free(packed);
+}
+
+void skinny_gemm_tn(int M, int N, int K, const float *A, int lda, const float *B, int ldb, float beta, float *C, int ldc) {
+    if (N >= VW || M < VW) {
+        blocked_gemm(M, N, K, A, 1, lda, B, ldb, beta, C, ldc);
+        return;
+    }
+
+    // Narrow output (e.g. the first layer's weight gradient): vectorize along M by
+    // computing C^T = B^T A, whose rows are contiguous in A
+    static _Thread_local float transpose_buffer[PACK_SIZE];
+    float *C_t = ((size_t)N * M <= PACK_SIZE) ? transpose_buffer : malloc((size_t)N * M * sizeof(float));
+    blocked_gemm(N, M, K, B, 1, ldb, A, lda, 0.0f, C_t, M);
+
+    for (int i = 0; i < M; i++)
+        for (int j = 0; j < N; j++)
+            C[i * ldc + j] = (beta == 0.0f) ? C_t[j * M + i] : beta * C[i * ldc + j] + C_t[j * M + i];
+
+    if (C_t != transpose_buffer) free(C_t);
+}
+
+void skinny_gemm_nn(int M, int N, int K, const float *A, int lda, const float *B, int ldb, float beta, float *C, int ldc) {
+    blocked_gemm(M, N, K, A, lda, 1, B, ldb, beta, C, ldc);
+}
+
+static inline int small_gemm(int M, int N, int K) {
+    return (long)M * N * K <= gemm_small_volume;
+}
+
+void auto_gemm_nt(int M, int N, int K, const float *A, int lda, const float *B, int ldb, float beta, float *C, int ldc) {
+    if (small_gemm(M, N, K) || (K <= gemm_nt_max_k && N >= NR)) {
+        skinny_gemm_nt(M, N, K, A, lda, B, ldb, beta, C, ldc);
+        return;
+    }
+
+    cblas_sgemm(CblasRowMajor, CblasNoTrans, CblasTrans, M, N, K, 1.0f, A, lda, B, ldb, beta, C, ldc);
+}
+
+void auto_gemm_tn(int M, int N, int K, const float *A, int lda, const float *B, int ldb, float beta, float *C, int ldc) {
+    if (small_gemm(M, N, K)) {
+        skinny_gemm_tn(M, N, K, A, lda, B, ldb, beta, C, ldc);
+        return;
+    }
+
+    cblas_sgemm(CblasRowMajor, CblasTrans, CblasNoTrans, M, N, K, 1.0f, A, lda, B, ldb, beta, C, ldc);
+}
+
+void auto_gemm_nn(int M, int N, int K, const float *A, int lda, const float *B, int ldb, float beta, float *C, int ldc) {
+    if (small_gemm(M, N, K)) {
+        skinny_gemm_nn(M, N, K, A, lda, B, ldb, beta, C, ldc);
+        return;
+    }
+
+    cblas_sgemm(CblasRowMajor, CblasNoTrans, CblasNoTrans, M, N, K, 1.0f, A, lda, B, ldb, beta, C, ldc);
+}
+
+void gemm_set_crossover(int nt_max_k, long small_volume) {
+    gemm_nt_max_k = nt_max_k;
+    gemm_small_volume = small_volume;
+}
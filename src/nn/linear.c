@@ -1,10 +1,11 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
-#include <cblas.h>
 #include <math.h>
 
 #include "rng.h"
+#include "trace.h"
+#include "nn/gemm.h"
 #include "nn/linear.h"
 
 LinearLayer create_linear(
@@ -44,14 +45,14 @@ void linear_forward(
     float *out,
     LinearCache *cache
 ) {
+    TRACE_BEGIN(ZONE_LINEAR_FORWARD);
+
     int insize = linear->input_size;
     int outsize = linear->output_size;
 
     // Z = X W^T
-    cblas_sgemm(
-        CblasRowMajor, CblasNoTrans, CblasTrans,
+    gemm_nt(
         batch_size, outsize, insize,
-        1.0f,
         input, insize,
         linear->weights, insize,
         0.0f,
@@ -76,6 +77,8 @@ void linear_forward(
             out[idx] = linear->activation.fn(out[idx] + linear->biases[j]);
         }
     }
+
+    TRACE_END(ZONE_LINEAR_FORWARD);
 }
 
 void linear_backward(
@@ -84,6 +87,8 @@ void linear_backward(
     const float *out_grad,      // Indicates ∂f/∂x_{out} of size [batch_size, output_size]
     float *in_grad              // Outputs ∂f/∂x_{in} of size [batch_size, input_size]
 ) {
+    TRACE_BEGIN(ZONE_LINEAR_BACKWARD);
+
     int in_size = linear->input_size;
     int out_size = linear->output_size;
     int batch_size = cache->size;
@@ -94,10 +99,8 @@ void linear_backward(
     }
 
     // Weight gradient ∂f/∂W = (dz/dW)^T (∂f/∂z)
-    cblas_sgemm(
-        CblasRowMajor, CblasTrans, CblasNoTrans,
+    gemm_tn(
         out_size, in_size, batch_size,
-        1.0f,
         grad_pre, out_size,
         cache->layer_inputs, in_size,
         1.0f,
@@ -111,10 +114,8 @@ void linear_backward(
     }
 
     if (in_grad) {
-        cblas_sgemm(
-            CblasRowMajor, CblasNoTrans, CblasNoTrans,
+        gemm_nn(
             batch_size, in_size, out_size,
-            1.0f,
             grad_pre, out_size,
             linear->weights, in_size,
             0.0f,
@@ -123,6 +124,8 @@ void linear_backward(
     }
 
     free(grad_pre);
+
+    TRACE_END(ZONE_LINEAR_BACKWARD);
 }
 
 void linear_zero_grad(LinearLayer *linear) {
@@ -3,10 +3,18 @@
 #include <string.h>
 #include <math.h>
 #include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "rng.h"
+#include "trace.h"
 #include "nn/mlp.h"
 
+// Rows recomputed at once by the rematerialized backward pass.
+#define MLP_REMAT_CHUNK 64
+
 MLP create_mlp(
     int* input_sizes,
     int output_size,
@@ -33,19 +41,222 @@ MLP create_mlp(
         .layers=layers,
         .num_layers=num_layers,
         .input_size=input_sizes[0],
-        .output_size=output_size
+        .output_size=output_size,
+        .num_heads=1,
+        .trunk_layers=num_layers,
+        .head_layers=NULL,
+        .head_sizes=NULL,
+        .mapping=NULL,
+        .mapping_size=0
     };
 }
 
+MLP create_multihead_mlp(
+    int *trunk_sizes,
+    int trunk_layers,
+    Activation *trunk_activations,
+    const MLPHead *heads,
+    int num_heads
+) {
+    int num_layers = trunk_layers;
+    for (int h = 0; h < num_heads; h++) num_layers += heads[h].num_layers;
+
+    MLP mlp = {
+        .layers = malloc(num_layers * sizeof(LinearLayer)),
+        .num_layers = num_layers,
+        .input_size = trunk_sizes[0],
+        .output_size = 0,
+        .num_heads = num_heads,
+        .trunk_layers = trunk_layers,
+        .head_layers = malloc(num_heads * sizeof(int)),
+        .head_sizes = malloc(num_heads * sizeof(int)),
+    };
+
+    for (int l = 0; l < trunk_layers; l++)
+        mlp.layers[l] = create_linear(trunk_sizes[l], trunk_sizes[l+1], trunk_activations[l]);
+
+    int l = trunk_layers;
+    for (int h = 0; h < num_heads; h++) {
+        const MLPHead *head = &heads[h];
+        int in = trunk_sizes[trunk_layers];
+
+        for (int j = 0; j < head->num_layers; j++, l++) {
+            int out = (j == head->num_layers - 1) ? head->output_size : head->hidden_sizes[j];
+            mlp.layers[l] = create_linear(in, out, head->activations[j]);
+            in = out;
+        }
+
+        mlp.head_layers[h] = head->num_layers;
+        mlp.head_sizes[h] = head->output_size;
+        mlp.output_size += head->output_size;
+    }
+
+    return mlp;
+}
+
 void kaiming_mlp_init(MLP *mlp) {
     for (int l=0; l<mlp->num_layers; l++)
         kaiming_linear_init(&mlp->layers[l]);
 }
 
 
-void mlp_forward(const MLP* mlp, const float* input, int batch_size, float* out, MLPCache *cache) {
+static inline float *remat_slot(const MLPCache *cache, int width, int slot) {
+    return cache->remat_scratch + (size_t)slot * cache->remat_chunk * width;
+}
+
+static int max_layer_width(const MLP *mlp) {
+    int width = 0;
+    for (int l = 0; l < mlp->num_layers; l++) {
+        if (mlp->layers[l].input_size > width) width = mlp->layers[l].input_size;
+        if (mlp->layers[l].output_size > width) width = mlp->layers[l].output_size;
+    }
+    return width;
+}
+
+/*
+ * Scratch layout for a segment length k (slots of remat_chunk x width floats):
+ *   [0, k)        pre-activations of the segment's layers
+ *   [k, 2k-1)     inputs of the segment's non-checkpointed layers
+ *   2k-1, 2k      ping-pong buffers for activations/gradients
+ *   2k+1          discarded output of the segment's last layer
+ */
+static void remat_forward(const MLP *mlp, const float *input, int batch_size, float *out, MLPCache *cache) {
+    int k = cache->checkpoint_every;
+    int width = max_layer_width(mlp);
+    float *ping[2] = { remat_slot(cache, width, 2*k - 1), remat_slot(cache, width, 2*k) };
+    float *final_out = out ? out : cache->output + cache->size * mlp->output_size;
+
+    for (int r0 = 0; r0 < batch_size; r0 += cache->remat_chunk) {
+        int n = batch_size - r0 < cache->remat_chunk ? batch_size - r0 : cache->remat_chunk;
+        const float *current_input = input + r0 * mlp->input_size;
+
+        for (int l = 0; l < mlp->num_layers; l++) {
+            const LinearLayer *layer = &mlp->layers[l];
+            float *output;
+
+            if (l == mlp->num_layers - 1)
+                output = final_out + r0 * layer->output_size;
+            else if ((l + 1) % k == 0)
+                output = cache->layer_caches[l+1].layer_inputs + (cache->size + r0) * layer->output_size;
+            else
+                output = ping[l & 1];
+
+            linear_forward(layer, current_input, n, output, NULL);
+            current_input = output;
+        }
+    }
+
+    if (out) {
+        memcpy(
+            cache->output + cache->size * mlp->output_size,
+            out,
+            batch_size * mlp->output_size * sizeof(float)
+        );
+    }
+
+    cache->size += batch_size;
+}
+
+static void remat_backward(MLP *mlp, const MLPCache *cache, const float *out_grad, float *input_gradient) {
+    int num_layers = mlp->num_layers;
+    int k = cache->checkpoint_every;
+    int width = max_layer_width(mlp);
+    float *grad_buffers[2] = { remat_slot(cache, width, 2*k - 1), remat_slot(cache, width, 2*k) };
+    float *discard = remat_slot(cache, width, 2*k + 1);
+
+    for (int r0 = 0; r0 < cache->size; r0 += cache->remat_chunk) {
+        int n = cache->size - r0 < cache->remat_chunk ? cache->size - r0 : cache->remat_chunk;
+        const float *current_grad = out_grad + r0 * mlp->output_size;
+        int g = 0;
+
+        for (int start = ((num_layers - 1) / k) * k; start >= 0; start -= k) {
+            int end = start + k < num_layers ? start + k : num_layers;
+
+            // Recompute the segment from its checkpointed input
+            for (int l = start; l < end; l++) {
+                int j = l - start;
+                const float *in = (j == 0)
+                    ? cache->layer_caches[start].layer_inputs + r0 * mlp->layers[start].input_size
+                    : remat_slot(cache, width, k + j - 1);
+                float *output = (l + 1 < end) ? remat_slot(cache, width, k + j) : discard;
+
+                LinearCache segment_cache = {
+                    .size = 0,
+                    .capacity = n,
+                    .layer_inputs = (float *)in,
+                    .pre_activations = remat_slot(cache, width, j)
+                };
+                linear_forward(&mlp->layers[l], in, n, output, &segment_cache);
+            }
+
+            for (int l = end - 1; l >= start; l--) {
+                int j = l - start;
+                LinearLayer *layer = &mlp->layers[l];
+
+                LinearCache segment_cache = {
+                    .size = n,
+                    .capacity = n,
+                    .layer_inputs = (j == 0)
+                        ? cache->layer_caches[start].layer_inputs + r0 * layer->input_size
+                        : remat_slot(cache, width, k + j - 1),
+                    .pre_activations = remat_slot(cache, width, j)
+                };
+
+                float *next_grad;
+                if (l == 0)
+                    next_grad = input_gradient ? input_gradient + r0 * layer->input_size : NULL;
+                else
+                    next_grad = grad_buffers[g];
+
+                linear_backward(layer, &segment_cache, current_grad, next_grad);
+
+                current_grad = next_grad;
+                g ^= 1;
+            }
+        }
+    }
+}
+
+/*
+ * Runs layers [first, last) on input. Intermediate outputs go straight into the next
+ * layer's cached inputs (temporaries without a cache); the last layer writes out.
+ */
+static void chain_forward(const MLP *mlp, int first, int last, const float *input, int batch_size, float *out, MLPCache *cache) {
     const float *current_input = input;
-    float *output;
+
+    for (int l = first; l < last; l++) {
+        const LinearLayer *layer = &mlp->layers[l];
+        float *output;
+
+        if (l == last - 1) output = out;
+        else if (cache) output = cache->layer_caches[l+1].layer_inputs + cache->size * layer->output_size;
+        else output = malloc(batch_size * layer->output_size * sizeof(float));
+
+        linear_forward(layer, current_input, batch_size, output, cache ? &cache->layer_caches[l] : NULL);
+
+        if (l > first && !cache) free((float *)current_input);
+
+        current_input = output;
+    }
+}
+
+// Backward through layers [first, last): out_grad is the gradient of layer last - 1's output
+static void chain_backward(MLP *mlp, const MLPCache *cache, int first, int last, const float *out_grad, float *in_grad) {
+    const float *current_grad = out_grad;
+
+    for (int l = last - 1; l >= first; l--) {
+        LinearLayer *layer = &mlp->layers[l];
+        float *next_grad = (l == first) ? in_grad : malloc(cache->size * layer->input_size * sizeof(float));
+
+        linear_backward(layer, &cache->layer_caches[l], current_grad, next_grad);
+
+        if (current_grad != out_grad) free((float *)current_grad);
+        current_grad = next_grad;
+    }
+}
+
+void mlp_forward(const MLP* mlp, const float* input, int batch_size, float* out, MLPCache *cache) {
+    TRACE_BEGIN(ZONE_MLP_FORWARD);
 
     int in_size = mlp->input_size;
 
@@ -67,23 +278,32 @@ void mlp_forward(const MLP* mlp, const float* input, int batch_size, float* out,
         }
     }
     
-    const LinearLayer *layer;
-    for (int l = 0; l < mlp->num_layers; l++) {
-        layer = &mlp->layers[l];
+    if (cache && cache->checkpoint_every > 1) {
+        remat_forward(mlp, input, batch_size, out, cache);
+        TRACE_END(ZONE_MLP_FORWARD);
+        return;
+    }
 
-        if (l == mlp->num_layers - 1) {
-            if (out) output = out;
-            else output = cache->output + cache->size * mlp->output_size;
-        } else if (cache) {
-            // Write the current layer's output directly into the next layer's input buffer
-            output = cache->layer_caches[l+1].layer_inputs + cache->size * layer->output_size;
-        } else output = malloc(batch_size * layer->output_size * sizeof(float));
+    float *final_out = out ? out : cache->output + cache->size * mlp->output_size;
 
-        linear_forward(layer, current_input, batch_size, output, cache ? &cache->layer_caches[l] : NULL);
+    if (mlp->num_heads > 1) {
+        // The trunk's output lands in the first head's cached inputs, which the other heads share
+        int T = mlp->trunk_layers, width = mlp->layers[T-1].output_size;
+        float *trunk = cache ? cache->layer_caches[T].layer_inputs + cache->size * width
+                             : malloc(batch_size * width * sizeof(float));
 
-        if (l > 0 && !cache) free((float *)current_input);
+        chain_forward(mlp, 0, T, input, batch_size, trunk, cache);
 
-        current_input = output;
+        int first = T;
+        for (int h = 0; h < mlp->num_heads; h++) {
+            chain_forward(mlp, first, first + mlp->head_layers[h], trunk, batch_size,
+                          mlp_head_output(mlp, final_out, batch_size, h), cache);
+            first += mlp->head_layers[h];
+        }
+
+        if (!cache) free(trunk);
+    } else {
+        chain_forward(mlp, 0, mlp->num_layers, input, batch_size, final_out, cache);
     }
 
     if (cache) {
@@ -97,37 +317,61 @@ void mlp_forward(const MLP* mlp, const float* input, int batch_size, float* out,
 
         cache->size += batch_size;
     }
+
+    TRACE_END(ZONE_MLP_FORWARD);
 }
 
 void mlp_backward(MLP *mlp, const MLPCache *cache, const float *out_grad, float *input_gradient) {
-    int num_layers = mlp->num_layers;
-    int batch_size = cache->size;
-
-    const float *current_grad = out_grad;
-    float *next_grad = NULL;
+    TRACE_BEGIN(ZONE_MLP_BACKWARD);
 
-    for (int l = num_layers - 1; l >= 0; l--) {
-        LinearLayer *layer = &mlp->layers[l];
-
-        if (l == 0)
-            next_grad = input_gradient;
-        else
-            next_grad = malloc(batch_size * layer->input_size * sizeof(float));
+    if (cache->checkpoint_every > 1) {
+        remat_backward(mlp, cache, out_grad, input_gradient);
+        TRACE_END(ZONE_MLP_BACKWARD);
+        return;
+    }
 
-        linear_backward(layer, &cache->layer_caches[l], current_grad, next_grad);
+    if (mlp->num_heads > 1) {
+        // Each head's input gradient is summed into the gradient of the trunk's output
+        int T = mlp->trunk_layers, n = cache->size * mlp->layers[T-1].output_size;
+        float *trunk_grad = malloc(n * sizeof(float));
+        float *head_grad = malloc(n * sizeof(float));
+
+        int first = T;
+        for (int h = 0; h < mlp->num_heads; h++) {
+            const float *grad = mlp_head_output(mlp, (float *)out_grad, cache->size, h);
+            chain_backward(mlp, cache, first, first + mlp->head_layers[h], grad, h == 0 ? trunk_grad : head_grad);
+            if (h > 0)
+                for (int i = 0; i < n; i++) trunk_grad[i] += head_grad[i];
+            first += mlp->head_layers[h];
+        }
 
-        if (current_grad != out_grad)
-            free((float *)current_grad);
+        chain_backward(mlp, cache, 0, T, trunk_grad, input_gradient);
 
-        current_grad = next_grad;
+        free(trunk_grad);
+        free(head_grad);
+    } else {
+        chain_backward(mlp, cache, 0, mlp->num_layers, out_grad, input_gradient);
     }
+
+    TRACE_END(ZONE_MLP_BACKWARD);
 }
 
 void free_mlp(MLP* mlp) {
-    for (int layer=0; layer<mlp->num_layers; layer++)
+    for (int layer=0; layer<mlp->num_layers; layer++) {
+        if (mlp->mapping) {
+            // Weights and biases live in the file mapping
+            mlp->layers[layer].weights = NULL;
+            mlp->layers[layer].biases = NULL;
+        }
+
         free_linear(&mlp->layers[layer]);
+    }
+
+    if (mlp->mapping) munmap(mlp->mapping, mlp->mapping_size);
 
     free(mlp->layers);
+    free(mlp->head_layers);
+    free(mlp->head_sizes);
 }
 
 int get_num_params(MLP *mlp) {
@@ -145,53 +389,219 @@ void mlp_zero_grad(MLP *mlp) {
         linear_zero_grad(&mlp->layers[i]);
 }
 
+/*
+ * Weight files start with a 'MLPW' magic and a version number, in native byte order.
+ *
+ *   v1: [magic, version, num_layers] then, per layer, [in, out, weights, biases] packed
+ *   v2: 64-byte header, a layer index, then every tensor at a 64-byte aligned offset.
+ *       An FNV-1a checksum covers everything after the header. The layout lets the
+ *       file be mmap'd and used in place (map_mlp_weights).
+ */
+#define MLPW_MAGIC 0x4D4C5057
+#define MLPW_ALIGN 64
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t num_layers;
+    uint32_t alignment;
+    uint64_t index_offset;
+    uint64_t data_offset;
+    uint64_t file_size;
+    uint64_t checksum;       // FNV-1a 64 of bytes [index_offset, file_size)
+    uint8_t reserved[16];
+} MLPWHeader;
+
+typedef struct {
+    uint32_t input_size;
+    uint32_t output_size;
+    uint64_t weights_offset;
+    uint64_t biases_offset;
+} MLPWLayerEntry;
+
+_Static_assert(sizeof(MLPWHeader) == 64, "MLPW v2 header must be 64 bytes");
+_Static_assert(sizeof(MLPWLayerEntry) == 24, "MLPW v2 index entry must be 24 bytes");
+
+static uint64_t fnv1a64(uint64_t hash, const void *data, size_t size) {
+    const uint8_t *bytes = data;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+static inline uint64_t align_up(uint64_t offset) {
+    return (offset + MLPW_ALIGN - 1) & ~(uint64_t)(MLPW_ALIGN - 1);
+}
+
 int save_mlp_weights(MLP *mlp, char *path) {
+    int num_layers = mlp->num_layers;
+    MLPWLayerEntry *index = calloc(num_layers, sizeof(MLPWLayerEntry));
+
+    MLPWHeader header = {
+        .magic = MLPW_MAGIC,
+        .version = 2,
+        .num_layers = (uint32_t)num_layers,
+        .alignment = MLPW_ALIGN,
+        .index_offset = sizeof(MLPWHeader),
+    };
+
+    uint64_t offset = align_up(sizeof(MLPWHeader) + num_layers * sizeof(MLPWLayerEntry));
+    header.data_offset = offset;
+
+    for (int l = 0; l < num_layers; l++) {
+        LinearLayer *layer = &mlp->layers[l];
+
+        index[l].input_size = (uint32_t)layer->input_size;
+        index[l].output_size = (uint32_t)layer->output_size;
+        index[l].weights_offset = offset;
+        offset = align_up(offset + (uint64_t)layer->input_size * layer->output_size * sizeof(float));
+        index[l].biases_offset = offset;
+        offset = align_up(offset + (uint64_t)layer->output_size * sizeof(float));
+    }
+    header.file_size = offset;
+
+    // Assemble the body in memory so the checksum and the write see the same bytes
+    size_t body_size = header.file_size - header.index_offset;
+    uint8_t *body = calloc(body_size, 1);
+
+    memcpy(body, index, num_layers * sizeof(MLPWLayerEntry));
+    for (int l = 0; l < num_layers; l++) {
+        LinearLayer *layer = &mlp->layers[l];
+
+        memcpy(body + index[l].weights_offset - header.index_offset, layer->weights,
+            (size_t)layer->input_size * layer->output_size * sizeof(float));
+        memcpy(body + index[l].biases_offset - header.index_offset, layer->biases,
+            (size_t)layer->output_size * sizeof(float));
+    }
+    header.checksum = fnv1a64(0xcbf29ce484222325ULL, body, body_size);
+    free(index);
+
     FILE *file = fopen(path, "wb");
 
     if (!file) {
         fprintf(stderr, "Error opening file %s.\n", path);
+        free(body);
         return 0;
     }
 
-    const uint32_t magic = 0x4D4C5057; /* 'MLPW' */
-    const uint32_t version = 1;
-    uint32_t num_layers = (uint32_t)mlp->num_layers;
+    int ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+             fwrite(body, 1, body_size, file) == body_size;
+    free(body);
 
-    if (fwrite(&magic, sizeof(magic), 1, file) != 1 ||
-        fwrite(&version, sizeof(version), 1, file) != 1 ||
-        fwrite(&num_layers, sizeof(num_layers), 1, file) != 1) {
-        fprintf(stderr, "Error writing header to %s.\n", path);
-        fclose(file);
+    if (fclose(file) != 0 || !ok) {
+        fprintf(stderr, "Error writing weights to %s.\n", path);
         return 0;
     }
 
+    return 1;
+}
+
+// Maps a v2 file read-only and checks it against the network's shape.
+static const MLPWLayerEntry *map_v2(const MLP *mlp, const char *path, int verify, void **base, size_t *size) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "Error opening file %s.\n", path);
+        return NULL;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(MLPWHeader)) {
+        fprintf(stderr, "Error reading header from %s.\n", path);
+        close(fd);
+        return NULL;
+    }
+
+    *size = (size_t)st.st_size;
+    *base = mmap(NULL, *size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (*base == MAP_FAILED) {
+        fprintf(stderr, "Error mapping file %s.\n", path);
+        return NULL;
+    }
+
+    const uint8_t *bytes = *base;
+    const MLPWHeader *header = *base;
+    const MLPWLayerEntry *index = (const MLPWLayerEntry *)(bytes + header->index_offset);
+    const char *error = NULL;
+
+    if (header->magic != MLPW_MAGIC || header->version != 2 || header->alignment != MLPW_ALIGN)
+        error = "Invalid file format or version";
+    else if (header->file_size != *size ||
+             header->index_offset + header->num_layers * sizeof(MLPWLayerEntry) > header->data_offset ||
+             header->data_offset > header->file_size)
+        error = "Truncated or corrupt header";
+    else if ((int)header->num_layers != mlp->num_layers)
+        error = "Layer count mismatch";
+    else if (verify && fnv1a64(0xcbf29ce484222325ULL, bytes + header->index_offset, *size - header->index_offset) != header->checksum)
+        error = "Checksum mismatch";
+
+    for (int l = 0; !error && l < mlp->num_layers; l++) {
+        const LinearLayer *layer = &mlp->layers[l];
+        uint64_t wsize = (uint64_t)layer->input_size * layer->output_size * sizeof(float);
+        uint64_t bsize = (uint64_t)layer->output_size * sizeof(float);
+
+        if ((int)index[l].input_size != layer->input_size || (int)index[l].output_size != layer->output_size)
+            error = "Layer size mismatch";
+        else if (index[l].weights_offset % MLPW_ALIGN || index[l].biases_offset % MLPW_ALIGN ||
+                 index[l].weights_offset + wsize > *size || index[l].biases_offset + bsize > *size)
+            error = "Tensor out of bounds";
+    }
+
+    if (error) {
+        fprintf(stderr, "%s in %s.\n", error, path);
+        munmap(*base, *size);
+        return NULL;
+    }
+
+    return index;
+}
+
+int map_mlp_weights(MLP *mlp, const char *path, int verify) {
+    void *base;
+    size_t size;
+
+    const MLPWLayerEntry *index = map_v2(mlp, path, verify, &base, &size);
+    if (!index) return 0;
+
     for (int l = 0; l < mlp->num_layers; l++) {
         LinearLayer *layer = &mlp->layers[l];
-        uint32_t in = (uint32_t)layer->input_size;
-        uint32_t out = (uint32_t)layer->output_size;
 
-        if (fwrite(&in, sizeof(in), 1, file) != 1 ||
-            fwrite(&out, sizeof(out), 1, file) != 1) {
-            fprintf(stderr, "Error writing layer sizes to %s.\n", path);
-            fclose(file);
-            return 0;
+        if (!mlp->mapping) {
+            free(layer->weights);
+            free(layer->biases);
         }
 
-        size_t wcount = (size_t)in * (size_t)out;
-        if (fwrite(layer->weights, sizeof(float), wcount, file) != wcount) {
-            fprintf(stderr, "Error writing weights for layer %d to %s.\n", l, path);
-            fclose(file);
-            return 0;
-        }
+        layer->weights = (float *)((uint8_t *)base + index[l].weights_offset);
+        layer->biases = (float *)((uint8_t *)base + index[l].biases_offset);
+    }
 
-        if (fwrite(layer->biases, sizeof(float), out, file) != out) {
-            fprintf(stderr, "Error writing biases for layer %d to %s.\n", l, path);
-            fclose(file);
-            return 0;
-        }
+    if (mlp->mapping) munmap(mlp->mapping, mlp->mapping_size);
+
+    mlp->mapping = base;
+    mlp->mapping_size = size;
+    return 1;
+}
+
+static int load_v2(MLP *mlp, const char *path) {
+    void *base;
+    size_t size;
+
+    const MLPWLayerEntry *index = map_v2(mlp, path, 1, &base, &size);
+    if (!index) return 0;
+
+    for (int l = 0; l < mlp->num_layers; l++) {
+        LinearLayer *layer = &mlp->layers[l];
+
+        memcpy(layer->weights, (uint8_t *)base + index[l].weights_offset,
+            (size_t)layer->input_size * layer->output_size * sizeof(float));
+        memcpy(layer->biases, (uint8_t *)base + index[l].biases_offset,
+            (size_t)layer->output_size * sizeof(float));
     }
 
-    fclose(file);
+    munmap(base, size);
     return 1;
 }
 
@@ -211,7 +621,18 @@ int load_mlp_weights(MLP *mlp, const char *path) {
         return 0;
     }
 
-    if (magic != 0x4D4C5057 || version != 1) {
+    if (mlp->mapping) {
+        fprintf(stderr, "Cannot load %s into weights mapped read-only.\n", path);
+        fclose(file);
+        return 0;
+    }
+
+    if (magic == MLPW_MAGIC && version == 2) {
+        fclose(file);
+        return load_v2(mlp, path);
+    }
+
+    if (magic != MLPW_MAGIC || version != 1) {
         fprintf(stderr, "Invalid file format or version in %s.\n", path);
         fclose(file);
         return 0;
@@ -265,6 +686,9 @@ MLPCache create_mlp_cache(const MLP *mlp, int capacity) {
     cache.num_layers = mlp->num_layers;
     cache.layer_caches = malloc(mlp->num_layers * sizeof(LinearCache));
     cache.output = malloc(capacity * mlp->output_size *  sizeof(float));
+    cache.checkpoint_every = 1;
+    cache.remat_chunk = 0;
+    cache.remat_scratch = NULL;
 
     for (int l = 0; l < mlp->num_layers; l++) {
         cache.layer_caches[l] = create_linear_cache(
@@ -272,9 +696,72 @@ MLPCache create_mlp_cache(const MLP *mlp, int capacity) {
         );
     }
 
+    // Every head reads the trunk's output from the first head's input buffer
+    int first = mlp->trunk_layers;
+    for (int h = 1; h < mlp->num_heads; h++) {
+        first += mlp->head_layers[h-1];
+        free(cache.layer_caches[first].layer_inputs);
+        cache.layer_caches[first].layer_inputs = cache.layer_caches[mlp->trunk_layers].layer_inputs;
+    }
+
     return cache;
 }
 
+MLPCache create_mlp_remat_cache(const MLP *mlp, int capacity, int checkpoint_every) {
+    int num_layers = mlp->num_layers;
+    int k = (checkpoint_every <= 0 || checkpoint_every > num_layers) ? num_layers : checkpoint_every;
+
+    if (k == 1) return create_mlp_cache(mlp, capacity);
+
+    if (mlp->num_heads > 1) {
+        fprintf(stderr, "WARNING: Rematerialization is not supported with multiple heads. Caching every layer.\n");
+        return create_mlp_cache(mlp, capacity);
+    }
+
+    MLPCache cache;
+
+    cache.size = 0;
+    cache.capacity = capacity;
+    cache.num_layers = num_layers;
+    cache.layer_caches = calloc(num_layers, sizeof(LinearCache));
+    cache.output = malloc(capacity * mlp->output_size * sizeof(float));
+    cache.checkpoint_every = k;
+    cache.remat_chunk = capacity < MLP_REMAT_CHUNK ? capacity : MLP_REMAT_CHUNK;
+
+    for (int l = 0; l < num_layers; l += k) {
+        cache.layer_caches[l].capacity = capacity;
+        cache.layer_caches[l].layer_inputs = malloc(capacity * mlp->layers[l].input_size * sizeof(float));
+    }
+
+    cache.remat_scratch = malloc((size_t)(2*k + 2) * cache.remat_chunk * max_layer_width(mlp) * sizeof(float));
+
+    return cache;
+}
+
+// Heads after the first share the trunk output buffer with it
+static int shares_inputs(const MLPCache *cache, int l) {
+    for (int j = 0; j < l; j++)
+        if (cache->layer_caches[j].layer_inputs && cache->layer_caches[j].layer_inputs == cache->layer_caches[l].layer_inputs)
+            return 1;
+    return 0;
+}
+
+size_t mlp_cache_bytes(const MLP *mlp, const MLPCache *cache) {
+    size_t floats = (size_t)cache->capacity * mlp->output_size;
+
+    for (int l = 0; l < cache->num_layers; l++) {
+        if (cache->layer_caches[l].layer_inputs && !shares_inputs(cache, l))
+            floats += (size_t)cache->capacity * mlp->layers[l].input_size;
+        if (cache->layer_caches[l].pre_activations)
+            floats += (size_t)cache->capacity * mlp->layers[l].output_size;
+    }
+
+    if (cache->remat_scratch)
+        floats += (size_t)(2*cache->checkpoint_every + 2) * cache->remat_chunk * max_layer_width(mlp);
+
+    return floats * sizeof(float);
+}
+
 void empty_mlp_cache(MLPCache *cache) {
     cache->size = 0;
     for (int l = 0; l < cache->num_layers; l++)
@@ -282,9 +769,12 @@ void empty_mlp_cache(MLPCache *cache) {
 }
 
 void free_mlp_cache(MLPCache *cache) {
-    for (int l = 0; l < cache->num_layers; l++)
+    for (int l = cache->num_layers - 1; l >= 0; l--) {
+        if (shares_inputs(cache, l)) cache->layer_caches[l].layer_inputs = NULL;
         free_linear_cache(&cache->layer_caches[l]);
+    }
 
     free(cache->layer_caches);
     free(cache->output);
+    free(cache->remat_scratch);
 }
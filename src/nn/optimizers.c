@@ -27,6 +27,10 @@ void gd_step(GDState *state, MLP *mlp, MLPCache *cache) {
     }
 }
 
+void gd_set_lr(GDState *state, float lr) {
+    state->lr = lr;
+}
+
 Optimizer make_gd(float lr) {
     GDState *state = malloc(sizeof(GDState));
 
@@ -34,7 +38,8 @@ Optimizer make_gd(float lr) {
 
     return (Optimizer) {
         .state=state,
-        .step=(void (*)(void *, MLP *, MLPCache *))gd_step
+        .step=(void (*)(void *, MLP *, MLPCache *))gd_step,
+        .set_lr=(void (*)(void *, float))gd_set_lr
     };
 }
 
@@ -49,6 +54,8 @@ typedef struct AdamState {
     float **weights_v;
     float **biases_m;
     float **biases_v;
+    int *weight_sizes;
+    int *bias_sizes;
 } AdamState;
 
 void adam_step(AdamState *state, MLP *mlp, MLPCache *cache) {
@@ -97,6 +104,55 @@ void free_adam_state(AdamState *state) {
     free(state->weights_v);
     free(state->biases_m);
     free(state->biases_v);
+    free(state->weight_sizes);
+    free(state->bias_sizes);
+}
+
+// Layout: t, then per layer weights_m, weights_v, biases_m, biases_v
+size_t adam_state_size(AdamState *state) {
+    size_t floats = 0;
+    for (int l = 0; l < state->num_layers; l++)
+        floats += 2 * (state->weight_sizes[l] + state->bias_sizes[l]);
+
+    return sizeof(long) + floats * sizeof(float);
+}
+
+void adam_save_state(AdamState *state, void *dst) {
+    char *p = dst;
+
+    memcpy(p, &state->t, sizeof(long));
+    p += sizeof(long);
+
+    for (int l = 0; l < state->num_layers; l++) {
+        size_t wbytes = state->weight_sizes[l] * sizeof(float);
+        size_t bbytes = state->bias_sizes[l] * sizeof(float);
+
+        memcpy(p, state->weights_m[l], wbytes); p += wbytes;
+        memcpy(p, state->weights_v[l], wbytes); p += wbytes;
+        memcpy(p, state->biases_m[l], bbytes);  p += bbytes;
+        memcpy(p, state->biases_v[l], bbytes);  p += bbytes;
+    }
+}
+
+void adam_load_state(AdamState *state, const void *src) {
+    const char *p = src;
+
+    memcpy(&state->t, p, sizeof(long));
+    p += sizeof(long);
+
+    for (int l = 0; l < state->num_layers; l++) {
+        size_t wbytes = state->weight_sizes[l] * sizeof(float);
+        size_t bbytes = state->bias_sizes[l] * sizeof(float);
+
+        memcpy(state->weights_m[l], p, wbytes); p += wbytes;
+        memcpy(state->weights_v[l], p, wbytes); p += wbytes;
+        memcpy(state->biases_m[l], p, bbytes);  p += bbytes;
+        memcpy(state->biases_v[l], p, bbytes);  p += bbytes;
+    }
+}
+
+void adam_set_lr(AdamState *state, float lr) {
+    state->lr = lr;
 }
 
 Optimizer make_adam(
@@ -118,11 +174,15 @@ Optimizer make_adam(
     state->weights_v = malloc(mlp->num_layers * sizeof(float*));
     state->biases_m = malloc(mlp->num_layers * sizeof(float*));
     state->biases_v = malloc(mlp->num_layers * sizeof(float*));
+    state->weight_sizes = malloc(mlp->num_layers * sizeof(int));
+    state->bias_sizes = malloc(mlp->num_layers * sizeof(int));
 
     state->num_layers = mlp->num_layers;
     for (int l = 0; l < mlp->num_layers; l++) {
         int weight_size = mlp->layers[l].input_size * mlp->layers[l].output_size;
         int bias_size = mlp->layers[l].output_size;
+        state->weight_sizes[l] = weight_size;
+        state->bias_sizes[l] = bias_size;
 
         state->weights_m[l] = calloc(weight_size, sizeof(float));
         state->weights_v[l] = calloc(weight_size, sizeof(float));
@@ -133,6 +193,10 @@ Optimizer make_adam(
     return (Optimizer){
         .state=state,
         .step=(void (*)(void *, MLP *, MLPCache *))adam_step,
-        .destroy=(void (*)(void *))free_adam_state
+        .destroy=(void (*)(void *))free_adam_state,
+        .state_size=(size_t (*)(void *))adam_state_size,
+        .save_state=(void (*)(void *, void *))adam_save_state,
+        .load_state=(void (*)(void *, const void *))adam_load_state,
+        .set_lr=(void (*)(void *, float))adam_set_lr
     };
 }
@@ -0,0 +1,276 @@
+#include <string.h>
+#include <math.h>
+#include <stdint.h>
+
+#include "nn/softmax.h"
+
+#define SOFTMAX_INLINE static inline __attribute__((always_inline))
+
+// Vector width follows the target ISA, as in gemm.c
+#if defined(__AVX__)
+#define VW 8
+#else
+#define VW 4
+#endif
+
+typedef float vfloat __attribute__((vector_size(VW * sizeof(float))));
+typedef int32_t vint __attribute__((vector_size(VW * sizeof(int32_t))));
+
+// exp overflows above 88.72 and leaves the normal range below -87.33
+#define EXP_HI 88.3762626647949f
+#define EXP_LO -87.3365447504f
+
+#define LOG2E 1.44269504088896341f
+#define LN2_HI 0.693359375f
+#define LN2_LO -2.12194440e-4f
+
+// Adding and subtracting 1.5 * 2^23 rounds a float to the nearest integer
+#define ROUND_MAGIC 12582912.0f
+
+SOFTMAX_INLINE vfloat vload(const float *p) {
+    vfloat v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+SOFTMAX_INLINE void vstore(float *p, vfloat v) {
+    memcpy(p, &v, sizeof(v));
+}
+
+SOFTMAX_INLINE vfloat vbroadcast(float x) {
+    return (vfloat){ 0 } + x;
+}
+
+SOFTMAX_INLINE vfloat vselect(vint mask, vfloat a, vfloat b) {
+    return (vfloat)(((vint)a & mask) | ((vint)b & ~mask));
+}
+
+SOFTMAX_INLINE float hsum(vfloat v) {
+    float s = 0.0f;
+    for (int i = 0; i < VW; i++) s += v[i];
+    return s;
+}
+
+SOFTMAX_INLINE float hmax(vfloat v) {
+    float m = v[0];
+    for (int i = 1; i < VW; i++) m = v[i] > m ? v[i] : m;
+    return m;
+}
+
+// Cephes expf polynomial on [-ln2/2, ln2/2]
+SOFTMAX_INLINE vfloat vexp(vfloat x) {
+    x = vselect(x > EXP_HI, vbroadcast(EXP_HI), x);
+    x = vselect(x < EXP_LO, vbroadcast(EXP_LO), x);
+
+    vfloat k = (x * LOG2E + ROUND_MAGIC) - ROUND_MAGIC;
+    vfloat r = x - k * LN2_HI - k * LN2_LO;
+
+    vfloat p = vbroadcast(1.9875691500e-4f);
+    p = p * r + 1.3981999507e-3f;
+    p = p * r + 8.3334519073e-3f;
+    p = p * r + 4.1665795894e-2f;
+    p = p * r + 1.6666665459e-1f;
+    p = p * r + 5.0000001201e-1f;
+    p = p * r * r + r + 1.0f;
+
+    vint bits = (__builtin_convertvector(k, vint) + 127) << 23;
+    return p * (vfloat)bits;
+}
+
+#define SQRT_HALF 0.707106781186547524f
+
+// Cephes logf for x > 0: x = m 2^e with m in [sqrt(1/2), sqrt(2)), log(m) from a degree-9 polynomial
+SOFTMAX_INLINE vfloat vlog(vfloat x) {
+    vint bits = (vint)x;
+    vint e = ((bits >> 23) & 0xff) - 126;
+    vfloat m = (vfloat)((bits & 0x007fffff) | 0x3f000000);    // [0.5, 1)
+
+    vint small = m < SQRT_HALF;
+    e += small;                                                 // the mask is -1 where set
+    m = m - 1.0f + vselect(small, m, vbroadcast(0.0f));
+
+    vfloat z = m * m;
+    vfloat y = vbroadcast(7.0376836292e-2f);
+    y = y * m - 1.1514610310e-1f;
+    y = y * m + 1.1676998740e-1f;
+    y = y * m - 1.2420140846e-1f;
+    y = y * m + 1.4249322787e-1f;
+    y = y * m - 1.6668057665e-1f;
+    y = y * m + 2.0000714765e-1f;
+    y = y * m - 2.4999993993e-1f;
+    y = y * m + 3.3333331174e-1f;
+    y = y * m * z;
+
+    vfloat fe = __builtin_convertvector(e, vfloat);
+    y += fe * LN2_LO - 0.5f * z;
+    return m + y + fe * LN2_HI;
+}
+
+// sin(2 pi t) for |t| <= 1/4 from the Taylor series to x^11 (error < 1e-7)
+SOFTMAX_INLINE vfloat vsin_2pi(vfloat t) {
+    vfloat x = t * (2.0f * (float)M_PI), x2 = x * x;
+    vfloat p = vbroadcast(-2.5052108e-8f);
+    p = p * x2 + 2.7557319e-6f;
+    p = p * x2 - 1.9841270e-4f;
+    p = p * x2 + 8.3333333e-3f;
+    p = p * x2 - 1.6666667e-1f;
+    return x + x * x2 * p;
+}
+
+SOFTMAX_INLINE vfloat vabs(vfloat x) {
+    return (vfloat)((vint)x & 0x7fffffff);
+}
+
+// Scalar tail through the same vector code, so every element gets the same rounding
+SOFTMAX_INLINE vfloat vload_tail(const float *p, int n, float fill) {
+    vfloat v = vbroadcast(fill);
+    for (int i = 0; i < n; i++) v[i] = p[i];
+    return v;
+}
+
+void vexpf(const float *x, int n, float *out) {
+    int i = 0;
+    for (; i + VW <= n; i += VW) vstore(out + i, vexp(vload(x + i)));
+
+    if (i < n) {
+        vfloat v = vexp(vload_tail(x + i, n - i, 0.0f));
+        for (int j = 0; i + j < n; j++) out[i + j] = v[j];
+    }
+}
+
+void vlogf(const float *x, int n, float *out) {
+    int i = 0;
+    for (; i + VW <= n; i += VW) vstore(out + i, vlog(vload(x + i)));
+
+    if (i < n) {
+        vfloat v = vlog(vload_tail(x + i, n - i, 1.0f));
+        for (int j = 0; i + j < n; j++) out[i + j] = v[j];
+    }
+}
+
+// (r cos 2 pi u2, r sin 2 pi u2) with r = sqrt(-2 log u1), for a vector of pairs
+SOFTMAX_INLINE void vbox_muller(vfloat u1, vfloat u2, vfloat *z1, vfloat *z2) {
+    vfloat r2 = -2.0f * vlog(u1), r;
+    for (int l = 0; l < VW; l++) r[l] = sqrtf(r2[l]);
+
+    // With t = u2 - 1/2: cos 2 pi u2 = -sin 2 pi (1/4 - |t|) and sin 2 pi u2 = -sin 2 pi t, folded
+    // onto [-1/4, 1/4] with sign bits instead of branches
+    vfloat t = u2 - 0.5f, a = vabs(t);
+    vint sign = (vint)t & (int32_t)0x80000000;
+    vfloat s = (vfloat)((vint)(0.25f - vabs(a - 0.25f)) | sign);
+
+    *z1 = -r * vsin_2pi(0.25f - a);
+    *z2 = -r * vsin_2pi(s);
+}
+
+void box_muller(float *u, int h) {
+    float *u2 = u + h;
+    vfloat z1, z2;
+
+    int i = 0;
+    for (; i + VW <= h; i += VW) {
+        vbox_muller(vload(u + i), vload(u2 + i), &z1, &z2);
+        vstore(u + i, z1);
+        vstore(u2 + i, z2);
+    }
+
+    if (i < h) {
+        vbox_muller(vload_tail(u + i, h - i, 0.5f), vload_tail(u2 + i, h - i, 0.5f), &z1, &z2);
+        for (int j = 0; i + j < h; j++) {
+            u[i + j] = z1[j];
+            u2[i + j] = z2[j];
+        }
+    }
+}
+
+int gumbel_argmax(const float *x, int n, const float *u) {
+    vfloat best = vbroadcast(-INFINITY);
+    vint best_idx = (vint){ 0 }, idx, step = (vint){ 0 } + VW;
+    for (int l = 0; l < VW; l++) idx[l] = l;
+
+    int i = 0;
+    for (; i + VW <= n; i += VW, idx += step) {
+        vfloat v = vload(x + i) - vlog(-vlog(vload(u + i)));
+        vint better = v > best;
+        best = vselect(better, v, best);
+        best_idx = (best_idx & ~better) | (idx & better);
+    }
+
+    if (i < n) {
+        // Padding lanes get a -inf logit and never win
+        vfloat v = vload_tail(x + i, n - i, -INFINITY) - vlog(-vlog(vload_tail(u + i, n - i, 0.5f)));
+        vint better = v > best;
+        best = vselect(better, v, best);
+        best_idx = (best_idx & ~better) | (idx & better);
+    }
+
+    // Lowest index among the lanes holding the max
+    int arg = best_idx[0];
+    float max = best[0];
+    for (int l = 1; l < VW; l++) {
+        if (best[l] > max || (best[l] == max && best_idx[l] < arg)) {
+            max = best[l];
+            arg = best_idx[l];
+        }
+    }
+
+    return n > 0 ? arg : 0;
+}
+
+float softmax_row(const float *x, int n, float *e, float *sum) {
+    vfloat vmax = vbroadcast(-INFINITY);
+    int i = 0;
+    for (; i + VW <= n; i += VW) {
+        vfloat v = vload(x + i);
+        vmax = vselect(v > vmax, v, vmax);
+    }
+    float max = hmax(vmax);
+    for (; i < n; i++) max = x[i] > max ? x[i] : max;
+
+    vfloat shift = vbroadcast(max), acc = vbroadcast(0.0f);
+    for (i = 0; i + VW <= n; i += VW) {
+        vfloat v = vexp(vload(x + i) - shift);
+        vstore(e + i, v);
+        acc += v;
+    }
+    float s = hsum(acc);
+
+    if (i < n) {
+        // Padding lanes hold exp(0) and stay out of the sum
+        vfloat v = vexp(vload_tail(x + i, n - i, max) - shift);
+        for (int j = 0; i + j < n; j++) {
+            e[i + j] = v[j];
+            s += v[j];
+        }
+    }
+
+    *sum = s;
+    return max + logf(s);
+}
+
+void log_softmax(const float *logits, int rows, int n, float *log_probs) {
+    for (int r = 0; r < rows; r++) {
+        const float *x = logits + (size_t)r * n;
+        float *out = log_probs + (size_t)r * n;
+        float sum;
+
+        // The row's exponentials are only needed for the sum: out is the scratch
+        float lse = softmax_row(x, n, out, &sum);
+
+        vfloat vlse = vbroadcast(lse);
+        int i = 0;
+        for (; i + VW <= n; i += VW) vstore(out + i, vload(x + i) - vlse);
+        for (; i < n; i++) out[i] = x[i] - lse;
+    }
+}
+
+int sample_inverse_cdf(const float *e, int n, float sum, float u) {
+    float target = u * sum, cum = 0.0f;
+
+    for (int i = 0; i < n - 1; i++) {
+        cum += e[i];
+        if (target < cum) return i;
+    }
+
+    return n - 1;
+}
@@ -0,0 +1,335 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <mpi.h>
+
+#include "distributed/comm.h"
+#include "pbt.h"
+
+#define MAX_VALUES 16
+
+// Explore multiplies the learning rate and 1 - γ by one of these
+#define EXPLORE_DOWN 0.8f
+#define EXPLORE_UP 1.25f
+
+// 1 - γ stays in this range
+#define MIN_HORIZON_RATE 1e-4f
+#define MAX_HORIZON_RATE 0.5f
+
+typedef struct PBTSpec {
+    int members;
+    int interval;
+    float fraction;
+    float lr_low, lr_high;
+    float gamma[MAX_VALUES];
+    int n_gamma;
+    int episodes[MAX_VALUES];
+    int n_episodes;
+} PBTSpec;
+
+typedef struct Hyperparameters {
+    float learning_rate;
+    float gamma;
+    int episodes;
+} Hyperparameters;
+
+typedef struct RankedMember {
+    double fitness;
+    int index;
+} RankedMember;
+
+static int parse_floats(const char *text, float *values) {
+    int n = 0;
+    char *end;
+
+    while (*text && n < MAX_VALUES) {
+        float v = strtof(text, &end);
+        if (end == text || !(v > 0.0f)) return 0;
+
+        values[n++] = v;
+        text = end;
+        if (*text == ',') text++;
+        else if (*text) return 0;
+    }
+
+    return n;
+}
+
+static int parse_ints(const char *text, int *values) {
+    float parsed[MAX_VALUES];
+    int n = parse_floats(text, parsed);
+
+    for (int i = 0; i < n; i++) {
+        if (parsed[i] != floorf(parsed[i])) return 0;
+        values[i] = (int)parsed[i];
+    }
+    return n;
+}
+
+static int parse_spec(const char *text, const Config *config, int world_size, PBTSpec *spec) {
+    memset(spec, 0, sizeof(*spec));
+    spec->members = world_size;
+    spec->interval = 50;
+    spec->fraction = 0.25f;
+    spec->lr_low = config->learning_rate / 4.0f;
+    spec->lr_high = config->learning_rate * 4.0f;
+
+    char buf[512];
+    strncpy(buf, text, sizeof(buf) - 1);
+    buf[sizeof(buf) - 1] = '\0';
+
+    for (char *field = strtok(buf, ":"); field; field = strtok(NULL, ":")) {
+        char *eq = strchr(field, '=');
+        if (!eq) return 0;
+        *eq = '\0';
+        const char *value = eq + 1;
+
+        int n_values = 0;
+        float range[MAX_VALUES];
+
+        if (strcmp(field, "members") == 0) n_values = parse_ints(value, &spec->members);
+        else if (strcmp(field, "interval") == 0) n_values = parse_ints(value, &spec->interval);
+        else if (strcmp(field, "fraction") == 0) n_values = parse_floats(value, &spec->fraction);
+        else if (strcmp(field, "gamma") == 0) n_values = spec->n_gamma = parse_floats(value, spec->gamma);
+        else if (strcmp(field, "episodes") == 0) n_values = spec->n_episodes = parse_ints(value, spec->episodes);
+        else if (strcmp(field, "lr") == 0) {
+            n_values = parse_floats(value, range);
+            if (n_values != 2 || range[0] > range[1]) return 0;
+            spec->lr_low = range[0];
+            spec->lr_high = range[1];
+        }
+        if (n_values == 0) return 0;
+    }
+
+    if (spec->n_gamma == 0) spec->gamma[spec->n_gamma++] = config->gamma;
+    if (spec->n_episodes == 0) spec->episodes[spec->n_episodes++] = config->episodes;
+
+    for (int i = 0; i < spec->n_gamma; i++)
+        if (spec->gamma[i] > 1.0f) return 0;
+
+    return spec->members <= world_size && world_size % spec->members == 0 && spec->fraction <= 0.5f;
+}
+
+// Uniform in [0, 1): draw k of a member in a round, from the run's seed (the ES seed hash)
+static float draw(uint32_t seed, int round, int member, int k) {
+    return (es_seed(seed, (uint32_t)round, (uint32_t)(4 * member + k)) >> 8) * (1.0f / 16777216.0f);
+}
+
+static int pick(float u, int n) {
+    int i = (int)(u * n);
+    return i < n ? i : n - 1;
+}
+
+static Hyperparameters initial_hyperparameters(const PBTSpec *spec, uint32_t seed, int member) {
+    return (Hyperparameters){
+        .learning_rate = spec->lr_low * powf(spec->lr_high / spec->lr_low, draw(seed, 0, member, 0)),
+        .gamma = spec->gamma[pick(draw(seed, 0, member, 1), spec->n_gamma)],
+        .episodes = spec->episodes[pick(draw(seed, 0, member, 2), spec->n_episodes)],
+    };
+}
+
+// The donor's hyperparameters with the learning rate and 1 - γ perturbed
+static Hyperparameters explore(Hyperparameters hp, uint32_t seed, int round, int member) {
+    hp.learning_rate *= draw(seed, round, member, 0) < 0.5f ? EXPLORE_DOWN : EXPLORE_UP;
+
+    float rate = (1.0f - hp.gamma) * (draw(seed, round, member, 1) < 0.5f ? EXPLORE_DOWN : EXPLORE_UP);
+    rate = fminf(fmaxf(rate, MIN_HORIZON_RATE), MAX_HORIZON_RATE);
+    hp.gamma = 1.0f - rate;
+
+    return hp;
+}
+
+static Config member_config(const Config *config, const Hyperparameters *hp, int member) {
+    Config run = *config;
+    run.learning_rate = hp->learning_rate;
+    run.gamma = hp->gamma;
+    run.episodes = hp->episodes;
+    run.seed = config->seed + member;
+    return run;
+}
+
+static int compare_fitness(const void *a, const void *b) {
+    const RankedMember *x = a, *y = b;
+    if (x->fitness != y->fitness) return x->fitness > y->fitness ? -1 : 1;
+    return x->index - y->index;
+}
+
+/*
+ * Ranks the members by fitness and gives each of the bottom `cut` a donor drawn from
+ * the top `cut`; donor[m] is -1 for the members that carry on.
+ */
+static void select_donors(const double *fitness, int members, int cut, uint32_t seed, int round, int *donor) {
+    RankedMember *ranked = malloc(members * sizeof(RankedMember));
+    for (int m = 0; m < members; m++) ranked[m] = (RankedMember){fitness[m], m};
+    qsort(ranked, members, sizeof(RankedMember), compare_fitness);
+
+    for (int m = 0; m < members; m++) donor[m] = -1;
+    for (int i = members - cut; i < members; i++) {
+        int m = ranked[i].index;
+        donor[m] = ranked[pick(draw(seed, round, m, 2), cut)].index;
+    }
+
+    free(ranked);
+}
+
+static void print_population(const Hyperparameters *hp, const double *fitness, const int *exploits, int members,
+                             int ranks_per_member, int best) {
+    fprintf(stdout, "\n");
+    fprintf(stdout, "=================================================================\n");
+    fprintf(stdout, "            POPULATION-BASED TRAINING (%d members)\n", members);
+    fprintf(stdout, "=================================================================\n");
+    fprintf(stdout, "  %6s %6s %10s %8s %9s %10s %9s\n", "member", "ranks", "lr", "gamma", "episodes", "return", "exploits");
+
+    for (int m = 0; m < members; m++) {
+        fprintf(stdout, "  %6d %6d %10.2e %8.4f %9d %10.2f %9d%s\n", m, ranks_per_member, hp[m].learning_rate,
+                hp[m].gamma, hp[m].episodes, fitness[m], exploits[m], m == best ? "  (best)" : "");
+    }
+    fprintf(stdout, "=================================================================\n\n");
+}
+
+int run_pbt(const Config *config, const MPIContext *ctx) {
+    PBTSpec spec;
+    if (!parse_spec(config->pbt, config, ctx->world_size, &spec)) {
+        main_printf(ctx, "ERROR: Invalid PBT spec '%s' (members must divide %d ranks)\n", config->pbt, ctx->world_size);
+        return 0;
+    }
+
+    int members = spec.members, ranks_per_member = ctx->world_size / members;
+    int member = ctx->rank / ranks_per_member;
+    uint32_t seed = (uint32_t)config->seed;
+
+    int cut = (int)(members * spec.fraction);
+    if (cut == 0 && members > 1) cut = 1;
+
+    // Every rank tracks the whole population; all decisions are made identically everywhere
+    Hyperparameters *hp = malloc(members * sizeof(Hyperparameters));
+    double *fitness = calloc(members, sizeof(double));
+    int *donor = malloc(members * sizeof(int));
+    int *exploits = calloc(members, sizeof(int));
+    double *gathered = malloc(2 * ctx->world_size * sizeof(double));
+    for (int m = 0; m < members; m++) hp[m] = initial_hyperparameters(&spec, seed, m);
+
+    MPI_Comm sub;
+    MPI_Comm_split(ctx->comm, member, ctx->rank, &sub);
+
+    MPIContext sub_ctx = *ctx;
+    sub_ctx.comm = sub;
+    MPI_Comm_rank(sub, &sub_ctx.rank);
+    MPI_Comm_size(sub, &sub_ctx.world_size);
+
+    Config run = member_config(config, &hp[member], member);
+    Trainer trainer = create_trainer(&run, &sub_ctx);
+
+    main_printf(ctx, "PBT: %d members of %d rank(s), exploit every %d steps, bottom %d copy the top %d\n",
+                members, ranks_per_member, spec.interval, cut, cut);
+
+    FILE *csv = NULL;
+    if (ctx->rank == 0 && config->output_dir) {
+        char path[512];
+        snprintf(path, sizeof(path), "%s/pbt.csv", config->output_dir);
+        csv = fopen(path, "w");
+        if (csv) fprintf(csv, "round,step,member,learning_rate,gamma,episodes,return,donor\n");
+        else fprintf(stderr, "ERROR: Could not write %s\n", path);
+    }
+
+    double start = get_time();
+    long env_steps = 0;
+    int transfers = 0;
+
+    for (int step = 0, round = 1; step < config->grad_steps; round++) {
+        int steps = spec.interval < config->grad_steps - step ? spec.interval : config->grad_steps - step;
+
+        // Fitness: mean return of the member's episodes over the interval
+        double local[2] = {0.0, 0.0};
+        for (int s = 0; s < steps; s++) {
+            const TrainingMetrics *metrics = &trainer.metrics;
+            int slot = trainer_step(&trainer), n = metrics->num_episodes;
+
+            for (int ep = 0; ep < n; ep++) {
+                local[0] += metrics->returns[slot * n + ep];
+                env_steps += metrics->steps[slot * n + ep];
+            }
+            local[1] += n;
+        }
+        step += steps;
+
+        MPI_Allgather(local, 2, MPI_DOUBLE, gathered, 2, MPI_DOUBLE, ctx->comm);
+        for (int m = 0; m < members; m++) {
+            double sum = 0.0, count = 0.0;
+            for (int r = m * ranks_per_member; r < (m + 1) * ranks_per_member; r++) {
+                sum += gathered[2 * r];
+                count += gathered[2 * r + 1];
+            }
+            fitness[m] = count > 0 ? sum / count : 0.0;
+        }
+
+        // No exploit after the last interval
+        if (step < config->grad_steps) select_donors(fitness, members, cut, seed, round, donor);
+        else for (int m = 0; m < members; m++) donor[m] = -1;
+
+        for (int m = 0; m < members; m++) {
+            if (csv) fprintf(csv, "%d,%d,%d,%.6e,%.6f,%d,%.4f,%d\n", round, step, m, hp[m].learning_rate,
+                             hp[m].gamma, hp[m].episodes, fitness[m], donor[m]);
+            if (donor[m] < 0) continue;
+
+            Hyperparameters next = explore(hp[donor[m]], seed, round, m);
+            main_printf(ctx, "PBT step %d: member %d (%.1f) <- member %d (%.1f), lr %.2e, gamma %.4f, %d episode(s)\n",
+                        step, m, fitness[m], donor[m], fitness[donor[m]], next.learning_rate, next.gamma, next.episodes);
+
+            // A new batch size needs new rollout buffers; the weights are overwritten below
+            if (m == member) trainer_set_episodes(&trainer, next.episodes);
+            hp[m] = next;
+            exploits[m]++;
+        }
+
+        // Exploit: one message from each donor's rank 0 to its recipient's rank 0, then a broadcast in the recipient
+        for (int m = 0; m < members; m++) {
+            if (donor[m] < 0) continue;
+
+            transfer_model_state(trainer.policy.mlp, &trainer.optimizer, donor[m] * ranks_per_member,
+                                 m * ranks_per_member, ctx);
+            transfers++;
+        }
+
+        if (donor[member] >= 0) {
+            trainer_set_hyperparameters(&trainer, hp[member].learning_rate, hp[member].gamma);
+            // The target network restarts from the copied weights
+            if (trainer.algo == ALGO_DQN) dqn_sync_target(&trainer.target, trainer.policy.mlp);
+            trainer_sync(&trainer);
+        }
+    }
+
+    double wall = get_time() - start;
+    long total_steps = 0;
+    MPI_Reduce(&env_steps, &total_steps, 1, MPI_LONG, MPI_SUM, 0, ctx->comm);
+
+    int best = 0;
+    for (int m = 1; m < members; m++)
+        if (fitness[m] > fitness[best]) best = m;
+
+    if (config->output_dir && member == best && sub_ctx.rank == 0) {
+        char path[512];
+        snprintf(path, sizeof(path), "%s/weights.bin", config->output_dir);
+        save_mlp_weights(trainer.policy.mlp, path);
+    }
+
+    if (ctx->rank == 0) {
+        size_t message = (size_t)get_num_params(trainer.policy.mlp) * sizeof(float) + optimizer_state_size(&trainer.optimizer);
+
+        print_population(hp, fitness, exploits, members, ranks_per_member, best);
+        fprintf(stdout, "  %ld env steps in %.3f s, %d exploit transfer(s) of %.1f KiB\n\n",
+                total_steps, wall, transfers, message / 1024.0);
+    }
+
+    if (csv) fclose(csv);
+    free_trainer(&trainer);
+    MPI_Comm_free(&sub);
+
+    free(hp);
+    free(fitness);
+    free(donor);
+    free(exploits);
+    free(gathered);
+    return 1;
+}
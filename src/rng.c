@@ -2,18 +2,112 @@
 #include <math.h>
 
 #include "rng.h"
+#include "nn/softmax.h"
+
+static RNGState rng = {0x853c49e6748fea9bULL, 0xda3e39cb94b95bdbULL};
+
+// Lanes of the interleaved fill: lane l produces outputs l, l + FILL_LANES, ...
+#define FILL_LANES 8
+
+#define PCG_MULT 6364136223846793005ULL
+
+// Multiplier and increment of `delta` LCG steps at once (Brown, "Random number generation with arbitrary strides")
+static void pcg32_stride(uint64_t delta, uint64_t inc, uint64_t *mult, uint64_t *plus) {
+    uint64_t cur_mult = PCG_MULT, cur_plus = inc, acc_mult = 1, acc_plus = 0;
+
+    while (delta > 0) {
+        if (delta & 1) {
+            acc_mult *= cur_mult;
+            acc_plus = acc_plus * cur_mult + cur_plus;
+        }
+        cur_plus = (cur_mult + 1) * cur_plus;
+        cur_mult *= cur_mult;
+        delta >>= 1;
+    }
+
+    *mult = acc_mult;
+    *plus = acc_plus;
+}
+
+static inline uint32_t pcg32_output(uint64_t old) {
+    uint32_t xorshifted = (uint32_t)(((old >> 18u) ^ old) >> 27u);
+    uint32_t rot = (uint32_t)(old >> 59u);
+    return (xorshifted >> rot) | (xorshifted << ((-rot) & 31));
+}
+
+// PCG32 (XSH RR): 64-bit LCG state, 32-bit permuted output
+static uint32_t pcg32_next(RNGState *s) {
+    uint64_t old = s->state;
+    s->state = old * PCG_MULT + s->inc;
+    return pcg32_output(old);
+}
+
+// Uniform in [0, 1) with 24 bits of precision
+static inline float pcg32_float(RNGState *s) {
+    return (pcg32_next(s) >> 8) * (1.0f / 16777216.0f);
+}
 
 void rng_seed(unsigned int s) {
-    srand(s);
+    rng.state = 0;
+    rng.inc = ((uint64_t)s << 1u) | 1u;
+    pcg32_next(&rng);
+    rng.state += 0x853c49e6748fea9bULL;
+    pcg32_next(&rng);
+}
+
+RNGState rng_get_state() {
+    return rng;
+}
+
+void rng_set_state(RNGState state) {
+    rng = state;
 }
 
 float rand_uniform(float low, float high) {
-    return ((float)rand() / (float)RAND_MAX) * (high - low) + low;
+    return pcg32_float(&rng) * (high - low) + low;
+}
+
+/*
+ * Consumes the same n draws of the stream, in the same order, as n scalar calls, but
+ * maps each 24-bit draw k to the cell midpoint (k + 0.5) / 2^24 rather than k / 2^24,
+ * so that no value is 0 or 1. The lanes walk the one stream FILL_LANES steps at a time,
+ * so the loop has no serial dependency across lanes and vectorizes.
+ */
+void rand_uniform_fill(float *out, int n) {
+    int i = 0;
+
+    if (n >= 2 * FILL_LANES) {
+        uint64_t lane[FILL_LANES], mult, plus;
+
+        lane[0] = rng.state;
+        for (int l = 1; l < FILL_LANES; l++) lane[l] = lane[l - 1] * PCG_MULT + rng.inc;
+        pcg32_stride(FILL_LANES, rng.inc, &mult, &plus);
+
+        for (; i + FILL_LANES <= n; i += FILL_LANES) {
+            for (int l = 0; l < FILL_LANES; l++) {
+                out[i + l] = ((pcg32_output(lane[l]) >> 8) + 0.5f) * (1.0f / 16777216.0f);
+                lane[l] = lane[l] * mult + plus;
+            }
+        }
+
+        rng.state = lane[0];
+    }
+
+    for (; i < n; i++) out[i] = ((pcg32_next(&rng) >> 8) + 0.5f) * (1.0f / 16777216.0f);
+}
+
+// Box-Muller on bulk uniforms, through the SIMD kernel in softmax.c
+void rand_normal_fill(float *out, int n) {
+    int h = n / 2;
+    rand_uniform_fill(out, 2 * h);
+    box_muller(out, h);
+
+    if (n & 1) out[n - 1] = rand_normal(0.0f, 1.0f);
 }
 
 float rand_normal(float mean, float std) {
-    float u1 = (float)rand() / (float)RAND_MAX;
-    float u2 = (float)rand() / (float)RAND_MAX;
+    float u1 = 1.0f - pcg32_float(&rng);    // (0, 1], keeps the log finite
+    float u2 = pcg32_float(&rng);
     float z  = sqrtf(-2.0f * logf(u1)) * cosf(2.0f * M_PI * u2);
     return mean + std * z;
 }
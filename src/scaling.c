@@ -0,0 +1,279 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <mpi.h>
+
+#include "rng.h"
+#include "scaling.h"
+
+#define MAX_VALUES 16
+
+// Rank-averaged returns are smoothed over this many steps for time-to-target
+#define TARGET_SMOOTHING 10
+
+typedef struct ScalingSpec {
+    int ranks[MAX_VALUES], n_ranks;
+    int episodes[MAX_VALUES], n_episodes;
+    int hidden[MAX_VALUES], n_hidden;
+    int strong;
+} ScalingSpec;
+
+typedef struct ScalingResult {
+    int ranks;
+    int episodes_per_rank;
+    int hidden;
+    double wall_time;
+    double env_steps_per_s;
+    double episodes_per_s;
+    double comm_compute;
+    double time_to_target;      // -1 if never reached
+    double efficiency;
+} ScalingResult;
+
+static int parse_list(const char *text, int *values) {
+    int n = 0;
+    char *end;
+
+    while (*text && n < MAX_VALUES) {
+        long v = strtol(text, &end, 10);
+        if (end == text || v < 1) return 0;
+
+        values[n++] = (int)v;
+        text = end;
+        if (*text == ',') text++;
+        else if (*text) return 0;
+    }
+
+    return n;
+}
+
+static int cmp_desc(const void *a, const void *b) {
+    return *(const int *)b - *(const int *)a;
+}
+
+static int parse_spec(const char *text, int world_size, int default_hidden, ScalingSpec *spec) {
+    memset(spec, 0, sizeof(*spec));
+
+    char buf[512];
+    strncpy(buf, text, sizeof(buf) - 1);
+    buf[sizeof(buf) - 1] = '\0';
+
+    for (char *field = strtok(buf, ":"); field; field = strtok(NULL, ":")) {
+        char *eq = strchr(field, '=');
+        if (!eq) return 0;
+        *eq = '\0';
+        const char *value = eq + 1;
+
+        if (strcmp(field, "ranks") == 0) spec->n_ranks = parse_list(value, spec->ranks);
+        else if (strcmp(field, "episodes") == 0) spec->n_episodes = parse_list(value, spec->episodes);
+        else if (strcmp(field, "hidden") == 0) spec->n_hidden = parse_list(value, spec->hidden);
+        else if (strcmp(field, "mode") == 0 && strcmp(value, "strong") == 0) spec->strong = 1;
+        else if (strcmp(field, "mode") == 0 && strcmp(value, "weak") == 0) spec->strong = 0;
+        else return 0;
+    }
+
+    if (spec->n_ranks == 0) {
+        for (int r = 1; r <= world_size && spec->n_ranks < MAX_VALUES; r *= 2)
+            spec->ranks[spec->n_ranks++] = r;
+    }
+    if (spec->n_episodes == 0) spec->episodes[spec->n_episodes++] = 1;
+    if (spec->n_hidden == 0) spec->hidden[spec->n_hidden++] = default_hidden;
+
+    for (int i = 0; i < spec->n_ranks; i++)
+        if (spec->ranks[i] > world_size) return 0;
+
+    qsort(spec->ranks, spec->n_ranks, sizeof(int), cmp_desc);
+    return 1;
+}
+
+// Waits on a barrier over the whole job, sleeping rather than spinning in MPI
+static void idle_barrier(MPI_Comm comm) {
+    MPI_Request request;
+    MPI_Ibarrier(comm, &request);
+
+    int done = 0;
+    struct timespec nap = {0, 1000000};
+    for (;;) {
+        MPI_Test(&request, &done, MPI_STATUS_IGNORE);
+        if (done) break;
+        nanosleep(&nap, NULL);
+    }
+}
+
+// Trains one configuration on sub_ctx; fills result on its rank 0
+static void run_configuration(const Config *config, const MPIContext *sub_ctx, ScalingResult *result) {
+    rng_seed(config->seed + sub_ctx->rank);
+
+    Trainer trainer = create_trainer(config, sub_ctx);
+    TrainingMetrics *metrics = &trainer.metrics;
+
+    int steps = config->grad_steps;
+    float *step_returns = calloc(steps, sizeof(float));
+    double *step_times = malloc(steps * sizeof(double));
+
+    MPI_Barrier(sub_ctx->comm);
+    double start = get_time();
+
+    for (int s = 0; s < steps; s++) {
+        int slot = trainer_step(&trainer);
+
+        for (int ep = 0; ep < trainer.episodes; ep++)
+            step_returns[s] += metrics->returns[slot * trainer.episodes + ep] / trainer.episodes;
+        step_times[s] = get_time() - start;
+    }
+
+    metrics->wall_time_train = metrics->wall_time_total = get_time() - start;
+    reduce_metrics(metrics, sub_ctx, 0);
+
+    int is_root = sub_ctx->rank == 0;
+    MPI_Reduce(is_root ? MPI_IN_PLACE : step_returns, step_returns, steps, MPI_FLOAT, MPI_SUM, 0, sub_ctx->comm);
+
+    if (is_root) {
+        const MetricsAggregates *t = &metrics->totals;
+        double wall = metrics->stats[STAT_WALL_TRAIN].max;
+        double compute = t->rollout_time + t->forward_time + t->backward_time + t->update_time;
+
+        result->wall_time = wall;
+        result->env_steps_per_s = wall > 0 ? t->env_steps / wall : 0.0;
+        result->episodes_per_s = wall > 0 ? t->episodes / wall : 0.0;
+        result->comm_compute = compute > 0 ? t->comm_time / compute : 0.0;
+        result->time_to_target = -1.0;
+
+        if (config->target_return > 0) {
+            double window_sum = 0.0;
+            for (int s = 0; s < steps; s++) {
+                window_sum += step_returns[s] / sub_ctx->world_size;
+                if (s >= TARGET_SMOOTHING) window_sum -= step_returns[s - TARGET_SMOOTHING] / sub_ctx->world_size;
+
+                int n = s + 1 < TARGET_SMOOTHING ? s + 1 : TARGET_SMOOTHING;
+                if (window_sum / n >= config->target_return) {
+                    result->time_to_target = step_times[s];
+                    break;
+                }
+            }
+        }
+    }
+
+    free(step_returns);
+    free(step_times);
+    free_trainer(&trainer);
+}
+
+static void write_results_csv(FILE *f, const ScalingResult *results, int n, int strong) {
+    fprintf(f, "mode,ranks,episodes_per_rank,hidden,wall_s,env_steps_per_s,episodes_per_s,efficiency,comm_compute,time_to_target_s\n");
+
+    for (int i = 0; i < n; i++) {
+        const ScalingResult *r = &results[i];
+        fprintf(f, "%s,%d,%d,%d,%.6f,%.3f,%.3f,%.4f,%.4f,%.6f\n",
+                strong ? "strong" : "weak", r->ranks, r->episodes_per_rank, r->hidden, r->wall_time,
+                r->env_steps_per_s, r->episodes_per_s, r->efficiency, r->comm_compute, r->time_to_target);
+    }
+}
+
+static void print_results(const ScalingResult *results, int n, int strong, const Config *config) {
+    fprintf(stdout, "\n");
+    fprintf(stdout, "=========================================================================================\n");
+    fprintf(stdout, "                      SCALING STUDY (%s scaling, %d grad steps)\n", strong ? "strong" : "weak", config->grad_steps);
+    fprintf(stdout, "=========================================================================================\n");
+    fprintf(stdout, "  %5s %9s %6s %9s %12s %12s %10s %10s %10s\n",
+            "ranks", "eps/rank", "hidden", "wall (s)", "steps/s", "episodes/s", "efficiency", "comm/comp", "to target");
+
+    for (int i = 0; i < n; i++) {
+        const ScalingResult *r = &results[i];
+        char target[32] = "-";
+        if (config->target_return > 0) {
+            if (r->time_to_target >= 0) snprintf(target, sizeof(target), "%.2f s", r->time_to_target);
+            else snprintf(target, sizeof(target), "never");
+        }
+
+        fprintf(stdout, "  %5d %9d %6d %9.3f %12.1f %12.2f %9.1f%% %9.1f%% %10s\n",
+                r->ranks, r->episodes_per_rank, r->hidden, r->wall_time, r->env_steps_per_s,
+                r->episodes_per_s, 100.0 * r->efficiency, 100.0 * r->comm_compute, target);
+    }
+    fprintf(stdout, "=========================================================================================\n\n");
+}
+
+int run_scaling_study(const Config *config, const MPIContext *ctx) {
+    ScalingSpec spec;
+    if (!parse_spec(config->scaling, ctx->world_size, config->hidden_size, &spec)) {
+        main_printf(ctx, "ERROR: Invalid scaling spec '%s' (ranks must be at most %d)\n", config->scaling, ctx->world_size);
+        return 0;
+    }
+
+    int capacity = spec.n_hidden * spec.n_episodes * spec.n_ranks;
+    ScalingResult *results = calloc(capacity, sizeof(ScalingResult));
+    int n = 0;
+
+    for (int h = 0; h < spec.n_hidden; h++) {
+        for (int e = 0; e < spec.n_episodes; e++) {
+            int group = n;
+
+            for (int i = 0; i < spec.n_ranks; i++) {
+                int ranks = spec.ranks[i];
+                int episodes = spec.strong ? spec.episodes[e] / ranks : spec.episodes[e];
+
+                if (episodes < 1 || (spec.strong && spec.episodes[e] % ranks != 0)) {
+                    main_printf(ctx, "WARNING: Skipping %d rank(s): %d episodes do not split evenly\n", ranks, spec.episodes[e]);
+                    continue;
+                }
+
+                main_printf(ctx, "Scaling: %d rank(s), %d episode(s) per rank, hidden %d\n", ranks, episodes, spec.hidden[h]);
+
+                Config run = *config;
+                run.hidden_size = spec.hidden[h];
+                run.episodes = episodes;
+
+                MPI_Comm sub;
+                MPI_Comm_split(ctx->comm, ctx->rank < ranks ? 0 : MPI_UNDEFINED, ctx->rank, &sub);
+
+                ScalingResult *result = &results[n++];
+                result->ranks = ranks;
+                result->episodes_per_rank = episodes;
+                result->hidden = spec.hidden[h];
+
+                if (sub != MPI_COMM_NULL) {
+                    MPIContext sub_ctx = *ctx;
+                    sub_ctx.comm = sub;
+                    MPI_Comm_rank(sub, &sub_ctx.rank);
+                    MPI_Comm_size(sub, &sub_ctx.world_size);
+
+                    run_configuration(&run, &sub_ctx, result);
+                    MPI_Comm_free(&sub);
+                }
+
+                idle_barrier(ctx->comm);
+            }
+
+            // Efficiency relative to the smallest world size of the group (the last one run)
+            if (n > group) {
+                const ScalingResult *base = &results[n - 1];
+                double base_per_rank = base->env_steps_per_s / base->ranks;
+
+                for (int i = group; i < n; i++)
+                    results[i].efficiency = base_per_rank > 0 ? results[i].env_steps_per_s / results[i].ranks / base_per_rank : 0.0;
+            }
+        }
+    }
+
+    if (ctx->rank == 0) {
+        print_results(results, n, spec.strong, config);
+
+        if (config->output_dir) {
+            char path[512];
+            snprintf(path, sizeof(path), "%s/scaling.csv", config->output_dir);
+
+            FILE *f = fopen(path, "w");
+            if (f) {
+                write_results_csv(f, results, n, spec.strong);
+                fclose(f);
+            } else {
+                fprintf(stderr, "ERROR: Could not write %s\n", path);
+            }
+        }
+    }
+
+    free(results);
+    return 1;
+}
@@ -0,0 +1,197 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "timeline.h"
+
+// The block header occupies the first values of the buffer
+#define BLOCK_VALUES (sizeof(TimelineBlock) / sizeof(TimelineValue))
+
+static size_t names_offset(int n_columns) {
+    return sizeof(TimelineHeader) + (size_t)n_columns * sizeof(TimelineColumn);
+}
+
+/*
+ * End of the blocks that only hold updates before resume_update, or -1 if the file
+ * was written by a run of another shape. A block cut short by a crash ends the file.
+ */
+static long long resume_offset(FILE *f, int world_size, const TimelineColumn *columns, int n_columns, long resume_update) {
+    TimelineHeader header;
+    TimelineColumn stored[64];
+
+    if (fread(&header, sizeof(header), 1, f) != 1 ||
+        memcmp(header.magic, TIMELINE_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != TIMELINE_VERSION || (int)header.world_size != world_size ||
+        (int)header.n_columns != n_columns || n_columns > 64 ||
+        fread(stored, sizeof(TimelineColumn), n_columns, f) != (size_t)n_columns ||
+        memcmp(stored, columns, n_columns * sizeof(TimelineColumn)) != 0)
+        return -1;
+
+    fseek(f, 0, SEEK_END);
+    long long size = ftell(f);
+    long long offset = (long long)header.data_offset;
+
+    TimelineBlock block;
+    while (fseek(f, offset, SEEK_SET) == 0 && fread(&block, sizeof(block), 1, f) == 1) {
+        long long bytes = sizeof(block) + (long long)n_columns * world_size * block.rows * sizeof(TimelineValue);
+
+        if (block.first_update + block.updates > resume_update || offset + bytes > size) break;
+        offset += bytes;
+    }
+
+    return offset;
+}
+
+// Rank 0: truncates the file for a resume, or writes a fresh header. Returns the end offset or -1.
+static long long prepare_file(
+    const char *path, int world_size, const TimelineColumn *columns, int n_columns,
+    const char *const *kinds, int n_kinds, long resume_update
+) {
+    FILE *f = resume_update > 0 ? fopen(path, "r+b") : NULL;
+
+    if (f) {
+        long long end = resume_offset(f, world_size, columns, n_columns, resume_update);
+        fflush(f);
+
+        int ok = end > 0 && ftruncate(fileno(f), end) == 0;
+        fclose(f);
+        if (ok) return end;
+
+        fprintf(stderr, "WARNING: %s does not match this run, starting a new timeline\n", path);
+    }
+
+    f = fopen(path, "wb");
+    if (!f) {
+        fprintf(stderr, "Error opening timeline file %s.\n", path);
+        return -1;
+    }
+
+    TimelineHeader header = {
+        .magic = TIMELINE_MAGIC,
+        .version = TIMELINE_VERSION,
+        .world_size = world_size,
+        .n_columns = n_columns,
+        .n_kinds = n_kinds,
+        .data_offset = names_offset(n_columns) + (size_t)n_kinds * TIMELINE_NAME_LEN,
+    };
+
+    int ok = fwrite(&header, sizeof(header), 1, f) == 1 &&
+             fwrite(columns, sizeof(TimelineColumn), n_columns, f) == (size_t)n_columns;
+
+    for (int k = 0; k < n_kinds && ok; k++) {
+        char name[TIMELINE_NAME_LEN] = {0};
+        strncpy(name, kinds[k], TIMELINE_NAME_LEN - 1);
+        ok = fwrite(name, sizeof(name), 1, f) == 1;
+    }
+
+    ok = (fclose(f) == 0) && ok;
+    if (!ok) {
+        fprintf(stderr, "Error writing timeline file %s.\n", path);
+        return -1;
+    }
+
+    return (long long)header.data_offset;
+}
+
+int timeline_open(
+    TimelineWriter *writer,
+    const MPIContext *ctx,
+    const char *path,
+    const TimelineColumn *columns,
+    int n_columns,
+    const char *const *kinds,
+    int n_kinds,
+    long resume_update
+) {
+    memset(writer, 0, sizeof(*writer));
+    writer->ctx = ctx;
+    writer->n_columns = n_columns;
+    writer->request = MPI_REQUEST_NULL;
+
+    long long end = 0;
+    if (ctx->rank == 0)
+        end = prepare_file(path, ctx->world_size, columns, n_columns, kinds, n_kinds, resume_update);
+
+    MPI_Bcast(&end, 1, MPI_LONG_LONG, 0, ctx->comm);
+    if (end < 0) return 0;
+
+    int ok = MPI_File_open(ctx->comm, path, MPI_MODE_WRONLY, MPI_INFO_NULL, &writer->file) == MPI_SUCCESS;
+
+    int all_ok;
+    MPI_Allreduce(&ok, &all_ok, 1, MPI_INT, MPI_MIN, ctx->comm);
+    if (!all_ok) {
+        if (ok) MPI_File_close(&writer->file);
+        return 0;
+    }
+
+    writer->end = (MPI_Offset)end;
+    return 1;
+}
+
+TimelineValue *timeline_block(TimelineWriter *writer, int rows) {
+    if (writer->request != MPI_REQUEST_NULL)
+        MPI_Wait(&writer->request, MPI_STATUS_IGNORE);
+
+    size_t n = (size_t)writer->n_columns * rows;
+    if (n > writer->capacity) {
+        free(writer->buffer);
+        writer->buffer = malloc((BLOCK_VALUES + n) * sizeof(TimelineValue));
+        writer->capacity = n;
+    }
+
+    writer->rows = rows;
+    return writer->buffer + BLOCK_VALUES;
+}
+
+void timeline_write_block(TimelineWriter *writer, long first_update, long updates) {
+    int rank = writer->ctx->rank, is_root = rank == 0;
+    MPI_Aint rank_bytes = (MPI_Aint)writer->rows * sizeof(TimelineValue);
+    MPI_Aint column_bytes = rank_bytes * writer->ctx->world_size;
+
+    // This rank's slice of every column (and the block header from rank 0), as a file view
+    int n = writer->n_columns + is_root, k = 0;
+    int *lengths = malloc(n * sizeof(int));
+    MPI_Aint *displacements = malloc(n * sizeof(MPI_Aint));
+
+    if (is_root) {
+        *(TimelineBlock *)writer->buffer = (TimelineBlock){first_update, updates, writer->rows, 0};
+        lengths[k] = sizeof(TimelineBlock);
+        displacements[k++] = 0;
+    }
+    for (int c = 0; c < writer->n_columns; c++) {
+        lengths[k] = (int)rank_bytes;
+        displacements[k++] = sizeof(TimelineBlock) + c * column_bytes + rank * rank_bytes;
+    }
+
+    MPI_Datatype filetype;
+    MPI_Type_create_hindexed(n, lengths, displacements, MPI_BYTE, &filetype);
+    MPI_Type_commit(&filetype);
+
+    MPI_File_set_view(writer->file, writer->end, MPI_BYTE, filetype, "native", MPI_INFO_NULL);
+
+    // Rank 0's header sits right before its columns in the buffer
+    const void *data = is_root ? (const void *)writer->buffer : (const void *)(writer->buffer + BLOCK_VALUES);
+    int count = (int)(is_root * sizeof(TimelineBlock) + writer->n_columns * rank_bytes);
+    MPI_File_iwrite_all(writer->file, data, count, MPI_BYTE, &writer->request);
+
+    MPI_Type_free(&filetype);
+    free(lengths);
+    free(displacements);
+
+    writer->end += sizeof(TimelineBlock) + writer->n_columns * column_bytes;
+}
+
+void timeline_close(TimelineWriter *writer) {
+    if (writer->request != MPI_REQUEST_NULL)
+        MPI_Wait(&writer->request, MPI_STATUS_IGNORE);
+
+    MPI_File_close(&writer->file);
+    free(writer->buffer);
+    writer->buffer = NULL;
+    writer->capacity = 0;
+}
+
+size_t timeline_bytes(const TimelineWriter *writer) {
+    return writer->buffer ? (BLOCK_VALUES + writer->capacity) * sizeof(TimelineValue) : 0;
+}
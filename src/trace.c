@@ -0,0 +1,123 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "trace.h"
+
+int trace_enabled = 0;
+_Thread_local TraceThread *trace_local = NULL;
+
+static double seconds_per_tick = 1e-9;
+static uint64_t origin_ticks;
+static double origin_seconds;
+
+static const char *zone_names[TRACE_N_ZONES] = {
+    [ZONE_MLP_FORWARD] = "mlp_forward",
+    [ZONE_MLP_BACKWARD] = "mlp_backward",
+    [ZONE_LINEAR_FORWARD] = "linear_forward",
+    [ZONE_LINEAR_BACKWARD] = "linear_backward",
+    [ZONE_ENV_STEP] = "env_step",
+    [ZONE_SAMPLE_ACTION] = "sample_action",
+    [ZONE_OPTIMIZER_STEP] = "optimizer_step",
+    [ZONE_MPI_BCAST] = "MPI_Bcast",
+    [ZONE_MPI_REDUCE] = "MPI_Reduce",
+    [ZONE_MPI_ALLREDUCE] = "MPI_Allreduce",
+    [ZONE_MPI_ALLGATHER] = "MPI_Allgather",
+    [ZONE_MPI_METRICS] = "MPI_metrics",
+};
+
+static double monotonic_raw() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+TraceThread *trace_thread_init() {
+    trace_local = malloc(sizeof(TraceThread));
+
+    // Without a buffer there is nowhere to record; stop rather than crash
+    if (!trace_local) {
+        fprintf(stderr, "WARNING: Could not allocate a trace buffer, tracing disabled.\n");
+        trace_enabled = 0;
+        static TraceThread sink;
+        return &sink;
+    }
+
+    // Touch every page now rather than fault them in on the hot path
+    memset(trace_local, 0, sizeof(TraceThread));
+    return trace_local;
+}
+
+int trace_init(double now_seconds) {
+#ifdef RL_TRACING
+    double start = monotonic_raw();
+    uint64_t start_ticks = trace_ticks();
+
+    while (monotonic_raw() - start < 0.02);
+
+    seconds_per_tick = (monotonic_raw() - start) / (double)(trace_ticks() - start_ticks);
+    origin_ticks = start_ticks;
+    origin_seconds = now_seconds;
+    trace_enabled = 1;
+    return 1;
+#else
+    (void)now_seconds;
+    (void)monotonic_raw;
+    return 0;
+#endif
+}
+
+const char *trace_zone_name(TraceZone zone) {
+    return zone_names[zone];
+}
+
+void trace_zone_stats(double *seconds, uint64_t *counts) {
+    for (int z = 0; z < TRACE_N_ZONES; z++) {
+        seconds[z] = trace_local ? trace_local->ticks[z] * seconds_per_tick : 0.0;
+        counts[z] = trace_local ? trace_local->count[z] : 0;
+    }
+}
+
+double trace_overhead_ns() {
+    if (!trace_enabled) return 0.0;
+
+    TraceThread *t = trace_local ? trace_local : trace_thread_init();
+    uint64_t head = t->head, ticks = t->ticks[ZONE_ENV_STEP], count = t->count[ZONE_ENV_STEP];
+    int pairs = 100000;
+
+    uint64_t start = trace_ticks();
+    for (int i = 0; i < pairs; i++) {
+        TRACE_BEGIN(ZONE_ENV_STEP);
+        TRACE_END(ZONE_ENV_STEP);
+    }
+    double ns = (trace_ticks() - start) * seconds_per_tick * 1e9 / pairs;
+
+    // Leave no trace of the measurement
+    t->head = head;
+    t->ticks[ZONE_ENV_STEP] = ticks;
+    t->count[ZONE_ENV_STEP] = count;
+    return ns;
+}
+
+void trace_write_chrome(FILE *f, int pid, double base_seconds) {
+    fprintf(f, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"rank %d zones\"}}", pid, pid);
+
+    TraceThread *t = trace_local;
+    if (t) {
+        uint64_t first = t->head > TRACE_RING_SIZE ? t->head - TRACE_RING_SIZE : 0;
+        int open[TRACE_N_ZONES] = {0};
+
+        for (uint64_t i = first; i < t->head; i++) {
+            const TraceEvent *e = &t->ring[i & (TRACE_RING_SIZE - 1)];
+
+            // The ring may start in the middle of a zone
+            if (e->end && !open[e->zone]) continue;
+            open[e->zone] = !e->end;
+
+            double seconds = origin_seconds - base_seconds + (double)(int64_t)(e->ticks - origin_ticks) * seconds_per_tick;
+            fprintf(f, ",\n{\"name\":\"%s\",\"ph\":\"%c\",\"pid\":%d,\"tid\":0,\"ts\":%.3f}",
+                    zone_names[e->zone], e->end ? 'E' : 'B', pid, seconds * 1e6);
+        }
+    }
+
+}
@@ -0,0 +1,814 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "training.h"
+#include "environments/cartpole.h"
+#include "distributed/comm.h"
+#include "rng.h"
+
+// DQN's ε decays linearly from 1 to its final value over this many env steps of a rank
+#define EPSILON_DECAY_STEPS 10000
+
+Env dispatch_environment(const char *env_name) {
+    if (!env_name || strcmp(env_name, "cartpole") == 0)
+        return make_cartpole_env(10.0f, false);
+
+    if (strcmp(env_name, "cartpole-continuous") == 0)
+        return make_cartpole_env(10.0f, true);
+
+    fprintf(stderr, "ERROR: Could not find environment matching %s\n", env_name);
+    exit(1);
+}
+
+bool parse_algorithm(const char *name, Algorithm *algo) {
+    if (!name || strcmp(name, "reinforce") == 0) *algo = ALGO_REINFORCE;
+    else if (strcmp(name, "a2c") == 0) *algo = ALGO_A2C;
+    else if (strcmp(name, "ppo") == 0) *algo = ALGO_PPO;
+    else if (strcmp(name, "es") == 0) *algo = ALGO_ES;
+    else if (strcmp(name, "dqn") == 0) *algo = ALGO_DQN;
+    else return false;
+
+    return true;
+}
+
+Policy dispatch_policy(Env *env, int hidden_size, bool value_head) {
+    MLP *policynet = malloc(sizeof(MLP));
+
+    Activation activations[2] = {relu, identity};
+    int input_size[2] = {env->obs_size, hidden_size};
+    int output_size = 1;
+
+    // Real actions (act_space 1 in every dimension) get a Gaussian head with a learned, state-dependent std
+    bool continuous = true;
+    for (int i = 0; i < env->act_size; i++) continuous = continuous && env->act_space[i] == 1;
+
+    if (continuous) {
+        output_size = 2 * env->act_size;
+    } else if (env->act_size == 1) {
+        int act_space = *env->act_space;
+        output_size = (act_space == 2) ? 1 : act_space;
+    }
+
+    if (value_head) {
+        Activation head_activations[1] = {identity};
+        MLPHead heads[2] = {
+            {.num_layers = 1, .output_size = output_size, .activations = head_activations},
+            {.num_layers = 1, .output_size = 1, .activations = head_activations},
+        };
+        *policynet = create_multihead_mlp(input_size, 1, activations, heads, 2);
+    } else {
+        *policynet = create_mlp(
+            input_size,
+            output_size,
+            2,
+            activations
+        );
+    }
+    kaiming_mlp_init(policynet);
+
+    if (continuous) return create_gaussian_policy(policynet, env->act_size, NULL);
+
+    if (env->act_size == 1) {
+        int act_space = *env->act_space;
+
+        if (act_space == 2) return create_binary_policy(policynet);
+        if (act_space > 2) return create_discrete_policy(policynet, act_space, SAMPLER_CDF);
+    }
+
+    fprintf(stderr, "ERROR: Could not initialize a policy for environment %s", env->name);
+    exit(1);
+}
+
+Policy dispatch_q_network(Env *env, int hidden_size) {
+    if (env->act_size != 1 || env->act_space[0] < 2) {
+        fprintf(stderr, "ERROR: Q-learning needs a single discrete action, environment %s has none\n", env->name);
+        exit(1);
+    }
+
+    MLP *qnet = malloc(sizeof(MLP));
+    Activation activations[2] = {relu, identity};
+    int input_size[2] = {env->obs_size, hidden_size};
+    int n_actions = env->act_space[0];
+
+    *qnet = create_mlp(input_size, n_actions, 2, activations);
+    kaiming_mlp_init(qnet);
+
+    return create_discrete_policy(qnet, n_actions, SAMPLER_GREEDY);
+}
+
+static float value_scale(float gamma) {
+    return gamma < 1.0f ? 1.0f / (1.0f - gamma) : 1.0f;
+}
+
+// Batched algorithms keep every episode of a step in the buffer at once; DQN runs minibatches through it
+static int rollout_capacity(const Trainer *trainer) {
+    bool batched = trainer->algo == ALGO_A2C || trainer->algo == ALGO_PPO || trainer->algo == ALGO_ES;
+    int capacity = batched ? trainer->episodes * trainer->max_steps : trainer->max_steps;
+
+    if (trainer->algo == ALGO_DQN) {
+        if (capacity < trainer->batch_size) capacity = trainer->batch_size;
+        if (capacity < 2) capacity = 2;
+    }
+    return capacity;
+}
+
+// ES records the episodes of both sides of every pair
+static int recorded_episodes(const Trainer *trainer) {
+    return trainer->algo == ALGO_ES ? 2 * trainer->es_pairs * trainer->episodes : trainer->episodes;
+}
+
+// The rollout buffer, activation cache and per-row scratch, sized by rollout_capacity
+static void create_rollout_scratch(Trainer *trainer, int checkpoint_every) {
+    bool batched = trainer->algo == ALGO_A2C || trainer->algo == ALGO_PPO || trainer->algo == ALGO_ES;
+    int capacity = rollout_capacity(trainer);
+    int obs_size = trainer->env.obs_size, act_size = trainer->env.act_size;
+    MLP *mlp = trainer->policy.mlp;
+    int out_size = mlp->output_size;
+
+    trainer->buffer = create_buffer(capacity, obs_size, act_size);
+    trainer->cache = create_mlp_remat_cache(mlp, capacity, checkpoint_every);
+
+    trainer->returns = malloc(capacity * sizeof(float));
+    trainer->targets = batched ? malloc(capacity * sizeof(float)) : NULL;
+    trainer->logits = malloc(capacity * out_size * sizeof(float));
+    trainer->dlogp = malloc(capacity * out_size * sizeof(float));
+
+    if (trainer->algo == ALGO_PPO) {
+        trainer->old_log_probs = malloc(capacity * sizeof(float));
+        trainer->order = malloc(capacity * sizeof(int));
+        trainer->batch_obs = malloc(capacity * obs_size * sizeof(float));
+        trainer->batch_actions = malloc(capacity * act_size * sizeof(float));
+        trainer->batch_advantages = malloc(capacity * sizeof(float));
+        trainer->batch_old_log_probs = malloc(capacity * sizeof(float));
+        trainer->batch_targets = malloc(capacity * sizeof(float));
+        trainer->batch_log_probs = malloc(capacity * sizeof(float));
+        trainer->batch_weights = malloc(capacity * sizeof(float));
+    }
+}
+
+static void free_rollout_scratch(Trainer *trainer) {
+    free_mlp_cache(&trainer->cache);
+    free_buffer(&trainer->buffer);
+    free(trainer->returns);
+    free(trainer->targets);
+    free(trainer->logits);
+    free(trainer->dlogp);
+    free(trainer->old_log_probs);
+    free(trainer->order);
+    free(trainer->batch_obs);
+    free(trainer->batch_actions);
+    free(trainer->batch_advantages);
+    free(trainer->batch_old_log_probs);
+    free(trainer->batch_targets);
+    free(trainer->batch_log_probs);
+    free(trainer->batch_weights);
+}
+
+Trainer create_trainer(const Config *config, const MPIContext *ctx) {
+    Trainer trainer = {
+        .ctx = ctx,
+        .episodes = config->episodes,
+        .max_steps = config->max_steps,
+        .gamma = config->gamma,
+        .entropy_coef = config->entropy_coef,
+        .gae_lambda = config->gae_lambda,
+        .value_coef = config->value_coef,
+        .ppo_epochs = config->ppo_epochs,
+        .minibatches = config->minibatches > 0 ? config->minibatches : 1,
+        .clip_range = config->clip_range,
+        .seed = (uint32_t)config->seed,
+        .es_sigma = config->es_sigma,
+        .es_pairs = config->es_pairs > 0 ? config->es_pairs : 1,
+        .batch_size = config->batch_size > 0 ? config->batch_size : 1,
+        .dqn_updates = config->dqn_updates,
+        .target_every = config->target_every > 0 ? config->target_every : 1,
+        .per_beta = config->per_beta,
+        .epsilon = config->epsilon,
+    };
+
+    // The value head predicts V(s) (1 - γ), in units of the horizon, so its target stays O(reward)
+    trainer.value_scale = value_scale(config->gamma);
+
+    if (!parse_algorithm(config->algo, &trainer.algo)) {
+        fprintf(stderr, "ERROR: Unknown algorithm %s\n", config->algo);
+        exit(1);
+    }
+
+    trainer.env = dispatch_environment(config->env_name);
+    if (trainer.algo == ALGO_DQN)
+        trainer.policy = dispatch_q_network(&trainer.env, config->hidden_size);
+    else
+        trainer.policy = dispatch_policy(&trainer.env, config->hidden_size, trainer.algo == ALGO_A2C || trainer.algo == ALGO_PPO);
+
+    MLP *mlp = trainer.policy.mlp;
+    int out_size = mlp->output_size;
+    trainer.optimizer = make_adam(mlp, config->learning_rate, 0.9f, 0.999f, 1e-08f);
+    create_rollout_scratch(&trainer, config->checkpoint_every);
+
+    trainer.metrics = create_metrics(config->metrics_window, recorded_episodes(&trainer));
+    trainer.metrics.cache_bytes = mlp_cache_bytes(mlp, &trainer.cache);
+    trainer.metrics.checkpoint_every = trainer.cache.checkpoint_every;
+
+    if (trainer.algo == ALGO_PPO) {
+        // Steps never broadcast the model, so the ranks start from the same one
+        trainer_sync(&trainer);
+    }
+
+    if (trainer.algo == ALGO_ES) {
+        int num_params = get_num_params(mlp);
+
+        trainer.theta = malloc(num_params * sizeof(float));
+        trainer.noise = malloc(num_params * sizeof(float));
+        trainer.es_results = malloc(ctx->world_size * trainer.es_pairs * sizeof(ESResult));
+
+        // As for PPO
+        trainer_sync(&trainer);
+    }
+
+    if (trainer.algo == ALGO_DQN) {
+        int obs_size = trainer.env.obs_size, act_size = trainer.env.act_size;
+        Activation activations[2] = {relu, identity};
+        int input_size[2] = {obs_size, config->hidden_size};
+
+        trainer.target = create_mlp(input_size, out_size, 2, activations);
+        trainer.replay = create_replay(config->replay_capacity > 0 ? config->replay_capacity : 1, obs_size, act_size, config->per_alpha);
+        trainer.replay_batch = create_replay_batch(trainer.batch_size, obs_size, act_size);
+        trainer.next_q = malloc(trainer.batch_size * out_size * sizeof(float));
+        trainer.td_errors = malloc(trainer.batch_size * sizeof(float));
+
+        // As for PPO, with the target network starting from the online one
+        dqn_sync_target(&trainer.target, mlp);
+        trainer_sync(&trainer);
+    }
+
+    return trainer;
+}
+
+// One rollout, forward and backward per episode, on discounted returns
+static void reinforce_episodes(Trainer *trainer, int slot) {
+    TrainingMetrics *metrics = &trainer->metrics;
+    Policy *policy = &trainer->policy;
+    ExperienceBuffer *buffer = &trainer->buffer;
+    MLPCache *cache = &trainer->cache;
+    uint64_t phase_mark[N_COUNTERS];
+
+    int idx = slot * trainer->episodes;
+    for (int ep = 0; ep < trainer->episodes; ep++) {
+        // Rollout
+        metrics_counter_mark(metrics, phase_mark);
+        double rollout_start = get_time();
+        if (ep == 0 && metrics->rollout_starts[slot] == 0.0)
+            metrics->rollout_starts[slot] = rollout_start;
+        policy_rollout(&trainer->env, policy, buffer->capacity, 1, buffer, NULL);
+        metrics->rollout_times[slot] += (get_time() - rollout_start);
+        metrics_count_phase(metrics, slot, PHASE_ROLLOUT, phase_mark);
+
+        metrics_counter_mark(metrics, phase_mark);
+        double forward_start = get_time();
+        if (ep == 0 && metrics->forward_starts[slot] == 0.0)
+            metrics->forward_starts[slot] = forward_start;
+        discounted_cumsum(buffer, trainer->gamma, trainer->returns);
+        
+        mlp_forward(policy->mlp, buffer->observations, buffer->size, trainer->logits, cache);
+        metrics->forward_times[slot] += (get_time() - forward_start);
+        metrics_count_phase(metrics, slot, PHASE_FORWARD, phase_mark);
+        
+        metrics_counter_mark(metrics, phase_mark);
+        double backward_start = get_time();
+        if (ep == 0 && metrics->backward_starts[slot] == 0.0)
+            metrics->backward_starts[slot] = backward_start;
+        metrics->loss[idx + ep] = policy_pg_loss_and_grad(
+            policy, trainer->logits, buffer->actions, trainer->returns, buffer->size, trainer->entropy_coef, trainer->dlogp
+        );
+
+        mlp_backward(policy->mlp, cache, trainer->dlogp, NULL);
+        empty_mlp_cache(cache);
+        metrics->backward_times[slot] += (get_time() - backward_start);
+        metrics_count_phase(metrics, slot, PHASE_BACKWARD, phase_mark);
+
+        metrics->returns[idx + ep] = mean_return(buffer);
+        metrics->steps[idx + ep] = buffer->size;
+    }
+}
+
+// Every episode of the step in one buffer, one forward through both heads, then normalized GAE advantages
+static void collect_batch(Trainer *trainer, int slot) {
+    TrainingMetrics *metrics = &trainer->metrics;
+    Policy *policy = &trainer->policy;
+    ExperienceBuffer *buffer = &trainer->buffer;
+    MLPCache *cache = &trainer->cache;
+    MLP *mlp = policy->mlp;
+    uint64_t phase_mark[N_COUNTERS];
+
+    metrics_counter_mark(metrics, phase_mark);
+    double rollout_start = get_time();
+    if (metrics->rollout_starts[slot] == 0.0) metrics->rollout_starts[slot] = rollout_start;
+    policy_rollout(&trainer->env, policy, trainer->max_steps, trainer->episodes, buffer, NULL);
+    metrics->rollout_times[slot] += (get_time() - rollout_start);
+    metrics_count_phase(metrics, slot, PHASE_ROLLOUT, phase_mark);
+
+    int size = buffer->size;
+    float *values = mlp_head_output(mlp, trainer->logits, size, 1);
+
+    metrics_counter_mark(metrics, phase_mark);
+    double forward_start = get_time();
+    if (metrics->forward_starts[slot] == 0.0) metrics->forward_starts[slot] = forward_start;
+    mlp_forward(mlp, buffer->observations, size, trainer->logits, cache);
+    for (int t = 0; t < size; t++) values[t] *= trainer->value_scale;
+    gae_advantages(buffer, values, trainer->gamma, trainer->gae_lambda, trainer->returns, trainer->targets);
+    if (trainer->old_log_probs)
+        policy_log_prob_from_logits(policy, trainer->logits, buffer->actions, size, trainer->old_log_probs, NULL);
+    metrics->forward_times[slot] += (get_time() - forward_start);
+    metrics_count_phase(metrics, slot, PHASE_FORWARD, phase_mark);
+
+    // The advantage statistics of the whole step, over every rank (communication time)
+    metrics_counter_mark(metrics, phase_mark);
+    double norm_start = get_time();
+    normalize_across_ranks(trainer->returns, size, trainer->ctx);
+    metrics->comm_times[slot] += (get_time() - norm_start);
+    metrics_count_phase(metrics, slot, PHASE_COMM, phase_mark);
+}
+
+// Returns and lengths of the batch's episodes, from episode slot `offset` of the update on
+static void record_episodes(Trainer *trainer, int slot, int offset) {
+    ExperienceBuffer *buffer = &trainer->buffer;
+    TrainingMetrics *metrics = &trainer->metrics;
+    int idx = slot * metrics->num_episodes + offset, ep = 0, first = 0;
+    float episode_return = 0.0f;
+
+    for (int t = 0; t < buffer->size && ep < trainer->episodes; t++) {
+        episode_return += buffer->rewards[t];
+        if (!buffer->dones[t] && t + 1 < buffer->size) continue;
+
+        metrics->returns[idx + ep] = episode_return;
+        metrics->steps[idx + ep] = t + 1 - first;
+        ep++;
+
+        episode_return = 0.0f;
+        first = t + 1;
+    }
+}
+
+// One backward over the batch: policy-gradient and value losses, per episode
+static void a2c_batch(Trainer *trainer, int slot) {
+    TrainingMetrics *metrics = &trainer->metrics;
+    Policy *policy = &trainer->policy;
+    ExperienceBuffer *buffer = &trainer->buffer;
+    MLPCache *cache = &trainer->cache;
+    MLP *mlp = policy->mlp;
+    uint64_t phase_mark[N_COUNTERS];
+
+    collect_batch(trainer, slot);
+
+    int size = buffer->size;
+    float *values = mlp_head_output(mlp, trainer->logits, size, 1);
+
+    metrics_counter_mark(metrics, phase_mark);
+    double backward_start = get_time();
+    if (metrics->backward_starts[slot] == 0.0) metrics->backward_starts[slot] = backward_start;
+
+    // Losses per episode, into the head-major gradient of both heads
+    int out_size = mlp_head_size(mlp, 0);
+    float *value_grad = mlp_head_output(mlp, trainer->dlogp, size, 1);
+    int idx = slot * trainer->episodes, ep = 0, first = 0;
+
+    for (int t = 0; t < size && ep < trainer->episodes; t++) {
+        if (!buffer->dones[t] && t + 1 < size) continue;
+
+        int n = t + 1 - first;
+        float loss = policy_pg_loss_and_grad(
+            policy, trainer->logits + first * out_size, buffer->actions + first * policy->act_size,
+            trainer->returns + first, n, trainer->entropy_coef, trainer->dlogp + first * out_size
+        );
+        loss += value_loss_and_grad(
+            values + first, trainer->targets + first, n, trainer->value_coef, trainer->value_scale, value_grad + first
+        );
+
+        metrics->loss[idx + ep++] = loss;
+        first = t + 1;
+    }
+
+    mlp_backward(mlp, cache, trainer->dlogp, NULL);
+    empty_mlp_cache(cache);
+    metrics->backward_times[slot] += (get_time() - backward_start);
+    metrics_count_phase(metrics, slot, PHASE_BACKWARD, phase_mark);
+
+    record_episodes(trainer, slot, 0);
+}
+
+// Copies row order[i] of src[rows, width] to row i of dst for i < n
+static void gather_rows(const float *src, int width, const int *order, int n, float *dst) {
+    for (int i = 0; i < n; i++) memcpy(dst + (size_t)i * width, src + (size_t)order[i] * width, width * sizeof(float));
+}
+
+// Forward, clipped loss and backward of the minibatch of buffer rows[n]; returns its loss
+static float ppo_minibatch(Trainer *trainer, int slot, const int *rows, int n) {
+    TrainingMetrics *metrics = &trainer->metrics;
+    Policy *policy = &trainer->policy;
+    ExperienceBuffer *buffer = &trainer->buffer;
+    MLPCache *cache = &trainer->cache;
+    MLP *mlp = policy->mlp;
+    uint64_t phase_mark[N_COUNTERS];
+    int obs_size = trainer->env.obs_size, act_size = trainer->env.act_size;
+
+    metrics_counter_mark(metrics, phase_mark);
+    double forward_start = get_time();
+    gather_rows(buffer->observations, obs_size, rows, n, trainer->batch_obs);
+    gather_rows(buffer->actions, act_size, rows, n, trainer->batch_actions);
+    for (int i = 0; i < n; i++) {
+        trainer->batch_advantages[i] = trainer->returns[rows[i]];
+        trainer->batch_old_log_probs[i] = trainer->old_log_probs[rows[i]];
+        trainer->batch_targets[i] = trainer->targets[rows[i]];
+    }
+
+    mlp_forward(mlp, trainer->batch_obs, n, trainer->logits, cache);
+    float *values = mlp_head_output(mlp, trainer->logits, n, 1);
+    for (int i = 0; i < n; i++) values[i] *= trainer->value_scale;
+    metrics->forward_times[slot] += (get_time() - forward_start);
+    metrics_count_phase(metrics, slot, PHASE_FORWARD, phase_mark);
+
+    metrics_counter_mark(metrics, phase_mark);
+    double backward_start = get_time();
+    float loss = ppo_loss_and_grad(
+        policy, trainer->logits, trainer->batch_actions, trainer->batch_advantages, trainer->batch_old_log_probs,
+        n, trainer->clip_range, trainer->entropy_coef, trainer->batch_log_probs, trainer->batch_weights, trainer->dlogp
+    );
+    loss += value_loss_and_grad(
+        values, trainer->batch_targets, n, trainer->value_coef, trainer->value_scale, mlp_head_output(mlp, trainer->dlogp, n, 1)
+    );
+    mlp_backward(mlp, cache, trainer->dlogp, NULL);
+    metrics->backward_times[slot] += (get_time() - backward_start);
+    metrics_count_phase(metrics, slot, PHASE_BACKWARD, phase_mark);
+
+    return loss;
+}
+
+// Sums the gradients over every rank, adding its time and traffic to the step's reduce totals
+static void allreduce_step(Trainer *trainer, int slot, uint64_t *phase_mark) {
+    TrainingMetrics *metrics = &trainer->metrics;
+    CommStats *reduce_stats = &metrics->comm_stats[slot * METRICS_N_COLLECTIVES + COLLECTIVE_REDUCE];
+
+    metrics_counter_mark(metrics, phase_mark);
+    double comm_start = get_time();
+    CommStats stats;
+    allreduce_gradients(trainer->policy.mlp, trainer->ctx, &stats);
+    if (metrics->reduce_starts[slot] == 0.0) metrics->reduce_starts[slot] = comm_start;
+    double comm_time = get_time() - comm_start;
+    metrics->reduce_times[slot] += comm_time;
+    metrics->comm_times[slot] += comm_time;
+    reduce_stats->bytes += stats.bytes;
+    reduce_stats->pack += stats.pack;
+    reduce_stats->mpi += stats.mpi;
+    reduce_stats->unpack += stats.unpack;
+    metrics_count_phase(metrics, slot, PHASE_COMM, phase_mark);
+}
+
+/*
+ * Epochs of shuffled minibatches over the batch, each with a forward, the clipped loss,
+ * a backward, one gradient allreduce and an optimizer step on every rank. Every rank
+ * splits its buffer into the same number of minibatches, so the collectives line up.
+ */
+static void ppo_epochs(Trainer *trainer, int slot) {
+    TrainingMetrics *metrics = &trainer->metrics;
+    Policy *policy = &trainer->policy;
+    ExperienceBuffer *buffer = &trainer->buffer;
+    MLPCache *cache = &trainer->cache;
+    MLP *mlp = policy->mlp;
+    uint64_t phase_mark[N_COUNTERS];
+
+    collect_batch(trainer, slot);
+
+    // The rollout forward is not backpropagated: each minibatch refills the cache from its first row
+    empty_mlp_cache(cache);
+
+    int size = buffer->size;
+    int *order = trainer->order;
+    for (int i = 0; i < size; i++) order[i] = i;
+
+    float loss_sum = 0.0f;
+
+    for (int epoch = 0; epoch < trainer->ppo_epochs; epoch++) {
+        // Fisher-Yates
+        for (int i = size - 1; i > 0; i--) {
+            int j = (int)rand_uniform(0.0f, (float)(i + 1));
+            if (j > i) j = i;
+            int tmp = order[i];
+            order[i] = order[j];
+            order[j] = tmp;
+        }
+
+        for (int m = 0; m < trainer->minibatches; m++) {
+            int first = (int)((long)size * m / trainer->minibatches);
+            int n = (int)((long)size * (m + 1) / trainer->minibatches) - first;
+
+            // A rank with fewer rows than minibatches still joins the allreduce, with zero gradients
+            mlp_zero_grad(mlp);
+            if (n > 0) loss_sum += ppo_minibatch(trainer, slot, order + first, n);
+
+            // Gradient allreduce (communication time), accumulated over the minibatches
+            allreduce_step(trainer, slot, phase_mark);
+
+            metrics_counter_mark(metrics, phase_mark);
+            double update_start = get_time();
+            if (metrics->update_starts[slot] == 0.0) metrics->update_starts[slot] = update_start;
+            optimizer_step(&trainer->optimizer, mlp, cache);
+            metrics->update_times[slot] += (get_time() - update_start);
+            metrics_count_phase(metrics, slot, PHASE_UPDATE, phase_mark);
+        }
+    }
+
+    // The mean minibatch loss stands for every episode of the step
+    int updates = trainer->ppo_epochs * trainer->minibatches;
+    for (int ep = 0; ep < trainer->episodes; ep++)
+        metrics->loss[slot * trainer->episodes + ep] = updates > 0 ? loss_sum / updates : 0.0f;
+
+    record_episodes(trainer, slot, 0);
+}
+
+/*
+ * es_pairs antithetic pairs per rank, each evaluated with forward-only rollouts, one
+ * allgather of the (seed, return) pairs, then the same update on every rank from the
+ * regenerated noise.
+ */
+static void es_step(Trainer *trainer, int slot) {
+    const MPIContext *mpi_ctx = trainer->ctx;
+    TrainingMetrics *metrics = &trainer->metrics;
+    Policy *policy = &trainer->policy;
+    ExperienceBuffer *buffer = &trainer->buffer;
+    MLP *mlp = policy->mlp;
+    uint64_t phase_mark[N_COUNTERS];
+
+    int num_params = get_num_params(mlp), pairs = trainer->es_pairs;
+    uint32_t step = (uint32_t)(metrics->updates - 1);
+    ESResult *local = trainer->es_results + mpi_ctx->rank * pairs;
+    es_get_params(mlp, trainer->theta);
+
+    metrics_counter_mark(metrics, phase_mark);
+    double rollout_start = get_time();
+    metrics->rollout_starts[slot] = rollout_start;
+    for (int p = 0; p < pairs; p++) {
+        local[p].seed = es_seed(trainer->seed, step, mpi_ctx->rank * pairs + p);
+        es_noise(local[p].seed, num_params, trainer->noise);
+
+        for (int side = 0; side < 2; side++) {
+            es_set_params(mlp, trainer->theta, trainer->noise, side == 0 ? trainer->es_sigma : -trainer->es_sigma);
+            policy_rollout(&trainer->env, policy, trainer->max_steps, trainer->episodes, buffer, NULL);
+
+            float mean = mean_return(buffer);
+            if (side == 0) local[p].positive = mean;
+            else local[p].negative = mean;
+            record_episodes(trainer, slot, (2 * p + side) * trainer->episodes);
+        }
+    }
+    es_set_params(mlp, trainer->theta, NULL, 0.0f);
+    metrics->rollout_times[slot] += (get_time() - rollout_start);
+    metrics_count_phase(metrics, slot, PHASE_ROLLOUT, phase_mark);
+
+    // The only exchange of the step (communication time)
+    metrics_counter_mark(metrics, phase_mark);
+    double comm_start = get_time();
+    metrics->comm_starts[slot] = metrics->reduce_starts[slot] = comm_start;
+    // In place: our pairs already sit in our block of es_results
+    allgather_bytes(NULL, pairs * sizeof(ESResult), trainer->es_results, mpi_ctx,
+        &metrics->comm_stats[slot * METRICS_N_COLLECTIVES + COLLECTIVE_REDUCE]);
+    metrics->reduce_times[slot] = (get_time() - comm_start);
+    metrics->comm_times[slot] += metrics->reduce_times[slot];
+    metrics_count_phase(metrics, slot, PHASE_COMM, phase_mark);
+
+    // Regenerating every rank's noise stands in for the backward pass
+    metrics_counter_mark(metrics, phase_mark);
+    double backward_start = get_time();
+    metrics->backward_starts[slot] = backward_start;
+    es_gradient(mlp, trainer->es_results, mpi_ctx->world_size * pairs, trainer->es_sigma, trainer->noise);
+    metrics->backward_times[slot] += (get_time() - backward_start);
+    metrics_count_phase(metrics, slot, PHASE_BACKWARD, phase_mark);
+
+    metrics_counter_mark(metrics, phase_mark);
+    double update_start = get_time();
+    metrics->update_starts[slot] = update_start;
+    optimizer_step(&trainer->optimizer, mlp, &trainer->cache);
+    metrics->update_times[slot] = (get_time() - update_start);
+    metrics_count_phase(metrics, slot, PHASE_UPDATE, phase_mark);
+}
+
+// ε-greedy episodes into the replay shard, with the episode returns and lengths
+static void dqn_episodes(Trainer *trainer, int slot) {
+    TrainingMetrics *metrics = &trainer->metrics;
+    Policy *policy = &trainer->policy;
+    Env *env = &trainer->env;
+    uint64_t phase_mark[N_COUNTERS];
+
+    int obs_size = env->obs_size, n_actions = policy->n_actions;
+    // The rollout buffer is otherwise unused: its first two rows hold s and s'
+    float *obs = trainer->buffer.observations, *next_obs = obs + obs_size, *q = trainer->logits;
+    float action, reward;
+
+    metrics_counter_mark(metrics, phase_mark);
+    double rollout_start = get_time();
+    metrics->rollout_starts[slot] = rollout_start;
+
+    for (int ep = 0; ep < trainer->episodes; ep++) {
+        float episode_return = 0.0f;
+        bool done = false;
+        int t = 0;
+        env_reset(env, obs);
+
+        for (; !done && t < trainer->max_steps; t++) {
+            float epsilon = 1.0f - (float)trainer->env_steps / EPSILON_DECAY_STEPS;
+            if (epsilon < trainer->epsilon) epsilon = trainer->epsilon;
+
+            if (rand_uniform(0.0f, 1.0f) < epsilon) {
+                action = (float)(int)rand_uniform(0.0f, (float)n_actions);
+                if (action >= n_actions) action = n_actions - 1;
+            } else {
+                mlp_forward(policy->mlp, obs, 1, q, NULL);
+                policy_sample_action_from_logits(policy, q, 1, &action);
+            }
+
+            // Hitting the step limit is a truncation: the target still bootstraps from s'
+            env_step(env, &action, next_obs, &reward, &done);
+            replay_add(&trainer->replay, obs, &action, reward, next_obs, done);
+
+            memcpy(obs, next_obs, obs_size * sizeof(float));
+            episode_return += reward;
+            trainer->env_steps++;
+        }
+
+        metrics->returns[slot * trainer->episodes + ep] = episode_return;
+        metrics->steps[slot * trainer->episodes + ep] = t;
+    }
+
+    metrics->rollout_times[slot] += (get_time() - rollout_start);
+    metrics_count_phase(metrics, slot, PHASE_ROLLOUT, phase_mark);
+}
+
+/*
+ * dqn_updates minibatches from this rank's replay shard, each with a forward of the
+ * online and target networks, the TD loss, a backward, one gradient allreduce and an
+ * optimizer step on every rank, and the target network refreshed every target_every
+ * updates. The global minibatch is batch_size rows from every shard.
+ */
+static void dqn_step(Trainer *trainer, int slot) {
+    TrainingMetrics *metrics = &trainer->metrics;
+    Policy *policy = &trainer->policy;
+    MLPCache *cache = &trainer->cache;
+    MLP *mlp = policy->mlp;
+    ReplayBatch *batch = &trainer->replay_batch;
+    uint64_t phase_mark[N_COUNTERS];
+    int n = trainer->batch_size;
+
+    dqn_episodes(trainer, slot);
+
+    float loss_sum = 0.0f;
+
+    for (int u = 0; u < trainer->dqn_updates; u++) {
+        metrics_counter_mark(metrics, phase_mark);
+        double forward_start = get_time();
+        if (metrics->forward_starts[slot] == 0.0) metrics->forward_starts[slot] = forward_start;
+        replay_sample(&trainer->replay, n, trainer->per_beta, batch);
+        mlp_forward(mlp, batch->observations, n, trainer->logits, cache);
+        mlp_forward(&trainer->target, batch->next_observations, n, trainer->next_q, NULL);
+        metrics->forward_times[slot] += (get_time() - forward_start);
+        metrics_count_phase(metrics, slot, PHASE_FORWARD, phase_mark);
+
+        metrics_counter_mark(metrics, phase_mark);
+        double backward_start = get_time();
+        if (metrics->backward_starts[slot] == 0.0) metrics->backward_starts[slot] = backward_start;
+        mlp_zero_grad(mlp);
+        loss_sum += dqn_loss_and_grad(
+            trainer->logits, trainer->next_q, batch, n, policy->n_actions, trainer->gamma, trainer->td_errors, trainer->dlogp
+        );
+        mlp_backward(mlp, cache, trainer->dlogp, NULL);
+        replay_update_priorities(&trainer->replay, batch->indices, trainer->td_errors, n);
+        metrics->backward_times[slot] += (get_time() - backward_start);
+        metrics_count_phase(metrics, slot, PHASE_BACKWARD, phase_mark);
+
+        // Gradient allreduce (communication time)
+        allreduce_step(trainer, slot, phase_mark);
+
+        metrics_counter_mark(metrics, phase_mark);
+        double update_start = get_time();
+        if (metrics->update_starts[slot] == 0.0) metrics->update_starts[slot] = update_start;
+        optimizer_step(&trainer->optimizer, mlp, cache);
+        if (++trainer->num_updates % trainer->target_every == 0) dqn_sync_target(&trainer->target, mlp);
+        metrics->update_times[slot] += (get_time() - update_start);
+        metrics_count_phase(metrics, slot, PHASE_UPDATE, phase_mark);
+    }
+
+    // The mean minibatch loss stands for every episode of the step
+    for (int ep = 0; ep < trainer->episodes; ep++)
+        metrics->loss[slot * trainer->episodes + ep] = trainer->dqn_updates > 0 ? loss_sum / trainer->dqn_updates : 0.0f;
+}
+
+int trainer_step(Trainer *trainer) {
+    const MPIContext *mpi_ctx = trainer->ctx;
+    TrainingMetrics *metrics = &trainer->metrics;
+    Policy *policy = &trainer->policy;
+    MLPCache *cache = &trainer->cache;
+
+    int slot = metrics_begin_update(metrics);
+
+    // Hardware counter readings at the start of the step and of the current phase
+    uint64_t step_mark[N_COUNTERS], phase_mark[N_COUNTERS];
+    metrics_counter_mark(metrics, step_mark);
+
+    double step_start = get_time();
+    metrics->step_starts[slot] = step_start;
+
+    if (trainer->algo == ALGO_PPO || trainer->algo == ALGO_ES || trainer->algo == ALGO_DQN) {
+        // Every rank steps its own optimizer replica, so the ranks stay in sync without moving the model
+        if (trainer->algo == ALGO_PPO) ppo_epochs(trainer, slot);
+        else if (trainer->algo == ALGO_ES) es_step(trainer, slot);
+        else dqn_step(trainer, slot);
+
+        metrics->step_times[slot] = (get_time() - step_start);
+        metrics_count_phase(metrics, slot, PHASE_STEP, step_mark);
+        metrics_end_update(metrics, mpi_ctx);
+        return slot;
+    }
+
+    // Sync model across processes (communication time)
+    if (metrics->comm_starts[slot] == 0.0) metrics->comm_starts[slot] = step_start;
+    broadcast_model_weights(policy->mlp, mpi_ctx, 0, &metrics->comm_stats[slot * METRICS_N_COLLECTIVES + COLLECTIVE_BCAST]);
+    metrics->bcast_starts[slot] = step_start;
+    metrics->bcast_times[slot] = (get_time() - step_start);
+    metrics->comm_times[slot] += metrics->bcast_times[slot];
+    metrics_count_phase(metrics, slot, PHASE_COMM, step_mark);
+
+    mlp_zero_grad(policy->mlp);
+
+    if (trainer->algo == ALGO_A2C) a2c_batch(trainer, slot);
+    else reinforce_episodes(trainer, slot);
+
+    // Aggregate gradients (communication time)
+    metrics_counter_mark(metrics, phase_mark);
+    double comm_start = get_time();
+    aggregate_gradients(policy->mlp, mpi_ctx, 0, &metrics->comm_stats[slot * METRICS_N_COLLECTIVES + COLLECTIVE_REDUCE]);
+    metrics->reduce_starts[slot] = comm_start;
+    metrics->reduce_times[slot] = (get_time() - comm_start);
+    metrics->comm_times[slot] += metrics->reduce_times[slot];
+    metrics_count_phase(metrics, slot, PHASE_COMM, phase_mark);
+
+    metrics_counter_mark(metrics, phase_mark);
+    double update_start = get_time();
+    metrics->update_starts[slot] = update_start;
+    if (mpi_ctx->rank == 0) {
+        optimizer_step(&trainer->optimizer, policy->mlp, cache);
+    }
+    metrics->update_times[slot] = (get_time() - update_start);
+    metrics_count_phase(metrics, slot, PHASE_UPDATE, phase_mark);
+
+    metrics->step_times[slot] = (get_time() - step_start);
+    metrics_count_phase(metrics, slot, PHASE_STEP, step_mark);
+
+    metrics_end_update(metrics, mpi_ctx);
+
+    return slot;
+}
+
+void trainer_sync(Trainer *trainer) {
+    broadcast_model_weights(trainer->policy.mlp, trainer->ctx, 0, NULL);
+    if (trainer->algo == ALGO_PPO || trainer->algo == ALGO_ES || trainer->algo == ALGO_DQN)
+        broadcast_optimizer_state(&trainer->optimizer, trainer->ctx, 0);
+    if (trainer->algo == ALGO_DQN) broadcast_model_weights(&trainer->target, trainer->ctx, 0, NULL);
+}
+
+void trainer_set_hyperparameters(Trainer *trainer, float learning_rate, float gamma) {
+    optimizer_set_lr(&trainer->optimizer, learning_rate);
+    trainer->gamma = gamma;
+    trainer->value_scale = value_scale(gamma);
+}
+
+void trainer_set_episodes(Trainer *trainer, int episodes) {
+    if (episodes == trainer->episodes) return;
+
+    int checkpoint_every = trainer->cache.checkpoint_every;
+    free_rollout_scratch(trainer);
+    trainer->episodes = episodes;
+    create_rollout_scratch(trainer, checkpoint_every);
+
+    metrics_set_episodes(&trainer->metrics, recorded_episodes(trainer));
+    trainer->metrics.cache_bytes = mlp_cache_bytes(trainer->policy.mlp, &trainer->cache);
+}
+
+void free_trainer(Trainer *trainer) {
+    free_rollout_scratch(trainer);
+    free_optimizer(&trainer->optimizer);
+    free_metrics(&trainer->metrics);
+    free(trainer->theta);
+    free(trainer->noise);
+    free(trainer->es_results);
+
+    if (trainer->algo == ALGO_DQN) {
+        free_mlp(&trainer->target);
+        free_replay(&trainer->replay);
+        free_replay_batch(&trainer->replay_batch);
+        free(trainer->next_q);
+        free(trainer->td_errors);
+    }
+
+    free_mlp(trainer->policy.mlp);
+    free(trainer->policy.mlp);
+    env_destroy(&trainer->env);
+}
@@ -0,0 +1,176 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <sys/stat.h>
+
+#include "mlp.h"
+#include "optimizers.h"
+#include "rng.h"
+#include "checkpoint.h"
+
+#include "test_utils.c"
+
+// One Adam step on random gradients
+static void train_step(MLP *mlp, Optimizer *opt, MLPCache *cache) {
+    for (int l = 0; l < mlp->num_layers; l++) {
+        LinearLayer *layer = &mlp->layers[l];
+        for (int i = 0; i < layer->input_size * layer->output_size; i++) layer->weights_grad[i] = rand_normal(0.0f, 1.0f);
+        for (int i = 0; i < layer->output_size; i++) layer->biases_grad[i] = rand_normal(0.0f, 1.0f);
+    }
+    optimizer_step(opt, mlp, cache);
+}
+
+int test_checkpoint_resume() {
+    TEST_START("checkpoint restores weights, Adam, RNG and metric totals");
+
+    const char *dir = "/tmp/test_checkpoint";
+    mkdir(dir, 0775);
+
+    int layer_sizes[] = {4, 8};
+    Activation acts[] = {relu, identity};
+
+    rng_seed(3);
+    MLP mlp = create_mlp(layer_sizes, 2, 2, acts);
+    kaiming_mlp_init(&mlp);
+    MLPCache cache = create_mlp_cache(&mlp, 1);
+    Optimizer opt = make_adam(&mlp, 1e-2f, 0.9f, 0.999f, 1e-8f);
+    TrainingMetrics metrics = create_metrics(10, 2);
+
+    for (int s = 0; s < 3; s++) {
+        int slot = metrics_begin_update(&metrics);
+        train_step(&mlp, &opt, &cache);
+        metrics.returns[2 * slot] = (float)s;
+        metrics.step_times[slot] = 0.5 * s;
+        metrics_end_update(&metrics, NULL);
+    }
+
+    Checkpointer *ckpt = create_checkpointer(dir, 0, 1);
+    ASSERT_NOT_NULL("checkpointer", ckpt);
+    checkpoint_async(ckpt, 3, &mlp, &opt, &metrics, NULL);
+    free_checkpointer(ckpt);
+
+    // Reference continuation
+    train_step(&mlp, &opt, &cache);
+    float expected = rand_uniform(0.0f, 1.0f);
+
+    MLP restored = create_mlp(layer_sizes, 2, 2, acts);
+    Optimizer restored_opt = make_adam(&restored, 1e-2f, 0.9f, 0.999f, 1e-8f);
+    TrainingMetrics restored_metrics = create_metrics(10, 2);
+    int next_step = -1;
+
+    rng_seed(99);
+    ASSERT_TRUE("load checkpoint", load_checkpoint(dir, 0, 1, &restored, &restored_opt, &restored_metrics, NULL, &next_step));
+    ASSERT_TRUE("grad step restored", next_step == 3);
+    ASSERT_TRUE("update counter restored", restored_metrics.updates == 3);
+    ASSERT_TRUE("aggregates restored", memcmp(&restored_metrics.totals, &metrics.totals, sizeof(MetricsAggregates)) == 0);
+
+    train_step(&restored, &restored_opt, &cache);
+    for (int l = 0; l < 2; l++) {
+        ASSERT_TRUE("weights continue bitwise", memcmp(restored.layers[l].weights, mlp.layers[l].weights,
+            layer_sizes[l] * mlp.layers[l].output_size * sizeof(float)) == 0);
+        ASSERT_TRUE("biases continue bitwise", memcmp(restored.layers[l].biases, mlp.layers[l].biases,
+            mlp.layers[l].output_size * sizeof(float)) == 0);
+    }
+    ASSERT_TRUE("RNG stream continues", rand_uniform(0.0f, 1.0f) == expected);
+
+    ASSERT_TRUE("world size checked", !load_checkpoint(dir, 0, 2, &restored, &restored_opt, &restored_metrics, NULL, &next_step));
+
+    free_optimizer(&opt);
+    free_optimizer(&restored_opt);
+    free_metrics(&metrics);
+    free_metrics(&restored_metrics);
+    free_mlp_cache(&cache);
+    free_mlp(&mlp);
+    free_mlp(&restored);
+
+    TEST_END("checkpoint restores weights, Adam, RNG and metric totals");
+    return 0;
+}
+
+int test_checkpoint_replay() {
+    TEST_START("checkpoint restores the replay shard, counters and target network");
+
+    const char *dir = "/tmp/test_checkpoint_replay";
+    mkdir(dir, 0775);
+
+    int layer_sizes[] = {3, 8};
+    Activation acts[] = {relu, identity};
+
+    rng_seed(5);
+    MLP mlp = create_mlp(layer_sizes, 2, 2, acts), target = create_mlp(layer_sizes, 2, 2, acts);
+    kaiming_mlp_init(&mlp);
+    kaiming_mlp_init(&target);
+    Optimizer opt = make_adam(&mlp, 1e-2f, 0.9f, 0.999f, 1e-8f);
+    TrainingMetrics metrics = create_metrics(10, 1);
+
+    // Seven transitions into five rows, so the ring has wrapped
+    ReplayBuffer replay = create_replay(5, 3, 1, 0.6f);
+    float obs[3], next_obs[3], action, td_errors[2] = {2.5f, -0.1f};
+    int rows[2] = {1, 3};
+    for (int i = 0; i < 7; i++) {
+        for (int k = 0; k < 3; k++) obs[k] = rand_normal(0.0f, 1.0f), next_obs[k] = rand_normal(0.0f, 1.0f);
+        action = (float)(i % 2);
+        replay_add(&replay, obs, &action, (float)i, next_obs, i == 4);
+    }
+    replay_update_priorities(&replay, rows, td_errors, 2);
+    long env_steps = 123, num_updates = 45;
+    ReplayState state = {&replay, &target, &env_steps, &num_updates};
+
+    Checkpointer *ckpt = create_checkpointer(dir, 0, 1);
+    ASSERT_NOT_NULL("checkpointer", ckpt);
+    checkpoint_async(ckpt, 2, &mlp, &opt, &metrics, &state);
+    free_checkpointer(ckpt);
+
+    ReplayBatch expected = create_replay_batch(4, 3, 1);
+    replay_sample(&replay, 4, 0.4f, &expected);
+
+    MLP restored = create_mlp(layer_sizes, 2, 2, acts), restored_target = create_mlp(layer_sizes, 2, 2, acts);
+    Optimizer restored_opt = make_adam(&restored, 1e-2f, 0.9f, 0.999f, 1e-8f);
+    TrainingMetrics restored_metrics = create_metrics(10, 1);
+    ReplayBuffer restored_replay = create_replay(5, 3, 1, 0.6f);
+    long restored_env_steps = 0, restored_num_updates = 0;
+    ReplayState restored_state = {&restored_replay, &restored_target, &restored_env_steps, &restored_num_updates};
+    int next_step = -1;
+
+    ASSERT_TRUE("replay required", !load_checkpoint(dir, 0, 1, &restored, &restored_opt, &restored_metrics, NULL, &next_step));
+    ASSERT_TRUE("load checkpoint", load_checkpoint(dir, 0, 1, &restored, &restored_opt, &restored_metrics, &restored_state, &next_step));
+    ASSERT_TRUE("counters restored", restored_env_steps == 123 && restored_num_updates == 45);
+    ASSERT_TRUE("ring position restored", restored_replay.head == replay.head && restored_replay.base.size == replay.base.size);
+    ASSERT_TRUE("largest priority restored", restored_replay.max_priority == replay.max_priority);
+    ASSERT_TRUE("sum tree restored", memcmp(restored_replay.priorities.nodes, replay.priorities.nodes,
+        2 * replay.priorities.leaves * sizeof(float)) == 0);
+    for (int l = 0; l < 2; l++)
+        ASSERT_TRUE("target restored", memcmp(restored_target.layers[l].weights, target.layers[l].weights,
+            layer_sizes[l] * target.layers[l].output_size * sizeof(float)) == 0);
+
+    // The restored RNG stream draws the same minibatch from the restored shard
+    ReplayBatch batch = create_replay_batch(4, 3, 1);
+    replay_sample(&restored_replay, 4, 0.4f, &batch);
+    ASSERT_TRUE("same rows drawn", memcmp(batch.indices, expected.indices, 4 * sizeof(int)) == 0);
+    ASSERT_TRUE("same transitions", memcmp(batch.next_observations, expected.next_observations, 4 * 3 * sizeof(float)) == 0);
+
+    free_replay_batch(&expected);
+    free_replay_batch(&batch);
+    free_replay(&replay);
+    free_replay(&restored_replay);
+    free_optimizer(&opt);
+    free_optimizer(&restored_opt);
+    free_metrics(&metrics);
+    free_metrics(&restored_metrics);
+    free_mlp(&mlp);
+    free_mlp(&target);
+    free_mlp(&restored);
+    free_mlp(&restored_target);
+
+    TEST_END("checkpoint restores the replay shard, counters and target network");
+    return 0;
+}
+
+int main() {
+    int failures = 0;
+
+    failures += test_checkpoint_resume();
+    failures += test_checkpoint_replay();
+
+    return failures;
+}
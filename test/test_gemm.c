@@ -0,0 +1,112 @@
+#include <stdlib.h>
+#include <math.h>
+#include <string.h>
+#include <cblas.h>
+
+#include "gemm.h"
+#include "backend.h"
+#include "rng.h"
+
+#include "test_utils.c"
+
+typedef void (*GemmFn)(int, int, int, const float *, int, const float *, int, float, float *, int);
+
+static void fill_random(float *x, int n) {
+    for (int i = 0; i < n; i++) x[i] = rand_uniform(-1.0f, 1.0f);
+}
+
+// Compares an in-tree kernel against cblas_sgemm on the same operands
+static int check_variant(
+    const char *name, GemmFn kernel,
+    enum CBLAS_TRANSPOSE ta, enum CBLAS_TRANSPOSE tb,
+    int M, int N, int K, float beta
+) {
+    int a_rows = (ta == CblasNoTrans) ? M : K, a_cols = (ta == CblasNoTrans) ? K : M;
+    int b_rows = (tb == CblasNoTrans) ? K : N, b_cols = (tb == CblasNoTrans) ? N : K;
+
+    float *A = malloc(a_rows * a_cols * sizeof(float));
+    float *B = malloc(b_rows * b_cols * sizeof(float));
+    float *C = malloc(M * N * sizeof(float));
+    float *C_ref = malloc(M * N * sizeof(float));
+
+    fill_random(A, a_rows * a_cols);
+    fill_random(B, b_rows * b_cols);
+    fill_random(C, M * N);
+    for (int i = 0; i < M * N; i++) C_ref[i] = C[i];
+
+    kernel(M, N, K, A, a_cols, B, b_cols, beta, C, N);
+    cblas_sgemm(CblasRowMajor, ta, tb, M, N, K, 1.0f, A, a_cols, B, b_cols, beta, C_ref, N);
+
+    printf("  %s M=%d N=%d K=%d beta=%.0f\n", name, M, N, K, beta);
+    ASSERT_FLOAT_EQ_ARR(name, C, C_ref, M * N, 1e-4f * (K + 1));
+
+    free(A);
+    free(B);
+    free(C);
+    free(C_ref);
+    return 0;
+}
+
+int test_gemm_kernels() {
+    TEST_START("in-tree GEMM kernels match BLAS");
+
+    // Policy shapes plus sizes that exercise every row/column tail
+    int shapes[][3] = {
+        {500, 16, 4}, {16, 4, 500}, {500, 4, 16},
+        {1, 1, 1}, {3, 7, 5}, {37, 23, 19}, {129, 40, 3}, {64, 64, 64}, {7, 17, 300},
+    };
+    int n_shapes = sizeof(shapes) / sizeof(shapes[0]);
+
+    for (int s = 0; s < n_shapes; s++) {
+        int M = shapes[s][0], N = shapes[s][1], K = shapes[s][2];
+
+        for (int b = 0; b < 2; b++) {
+            float beta = (float)b;
+            if (check_variant("nt", skinny_gemm_nt, CblasNoTrans, CblasTrans, M, N, K, beta)) return 1;
+            if (check_variant("tn", skinny_gemm_tn, CblasTrans, CblasNoTrans, M, N, K, beta)) return 1;
+            if (check_variant("nn", skinny_gemm_nn, CblasNoTrans, CblasNoTrans, M, N, K, beta)) return 1;
+
+            // Dispatching entry points, whichever implementation they pick
+            if (check_variant("gemm_nt", gemm_nt, CblasNoTrans, CblasTrans, M, N, K, beta)) return 1;
+            if (check_variant("gemm_tn", gemm_tn, CblasTrans, CblasNoTrans, M, N, K, beta)) return 1;
+            if (check_variant("gemm_nn", gemm_nn, CblasNoTrans, CblasNoTrans, M, N, K, beta)) return 1;
+        }
+    }
+
+    TEST_END("in-tree GEMM kernels match BLAS");
+    return 0;
+}
+
+int test_gemm_backends() {
+    TEST_START("every linked GEMM backend matches BLAS");
+
+    const char *names[] = {"reference", "kernels", "openblas", "blis", "auto"};
+
+    for (int b = 0; b < 5; b++) {
+        if (!gemm_backend_select(names[b])) {
+            printf("  %s not available with %s, skipped\n", names[b], blas_vendor());
+            continue;
+        }
+
+        if (check_variant(names[b], gemm_nt, CblasNoTrans, CblasTrans, 37, 23, 19, 1.0f)) return 1;
+        if (check_variant(names[b], gemm_tn, CblasTrans, CblasNoTrans, 37, 23, 19, 0.0f)) return 1;
+        if (check_variant(names[b], gemm_nn, CblasNoTrans, CblasNoTrans, 37, 23, 19, 1.0f)) return 1;
+    }
+
+    ASSERT_TRUE("unknown backend rejected", !gemm_backend_select("missing"));
+    ASSERT_TRUE("active backend kept", strcmp(gemm_backend()->name, "auto") == 0);
+
+    TEST_END("every linked GEMM backend matches BLAS");
+    return 0;
+}
+
+int main() {
+    rng_seed(7);
+
+    int failures = 0;
+
+    failures += test_gemm_kernels();
+    failures += test_gemm_backends();
+
+    return failures;
+}
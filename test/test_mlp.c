@@ -1,7 +1,11 @@
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
+#include <stdint.h>
+#include <stdio.h>
 
 #include "mlp.h"
+#include "rng.h"
 
 #include "test_utils.c"
 
@@ -141,6 +145,250 @@ int test_backward_correctness() {
     return 0;
 }
 
+int test_remat_matches_full_cache() {
+    TEST_START("rematerialized backward matches full cache");
+
+    int layer_sizes[] = {4, 16, 8, 12, 3};
+    Activation acts[] = {relu, sigmoid, relu, identity};
+    int n_layers = 4;
+    int batch_size = 150;
+
+    MLP mlp = create_mlp(layer_sizes, 3, n_layers, acts);
+    kaiming_mlp_init(&mlp);
+
+    float *input = malloc(batch_size * 4 * sizeof(float));
+    float *out_grad = malloc(batch_size * 3 * sizeof(float));
+    for (int i = 0; i < batch_size * 4; i++) input[i] = rand_uniform(-1.0f, 1.0f);
+    for (int i = 0; i < batch_size * 3; i++) out_grad[i] = rand_uniform(-1.0f, 1.0f);
+
+    float *output = malloc(batch_size * 3 * sizeof(float));
+    float *in_grad = malloc(batch_size * 4 * sizeof(float));
+    float *ref_output = malloc(batch_size * 3 * sizeof(float));
+    float *ref_in_grad = malloc(batch_size * 4 * sizeof(float));
+
+    MLP ref = create_mlp(layer_sizes, 3, n_layers, acts);
+    for (int l = 0; l < n_layers; l++) {
+        memcpy(ref.layers[l].weights, mlp.layers[l].weights, layer_sizes[l] * ref.layers[l].output_size * sizeof(float));
+        memcpy(ref.layers[l].biases, mlp.layers[l].biases, ref.layers[l].output_size * sizeof(float));
+    }
+
+    MLPCache ref_cache = create_mlp_cache(&ref, batch_size);
+    mlp_zero_grad(&ref);
+    // Split the batch to exercise appending to the cache
+    mlp_forward(&ref, input, 100, ref_output, &ref_cache);
+    mlp_forward(&ref, input + 100 * 4, 50, ref_output + 100 * 3, &ref_cache);
+    mlp_backward(&ref, &ref_cache, out_grad, ref_in_grad);
+
+    int intervals[] = {2, 3, 0};
+    for (int c = 0; c < 3; c++) {
+        MLPCache cache = create_mlp_remat_cache(&mlp, batch_size, intervals[c]);
+        ASSERT_TRUE("remat cache is smaller", mlp_cache_bytes(&mlp, &cache) < mlp_cache_bytes(&ref, &ref_cache));
+
+        mlp_zero_grad(&mlp);
+        mlp_forward(&mlp, input, 100, output, &cache);
+        mlp_forward(&mlp, input + 100 * 4, 50, output + 100 * 3, &cache);
+        ASSERT_FLOAT_EQ_ARR("remat forward output", output, ref_output, batch_size * 3, GLOBAL_TOL);
+
+        mlp_backward(&mlp, &cache, out_grad, in_grad);
+        ASSERT_FLOAT_EQ_ARR("remat input gradient", in_grad, ref_in_grad, batch_size * 4, 1e-4f);
+
+        for (int l = 0; l < n_layers; l++) {
+            LinearLayer *layer = &mlp.layers[l];
+            ASSERT_FLOAT_EQ_ARR("remat weight gradient", layer->weights_grad, ref.layers[l].weights_grad,
+                                layer->input_size * layer->output_size, 1e-3f);
+            ASSERT_FLOAT_EQ_ARR("remat bias gradient", layer->biases_grad, ref.layers[l].biases_grad,
+                                layer->output_size, 1e-3f);
+        }
+
+        free_mlp_cache(&cache);
+    }
+
+    free_mlp_cache(&ref_cache);
+    free_mlp(&ref);
+    free_mlp(&mlp);
+    free(input);
+    free(out_grad);
+    free(output);
+    free(in_grad);
+    free(ref_output);
+    free(ref_in_grad);
+
+    TEST_END("rematerialized backward matches full cache");
+    return 0;
+}
+
+static void copy_layer(LinearLayer *dst, const LinearLayer *src) {
+    memcpy(dst->weights, src->weights, src->input_size * src->output_size * sizeof(float));
+    memcpy(dst->biases, src->biases, src->output_size * sizeof(float));
+}
+
+int test_multihead_matches_separate() {
+    TEST_START("multi-head forward and backward match separate networks");
+
+    int batch_size = 50;
+    int trunk_sizes[] = {4, 16, 12};
+    Activation trunk_acts[] = {relu, relu};
+    int hidden[] = {8};
+    Activation head0_acts[] = {relu, identity}, head1_acts[] = {identity};
+    MLPHead heads[2] = {
+        {.num_layers = 2, .hidden_sizes = hidden, .output_size = 3, .activations = head0_acts},
+        {.num_layers = 1, .hidden_sizes = NULL, .output_size = 1, .activations = head1_acts},
+    };
+
+    MLP mlp = create_multihead_mlp(trunk_sizes, 2, trunk_acts, heads, 2);
+    kaiming_mlp_init(&mlp);
+    ASSERT_TRUE("shape", mlp.num_layers == 5 && mlp.output_size == 4 && mlp_head_size(&mlp, 1) == 1);
+
+    // The same layers as two plain chains
+    int sizes0[] = {4, 16, 12, 8}, sizes1[] = {4, 16, 12};
+    Activation acts0[] = {relu, relu, relu, identity}, acts1[] = {relu, relu, identity};
+    MLP ref0 = create_mlp(sizes0, 3, 4, acts0), ref1 = create_mlp(sizes1, 1, 3, acts1);
+    for (int l = 0; l < 2; l++) {
+        copy_layer(&ref0.layers[l], &mlp.layers[l]);
+        copy_layer(&ref1.layers[l], &mlp.layers[l]);
+    }
+    copy_layer(&ref0.layers[2], &mlp.layers[2]);
+    copy_layer(&ref0.layers[3], &mlp.layers[3]);
+    copy_layer(&ref1.layers[2], &mlp.layers[4]);
+
+    float *input = malloc(batch_size * 4 * sizeof(float));
+    float *out_grad = malloc(batch_size * 4 * sizeof(float));
+    for (int i = 0; i < batch_size * 4; i++) input[i] = rand_uniform(-1.0f, 1.0f);
+    for (int i = 0; i < batch_size * 4; i++) out_grad[i] = rand_uniform(-1.0f, 1.0f);
+
+    float *output = malloc(batch_size * 4 * sizeof(float));
+    float *uncached = malloc(batch_size * 4 * sizeof(float));
+    float *out0 = malloc(batch_size * 3 * sizeof(float)), *out1 = malloc(batch_size * sizeof(float));
+    float *in_grad = malloc(batch_size * 4 * sizeof(float));
+    float *in_grad0 = malloc(batch_size * 4 * sizeof(float)), *in_grad1 = malloc(batch_size * 4 * sizeof(float));
+
+    MLPCache cache = create_mlp_cache(&mlp, batch_size);
+    MLPCache cache0 = create_mlp_cache(&ref0, batch_size), cache1 = create_mlp_cache(&ref1, batch_size);
+    ASSERT_TRUE("heads share the trunk output in the cache", cache.layer_caches[2].layer_inputs == cache.layer_caches[4].layer_inputs);
+
+    mlp_zero_grad(&mlp);
+    mlp_zero_grad(&ref0);
+    mlp_zero_grad(&ref1);
+    mlp_forward(&mlp, input, batch_size, output, &cache);
+    mlp_forward(&mlp, input, batch_size, uncached, NULL);
+    mlp_forward(&ref0, input, batch_size, out0, &cache0);
+    mlp_forward(&ref1, input, batch_size, out1, &cache1);
+
+    // Head-major outputs
+    ASSERT_FLOAT_EQ_ARR("policy head", mlp_head_output(&mlp, output, batch_size, 0), out0, batch_size * 3, GLOBAL_TOL);
+    ASSERT_FLOAT_EQ_ARR("value head", mlp_head_output(&mlp, output, batch_size, 1), out1, batch_size, GLOBAL_TOL);
+    ASSERT_FLOAT_EQ_ARR("without a cache", uncached, output, batch_size * 4, GLOBAL_TOL);
+
+    mlp_backward(&mlp, &cache, out_grad, in_grad);
+    mlp_backward(&ref0, &cache0, out_grad, in_grad0);
+    mlp_backward(&ref1, &cache1, out_grad + batch_size * 3, in_grad1);
+
+    for (int i = 0; i < batch_size * 4; i++) in_grad0[i] += in_grad1[i];
+    ASSERT_FLOAT_EQ_ARR("input gradient is the sum over heads", in_grad, in_grad0, batch_size * 4, 1e-4f);
+
+    for (int l = 0; l < 2; l++) {
+        LinearLayer *layer = &mlp.layers[l];
+        int n = layer->input_size * layer->output_size;
+        for (int i = 0; i < n; i++) ref0.layers[l].weights_grad[i] += ref1.layers[l].weights_grad[i];
+        for (int i = 0; i < layer->output_size; i++) ref0.layers[l].biases_grad[i] += ref1.layers[l].biases_grad[i];
+
+        ASSERT_FLOAT_EQ_ARR("trunk weight gradient", layer->weights_grad, ref0.layers[l].weights_grad, n, 1e-3f);
+        ASSERT_FLOAT_EQ_ARR("trunk bias gradient", layer->biases_grad, ref0.layers[l].biases_grad, layer->output_size, 1e-3f);
+    }
+    ASSERT_FLOAT_EQ_ARR("policy head gradient", mlp.layers[3].weights_grad, ref0.layers[3].weights_grad, 8 * 3, 1e-4f);
+    ASSERT_FLOAT_EQ_ARR("value head gradient", mlp.layers[4].weights_grad, ref1.layers[2].weights_grad, 12, 1e-4f);
+
+    free_mlp_cache(&cache);
+    free_mlp_cache(&cache0);
+    free_mlp_cache(&cache1);
+    free_mlp(&mlp);
+    free_mlp(&ref0);
+    free_mlp(&ref1);
+    free(input);
+    free(out_grad);
+    free(output);
+    free(uncached);
+    free(out0);
+    free(out1);
+    free(in_grad);
+    free(in_grad0);
+    free(in_grad1);
+
+    TEST_END("multi-head forward and backward match separate networks");
+    return 0;
+}
+
+static int same_weights(const MLP *a, const MLP *b) {
+    for (int l = 0; l < a->num_layers; l++) {
+        const LinearLayer *x = &a->layers[l], *y = &b->layers[l];
+        if (memcmp(x->weights, y->weights, x->input_size * x->output_size * sizeof(float)) != 0) return 0;
+        if (memcmp(x->biases, y->biases, x->output_size * sizeof(float)) != 0) return 0;
+    }
+    return 1;
+}
+
+int test_weight_formats() {
+    TEST_START("v1/v2 weight files and zero-copy mapping");
+
+    int layer_sizes[] = {4, 13, 3};
+    Activation acts[] = {relu, sigmoid, identity};
+    char path[] = "/tmp/test_mlp_weights.bin";
+
+    MLP mlp = create_mlp(layer_sizes, 5, 3, acts);
+    kaiming_mlp_init(&mlp);
+    for (int l = 0; l < 3; l++)
+        for (int i = 0; i < mlp.layers[l].output_size; i++) mlp.layers[l].biases[i] = rand_uniform(-1.0f, 1.0f);
+
+    ASSERT_TRUE("save v2", save_mlp_weights(&mlp, path));
+
+    MLP copy = create_mlp(layer_sizes, 5, 3, acts);
+    ASSERT_TRUE("load v2", load_mlp_weights(&copy, path));
+    ASSERT_TRUE("v2 round trip", same_weights(&mlp, &copy));
+
+    MLP mapped = create_mlp(layer_sizes, 5, 3, acts);
+    ASSERT_TRUE("map v2", map_mlp_weights(&mapped, path, 1));
+    ASSERT_TRUE("mapped round trip", same_weights(&mlp, &mapped));
+    for (int l = 0; l < 3; l++)
+        ASSERT_TRUE("tensors 64-byte aligned", ((uintptr_t)mapped.layers[l].weights % 64) == 0 && ((uintptr_t)mapped.layers[l].biases % 64) == 0);
+
+    float input[4] = {0.5f, -1.0f, 2.0f, 0.25f}, out[5], ref_out[5];
+    mlp_forward(&mlp, input, 1, ref_out, NULL);
+    mlp_forward(&mapped, input, 1, out, NULL);
+    ASSERT_FLOAT_EQ_ARR("mapped forward", out, ref_out, 5, GLOBAL_TOL);
+
+    // A flipped byte in a tensor is caught by the checksum
+    FILE *file = fopen(path, "r+b");
+    fseek(file, -4, SEEK_END);
+    fputc(0x5A, file);
+    fclose(file);
+    MLP corrupt = create_mlp(layer_sizes, 5, 3, acts);
+    ASSERT_TRUE("corrupt file rejected", !load_mlp_weights(&corrupt, path));
+
+    // Hand-written v1 file
+    file = fopen(path, "wb");
+    uint32_t header[3] = {0x4D4C5057, 1, 3};
+    fwrite(header, sizeof(uint32_t), 3, file);
+    for (int l = 0; l < 3; l++) {
+        uint32_t sizes[2] = {mlp.layers[l].input_size, mlp.layers[l].output_size};
+        fwrite(sizes, sizeof(uint32_t), 2, file);
+        fwrite(mlp.layers[l].weights, sizeof(float), sizes[0] * sizes[1], file);
+        fwrite(mlp.layers[l].biases, sizeof(float), sizes[1], file);
+    }
+    fclose(file);
+    ASSERT_TRUE("load v1", load_mlp_weights(&corrupt, path));
+    ASSERT_TRUE("v1 round trip", same_weights(&mlp, &corrupt));
+    ASSERT_TRUE("v1 cannot be mapped", !map_mlp_weights(&corrupt, path, 0));
+
+    remove(path);
+    free_mlp(&mlp);
+    free_mlp(&copy);
+    free_mlp(&mapped);
+    free_mlp(&corrupt);
+
+    TEST_END("v1/v2 weight files and zero-copy mapping");
+    return 0;
+}
+
 int main() {
     int total_tests = 1;
     int failed_tests = 0;
@@ -151,5 +399,11 @@ int main() {
 
     failed_tests += test_backward_correctness();
 
-    return 0;
+    failed_tests += test_remat_matches_full_cache();
+
+    failed_tests += test_multihead_matches_separate();
+
+    failed_tests += test_weight_formats();
+
+    return failed_tests;
 }
\ No newline at end of file
@@ -0,0 +1,670 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "mlp.h"
+#include "softmax.h"
+#include "algorithms/policy.h"
+#include "algorithms/a2c.h"
+#include "algorithms/ppo.h"
+#include "algorithms/es.h"
+#include "algorithms/dqn.h"
+#include "rng.h"
+#include "training.h"
+
+#include "test_utils.c"
+
+int test_vexpf() {
+    TEST_START("vectorized exp matches expf");
+
+    float x[203], out[203];
+    for (int i = 0; i < 203; i++) x[i] = -100.0f + i * 0.93f;
+    vexpf(x, 203, out);
+
+    float worst = 0.0f;
+    for (int i = 0; i < 203; i++) {
+        float ref = expf(x[i]);
+        if (ref < 1e-37f) continue;     // below the normal range the kernel stops at ~1e-38
+
+        float rel = fabsf(out[i] - ref) / ref;
+        if (rel > worst) worst = rel;
+    }
+    printf("max relative error %.3g\n", worst);
+    ASSERT_TRUE("relative error within a few ulp", worst < 4e-7f);
+
+    TEST_END("vectorized exp matches expf");
+    return 0;
+}
+
+int test_vlogf() {
+    TEST_START("vectorized log matches logf");
+
+    float x[203], out[203];
+    for (int i = 0; i < 203; i++) x[i] = expf(-80.0f + i * 0.8f) * (1.0f + 0.37f * (i % 3));
+    vlogf(x, 203, out);
+
+    float worst = 0.0f;
+    for (int i = 0; i < 203; i++) {
+        float err = fabsf(out[i] - logf(x[i])) / fmaxf(1.0f, fabsf(logf(x[i])));
+        if (err > worst) worst = err;
+    }
+    printf("max error %.3g\n", worst);
+    ASSERT_TRUE("error within a few ulp", worst < 4e-7f);
+
+    TEST_END("vectorized log matches logf");
+    return 0;
+}
+
+// Entropy of softmax(z) with z[k] shifted by dz, in double precision
+static double shifted_entropy(const float *z, int n, int k, double dz) {
+    double max = -INFINITY, sum = 0.0, pz = 0.0;
+    for (int a = 0; a < n; a++) max = fmax(max, z[a] + (a == k ? dz : 0.0));
+    for (int a = 0; a < n; a++) sum += exp(z[a] + (a == k ? dz : 0.0) - max);
+    double lse = max + log(sum);
+    for (int a = 0; a < n; a++) {
+        double za = z[a] + (a == k ? dz : 0.0);
+        pz += exp(za - lse) * za;
+    }
+    return lse - pz;
+}
+
+int test_discrete_policy(int n_actions) {
+    TEST_START("discrete log-prob, entropy and gradients per row");
+
+    int batch = 3;
+    int sizes[2] = {4, 8};
+    Activation acts[2] = {relu, identity};
+    MLP mlp = create_mlp(sizes, n_actions, 2, acts);
+    Policy policy = create_discrete_policy(&mlp, n_actions, SAMPLER_CDF);
+
+    float *logits = malloc(batch * n_actions * sizeof(float));
+    float *grad = malloc(batch * n_actions * sizeof(float));
+    float *grad_h = malloc(batch * n_actions * sizeof(float));
+    float actions[3], log_prob[3], entropy[3];
+
+    // Rows with different scales, so a kernel reading the wrong row shows up
+    for (int b = 0; b < batch; b++)
+        for (int a = 0; a < n_actions; a++)
+            logits[b * n_actions + a] = rand_uniform(-3.0f, 3.0f) * (b + 1) + 10.0f * b;
+    for (int b = 0; b < batch; b++) actions[b] = (float)((b * 7) % n_actions);
+
+    policy_log_prob_from_logits(&policy, logits, actions, batch, log_prob, grad);
+    policy_entropy_from_logits(&policy, logits, batch, entropy, grad_h);
+
+    for (int b = 0; b < batch; b++) {
+        const float *z = logits + b * n_actions;
+        int action = (int)actions[b];
+
+        double max = z[0], sum = 0.0, pz = 0.0;
+        for (int a = 1; a < n_actions; a++) if (z[a] > max) max = z[a];
+        for (int a = 0; a < n_actions; a++) sum += exp(z[a] - max);
+        double lse = max + log(sum);
+        for (int a = 0; a < n_actions; a++) pz += exp(z[a] - lse) * z[a];
+        double H = lse - pz;
+
+        ASSERT_TRUE("log-prob", fabs(log_prob[b] - (z[action] - lse)) < 1e-4);
+        ASSERT_TRUE("entropy", fabs(entropy[b] - H) < 1e-4 * (1.0 + H));
+
+        for (int a = 0; a < n_actions; a++) {
+            double p = exp(z[a] - lse);
+            double g = (a == action) - p;
+            double gh = (shifted_entropy(z, n_actions, a, 1e-4) - shifted_entropy(z, n_actions, a, -1e-4)) / 2e-4;
+            if (fabs(grad[b * n_actions + a] - g) > 1e-5 || fabs(grad_h[b * n_actions + a] - gh) > 1e-4) {
+                printf("row %d action %d: grad %g vs %g, entropy grad %g vs %g\n",
+                       b, a, grad[b * n_actions + a], g, grad_h[b * n_actions + a], gh);
+                UNREACHABLE("gradient mismatch");
+            }
+        }
+    }
+    ASSERT_TRUE("gradients", 1);
+
+    free(logits);
+    free(grad);
+    free(grad_h);
+    free_mlp(&mlp);
+
+    TEST_END("discrete log-prob, entropy and gradients per row");
+    return 0;
+}
+
+// The fused loss against log_prob and entropy scaled by hand
+int test_pg_loss(Policy *policy, const char *name) {
+    TEST_START(name);
+
+    int batch = 6, out = policy->mlp->output_size, d = policy->act_size;
+    float beta = 0.3f;
+    float *logits = malloc(batch * out * sizeof(float));
+    float *grad = malloc(batch * out * sizeof(float));
+    float *grad_lp = malloc(batch * out * sizeof(float));
+    float *grad_h = malloc(batch * out * sizeof(float));
+    float *actions = malloc(batch * d * sizeof(float));
+    float advantages[6], log_prob[6], entropy[6];
+
+    for (int i = 0; i < batch * out; i++) logits[i] = rand_uniform(-3.0f, 3.0f);
+    for (int b = 0; b < batch; b++) {
+        advantages[b] = rand_uniform(-2.0f, 2.0f);
+        for (int i = 0; i < d; i++)
+            actions[b * d + i] = policy->n_actions ? (float)(b % policy->n_actions) : rand_uniform(-2.0f, 2.0f);
+    }
+
+    float loss = policy_pg_loss_and_grad(policy, logits, actions, advantages, batch, beta, grad);
+    policy_log_prob_from_logits(policy, logits, actions, batch, log_prob, grad_lp);
+    policy_entropy_from_logits(policy, logits, batch, entropy, grad_h);
+
+    double ref = 0.0;
+    for (int b = 0; b < batch; b++) ref -= advantages[b] * log_prob[b] + beta * entropy[b];
+    ASSERT_TRUE("loss", fabs(loss - ref) < 1e-4 * (1.0 + fabs(ref)));
+
+    for (int b = 0; b < batch; b++) {
+        for (int j = 0; j < out; j++) {
+            int k = b * out + j;
+            float g = -advantages[b] * grad_lp[k] - beta * grad_h[k];
+            if (fabsf(grad[k] - g) > 1e-5f * (1.0f + fabsf(g))) {
+                printf("row %d output %d: fused %g vs %g\n", b, j, grad[k], g);
+                UNREACHABLE("gradient mismatch");
+            }
+        }
+    }
+    ASSERT_TRUE("gradients", 1);
+
+    // Categorical losses are smooth everywhere, so the fused gradient (entropy term
+    // included) must also match central differences of the fused loss itself
+    if (policy->n_actions) {
+        float fd_worst = 0.0f, eps = 1e-2f;
+        for (int k = 0; k < batch * out; k++) {
+            float saved = logits[k];
+            logits[k] = saved + eps;
+            float hi = policy_pg_loss_and_grad(policy, logits, actions, advantages, batch, beta, NULL);
+            logits[k] = saved - eps;
+            float lo = policy_pg_loss_and_grad(policy, logits, actions, advantages, batch, beta, NULL);
+            logits[k] = saved;
+
+            fd_worst = fmaxf(fd_worst, fabsf(grad[k] - (hi - lo) / (2.0f * eps)));
+        }
+        ASSERT_TRUE("gradients match finite differences", fd_worst < 5e-3f);
+    }
+
+    // Without the entropy term the gradient is the scaled log-prob gradient
+    policy_pg_loss_and_grad(policy, logits, actions, advantages, batch, 0.0f, grad);
+    float worst = 0.0f;
+    for (int k = 0; k < batch * out; k++)
+        worst = fmaxf(worst, fabsf(grad[k] + advantages[k / out] * grad_lp[k]) / (1.0f + fabsf(grad[k])));
+    ASSERT_TRUE("gradients without entropy", worst < 1e-5f);
+
+    free(logits);
+    free(grad);
+    free(grad_lp);
+    free(grad_h);
+    free(actions);
+
+    TEST_END(name);
+    return 0;
+}
+
+int test_normal_fill() {
+    TEST_START("bulk normals have unit moments");
+
+    int n = 200001;
+    float *z = malloc(n * sizeof(float));
+    rand_normal_fill(z, n);
+
+    double m1 = 0.0, m2 = 0.0, m4 = 0.0;
+    int within = 0;
+    for (int i = 0; i < n; i++) {
+        m1 += z[i];
+        m2 += (double)z[i] * z[i];
+        m4 += (double)z[i] * z[i] * z[i] * z[i];
+        within += fabsf(z[i]) < 1.0f;
+    }
+    m1 /= n; m2 /= n; m4 /= n;
+    printf("mean %.4f, variance %.4f, kurtosis %.3f, P(|z| < 1) %.4f\n", m1, m2, m4, (double)within / n);
+
+    ASSERT_TRUE("mean", fabs(m1) < 0.01);
+    ASSERT_TRUE("variance", fabs(m2 - 1.0) < 0.015);
+    ASSERT_TRUE("kurtosis", fabs(m4 - 3.0) < 0.1);
+    ASSERT_TRUE("P(|z| < 1)", fabs((double)within / n - 0.682689) < 0.005);
+
+    free(z);
+
+    TEST_END("bulk normals have unit moments");
+    return 0;
+}
+
+// Closed-form log-prob, entropy and gradients against central differences
+int test_gaussian_policy(bool fixed_std) {
+    TEST_START(fixed_std ? "Gaussian policy with fixed std" : "Gaussian policy with state-dependent std");
+
+    int d = 3, batch = 4, out = fixed_std ? d : 2 * d;
+    int sizes[2] = {4, 8};
+    Activation acts[2] = {relu, identity};
+    float log_std[3] = {-0.5f, 0.0f, 0.4f};
+    MLP mlp = create_mlp(sizes, out, 2, acts);
+    Policy policy = create_gaussian_policy(&mlp, d, fixed_std ? log_std : NULL);
+
+    float logits[24], actions[12], log_prob[4], entropy[4], grad[24], grad_h[24];
+    for (int i = 0; i < batch * out; i++) logits[i] = rand_uniform(-1.0f, 1.0f);
+    for (int i = 0; i < batch * d; i++) actions[i] = rand_uniform(-2.0f, 2.0f);
+
+    policy_log_prob_from_logits(&policy, logits, actions, batch, log_prob, grad);
+    policy_entropy_from_logits(&policy, logits, batch, entropy, grad_h);
+
+    for (int b = 0; b < batch; b++) {
+        double lp = 0.0, H = 0.0;
+        for (int i = 0; i < d; i++) {
+            double mu = logits[b * out + i], s = fixed_std ? log_std[i] : logits[b * out + d + i];
+            double z = (actions[b * d + i] - mu) / exp(s);
+            lp += -0.5 * z * z - s - 0.5 * log(2.0 * M_PI);
+            H += s + 0.5 * (1.0 + log(2.0 * M_PI));
+        }
+        ASSERT_TRUE("log-prob", fabs(log_prob[b] - lp) < 1e-4);
+        ASSERT_TRUE("entropy", fabs(entropy[b] - H) < 1e-4);
+    }
+
+    float worst = 0.0f, eps = 1e-2f;
+    for (int k = 0; k < batch * out; k++) {
+        int b = k / out;
+        float saved = logits[k], lp_hi[4], lp_lo[4], h_hi[4], h_lo[4];
+
+        logits[k] = saved + eps;
+        policy_log_prob_from_logits(&policy, logits, actions, batch, lp_hi, NULL);
+        policy_entropy_from_logits(&policy, logits, batch, h_hi, NULL);
+        logits[k] = saved - eps;
+        policy_log_prob_from_logits(&policy, logits, actions, batch, lp_lo, NULL);
+        policy_entropy_from_logits(&policy, logits, batch, h_lo, NULL);
+        logits[k] = saved;
+
+        worst = fmaxf(worst, fabsf(grad[k] - (lp_hi[b] - lp_lo[b]) / (2.0f * eps)));
+        worst = fmaxf(worst, fabsf(grad_h[k] - (h_hi[b] - h_lo[b]) / (2.0f * eps)));
+    }
+    printf("max gradient error %.3g\n", worst);
+    ASSERT_TRUE("gradients match finite differences", worst < 5e-3f);
+
+    // Sampled actions have the policy's mean and std
+    int draws = 20000;
+    float *samples = malloc(draws * d * sizeof(float));
+    float *rows = malloc(draws * out * sizeof(float));
+    for (int r = 0; r < draws; r++)
+        for (int j = 0; j < out; j++) rows[r * out + j] = logits[j];
+    policy_sample_action_from_logits(&policy, rows, draws, samples);
+
+    for (int i = 0; i < d; i++) {
+        double m = 0.0, v = 0.0, mu = logits[i], sd = exp(fixed_std ? log_std[i] : logits[d + i]);
+        for (int r = 0; r < draws; r++) m += samples[r * d + i];
+        m /= draws;
+        for (int r = 0; r < draws; r++) v += (samples[r * d + i] - m) * (samples[r * d + i] - m);
+        v /= draws;
+
+        ASSERT_TRUE("sample mean", fabs(m - mu) < 5.0 * sd / sqrt(draws));
+        ASSERT_TRUE("sample std", fabs(sqrt(v) / sd - 1.0) < 0.03);
+    }
+
+    free(samples);
+    free(rows);
+    free_mlp(&mlp);
+
+    TEST_END(fixed_std ? "Gaussian policy with fixed std" : "Gaussian policy with state-dependent std");
+    return 0;
+}
+
+int test_discrete_sampling(DiscreteSampler sampler, const char *name) {
+    TEST_START(name);
+
+    int n_actions = 5, batch = 8, draws = 5000;
+    int sizes[2] = {4, 8};
+    Activation acts[2] = {relu, identity};
+    MLP mlp = create_mlp(sizes, n_actions, 2, acts);
+    Policy policy = create_discrete_policy(&mlp, n_actions, sampler);
+
+    // Rows 0-3 favour action 0, rows 4-7 action 4: two runs for the alias sampler
+    float rows[2][5] = {{2.0f, 1.0f, 0.0f, -1.0f, -2.0f}, {-2.0f, -1.0f, 0.0f, 1.0f, 2.0f}};
+    float logits[40];
+    int counts[2][5] = {{0}};
+    float actions[8];
+
+    for (int b = 0; b < batch; b++)
+        for (int a = 0; a < n_actions; a++) logits[b * n_actions + a] = rows[b / 4][a];
+
+    for (int d = 0; d < draws; d++) {
+        policy_sample_action_from_logits(&policy, logits, batch, actions);
+        for (int b = 0; b < batch; b++) counts[b / 4][(int)actions[b]]++;
+    }
+
+    double sum = 0.0;
+    for (int a = 0; a < n_actions; a++) sum += exp(rows[0][a]);
+
+    int n = draws * batch / 2;
+    for (int r = 0; r < 2; r++) {
+        for (int a = 0; a < n_actions; a++) {
+            double p = exp(rows[r][a]) / sum;
+            double freq = (double)counts[r][a] / n;
+            double sigma = sqrt(p * (1.0 - p) / n);
+            if (fabs(freq - p) > 5.0 * sigma + 1e-3) {
+                printf("row %d action %d: frequency %.4f, probability %.4f\n", r, a, freq, p);
+                UNREACHABLE("sampling frequency off");
+            }
+        }
+    }
+    ASSERT_TRUE("frequencies within 5 sigma", 1);
+
+    free_mlp(&mlp);
+
+    TEST_END(name);
+    return 0;
+}
+
+// GAE against its definition as a discounted sum of TD errors within each episode
+int test_gae() {
+    TEST_START("GAE advantages and lambda-returns");
+
+    int size = 7;
+    float gamma = 0.9f, lambda = 0.8f;
+    ExperienceBuffer buffer = create_buffer(size, 1, 1);
+    buffer.size = size;
+
+    float values[7], zeros[7] = {0}, adv[7], targets[7], returns[7];
+    for (int t = 0; t < size; t++) {
+        buffer.rewards[t] = rand_uniform(-1.0f, 1.0f);
+        buffer.dones[t] = (t == 2 || t == size - 1);
+        values[t] = rand_uniform(-1.0f, 1.0f);
+    }
+
+    float expected[7];
+    for (int t = 0; t < size; t++) {
+        float sum = 0.0f, weight = 1.0f;
+        for (int k = t; k < size; k++) {
+            float next = buffer.dones[k] ? 0.0f : values[k + 1];
+            sum += weight * (buffer.rewards[k] + gamma * next - values[k]);
+            if (buffer.dones[k]) break;
+            weight *= gamma * lambda;
+        }
+        expected[t] = sum;
+    }
+
+    gae_advantages(&buffer, values, gamma, lambda, adv, targets);
+    ASSERT_FLOAT_EQ_ARR("advantages", adv, expected, size, GLOBAL_TOL);
+    for (int t = 0; t < size; t++) expected[t] += values[t];
+    ASSERT_FLOAT_EQ_ARR("targets", targets, expected, size, GLOBAL_TOL);
+
+    // Without a value, GAE(1) is the discounted return
+    gae_advantages(&buffer, zeros, gamma, 1.0f, adv, targets);
+    discounted_cumsum(&buffer, gamma, returns);
+    ASSERT_FLOAT_EQ_ARR("lambda = 1", adv, returns, size, GLOBAL_TOL);
+
+    free_buffer(&buffer);
+
+    TEST_END("GAE advantages and lambda-returns");
+    return 0;
+}
+
+// The clipped loss at r = 1 and with every ratio outside the clip range
+int test_ppo_loss() {
+    TEST_START("clipped PPO loss");
+
+    int batch = 8, n = 5;
+    float clip = 0.2f;
+    int sizes[2] = {4, 8};
+    Activation acts[2] = {relu, identity};
+    MLP mlp = create_mlp(sizes, n, 2, acts);
+    Policy policy = create_discrete_policy(&mlp, n, SAMPLER_CDF);
+
+    float logits[8 * 5], grad[8 * 5], ref_grad[8 * 5], actions[8], advantages[8];
+    float log_probs[8], old_log_probs[8], scratch_lp[8], weights[8];
+    for (int i = 0; i < batch * n; i++) logits[i] = rand_uniform(-2.0f, 2.0f);
+    for (int b = 0; b < batch; b++) {
+        actions[b] = (float)(b % n);
+        advantages[b] = b % 2 ? rand_uniform(0.1f, 2.0f) : rand_uniform(-2.0f, -0.1f);
+    }
+    policy_log_prob_from_logits(&policy, logits, actions, batch, log_probs, NULL);
+
+    // On-policy the clipped objective is the policy gradient
+    float loss = ppo_loss_and_grad(&policy, logits, actions, advantages, log_probs, batch, clip, 0.1f, scratch_lp, weights, grad);
+    float ref = policy_pg_loss_and_grad(&policy, logits, actions, advantages, batch, 0.1f, ref_grad);
+    // -Σ A - β Σ H against -Σ (A log π + β H)
+    float shift = 0.0f;
+    for (int b = 0; b < batch; b++) shift += advantages[b] * (log_probs[b] - 1.0f);
+    ASSERT_FLOAT_EQ("loss at r = 1", loss, ref + shift, 1e-4f);
+    ASSERT_FLOAT_EQ_ARR("gradient at r = 1", grad, ref_grad, batch * n, 1e-5f);
+
+    // r = e: clipped (no gradient) where A > 0, unclipped where A < 0
+    for (int b = 0; b < batch; b++) old_log_probs[b] = log_probs[b] - 1.0f;
+    loss = ppo_loss_and_grad(&policy, logits, actions, advantages, old_log_probs, batch, clip, 0.0f, scratch_lp, weights, grad);
+
+    float expected = 0.0f;
+    for (int b = 0; b < batch; b++) {
+        float r = expf(1.0f);
+        expected -= advantages[b] > 0.0f ? (1.0f + clip) * advantages[b] : r * advantages[b];
+        weights[b] = advantages[b] > 0.0f ? 0.0f : r * advantages[b];
+    }
+    policy_pg_loss_and_grad(&policy, logits, actions, weights, batch, 0.0f, ref_grad);
+    ASSERT_FLOAT_EQ("clipped loss", loss, expected, 1e-4f);
+    ASSERT_FLOAT_EQ_ARR("clipped gradient", grad, ref_grad, batch * n, 1e-5f);
+
+    free_mlp(&mlp);
+
+    TEST_END("clipped PPO loss");
+    return 0;
+}
+
+int test_es() {
+    TEST_START("evolution strategies noise and gradient");
+
+    int sizes[2] = {5, 2};
+    Activation acts[2] = {relu, identity};
+    MLP mlp = create_mlp(sizes, 3, 2, acts);
+    int n = get_num_params(&mlp);
+
+    float *noise = malloc(n * sizeof(float)), *again = malloc(n * sizeof(float));
+    float *theta = malloc(n * sizeof(float)), *perturbed = malloc(n * sizeof(float));
+
+    // The noise is a function of the seed and leaves the process stream alone
+    RNGState before = rng_get_state();
+    float next = rand_uniform(0.0f, 1.0f);
+    rng_set_state(before);
+    uint32_t seed = es_seed(42, 3, 1);
+    es_noise(seed, n, noise);
+    es_noise(seed, n, again);
+    ASSERT_FLOAT_EQ_ARR("same seed, same noise", noise, again, n, 0.0f);
+    ASSERT_FLOAT_EQ("process RNG untouched", rand_uniform(0.0f, 1.0f), next, 0.0f);
+    ASSERT_TRUE("distinct seeds", es_seed(42, 3, 1) != es_seed(42, 3, 2) && es_seed(42, 3, 1) != es_seed(42, 4, 1));
+
+    float sigma = 0.1f;
+    es_get_params(&mlp, theta);
+    es_set_params(&mlp, theta, noise, sigma);
+    es_get_params(&mlp, perturbed);
+    for (int i = 0; i < n; i++) perturbed[i] -= sigma * noise[i];
+    ASSERT_FLOAT_EQ_ARR("perturbed parameters", perturbed, theta, n, 1e-6f);
+
+    // A single pair with the positive side ahead: ∇ = -ε / (2σ)
+    ESResult result = {seed, 10.0f, 2.0f};
+    es_set_params(&mlp, theta, NULL, 0.0f);
+    es_gradient(&mlp, &result, 1, sigma, again);
+    LinearLayer *layer = &mlp.layers[0];
+    int weights_size = layer->input_size * layer->output_size;
+    for (int i = 0; i < weights_size; i++) again[i] = -noise[i] / (2.0f * sigma);
+    ASSERT_FLOAT_EQ_ARR("gradient along the better side", layer->weights_grad, again, weights_size, 1e-5f);
+
+    free(noise);
+    free(again);
+    free(theta);
+    free(perturbed);
+    free_mlp(&mlp);
+
+    TEST_END("evolution strategies noise and gradient");
+    return 0;
+}
+
+int test_replay() {
+    TEST_START("prioritized replay ring and sum tree");
+
+    int capacity = 5;
+    ReplayBuffer replay = create_replay(capacity, 2, 1, 1.0f);
+    ReplayBatch batch = create_replay_batch(4000, 2, 1);
+
+    // Seven transitions into five rows: 5 and 6 overwrite 0 and 1
+    for (int t = 0; t < 7; t++) {
+        float obs[2] = {(float)t, 0.0f}, next[2] = {(float)t + 1, 0.0f}, action = (float)(t % 2);
+        replay_add(&replay, obs, &action, (float)t, next, t == 3);
+    }
+    ASSERT_TRUE("size and head", replay.base.size == capacity && replay.head == 2);
+    ASSERT_FLOAT_EQ("oldest row overwritten", replay.base.rewards[0], 5.0f, 0.0f);
+    ASSERT_FLOAT_EQ("next observation kept", replay.next_observations[2 * 1], 7.0f, 0.0f);
+
+    // Priorities (|δ| + ε)^1 of about 1, 2, 3, 4, 0 by row
+    int rows[5] = {0, 1, 2, 3, 4};
+    float td[5] = {1.0f, -2.0f, 3.0f, 4.0f, 0.0f};
+    replay_update_priorities(&replay, rows, td, 5);
+    ASSERT_FLOAT_EQ("root holds the total", sum_tree_total(&replay.priorities), 10.005f, 1e-4f);
+    ASSERT_TRUE("find walks the prefix sums", sum_tree_find(&replay.priorities, 0.5f) == 0 &&
+                sum_tree_find(&replay.priorities, 1.5f) == 1 && sum_tree_find(&replay.priorities, 9.9f) == 3);
+
+    int counts[5] = {0};
+    replay_sample(&replay, 4000, 1.0f, &batch);
+    for (int b = 0; b < 4000; b++) counts[batch.indices[b]]++;
+    for (int i = 0; i < 4; i++) ASSERT_FLOAT_EQ("draws follow priority", counts[i] / 4000.0f, (i + 1) / 10.0f, 0.02f);
+
+    // With β = 1 the weights undo the sampling bias: w ∝ 1 / p
+    int low = -1, high = -1;
+    for (int b = 0; b < 4000; b++) {
+        if (batch.indices[b] == 0) low = b;
+        if (batch.indices[b] == 3) high = b;
+    }
+    ASSERT_FLOAT_EQ("importance weights", batch.weights[high] / batch.weights[low], 1.001f / 4.001f, 1e-4f);
+    ASSERT_FLOAT_EQ("gathered row", batch.observations[2 * high], 3.0f, 0.0f);
+
+    free_replay_batch(&batch);
+    free_replay(&replay);
+
+    TEST_END("prioritized replay ring and sum tree");
+    return 0;
+}
+
+int test_dqn_loss() {
+    TEST_START("DQN TD loss");
+
+    float q[6] = {1.0f, 2.0f, 0.5f, 0.0f, 3.0f, -1.0f};
+    float next_q[6] = {1.0f, 4.0f, 2.0f, 0.0f, 0.0f, 0.0f};
+    float actions[2] = {1.0f, 0.0f}, rewards[2] = {1.0f, 1.0f}, weights[2] = {1.0f, 0.5f};
+    bool dones[2] = {false, true};
+    ReplayBatch batch = {.actions = actions, .rewards = rewards, .dones = dones, .weights = weights};
+    float td[2], grad[6];
+
+    // δ_0 = 2 - (1 + 0.5 * 4) = -1; δ_1 = 0 - 1 = -1 with no bootstrap past the terminal
+    float loss = dqn_loss_and_grad(q, next_q, &batch, 2, 3, 0.5f, td, grad);
+    ASSERT_FLOAT_EQ("TD error with bootstrap", td[0], -1.0f, 1e-6f);
+    ASSERT_FLOAT_EQ("TD error at a terminal", td[1], -1.0f, 1e-6f);
+    ASSERT_FLOAT_EQ("weighted Huber loss", loss, (0.5f + 0.5f * 0.5f) / 2.0f, 1e-6f);
+
+    float expected[6] = {0.0f, -0.5f, 0.0f, -0.25f, 0.0f, 0.0f};
+    ASSERT_FLOAT_EQ_ARR("gradient on the taken actions", grad, expected, 6, 1e-6f);
+
+    TEST_END("DQN TD loss");
+    return 0;
+}
+
+// Copies every layer's weight and bias gradients into grads[get_num_params(mlp)]
+static void flatten_grads(const MLP *mlp, float *grads) {
+    for (int l = 0; l < mlp->num_layers; l++) {
+        const LinearLayer *layer = &mlp->layers[l];
+        size_t w = (size_t)layer->input_size * layer->output_size;
+
+        memcpy(grads, layer->weights_grad, w * sizeof(float));
+        memcpy(grads + w, layer->biases_grad, layer->output_size * sizeof(float));
+        grads += w + layer->output_size;
+    }
+}
+
+/*
+ * One PPO step with a single epoch and minibatch leaves the gradient of that minibatch
+ * in the layers (a zero learning rate keeps the weights). It must be the gradient of a
+ * forward over the minibatch alone, not one mixed with the rollout's cached activations.
+ */
+int test_ppo_minibatch_gradient(const MPIContext *ctx) {
+    TEST_START("PPO minibatch gradient matches a fresh forward");
+
+    Config config = {
+        .seed = 5, .hidden_size = 16, .episodes = 2, .max_steps = 10, .gamma = 0.99f,
+        .entropy_coef = 0.01f, .algo = "ppo", .gae_lambda = 0.95f, .value_coef = 0.5f,
+        .ppo_epochs = 1, .minibatches = 1, .clip_range = 0.2f, .learning_rate = 0.0f,
+        .checkpoint_every = 1, .env_name = "cartpole", .metrics_window = 4,
+    };
+    Trainer trainer = create_trainer(&config, ctx);
+    MLP *mlp = trainer.policy.mlp;
+    int num_params = get_num_params(mlp);
+
+    trainer_step(&trainer);
+    int n = trainer.buffer.size;
+
+    float *step_grads = malloc(num_params * sizeof(float));
+    float *fresh_grads = malloc(num_params * sizeof(float));
+    flatten_grads(mlp, step_grads);
+
+    // The same minibatch, through a cache that holds nothing else
+    MLPCache cache = create_mlp_cache(mlp, n);
+    mlp_zero_grad(mlp);
+    mlp_forward(mlp, trainer.batch_obs, n, trainer.logits, &cache);
+    float *values = mlp_head_output(mlp, trainer.logits, n, 1);
+    for (int i = 0; i < n; i++) values[i] *= trainer.value_scale;
+    ppo_loss_and_grad(
+        &trainer.policy, trainer.logits, trainer.batch_actions, trainer.batch_advantages, trainer.batch_old_log_probs,
+        n, trainer.clip_range, trainer.entropy_coef, trainer.batch_log_probs, trainer.batch_weights, trainer.dlogp
+    );
+    value_loss_and_grad(
+        values, trainer.batch_targets, n, trainer.value_coef, trainer.value_scale, mlp_head_output(mlp, trainer.dlogp, n, 1)
+    );
+    mlp_backward(mlp, &cache, trainer.dlogp, NULL);
+    flatten_grads(mlp, fresh_grads);
+
+    ASSERT_TRUE("non-empty batch", n > 0);
+    ASSERT_FLOAT_EQ_ARR("gradient", step_grads, fresh_grads, num_params, 1e-5f);
+
+    free(step_grads);
+    free(fresh_grads);
+    free_mlp_cache(&cache);
+    free_trainer(&trainer);
+
+    TEST_END("PPO minibatch gradient matches a fresh forward");
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    MPIContext ctx = mpi_init_context(&argc, &argv);
+    int failures = 0;
+    rng_seed(11);
+
+    failures += test_vexpf();
+    failures += test_vlogf();
+    failures += test_discrete_policy(3);
+    failures += test_discrete_policy(17);
+    failures += test_discrete_policy(1000);
+    int sizes[2] = {4, 8};
+    Activation acts[2] = {relu, identity};
+    MLP binary_mlp = create_mlp(sizes, 1, 2, acts), discrete_mlp = create_mlp(sizes, 7, 2, acts);
+    Policy binary = create_binary_policy(&binary_mlp), discrete = create_discrete_policy(&discrete_mlp, 7, SAMPLER_CDF);
+    failures += test_pg_loss(&binary, "fused binary policy-gradient loss");
+    failures += test_pg_loss(&discrete, "fused discrete policy-gradient loss");
+    free_mlp(&binary_mlp);
+    free_mlp(&discrete_mlp);
+
+    MLP gaussian_mlp = create_mlp(sizes, 4, 2, acts);
+    Policy gaussian = create_gaussian_policy(&gaussian_mlp, 2, NULL);
+    failures += test_pg_loss(&gaussian, "fused Gaussian policy-gradient loss");
+    free_mlp(&gaussian_mlp);
+
+    failures += test_normal_fill();
+    failures += test_gaussian_policy(true);
+    failures += test_gaussian_policy(false);
+
+    failures += test_discrete_sampling(SAMPLER_CDF, "inverse-CDF sampling follows each row's distribution");
+    failures += test_discrete_sampling(SAMPLER_GUMBEL, "Gumbel-max sampling follows each row's distribution");
+    failures += test_discrete_sampling(SAMPLER_ALIAS, "alias sampling follows each row's distribution");
+
+    failures += test_gae();
+    failures += test_ppo_loss();
+    failures += test_es();
+    failures += test_replay();
+    failures += test_dqn_loss();
+    failures += test_ppo_minibatch_gradient(&ctx);
+
+    mpi_finalize(&ctx);
+    return failures;
+}
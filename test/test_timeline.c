@@ -0,0 +1,89 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <sys/stat.h>
+
+#include "timeline.h"
+
+#include "test_utils.c"
+
+static const TimelineColumn columns[] = {{"update", TIMELINE_INT}, {"duration", TIMELINE_FLOAT}};
+static const char *kinds[] = {"step"};
+
+// Writes updates [first, first + n), one row each
+static void write_updates(TimelineWriter *writer, long first, int n) {
+    TimelineValue *v = timeline_block(writer, n);
+    for (int k = 0; k < n; k++) {
+        v[k].i = first + k;
+        v[n + k].f = 0.5 * (first + k);
+    }
+    timeline_write_block(writer, first, n);
+}
+
+static long file_size(const char *path) {
+    struct stat st;
+    return stat(path, &st) == 0 ? (long)st.st_size : -1;
+}
+
+int test_timeline_blocks(const MPIContext *ctx) {
+    TEST_START("timeline blocks are columnar and survive a resume");
+
+    const char *path = "/tmp/test_timeline.bin";
+    TimelineWriter writer;
+
+    ASSERT_TRUE("open", timeline_open(&writer, ctx, path, columns, 2, kinds, 1, 0));
+    write_updates(&writer, 0, 3);
+    write_updates(&writer, 3, 2);
+    timeline_close(&writer);
+
+    FILE *f = fopen(path, "rb");
+    ASSERT_NOT_NULL("file written", f);
+
+    TimelineHeader header;
+    ASSERT_TRUE("header read", fread(&header, sizeof(header), 1, f) == 1);
+    ASSERT_TRUE("magic", memcmp(header.magic, TIMELINE_MAGIC, sizeof(header.magic)) == 0);
+    ASSERT_TRUE("shape", header.world_size == 1 && header.n_columns == 2 && header.n_kinds == 1);
+
+    // Second block: header, then the update column, then the duration column
+    long first_block = sizeof(TimelineBlock) + 2 * 3 * sizeof(TimelineValue);
+    TimelineBlock block;
+    TimelineValue values[4];
+    fseek(f, (long)header.data_offset + first_block, SEEK_SET);
+    ASSERT_TRUE("block read", fread(&block, sizeof(block), 1, f) == 1 && fread(values, sizeof(TimelineValue), 4, f) == 4);
+    fclose(f);
+
+    ASSERT_TRUE("block header", block.first_update == 3 && block.updates == 2 && block.rows == 2);
+    ASSERT_TRUE("update column", values[0].i == 3 && values[1].i == 4);
+    ASSERT_TRUE("duration column", fabs(values[2].f - 1.5) < 1e-12 && fabs(values[3].f - 2.0) < 1e-12);
+
+    // Resuming at update 3 drops the second block only
+    ASSERT_TRUE("reopen", timeline_open(&writer, ctx, path, columns, 2, kinds, 1, 3));
+    timeline_close(&writer);
+    ASSERT_TRUE("truncated to the first block", file_size(path) == (long)header.data_offset + first_block);
+
+    TEST_END("timeline blocks are columnar and survive a resume");
+    return 0;
+}
+
+int test_write_ordered(const MPIContext *ctx) {
+    TEST_START("ordered collective write replaces the file");
+
+    const char *path = "/tmp/test_write_ordered.txt";
+    ASSERT_TRUE("long write", mpi_write_ordered(ctx, path, "0123456789", 10));
+    ASSERT_TRUE("short write", mpi_write_ordered(ctx, path, "abc", 3));
+    ASSERT_TRUE("size", file_size(path) == 3);
+
+    TEST_END("ordered collective write replaces the file");
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    MPIContext ctx = mpi_init_context(&argc, &argv);
+    int failures = 0;
+
+    failures += test_timeline_blocks(&ctx);
+    failures += test_write_ordered(&ctx);
+
+    mpi_finalize(&ctx);
+    return failures;
+}
@@ -0,0 +1,160 @@
+/*
+ * Converts a binary timeline (training_timeline.bin, see timeline.h) to CSV.
+ *
+ * Rows come out rank by rank, each rank's in update order, with a leading rank column
+ * and the phase as a name; missing values (collective costs on phase rows, counters on
+ * collective rows) are empty fields. -r keeps one rank, which gives the same CSV a
+ * per-rank timeline file would hold.
+ *
+ *   timeline_to_csv [-r <rank>] [-o <out.csv>] training_timeline.bin
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+
+#include "timeline.h"
+
+typedef struct BlockIndex {
+    long offset;            // of the first column
+    int64_t rows;
+} BlockIndex;
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [-r <rank>] [-o <out.csv>] <training_timeline.bin>\n", prog);
+    exit(2);
+}
+
+static void print_value(FILE *out, char type, TimelineValue v) {
+    switch (type) {
+        case TIMELINE_INT:
+            if (v.i != INT64_MIN) fprintf(out, "%lld", (long long)v.i);
+            break;
+        case TIMELINE_UINT:
+            if (v.u != UINT64_MAX) fprintf(out, "%llu", (unsigned long long)v.u);
+            break;
+        case TIMELINE_FLOAT:
+            if (!isnan(v.f)) fprintf(out, "%.9f", v.f);
+            break;
+    }
+}
+
+int main(int argc, char *argv[]) {
+    const char *in_path = NULL, *out_path = NULL;
+    int only_rank = -1;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) only_rank = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) out_path = argv[++i];
+        else if (argv[i][0] != '-' && !in_path) in_path = argv[i];
+        else usage(argv[0]);
+    }
+    if (!in_path) usage(argv[0]);
+
+    FILE *f = fopen(in_path, "rb");
+    if (!f) {
+        fprintf(stderr, "Error opening %s.\n", in_path);
+        return 1;
+    }
+
+    TimelineHeader header;
+    if (fread(&header, sizeof(header), 1, f) != 1 || memcmp(header.magic, TIMELINE_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != TIMELINE_VERSION) {
+        fprintf(stderr, "%s is not a version %d timeline.\n", in_path, TIMELINE_VERSION);
+        fclose(f);
+        return 1;
+    }
+
+    int n_columns = header.n_columns, n_kinds = header.n_kinds, world_size = header.world_size;
+    TimelineColumn *columns = malloc(n_columns * sizeof(TimelineColumn));
+    char (*kinds)[TIMELINE_NAME_LEN] = malloc(n_kinds * TIMELINE_NAME_LEN);
+
+    if (fread(columns, sizeof(TimelineColumn), n_columns, f) != (size_t)n_columns ||
+        fread(kinds, TIMELINE_NAME_LEN, n_kinds, f) != (size_t)n_kinds) {
+        fprintf(stderr, "%s: truncated header.\n", in_path);
+        return 1;
+    }
+
+    // Index the blocks; a block cut short ends the file
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+
+    int n_blocks = 0, capacity = 64;
+    BlockIndex *blocks = malloc(capacity * sizeof(BlockIndex));
+    long offset = (long)header.data_offset;
+    TimelineBlock block;
+
+    while (fseek(f, offset, SEEK_SET) == 0 && fread(&block, sizeof(block), 1, f) == 1) {
+        long bytes = sizeof(block) + (long)n_columns * world_size * block.rows * sizeof(TimelineValue);
+        if (offset + bytes > size) {
+            fprintf(stderr, "WARNING: %s: ignoring an incomplete block at byte %ld\n", in_path, offset);
+            break;
+        }
+
+        if (n_blocks == capacity) {
+            capacity *= 2;
+            blocks = realloc(blocks, capacity * sizeof(BlockIndex));
+        }
+        blocks[n_blocks++] = (BlockIndex){offset + (long)sizeof(block), block.rows};
+        offset += bytes;
+    }
+
+    FILE *out = out_path ? fopen(out_path, "w") : stdout;
+    if (!out) {
+        fprintf(stderr, "Error opening %s.\n", out_path);
+        return 1;
+    }
+
+    fputs("rank", out);
+    for (int c = 0; c < n_columns; c++) fprintf(out, ",%.*s", TIMELINE_NAME_LEN - 1, columns[c].name);
+    fputc('\n', out);
+
+    // One rank's slice of every column of a block, [n_columns][rows]
+    TimelineValue *values = NULL;
+    int64_t values_rows = 0;
+
+    for (int r = 0; r < world_size; r++) {
+        if (only_rank >= 0 && r != only_rank) continue;
+
+        for (int b = 0; b < n_blocks; b++) {
+            int64_t rows = blocks[b].rows;
+            if (rows > values_rows) {
+                free(values);
+                values = malloc(n_columns * rows * sizeof(TimelineValue));
+                values_rows = rows;
+            }
+
+            for (int c = 0; c < n_columns; c++) {
+                fseek(f, blocks[b].offset + ((long)c * world_size + r) * rows * (long)sizeof(TimelineValue), SEEK_SET);
+                if (fread(values + c * rows, sizeof(TimelineValue), rows, f) != (size_t)rows) {
+                    fprintf(stderr, "%s: read error.\n", in_path);
+                    return 1;
+                }
+            }
+
+            for (int64_t k = 0; k < rows; k++) {
+                fprintf(out, "%d", r);
+                for (int c = 0; c < n_columns; c++) {
+                    TimelineValue v = values[c * rows + k];
+                    fputc(',', out);
+
+                    // The phase column indexes the row kind names
+                    if (strcmp(columns[c].name, "phase") == 0 && v.i >= 0 && v.i < n_kinds)
+                        fprintf(out, "%.*s", TIMELINE_NAME_LEN, kinds[v.i]);
+                    else
+                        print_value(out, columns[c].type, v);
+                }
+                fputc('\n', out);
+            }
+        }
+    }
+
+    if (out != stdout) fclose(out);
+    fclose(f);
+    free(values);
+    free(blocks);
+    free(columns);
+    free(kinds);
+    return 0;
+}